@@ -0,0 +1,132 @@
+/*
+
+PICCANTE Examples
+The hottest examples of Piccante:
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3.0 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See the GNU Lesser General Public License
+    ( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+*/
+
+//This means that OpenGL acceleration layer is disabled
+#define PIC_DISABLE_OPENGL
+
+#include <chrono>
+#include <vector>
+
+#include "piccante.hpp"
+
+/**
+ * @brief runBenchmark filters img nRuns times and returns the mean time in ms.
+ */
+double runBenchmark(pic::Filter *flt, pic::Image *img, pic::Image *out, int nRuns)
+{
+    flt->Process(pic::Single(img), out);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for(int i = 0; i < nRuns; i++) {
+        flt->Process(pic::Single(img), out);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / double(nRuns);
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 7680;
+    int height = 4320;
+    int nRuns = 4;
+
+    if(argc == 4) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+        nRuns = atoi(argv[3]);
+    }
+
+    printf("Allocating a random %d x %d image...", width, height);
+    pic::Image img(1, width, height, 3);
+    img.setRand(1);
+    pic::Image out(1, width, height, 3);
+    printf("Ok\n");
+
+    pic::FilterLuminance flt_lum;
+    pic::FilterGaussian2D flt_gauss(2.0f);
+
+    int tileSizes[] = {16, 32, 64, 128};
+    pic::TILE_ORDER orders[] = {pic::TO_ROW_MAJOR, pic::TO_MORTON, pic::TO_HILBERT};
+    const char *orderNames[] = {"row-major", "Morton", "Hilbert"};
+
+    pic::ThreadPool *pool = pic::ThreadPool::getInstance();
+    int maxThreads = pic::ThreadPool::getHardwareThreads();
+
+    //powers of two below maxThreads, then maxThreads
+    std::vector<int> threads;
+    for(int n = 1; n < maxThreads; n *= 2) {
+        threads.push_back(n);
+    }
+    threads.push_back(maxThreads);
+
+    printf("\nFilterLuminance (ms per run)\n");
+    printf("threads\ttile\torder\t\ttime\tspeed-up\n");
+
+    for(int t = 0; t < 4; t++) {
+        for(int o = 0; o < 3; o++) {
+            double time_1 = 0.0;
+
+            for(unsigned int i = 0; i < threads.size(); i++) {
+                int n = threads[i];
+                pool->setNumThreads(n);
+                flt_lum.setTileSize(tileSizes[t], orders[o]);
+
+                double time_n = runBenchmark(&flt_lum, &img, &out, nRuns);
+
+                if(n == 1) {
+                    time_1 = time_n;
+                }
+
+                printf("%d\t%d\t%s\t%.2f\t%.2fx\n", n, tileSizes[t], orderNames[o],
+                       time_n, time_1 / time_n);
+            }
+        }
+    }
+
+    printf("\nFilterGaussian2D sigma = 2.0 (ms per run)\n");
+    printf("threads\ttile\torder\t\ttime\tspeed-up\n");
+
+    double time_1 = 0.0;
+    for(unsigned int i = 0; i < threads.size(); i++) {
+        int n = threads[i];
+        pool->setNumThreads(n);
+
+        double time_n = runBenchmark(&flt_gauss, &img, &out, nRuns);
+
+        if(n == 1) {
+            time_1 = time_n;
+        }
+
+        printf("%d\t%d\t%s\t%.2f\t%.2fx\n", n, flt_gauss.getTileSize(), orderNames[0],
+               time_n, time_1 / time_n);
+    }
+
+    pool->setNumThreads(0);
+
+    return 0;
+}
@@ -27,7 +27,7 @@ This program is free software: you can redistribute it and/or modify
 #define PIC_DISABLE_OPENGL
 
 #include "piccante.hpp"
-#include "util/k_means_plusplus.hpp"
+#include "util/k_means_plus_plus.hpp"
 int main(int argc, char *argv[])
 {
     std::string img_str;
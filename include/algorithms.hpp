@@ -26,6 +26,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "algorithms/discrete_cosine_transform.hpp"
 #include "algorithms/poisson_filling.hpp"
 #include "algorithms/poisson_solver.hpp"
+#include "algorithms/poisson_solver_multigrid.hpp"
+#include "algorithms/weighted_laplacian_solver.hpp"
 #include "algorithms/poisson_image_editing.hpp"
 #include "algorithms/pushpull.hpp"
 #include "algorithms/pyramid.hpp"
@@ -20,6 +20,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "../image.hpp"
 #include "../filtering/filter_bilateral_2ds.hpp"
+#include "../filtering/filter_bilateral_2dpl.hpp"
 #include "../util/math.hpp"
 
 namespace pic {
@@ -31,11 +32,14 @@ namespace pic {
  * @param sigma_s
  * @param sigma_r
  * @param bLogDomain
+ * @param bLattice if it is true, the permutohedral lattice filter is used
+ * instead of the sampled one.
  */
 PIC_INLINE void bilateralSeparation(Image *imgIn, ImageVec &out,
                                          float sigma_s = -1.0f,
                                          float sigma_r = 0.4f,
-                                         bool bLogDomain = false)
+                                         bool bLogDomain = false,
+                                         bool bLattice = false)
 {
     if(imgIn == NULL) {
         return;
@@ -62,7 +66,13 @@ PIC_INLINE void bilateralSeparation(Image *imgIn, ImageVec &out,
 
     img_tmp->applyFunction(log10fPlusEpsilon);
 
-    Image *img_flt = FilterBilateral2DS::execute(img_tmp, NULL, sigma_s, sigma_r);
+    Image *img_flt;
+
+    if(bLattice) {
+        img_flt = FilterBilateral2DPL::execute(img_tmp, NULL, sigma_s, sigma_r);
+    } else {
+        img_flt = FilterBilateral2DS::execute(img_tmp, NULL, sigma_s, sigma_r);
+    }
 
     if(!bLogDomain) {
         img_flt->applyFunction(powf10fMinusEpsilon);
@@ -21,6 +21,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <vector>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <utility>
 
 #include "../base.hpp"
@@ -28,17 +29,86 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "../image.hpp"
 
 #include "../util/buffer.hpp"
+#include "../util/bbox.hpp"
+#include "../util/thread_pool.hpp"
 
 namespace pic {
 
-struct LabelInfo
+/**
+ * @brief The UnionFind class is a disjoint-set forest with path
+ * compression and union by rank.
+ */
+class UnionFind
 {
-    uint id;
-    uint minLabel;
+public:
+    std::vector<uint> parent;
+    std::vector<unsigned char> rank;
 
-    friend bool operator<(LabelInfo const &a, LabelInfo const &b)
+    UnionFind()
     {
-        return a.id < b.id;
+    }
+
+    /**
+     * @brief makeSet adds a new set.
+     * @return This function returns the element of the new set.
+     */
+    uint makeSet()
+    {
+        uint x = uint(parent.size());
+        parent.push_back(x);
+        rank.push_back(0);
+        return x;
+    }
+
+    /**
+     * @brief find
+     * @param x
+     * @return This function returns the representative of the set of x.
+     */
+    uint find(uint x)
+    {
+        uint root = x;
+        while(parent[root] != root) {
+            root = parent[root];
+        }
+
+        //path compression
+        while(parent[x] != root) {
+            uint next = parent[x];
+            parent[x] = root;
+            x = next;
+        }
+
+        return root;
+    }
+
+    /**
+     * @brief merge joins the sets of a and b.
+     * @param a
+     * @param b
+     * @return This function returns the representative of the new set.
+     */
+    uint merge(uint a, uint b)
+    {
+        a = find(a);
+        b = find(b);
+
+        if(a == b) {
+            return a;
+        }
+
+        if(rank[a] < rank[b]) {
+            parent[a] = b;
+            return b;
+        }
+
+        parent[b] = a;
+
+        if(rank[a] == rank[b]) {
+            rank[a]++;
+        }
+
+        return a;
     }
 };
 
@@ -50,10 +120,16 @@ public:
     std::set< int > neighbors;
     bool bValid;
 
+    //statistics: bounding box (x1 and y1 are exclusive) and centroid
+    BBox box;
+    float centroid[2];
+
     LabelOutput()
     {
         id = 0;
         bValid = true;
+        box.setBox(0, 0, 0, 0, 0, 1, 0, 0, 1);
+        centroid[0] = centroid[1] = 0.0f;
     }
 
     LabelOutput(uint id, int i)
@@ -61,6 +137,8 @@ public:
         this->id = id;
         coords.push_back(i);
         bValid = true;
+        box.setBox(0, 0, 0, 0, 0, 1, 0, 0, 1);
+        centroid[0] = centroid[1] = 0.0f;
     }
 
     void push_back(int i)
@@ -68,6 +146,36 @@ public:
         coords.push_back(i);
     }
 
+    /**
+     * @brief getArea
+     * @return This function returns the number of pixels of the component.
+     */
+    int getArea()
+    {
+        return int(coords.size());
+    }
+
+    /**
+     * @brief mergeStats updates the statistics for merging b into
+     * this component; it has to be called before merging coordinates.
+     * @param b
+     */
+    void mergeStats(LabelOutput &b)
+    {
+        float a0 = float(coords.size());
+        float a1 = float(b.coords.size());
+
+        if((a0 + a1) > 0.0f) {
+            centroid[0] = (centroid[0] * a0 + b.centroid[0] * a1) / (a0 + a1);
+            centroid[1] = (centroid[1] * a0 + b.centroid[1] * a1) / (a0 + a1);
+        }
+
+        box.x0 = MIN(box.x0, b.box.x0);
+        box.y0 = MIN(box.y0, b.box.y0);
+        box.x1 = MAX(box.x1, b.box.x1);
+        box.y1 = MAX(box.y1, b.box.y1);
+    }
+
     friend bool operator<(LabelOutput const &a, LabelOutput const &b)
     {
         return a.id < b.id;
@@ -78,158 +186,283 @@ class ConnectedComponents
 {
 protected:
     float thr;
+    bool bEight;
 
     /**
-     * @brief secondPass
+     * @brief labelStrip labels the rows [y0, y1) with local labels
+     * considering only neighbors inside the strip.
+     * @param connected
+     * @param width
+     * @param y0
+     * @param y1
      * @param imgOut
-     * @param labelEq
+     * @param uf
      */
-    void secondPass(uint *imgOut, std::vector<LabelOutput> &ret, std::set<LabelInfo> &labelEq, int n)
+    template<class F>
+    void labelStrip(F &connected, int width, int y0, int y1, uint *imgOut, UnionFind &uf)
     {
-        //Label Search
-        LabelInfo tmpLI;
-        std::set<LabelInfo> labelEq_new;
+        for(int j = y0; j < y1; j++) {
+            int indY = j * width;
 
-        for(auto it2 = labelEq.begin() ; it2 != labelEq.end(); it2++) {
-            auto minVal = it2->minLabel;
-            bool test = true;
+            for(int i = 0; i < width; i++) {
+                int ind = indY + i;
 
-            while(test) {
-                test = false;
-                tmpLI.id = minVal;
-                auto it = labelEq.find(tmpLI);
+                uint label = 0xffffffff;
 
-                if(it != labelEq.end()) {
-                    auto tmpMinLabel = (*it).minLabel;
+                //causal neighbors: left, up, up-left, up-right
+                int neighbors[4];
+                int nNeighbors = 0;
+
+                if(i > 0) {
+                    neighbors[nNeighbors++] = ind - 1;
+                }
+
+                if(j > y0) {
+                    neighbors[nNeighbors++] = ind - width;
 
-                    if(minVal > tmpMinLabel) {
-                        minVal = tmpMinLabel;
-                        test = true;
+                    if(bEight) {
+                        if(i > 0) {
+                            neighbors[nNeighbors++] = ind - width - 1;
+                        }
+
+                        if(i < (width - 1)) {
+                            neighbors[nNeighbors++] = ind - width + 1;
+                        }
                     }
                 }
+
+                for(int k = 0; k < nNeighbors; k++) {
+                    if(connected(ind, neighbors[k])) {
+                        uint l = imgOut[neighbors[k]];
+                        label = (label == 0xffffffff) ? l : uf.merge(label, l);
+                    }
+                }
+
+                imgOut[ind] = (label == 0xffffffff) ? uf.makeSet() : label;
             }
+        }
+    }
+
+    /**
+     * @brief label computes connected components; strips of rows are
+     * labeled in parallel, and then they are merged along their borders.
+     * Final labels are consecutive, starting from 1, in order of first
+     * appearance.
+     * @param connected is a function (ind, ind_neighbor) that returns
+     * true if two pixels are connected.
+     * @param width
+     * @param height
+     * @param imgOut
+     * @param ret
+     */
+    template<class F>
+    void label(F &connected, int width, int height, uint *imgOut, std::vector<LabelOutput> &ret)
+    {
+        ThreadPool *tp = ThreadPool::getInstance();
+
+        int nStrips = MIN(height, tp->getNumThreads() * 4);
+        nStrips = MAX(nStrips, 1);
 
-            LabelInfo tmp_it;
-            tmp_it.id = it2->id;
-            tmp_it.minLabel = minVal;
-            labelEq_new.insert(tmp_it);
+        std::vector<int> strip_y(nStrips + 1);
+        for(int s = 0; s <= nStrips; s++) {
+            strip_y[s] = int((long long)(height) * s / nStrips);
         }
 
-        //Second pass: using tracked neighbors
-        //for assigning the correct labels
-        //TO DO: optimizing outside this loop
-        std::set<uint> unique;
-        //std::set<uint>::iterator uniqueIt;
-        std::map<uint, int> mapping;
+        std::vector<UnionFind> ufs(nStrips);
 
-        int counter = 0;
+        tp->run(nStrips, [&](int s) {
+            labelStrip(connected, width, strip_y[s], strip_y[s + 1], imgOut, ufs[s]);
+        });
 
-        for(int i = 0; i < n; i++) {
-            tmpLI.id = imgOut[i];
-            auto it = labelEq_new.find(tmpLI);
+        //global labels: local labels of a strip are shifted by offset
+        std::vector<uint> offset(nStrips + 1, 0);
+        for(int s = 0; s < nStrips; s++) {
+            offset[s + 1] = offset[s] + uint(ufs[s].parent.size());
+        }
 
-            if(it != labelEq_new.end()) {
-                imgOut[i] = it->minLabel;
+        UnionFind uf;
+        uf.parent.resize(offset[nStrips]);
+        uf.rank.resize(offset[nStrips]);
+
+        for(int s = 0; s < nStrips; s++) {
+            for(uint k = 0; k < ufs[s].parent.size(); k++) {
+                uf.parent[offset[s] + k] = offset[s] + ufs[s].parent[k];
+                uf.rank[offset[s] + k] = ufs[s].rank[k];
             }
 
-            //store coordiantes of the connected components
-            auto id = imgOut[i];
-            auto uniqueIt = unique.find(id);
+            ufs[s].parent.clear();
+            ufs[s].rank.clear();
+        }
 
-            if(uniqueIt != unique.end()) {
-                ret[mapping[id]].push_back(i);
-            } else {
-                std::pair<uint, int> tmp = std::make_pair(id, counter);
-                mapping.insert(tmp);
+        //merging strips along their borders
+        for(int s = 1; s < nStrips; s++) {
+            int j = strip_y[s];
 
-                LabelOutput tmpRet(id, i);
-                ret.push_back(tmpRet);
+            if(j == strip_y[s - 1]) {
+                continue;
+            }
 
-                unique.insert(id);
-                counter++;
+            int indY = j * width;
+
+            for(int i = 0; i < width; i++) {
+                int ind = indY + i;
+                uint l = imgOut[ind] + offset[s];
+
+                for(int di = (bEight ? -1 : 0); di <= (bEight ? 1 : 0); di++) {
+                    int i2 = i + di;
+
+                    if((i2 < 0) || (i2 >= width)) {
+                        continue;
+                    }
+
+                    int ind2 = ind - width + di;
+
+                    if(connected(ind, ind2)) {
+                        uf.merge(l, imgOut[ind2] + offset[s - 1]);
+                    }
+                }
             }
         }
-    }
 
-    void track(uint *imgOut, int &label, std::set<LabelInfo> &labelEq,
-               int neighbors[2], int nNeighbors, int ind)
-    {
-        std::set<LabelInfo>::iterator it;
-        //No neighbors?
-        if(nNeighbors == 0) {
-            imgOut[ind] = label;
-            label++;
+        //consecutive labels: a label is never smaller than the first
+        //one of its component
+        uint nLabels = offset[nStrips];
+        std::vector<uint> final_label(nLabels, 0);
+
+        //first_new[s] is the last final label assigned before strip s;
+        //labels greater than it appear for the first time in strip s
+        std::vector<uint> first_new(nStrips + 1, 0);
+
+        uint counter = 0;
+        int s_cur = 0;
+        for(uint l = 0; l < nLabels; l++) {
+            while(l == offset[s_cur + 1]) {
+                s_cur++;
+                first_new[s_cur] = counter;
+            }
+
+            uint r = uf.find(l);
+
+            if(final_label[r] == 0) {
+                counter++;
+                final_label[r] = counter;
+            }
+
+            final_label[l] = final_label[r];
         }
 
-        if(nNeighbors == 1) {
-            imgOut[ind] = imgOut[neighbors[0]];
+        for(s_cur++; s_cur <= nStrips; s_cur++) {
+            first_new[s_cur] = counter;
         }
 
-        if(nNeighbors == 2) {
-            //Assign the label of neighbors
-            uint minVal, t1, t2;
-            t1 = imgOut[neighbors[0]];
-            t2 = imgOut[neighbors[1]];
-            minVal = MIN(t1, t2);
+        //relabeling and gathering coordinates and statistics; a strip
+        //fills ret directly for the labels that first appear in it, and
+        //keeps the labels of previous strips aside, to be merged later
+        ret.resize(counter);
+        std::vector<double> sum_x(counter, 0.0), sum_y(counter, 0.0);
+
+        std::vector< std::vector<LabelOutput> > strip_lo(nStrips);
+        std::vector< std::vector<double> > strip_sum(nStrips);
 
-            //Track neighbors
-            LabelInfo tmpLI;
-            bool test = true;
+        tp->run(nStrips, [&](int s) {
+            uint nLocal = offset[s + 1] - offset[s];
+
+            for(uint l = first_new[s]; l < first_new[s + 1]; l++) {
+                ret[l].id = l + 1;
+                ret[l].box.setBox(width, -1, height, -1, 0, 1, width, height, 1);
+            }
 
-            while(test) {
-                test = false;
-                tmpLI.id = minVal;
-                it = labelEq.find(tmpLI);
+            //labels of previous strips can only be reached through the
+            //first row of the strip, so they are few
+            std::vector<LabelOutput> &lo = strip_lo[s];
+            std::unordered_map<uint, uint> slot_map;
 
-                if(it != labelEq.end()) {
-                    uint tmpMinLabel = it->minLabel;
+            std::vector<LabelOutput*> dst(nLocal);
+            std::vector<double*> dst_sum(nLocal);
 
-                    if(minVal > tmpMinLabel) {
-                        minVal = tmpMinLabel;
-                        test = true;
+            for(uint k = 0; k < nLocal; k++) {
+                uint l = final_label[offset[s] + k];
+
+                if(l <= first_new[s]) {
+                    auto it = slot_map.insert(std::make_pair(l, uint(lo.size())));
+
+                    if(it.second) {
+                        lo.push_back(LabelOutput());
+                        lo.back().id = l;
+                        lo.back().box.setBox(width, -1, height, -1, 0, 1, width, height, 1);
                     }
                 }
             }
 
-            imgOut[ind] = minVal;
-
-            //Track T1
-            test = true;
-            tmpLI.id = t1;
-            it = labelEq.find(tmpLI);
-
-            if(it != labelEq.end()) {
-                LabelInfo tmp_it;
-                tmp_it.id = it->id;
-                tmp_it.minLabel = minVal;
-
-                labelEq.erase(it);
-                labelEq.insert(tmp_it);
-            } else {
-                LabelInfo tmpLabelInfo;
-                tmpLabelInfo.id = t1;
-                tmpLabelInfo.minLabel = minVal;
-                labelEq.insert(tmpLabelInfo);
+            std::vector<double> &sum = strip_sum[s];
+            sum.assign(lo.size() * 2, 0.0);
+
+            for(uint k = 0; k < nLocal; k++) {
+                uint l = final_label[offset[s] + k];
+
+                if(l > first_new[s]) {
+                    dst[k] = &ret[l - 1];
+                    dst_sum[k] = NULL;
+                } else {
+                    uint slot = slot_map[l];
+                    dst[k] = &lo[slot];
+                    dst_sum[k] = &sum[slot * 2];
+                }
             }
 
-            //Track T2
-            tmpLI.id = t2;
-            it = labelEq.find(tmpLI);
-
-            if(it != labelEq.end()) {
-                LabelInfo tmp_it;
-                tmp_it.id = it->id;
-                tmp_it.minLabel = minVal;
-
-                labelEq.erase(it);
-                labelEq.insert(tmp_it);
-            } else {
-                LabelInfo tmpLabelInfo;
-                tmpLabelInfo.id = t2;
-                tmpLabelInfo.minLabel = minVal;
-                labelEq.insert(tmpLabelInfo);
+            for(int j = strip_y[s]; j < strip_y[s + 1]; j++) {
+                int indY = j * width;
+
+                for(int i = 0; i < width; i++) {
+                    int ind = indY + i;
+                    uint k = imgOut[ind];
+                    LabelOutput *cur = dst[k];
+
+                    imgOut[ind] = cur->id;
+                    cur->coords.push_back(ind);
+
+                    cur->box.x0 = MIN(cur->box.x0, i);
+                    cur->box.x1 = MAX(cur->box.x1, i);
+                    cur->box.y0 = MIN(cur->box.y0, j);
+                    cur->box.y1 = MAX(cur->box.y1, j);
+
+                    if(dst_sum[k] == NULL) {
+                        sum_x[cur->id - 1] += double(i);
+                        sum_y[cur->id - 1] += double(j);
+                    } else {
+                        dst_sum[k][0] += double(i);
+                        dst_sum[k][1] += double(j);
+                    }
+                }
+            }
+        });
+
+        //merging in strip order keeps coordinates in raster order
+        for(int s = 1; s < nStrips; s++) {
+            std::vector<LabelOutput> &lo = strip_lo[s];
+
+            for(uint k = 0; k < lo.size(); k++) {
+                LabelOutput &out = ret[lo[k].id - 1];
+
+                out.coords.insert(out.coords.end(), lo[k].coords.begin(), lo[k].coords.end());
+
+                out.box.x0 = MIN(out.box.x0, lo[k].box.x0);
+                out.box.x1 = MAX(out.box.x1, lo[k].box.x1);
+                out.box.y0 = MIN(out.box.y0, lo[k].box.y0);
+                out.box.y1 = MAX(out.box.y1, lo[k].box.y1);
+
+                sum_x[lo[k].id - 1] += strip_sum[s][k * 2    ];
+                sum_y[lo[k].id - 1] += strip_sum[s][k * 2 + 1];
             }
         }
+
+        for(uint k = 0; k < counter; k++) {
+            double area = double(ret[k].coords.size());
+            ret[k].centroid[0] = float(sum_x[k] / area);
+            ret[k].centroid[1] = float(sum_y[k] / area);
+            ret[k].box.x1++;
+            ret[k].box.y1++;
+        }
     }
 
 public:
@@ -237,10 +470,12 @@ public:
     /**
      * @brief ConnectedComponents
      * @param thr
+     * @param bEight enables 8-connectivity; the default is 4-connectivity.
      */
-    ConnectedComponents(float thr = 0.05f)
+    ConnectedComponents(float thr = 0.05f, bool bEight = false)
     {
         this->thr  = thr > 0.0f ? thr : 0.05f;
+        this->bEight = bEight;
     }
 
     /**
@@ -267,56 +502,23 @@ public:
             imgOut = new uint[n];
         }
 
-        Buffer<uint>::assign(imgOut, n, 0);
-
-        //First pass:
-        // 1) assign basics labels
-        // 2) generate the list of neighbors
-        int label = 1;
-        std::set<LabelInfo> labelEq;
-        for(int j = 0; j < height; j++) {
-            int indY = j * width;
-
-            for(int i = 0; i < width; i++) {
-                int ind = (indY + i);
-
-                int ind_img = ind * channels;
-
-                //neighbors
-                int neighbors[2];
-                int nNeighbors = 0;
+        ret.clear();
 
-                if((i - 1) > -1) {
-                    int ind_img_prev = ind_img - channels;
-
-                    float n1 = Arrayf::norm(&data[ind_img], channels);
-                    float n2 = Arrayf::norm(&data[ind_img_prev], channels);
-                    float dist = sqrtf(Arrayf::distanceSq(&data[ind_img], &data[ind_img_prev], channels));
-
-                    if(dist <= (thr * MAX(n1, n2))) {
-                        neighbors[0] = ind - 1;
-                        nNeighbors++;
-                    }
-                }
+        float thr = this->thr;
 
-                if((j - 1) > -1) {
-                    int ind_img_prev = ind_img - (width * channels);
+        auto connected = [data, channels, thr](int ind, int ind_prev) {
+            float *p0 = &data[ind * channels];
+            float *p1 = &data[ind_prev * channels];
 
-                    float n1 = Arrayf::norm(&data[ind_img], channels);
-                    float n2 = Arrayf::norm(&data[ind_img_prev], channels);
-                    float dist = sqrtf(Arrayf::distanceSq(&data[ind_img], &data[ind_img_prev], channels));
+            float n1 = Arrayf::norm(p0, channels);
+            float n2 = Arrayf::norm(p1, channels);
+            float dist = sqrtf(Arrayf::distanceSq(p0, p1, channels));
 
-                    if(dist <= (thr * MAX(n1, n2))) {
-                        neighbors[nNeighbors] = ind - width;
-                        nNeighbors++;
-                    }
-                }
+            return (dist <= (thr * MAX(n1, n2)));
+        };
 
-                track(imgOut, label, labelEq, neighbors, nNeighbors, ind);
-            }
-        }
+        label(connected, width, height, imgOut, ret);
 
-        secondPass(imgOut, ret, labelEq, n);
         return imgOut;
     }
 
@@ -343,45 +545,16 @@ public:
             imgOut = new uint[n];
         }
 
-        Buffer<uint>::assign(imgOut, n, 0);
+        ret.clear();
 
         T *data = imgIn;
-        //First pass:
-        // 1) assign basics labels
-        // 2) generate the list of neighbors
-        int label = 1;
-        std::set<LabelInfo> labelEq;
-        for(int j = 0; j < height; j++) {
-            int indY = j * width;
-
-            for(int i = 0; i < width; i++) {
-                int ind = (indY + i);
-
-                //neighbors
-                int neighbors[2];
-                int nNeighbors = 0;
 
-                if((i - 1) > -1) {
-                    int ind_prev = ind - 1;
-                    if(data[ind] == data[ind_prev]) {
-                        neighbors[0] = ind_prev;
-                        nNeighbors++;
-                    }
-                }
+        auto connected = [data](int ind, int ind_prev) {
+            return data[ind] == data[ind_prev];
+        };
 
-                if((j - 1) > -1) {
-                    int ind_prev = ind - width;
-                    if(data[ind] == data[ind_prev]) {
-                        neighbors[nNeighbors] = ind_prev;
-                        nNeighbors++;
-                    }
-                }
+        label(connected, width, height, imgOut, ret);
 
-                track(imgOut, label, labelEq, neighbors, nNeighbors, ind);
-            }
-        }
-
-        secondPass(imgOut, ret, labelEq, n);
         return imgOut;
     }
 
@@ -601,6 +774,8 @@ public:
                     if(labelsList[i].coords.size() > labelsList[index].coords.size()) {
                         labelsList[index].bValid = false;
 
+                        labelsList[i].mergeStats(labelsList[index]);
+
                         //update coordinates
                         labelsList[i].coords.insert(labelsList[i].coords.begin(),
                                                     labelsList[index].coords.begin(),
@@ -622,6 +797,8 @@ public:
                     } else {
                         labelsList[i].bValid = false;
 
+                        labelsList[index].mergeStats(labelsList[i]);
+
                         //update coordinates
                         labelsList[index].coords.insert(labelsList[index].coords.begin(),
                                                         labelsList[i].coords.begin(),
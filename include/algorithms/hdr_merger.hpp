@@ -20,11 +20,15 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <vector>
 #include <string>
+#include <stdio.h>
+#include <algorithm>
 
 #include "../base.hpp"
 #include "../util/vec.hpp"
 #include "../algorithms.hpp"
 #include "../algorithms/camera_response_function.hpp"
+#include "../io/image_stream.hpp"
+#include "../util/thread_pool.hpp"
 #include "../features_matching/ward_alignment.hpp"
 #include "../filtering/filter_assemble_hdr.hpp"
 
@@ -71,6 +75,69 @@ protected:
         }
     }
 
+    /**
+     * @brief scanExposure streams an exposure from a file for computing its
+     * subsampled version and its range.
+     * @param name
+     * @param shift is the alignment shift; the range is computed only over
+     * the pixels that are visible after shifting.
+     * @param stride is the subsampling step.
+     * @param thumb is the subsampled exposure; it can be NULL.
+     * @param bBright is set to true if the exposure has values over 0.9.
+     * @param bDark is set to true if the exposure has values below 0.1.
+     * @return This function returns true if the file was read.
+     */
+    static bool scanExposure(std::string name, Vec2i shift, int stride, Image *thumb,
+                             bool &bBright, bool &bDark)
+    {
+        ImageStreamReader reader;
+
+        if(!reader.open(name)) {
+            return false;
+        }
+
+        int width = reader.width;
+        int channels = reader.channels;
+        int rowSize = width * channels;
+
+        std::vector<float> row(rowSize);
+
+        int x0 = CLAMPi(shift[0], 0, width - 1) * channels;
+        int x1 = (CLAMPi(width - 1 + shift[0], 0, width - 1) + 1) * channels;
+        int y0 = CLAMPi(shift[1], 0, reader.height - 1);
+        int y1 = CLAMPi(reader.height - 1 + shift[1], 0, reader.height - 1);
+
+        bBright = false;
+        bDark = false;
+
+        for(int j = 0; j < reader.height; j++) {
+            if(!reader.readRows(1, &row[0])) {
+                return false;
+            }
+
+            if((j >= y0) && (j <= y1)) {
+                for(int i = x0; i < x1; i++) {
+                    bBright = bBright || (row[i] > 0.9f);
+                    bDark = bDark || (row[i] < 0.1f);
+                }
+            }
+
+            if((thumb == NULL) || ((j % stride) != 0)) {
+                continue;
+            }
+
+            float *out = (*thumb)(0, j / stride);
+            for(int i = 0; i < width; i += stride) {
+                for(int k = 0; k < channels; k++) {
+                    *out = row[i * channels + k];
+                    out++;
+                }
+            }
+        }
+
+        return true;
+    }
+
 public:
 
     /**
@@ -139,6 +206,11 @@ public:
         for(int i = 0; i < n; i++) {
             Image *img = new Image();
             img->Read(file_name_vec[i], LT_NOR);
+
+            if(exposure_time_vec[i] > 0.0f) {
+                img->exposure = exposure_time_vec[i];
+            }
+
             stack.push_back(img);
             bValid = bValid && img->isValid();
         }
@@ -193,6 +265,247 @@ public:
 
         return imgOut;
     }
+
+    /**
+     * @brief executeTiled merges the exposures out-of-core, a band of rows
+     * at a time, and it writes the HDR image to a file. PFM, TMP and HDR
+     * exposures are streamed from memory mappings; the other formats are
+     * decoded once, one at a time, and dumped into temporary TMP files next
+     * to nameOut. The CRF is estimated from subsampled exposures, and only
+     * HA_MTB alignment is supported. Memory does not depend on the number
+     * of exposures.
+     * @param nameOut is a PFM, TMP or HDR file name.
+     * @param bandHeight is the number of rows of a band.
+     * @return This function returns true if the HDR image was written.
+     */
+    bool executeTiled(std::string nameOut, int bandHeight = 64)
+    {
+        int n = int(file_name_vec.size());
+
+        if(n < 1) {
+            return false;
+        }
+
+        LABEL_IO_EXTENSION label = getLabelHDRExtension(nameOut);
+        if((label != IO_PFM) && (label != IO_TMP) && (label != IO_HDR)) {
+            return false;
+        }
+
+        std::vector<std::string> names(file_name_vec);
+        std::vector<std::string> names_tmp;
+        std::vector<float> exposures(n);
+
+        int width = -1;
+        int height = -1;
+        int channels = -1;
+        bool bValid = true;
+
+        //exposures that cannot be streamed are decoded once and dumped
+        for(int i = 0; (i < n) && bValid; i++) {
+            ImageStreamReader reader;
+            float t = exposure_time_vec[i];
+
+            int w, h, c;
+            if(reader.open(names[i])) {
+                w = reader.width;
+                h = reader.height;
+                c = reader.channels;
+
+                if(t <= 0.0f) {
+                    t = 1.0f;
+                }
+            } else {
+                Image img;
+                img.Read(names[i], LT_NOR);
+
+                if(!img.isValid()) {
+                    bValid = false;
+                    break;
+                }
+
+                w = img.width;
+                h = img.height;
+                c = img.channels;
+
+                if(t <= 0.0f) {
+                    t = img.exposure;
+                }
+
+                names[i] = nameOut + "_exp_" + fromNumberToString(i) + ".tmp";
+                names_tmp.push_back(names[i]);
+                bValid = img.Write(names[i]);
+            }
+
+            if(width < 0) {
+                width = w;
+                height = h;
+                channels = c;
+            }
+
+            bValid = bValid && (w == width) && (h == height) && (c == channels);
+            exposures[i] = t;
+        }
+
+        std::vector<int> order(n);
+        for(int i = 0; i < n; i++) {
+            order[i] = i;
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&exposures](int a, int b) {
+            return exposures[a] < exposures[b];
+        });
+
+        int i_min, i_max;
+        FilterAssembleHDR::getExposureRange(exposures, i_min, i_max);
+
+        bool bCRF = (crf == NULL);
+        bool bAlign = (hdra == HA_MTB) && (n > 1);
+
+        //subsampled exposures for the CRF, at most 512 x 512 pixels
+        int stride = 1;
+        while((width / stride) * (height / stride) > 262144) {
+            stride++;
+        }
+
+        ImageVec thumbs;
+        std::vector<Vec2i> shifts(n, Vec2i(0, 0));
+
+        Image *img_prev = NULL;
+        for(int k = 0; (k < n) && bValid; k++) {
+            int i = order[k];
+
+            if(bAlign) {
+                Image *img = new Image(names[i]);
+
+                if(img_prev != NULL) {
+                    shifts[order[k - 1]] = WardAlignment::execute(img, img_prev);
+                }
+
+                delete_s(img_prev);
+                img_prev = img;
+            }
+
+            if(bCRF) {
+                Image *thumb = new Image(1, (width + stride - 1) / stride,
+                                         (height + stride - 1) / stride, channels);
+                thumb->exposure = exposures[i];
+                thumbs.push_back(thumb);
+
+                bool bBright_i, bDark_i;
+                bValid = scanExposure(names[i], Vec2i(0, 0), stride, thumb, bBright_i, bDark_i);
+            }
+        }
+
+        delete_s(img_prev);
+
+        //shifts are relative to the longest exposure
+        for(int k = n - 3; k >= 0; k--) {
+            shifts[order[k]] += shifts[order[k + 1]];
+        }
+
+        //check the range of the shortest and the longest exposures
+        bool bBright = false;
+        bool bDark = false;
+
+        bValid = bValid && scanExposure(names[i_min], shifts[i_min], 1, NULL, bBright, bDark);
+        bool bMin = bBright;
+
+        bValid = bValid && scanExposure(names[i_max], shifts[i_max], 1, NULL, bBright, bDark);
+        bool bMax = bDark;
+
+        if(bValid && bCRF) {
+            crf = new CameraResponseFunction();
+            crf->DebevecMalik(thumbs, weight, 256, 20.0f);
+        }
+
+        stdVectorClear(thumbs);
+
+        //open all exposures
+        std::vector<ImageStreamReader> readers(n);
+        for(int i = 0; (i < n) && bValid; i++) {
+            bValid = readers[i].open(names[i]);
+        }
+
+        ImageStreamWriter writer;
+        bValid = bValid && writer.open(nameOut, width, height, channels);
+
+        if(bValid) {
+            merger.update(crf, weight, domain);
+            merger.setupWeights(exposures, bMin, bMax);
+            merger.setupLUT(channels);
+
+            int rowSize = width * channels;
+            bandHeight = CLAMPi(bandHeight, 1, height);
+
+            std::vector<float> band(bandHeight * rowSize);
+            std::vector<float> acc(bandHeight * rowSize);
+            std::vector<float> totWeight(bandHeight * width);
+            std::vector< std::vector<float> > rows(n);
+
+            ThreadPool *pool = ThreadPool::getInstance();
+
+            for(int y0 = 0; (y0 < height) && bValid; y0 += bandHeight) {
+                int nRows = MIN(bandHeight, height - y0);
+
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                std::fill(totWeight.begin(), totWeight.end(), 0.0f);
+
+                for(int i = 0; (i < n) && bValid; i++) {
+                    int dx = shifts[i][0];
+                    int dy = shifts[i][1];
+
+                    if((dx == 0) && (dy == 0)) {
+                        bValid = readers[i].readRows(nRows, &band[0]);
+                    } else {
+                        //rows are read in order; the last one is kept for borders
+                        std::vector<float> &row = rows[i];
+                        row.resize(rowSize);
+
+                        for(int j = 0; (j < nRows) && bValid; j++) {
+                            int y = CLAMPi(y0 + j + dy, 0, height - 1);
+
+                            while(bValid && (readers[i].y <= y)) {
+                                bValid = readers[i].readRows(1, &row[0]);
+                            }
+
+                            float *out = &band[j * rowSize];
+                            for(int x = 0; x < width; x++) {
+                                int xs = CLAMPi(x + dx, 0, width - 1);
+                                memcpy(&out[x * channels], &row[xs * channels], channels * sizeof(float));
+                            }
+                        }
+                    }
+
+                    float t = exposures[i];
+                    CRF_WEIGHT type = merger.getWeightType(i);
+
+                    pool->parallelFor(0, nRows, [&](int j0, int j1) {
+                        merger.accumulate(&band[j0 * rowSize], (j1 - j0) * width, channels, t, type,
+                                          &acc[j0 * rowSize], &totWeight[j0 * width]);
+                    }, 4);
+                }
+
+                pool->parallelFor(0, nRows, [&](int j0, int j1) {
+                    merger.normalize(&acc[j0 * rowSize], &totWeight[j0 * width], (j1 - j0) * width,
+                                     channels, &acc[j0 * rowSize]);
+                }, 4);
+
+                bValid = bValid && writer.writeRows(nRows, &acc[0]);
+            }
+        }
+
+        writer.close();
+
+        for(int i = 0; i < n; i++) {
+            readers[i].close();
+        }
+
+        for(unsigned int i = 0; i < names_tmp.size(); i++) {
+            remove(names_tmp[i].c_str());
+        }
+
+        return bValid;
+    }
 };
 
 } // end namespace pic
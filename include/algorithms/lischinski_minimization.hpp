@@ -18,20 +18,9 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_ALGORITHMS_LISCHINSKI_MINIMIZATION_HPP
 #define PIC_ALGORITHMS_LISCHINSKI_MINIMIZATION_HPP
 
-#ifndef PIC_DISABLE_EIGEN
-
-#ifndef PIC_EIGEN_NOT_BUNDLED
-    #include "../externals/Eigen/Sparse"
-    #include "../externals/Eigen/src/SparseCore/SparseMatrix.h"
-#else
-    #include <Eigen/Sparse>
-    #include <Eigen/src/SparseCore/SparseMatrix.h>
-#endif
-
-#endif
-
 #include "../base.hpp"
 #include "../image.hpp"
+#include "../algorithms/weighted_laplacian_solver.hpp"
 
 namespace pic {
 /**
@@ -77,6 +66,8 @@ inline float LischinskiFunctionGauss(float Lcur, float Lref, float param[2])
  * @param alpha
  * @param lambda
  * @param LISCHINSKI_EPSILON
+ * @param bWarmStart if it is true, gOut is the initial guess of the
+ * solver (e.g., the solution for the previous frame of a video).
  * @return
  */
 PIC_INLINE Image *LischinskiMinimization(Image *L,
@@ -86,13 +77,13 @@ PIC_INLINE Image *LischinskiMinimization(Image *L,
                               Image *gOut = NULL,
                               float alpha = 1.0f,
                               float lambda = 0.4f,
-                              float LISCHINSKI_EPSILON = 1e-4f)
+                              float LISCHINSKI_EPSILON = 1e-4f,
+                              bool bWarmStart = false)
 {
     if(L == NULL || g == NULL) {
         return gOut;
     }
 
-#ifndef PIC_DISABLE_EIGEN
     bool bOmega = (omega == NULL);
 
     int width = L->width;
@@ -103,23 +94,29 @@ PIC_INLINE Image *LischinskiMinimization(Image *L,
     param[0] = alpha;
     param[1] = lambda;
 
-    Eigen::VectorXd b, x;
-    b = Eigen::VectorXd::Zero(tot);
+    if(gOut == NULL) {
+        gOut = g->allocateSimilarOne();
+        bWarmStart = false;
+    } else {
+        if(!gOut->isSimilarType(g)) {
+            gOut = g->allocateSimilarOne();
+            bWarmStart = false;
+        }
+    }
+
+    WeightedLaplacianSolver solver;
+    solver.setup(width, height);
 
-    #ifdef PIC_DEBUG
-        printf("Init matrix...");
-    #endif
+    float *mass = solver.getMass();
+    float *wx = solver.getWeightX();
+    float *wy = solver.getWeightY();
 
-    std::vector< Eigen::Triplet< double > > tL;
+    std::vector<float> b(tot), x(tot);
 
     for(int i = 0; i < height; i++) {
         int tmpInd = i * width;
 
         for(int j = 0; j < width; j++) {
-
-            float sum = 0.0f;
-            float tmp;
-            int indJ;
             int indI = tmpInd + j;
             float Lref = L->data[indI];
 
@@ -130,81 +127,27 @@ PIC_INLINE Image *LischinskiMinimization(Image *L,
                 omega_val = omega->data[indI];
             }
 
+            mass[indI] = omega_val;
             b[indI] = omega_val * g->data[indI];
-
-            if((i - 1) >= 0) {
-                indJ = indI - width;
-                tmp = LischinskiFunction(L->data[indJ], Lref, param, LISCHINSKI_EPSILON);
-                tL.push_back(Eigen::Triplet< double > (indI, indJ, tmp));
-                sum += tmp;
-            }
+            x[indI] = bWarmStart ? gOut->data[indI] : g->data[indI];
 
             if((i + 1) < height) {
-                indJ = indI + width;
-                tmp = LischinskiFunction(L->data[indJ], Lref, param, LISCHINSKI_EPSILON);
-                tL.push_back(Eigen::Triplet< double > (indI, indJ, tmp));
-                sum += tmp;
-            }
-
-            if((j - 1) >= 0) {
-                indJ = indI - 1;
-                tmp = LischinskiFunction(L->data[indJ], Lref, param, LISCHINSKI_EPSILON);
-                tL.push_back(Eigen::Triplet< double > (indI, indJ, tmp));
-                sum += tmp;
+                wy[indI] = -LischinskiFunction(L->data[indI + width], Lref, param, LISCHINSKI_EPSILON);
             }
 
             if((j + 1) < width) {
-                indJ = indI + 1;
-                tmp = LischinskiFunction(L->data[indJ], Lref, param, LISCHINSKI_EPSILON);
-                tL.push_back(Eigen::Triplet< double > (indI, indJ, tmp));
-                sum += tmp;
+                wx[indI] = -LischinskiFunction(L->data[indI + 1], Lref, param, LISCHINSKI_EPSILON);
             }
-
-            tL.push_back(Eigen::Triplet< double > (indI, indI, omega_val - sum));
         }
     }
 
-    #ifdef PIC_DEBUG
-        printf("Ok\n");
-    #endif
-
-    Eigen::SparseMatrix<double> A = Eigen::SparseMatrix<double>(tot, tot);
-    A.setFromTriplets(tL.begin(), tL.end());
+    solver.solve(&x[0], &b[0]);
 
-    Eigen::SimplicialCholesky<Eigen::SparseMatrix<double> > solver(A);
-    x = solver.solve(b);
-
-    if(solver.info() != Eigen::Success) {
-        #ifdef PIC_DEBUG
-            printf("SOLVER FAILED!\n");
-        #endif
-        return NULL;
+    for(int i = 0; i < tot; i++) {
+        gOut->data[i * gOut->channels] = x[i];
     }
 
-    #ifdef PIC_DEBUG
-        printf("SOLVER SUCCESS!\n");
-    #endif
-
-    if(gOut == NULL) {
-        gOut = g->allocateSimilarOne();
-    } else {
-        if(!gOut->isSimilarType(g)) {
-            gOut = g->allocateSimilarOne();
-        }
-    }
-
-    for(int i = 0; i < height; i++) {
-        int counter = i * width;
-
-        for(int j = 0; j < width; j++) {
-            (*gOut)(j, i)[0] = float(x(counter + j));
-        }
-    }
-
-    return gOut;
-#else
     return gOut;
-#endif
 }
 
 } // end namespace pic
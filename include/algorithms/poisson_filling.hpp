@@ -18,144 +18,35 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_ALGORITHMS_POISSON_FILLING_HPP
 #define PIC_ALGORITHMS_POISSON_FILLING_HPP
 
+#include <vector>
+
 #include "../util/std_util.hpp"
-#include "../util/buffer.hpp"
-#include "../util/mask.hpp"
-#include "../util/array.hpp"
 #include "../util/math.hpp"
 #include "../image.hpp"
+#include "../algorithms/poisson_solver_multigrid.hpp"
 
 namespace pic {
 
 /**
- * @brief The PoissonFilling class
+ * @brief The PoissonFilling class fills the pixels of an image equal to
+ * a given value with a membrane (harmonic) interpolation of the
+ * others; i.e., it solves lap(u) = 0 in the holes with a multigrid solver.
  */
 class PoissonFilling
 {
 protected:
-    int maxIter;
-    float threshold, value;
-
-    bool *mask, *maskPoisson;
-    Image *imgTmp;
-
-    /**
-     * @brief release
-     */
-    void release()
-    {
-        mask = delete_vec_s(mask);
-        maskPoisson = delete_vec_s(maskPoisson);
-        imgTmp = delete_s(imgTmp);
-    }
+    float value;
 
-    /**
-     * @brief update
-     * @param imgOut
-     * @param imgIn
-     */
-    void update(Image *imgOut, Image *imgIn)
-    {
-        imgOut->assign(imgIn);
-
-        #pragma omp parallel for
-
-        for(int i = 0; i < imgIn->height; i++) {
-            for(int j = 0; j < imgIn->width; j++) {
-                float *src = (*imgIn)(j, i);
-                float *n0  = (*imgIn)(j + 1, i);
-                float *n1  = (*imgIn)(j - 1, i);
-                float *n2  = (*imgIn)(j, i + 1);
-                float *n3  = (*imgIn)(j, i - 1);
-
-                int ind = i * imgIn->width + j;
-
-                float *out = (*imgOut)(j, i);
-
-                for(int k = 0; k < imgIn->channels; k++) {
-
-                    if(equalf(src[k], value)) {
-                        int div = 0;
-
-                        out[k] = 0.0f;
-
-                        if(!equalf(n0[k], value)) {
-                            out[k] += n0[k];
-                            div++;
-                        }
-
-                        if(!equalf(n1[k], value)) {
-                            out[k] += n1[k];
-                            div++;
-                        }
-
-                        if(!equalf(n2[k], value)) {
-                            out[k] += n2[k];
-                            div++;
-                        }
-
-                        if(!equalf(n3[k], value)) {
-                            out[k] += n3[k];
-                            div++;
-                        }
-
-                        if(div > 0) {
-                            out[k] = out[k] / float(div);
-                            mask[ind] = false;
-                        }
-                    } else { //Poisson solver
-                        if(maskPoisson[ind]) {
-                            int div = 0;
-                            float tmp = 0.0f;
-
-                            if(!equalf(n0[k], value)) {
-                                tmp += -src[k] + n0[k];
-                                div++;
-                            }
-
-                            if(!equalf(n1[k], value)) {
-                                tmp += -src[k] + n1[k];
-                                div++;
-                            }
-
-                            if(!equalf(n2[k], value)) {
-                                tmp += -src[k] + n2[k];
-                                div++;
-                            }
-
-                            if(!equalf(n3[k], value)) {
-                                tmp += -src[k] + n3[k];
-                                div++;
-                            }
-
-                            out[k] = src[k] + tmp / float(div);
-                        }
-                    }
-                }
-            }
-        }
-    }
+    PoissonSolverMultigrid solver;
 
 public:
 
     /**
      * @brief PoissonFilling
      */
-    PoissonFilling(float value)
+    PoissonFilling(float value) : solver(true)
     {
-        imgTmp = NULL;
-        mask = NULL;
-        maskPoisson = NULL;
-
         this->value = value;
-        threshold = 1e-4f;
-
-        maxIter = 1000;
-    }
-
-    ~PoissonFilling()
-    {
-        release();
     }
 
     /**
@@ -171,7 +62,8 @@ public:
      * @brief execute
      * @param imgIn
      * @param imgOut
-     * @param mask
+     * @param mask is the optional mask of the pixels to fill; if it
+     * is NULL, they are the ones equal to value in each channel.
      * @return
      */
     Image *execute(Image *imgIn, Image *imgOut, bool *mask = NULL)
@@ -184,48 +76,44 @@ public:
             return NULL;
         }
 
-        if(imgTmp != NULL) {
-            if(!imgTmp->isSimilarType(imgIn)) {
-                release();
-                imgTmp = imgIn->clone();
-            }
-        } else {
-            imgTmp = imgIn->clone();
-        }
-
         if(imgOut == NULL) {
             imgOut = imgIn->clone();
         } else {
             imgOut->assign(imgIn);
         }
 
-        if(mask == NULL) {
-            float *color = Arrayf::genValue(value, 3, NULL);
-
-            mask = imgIn->convertToMask(color, threshold, false, NULL);
+        int width = imgIn->width;
+        int height = imgIn->height;
+        int nPixels = imgIn->nPixels();
+        int channels = imgIn->channels;
 
-            delete_vec_s(color);
-        }
+        std::vector<unsigned char> domain(nPixels);
+        std::vector<float> u(nPixels), b(nPixels, 0.0f);
 
-        maskPoisson = Mask::clone(maskPoisson, mask, imgIn->nPixels(), 1);
+        for(int k = 0; k < channels; k++) {
+            int count = 0;
 
-        Image *work[2];
-        work[0] = imgTmp;
-        work[1] = imgOut;
+            for(int i = 0; i < nPixels; i++) {
+                u[i] = imgIn->data[i * channels + k];
 
-        int i = 0;
+                bool bHole = (mask != NULL) ? mask[i] : equalf(u[i], value);
+                domain[i] = bHole ? 1 : 0;
 
-        while(!Mask::empty(mask, imgIn->width, imgIn->height)) {
-            update(work[i % 2], work[(i + 1) % 2]);
-            i++;
+                if(bHole) {
+                    count++;
+                }
+            }
 
-            if(i > maxIter) {
-                break;
+            //there is nothing to fill or nothing to fill from
+            if((count == 0) || (count == nPixels)) {
+                continue;
             }
-        }
 
-        if((i % 2) == 1) {
-            imgOut->assign(imgTmp);
+            solver.solve(&u[0], &b[0], width, height, &domain[0]);
+
+            for(int i = 0; i < nPixels; i++) {
+                imgOut->data[i * channels + k] = u[i];
+            }
         }
 
         return imgOut;
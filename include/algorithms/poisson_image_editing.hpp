@@ -24,22 +24,10 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "../image.hpp"
 #include "../util/std_util.hpp"
 #include "../filtering/filter_laplacian.hpp"
-
-#ifndef PIC_DISABLE_EIGEN
-
-#ifndef PIC_EIGEN_NOT_BUNDLED
-    #include "../externals/Eigen/Sparse"
-    #include "../externals/Eigen/src/SparseCore/SparseMatrix.h"
-#else
-    #include <Eigen/Sparse>
-    #include <Eigen/src/SparseCore/SparseMatrix.h>
-#endif
-
-#endif
+#include "../algorithms/poisson_solver_multigrid.hpp"
 
 namespace pic {
 
-#ifndef PIC_DISABLE_EIGEN
 /**
  * @brief computePoissonImageEditing
  * @param source
@@ -57,170 +45,31 @@ PIC_INLINE Image *computePoissonImageEditing(Image *source, Image *target, bool
     //allocate the output
     if(ret == NULL) {
         ret = target->clone();
+    } else {
+        ret->assign(target);
     }
 
-    int width  = target->width;
-    int height = target->height;
-
-    #ifdef PIC_DEBUG
-        printf("Init matrix...");
-    #endif
-
     Image *lap_source = FilterLaplacian::execute(source, NULL);
 
-    std::vector< Eigen::Triplet< double > > tL;
-
-    //indices pass
-    int *index = new int[width * height];
-    int count = 0;
-    for(int i = 0; i < height; i++) {
-        int tmpI = i * width;
-
-        for(int j = 0; j < width; j++) {
-            int indI = tmpI + j;
-
-            if(mask[indI]) {
-                index[indI] = count;
-                count++;
-            } else {
-                index[indI] = 0;
-            }
-        }
-    }
-
-    //matrix A pass
-    count = 0;
-    for(int i = 0; i < height; i++) {
-        int tmpI = i * width;
-
-        for(int j = 0; j < width; j++) {
-            int indI = tmpI + j;
-
-            if(mask[indI]) {
-                if((j + 1) < (width - 1)) {
-                    if(mask[indI + 1]) {
-                        tL.push_back(Eigen::Triplet< double > (count, index[indI + 1], -1.0));
-                    }
-                }
-
-                if((j - 1) > -1) {
-                    if(mask[indI - 1]) {
-                        tL.push_back(Eigen::Triplet< double > (count, index[indI - 1], -1.0));
-                    }
-                }
-
-                if((i + 1) < (height - 1)) {
-                    if(mask[indI + width]) {
-                        tL.push_back(Eigen::Triplet< double > (count, index[indI + width], -1.0));
-                    }
-                }
-
-                if((i - 1) > -1) {
-                    if(mask[indI - width]) {
-                        tL.push_back(Eigen::Triplet< double > (count, index[indI - width], -1.0));
-                    }
-                }
-
-                tL.push_back(Eigen::Triplet< double > (count, count , 4.0));
-
-                count++;
-            }
-        }
-    }
-
-    int tot = count;
-    Eigen::SparseMatrix<double> A = Eigen::SparseMatrix<double>(tot, tot);
-    A.setFromTriplets(tL.begin(), tL.end());
-
-    #ifdef PIC_DEBUG
-        printf("Ok\n");
-    #endif
-
-    //solve the linear system for each color channel
-    Eigen::SimplicialCholesky<Eigen::SparseMatrix<double> > solver(A);
-
-    for(int k=0; k< target->channels; k++) {
-
-        Eigen::VectorXd b, x;
-        b = Eigen::VectorXd::Zero(tot);
-
-        //assign values to b
-        int count = 0;
-        for(int i = 0; i < height; i++) {
-            int tmpI = i * width;
-
-            for(int j = 0; j < width; j++) {
-                int indI = (tmpI + j);
-
-                if(mask[indI]) {
-
-                    b[count] = -(*lap_source)(j, i)[k];
-
-                    if((j + 1) < (width - 1)) {
-                        if(!mask[indI + 1]) {
-                            b[count] += (*target)(j + 1, i)[k];
-                        }
-                    }
-
-                    if((j - 1) > -1) {
-                        if(!mask[indI - 1]) {
-                            b[count] += (*target)(j - 1, i)[k];
-                        }
-                    }                        
-
-                    if((i + 1) < (height - 1)) {
-                        if(!mask[indI + width]) {
-                            b[count] += (*target)(j, i + 1)[k];
-                        }
-                    }
-
-                    if((i - 1) > -1) {
-                        if(!mask[indI - width]) {
-                           b[count] += (*target)(j, i - 1)[k];
-                        }
-                    }
-
-                    count++;
-                }
-            }
-        }
-
-        x = solver.solve(b);
-
-        if(solver.info() != Eigen::Success) {
-            #ifdef PIC_DEBUG
-                printf("SOLVER FAILED!\n");
-            #endif
-
-            return NULL;
-        }
-
-        #ifdef PIC_DEBUG
-            printf("SOLVER SUCCESS!\n");
-        #endif
-
-        count = 0;
-        for(int i = 0; i < height; i++) {
-            int tmpI = i * width;
+    //pixels outside the mask are the boundary
+    PoissonSolverMultigrid solver(false);
+    solver.Process(lap_source, mask, ret);
 
-            for(int j = 0; j < width; j++) {
-                int indI = (tmpI + j);
+    int nPixels = ret->nPixels();
+    for(int i = 0; i < nPixels; i++) {
+        if(mask[i]) {
+            float *val = &ret->data[i * ret->channels];
 
-                if(mask[indI]) {
-                    float val = float(x(count));
-                    (*ret)(j, i)[k] = val > 0.0f ? val : 0.0f;
-                    count++;
-                }
+            for(int k = 0; k < ret->channels; k++) {
+                val[k] = val[k] > 0.0f ? val[k] : 0.0f;
             }
         }
     }
 
     delete_s(lap_source);
-    delete_vec_s(index);
 
     return ret;
 }
-#endif
 
 } // end namespace pic
 
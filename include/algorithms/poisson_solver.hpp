@@ -21,25 +21,13 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "../base.hpp"
 
 #include "../image.hpp"
-
-#ifndef PIC_DISABLE_EIGEN
-
-#ifndef PIC_EIGEN_NOT_BUNDLED
-    #include "../externals/Eigen/Sparse"
-    #include "../externals/Eigen/src/SparseCore/SparseMatrix.h"
-#else
-    #include <Eigen/Sparse>
-    #include <Eigen/src/SparseCore/SparseMatrix.h>
-#endif
-
-#endif
+#include "../algorithms/poisson_solver_multigrid.hpp"
 
 namespace pic {
 
-#ifndef PIC_DISABLE_EIGEN
-
 /**
- * @brief computePoissonSolver
+ * @brief computePoissonSolver solves lap(u) = f, with u = 0 outside the
+ * image, using a multigrid solver.
  * @param f
  * @param ret
  * @return
@@ -55,89 +43,14 @@ PIC_INLINE Image *computePoissonSolver(Image *f, Image *ret = NULL)
         ret = f->allocateSimilarOne();
     }
 
-    int width = f->width;
-    int height = f->height;
-    int tot = height * width;
-
-    #ifdef PIC_DEBUG
-        printf("Init matrix...");
-    #endif
-
-    std::vector< Eigen::Triplet< double > > tL;
-
-    for(int i = 0; i < height; i++) {
-        int tmpI = i * width;
-
-        for(int j = 0; j < width; j++) {
-            int indI = tmpI + j;
-
-            tL.push_back(Eigen::Triplet< double > (indI, indI, 4.0f));
-
-            if(((indI + 1) < tot) &&
-               ((indI % width) != (width - 1))) {
-
-                tL.push_back(Eigen::Triplet< double > (indI, indI + 1, -1.0f));
-                tL.push_back(Eigen::Triplet< double > (indI + 1, indI, -1.0f));
-            }
-        }
-    }
-
-    for(int i = 0; i < (tot - width); i++) {
-        tL.push_back(Eigen::Triplet< double > (i + width, i         , -1.0f));
-        tL.push_back(Eigen::Triplet< double > (i        , i +  width, -1.0f));
-    }
-
-    #ifdef PIC_DEBUG
-        printf("Ok\n");
-    #endif
-
-    //solve the linear system for each color channel
-    Eigen::SparseMatrix<double> A = Eigen::SparseMatrix<double>(tot, tot);
-    A.setFromTriplets(tL.begin(), tL.end());
-    Eigen::SimplicialCholesky<Eigen::SparseMatrix<double> > solver(A);
-
-    for(int k = 0; k < f->channels; k++) {
-
-        Eigen::VectorXd b, x;
-        b = Eigen::VectorXd::Zero(tot);
-
-        //copy values from f to b
-        for(int i = 0; i < height; i++) {
-            int tmpI = i * width;
-            for(int j = 0; j < width; j++) {
-                int indI = (tmpI + j);
-                b[indI] = - f->data[indI * f->channels + k];
-            }
-        }
-
-        x = solver.solve(b);
+    ret->setZero();
 
-        if(solver.info() != Eigen::Success) {
-            #ifdef PIC_DEBUG
-                printf("SOLVER FAILED!\n");
-            #endif
-
-            return ret;
-        }
-
-        #ifdef PIC_DEBUG
-            printf("SOLVER SUCCESS!\n");
-        #endif
-
-        for(int i = 0; i < height; i++) {
-            int tmpI = i * width;
-
-            for(int j = 0; j < width; j++) {
-                (*ret)(j, i)[k] = float(x(tmpI + j));
-            }
-        }
-    }
+    PoissonSolverMultigrid solver(false);
+    solver.Process(f, NULL, ret);
 
     return ret;
 }
 
-#endif
-
 /**
  * @brief computePoissonSolverIterative
  * @param img
@@ -0,0 +1,752 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_ALGORITHMS_POISSON_SOLVER_MULTIGRID_HPP
+#define PIC_ALGORITHMS_POISSON_SOLVER_MULTIGRID_HPP
+
+#include <vector>
+#include <math.h>
+#include <float.h>
+
+#include "../base.hpp"
+#include "../image.hpp"
+#include "../util/math.hpp"
+#include "../util/thread_pool.hpp"
+
+#ifndef PIC_DISABLE_EIGEN
+
+#ifndef PIC_EIGEN_NOT_BUNDLED
+    #include "../externals/Eigen/Sparse"
+    #include "../externals/Eigen/src/SparseCore/SparseMatrix.h"
+#else
+    #include <Eigen/Sparse>
+    #include <Eigen/src/SparseCore/SparseMatrix.h>
+#endif
+
+#endif
+
+namespace pic {
+
+/**
+ * @brief The PoissonSolverMultigrid class is a matrix-free geometric
+ * multigrid solver for the 5-point Poisson equation on a masked domain:
+ * for each pixel p of the domain, n_p u_p - sum_q u_q = b_p, where q are the
+ * neighbors of p in the image; pixels outside the domain keep their value
+ * (Dirichlet boundary). Outside the image, u is zero (Dirichlet) or
+ * the stencil is cut (Neumann, n_p is the number of neighbors in the image).
+ *
+ * Levels are cell-centered and a coarse cell belongs to the domain if all
+ * its children do. The solver runs a full multigrid (FMG) pass
+ * followed by V-cycles with red-black Gauss-Seidel smoothing; smoothing and
+ * residuals are multithreaded on each level and data is stored in float.
+ * If V-cycles stagnate before the tolerance, the system is solved directly
+ * with Eigen.
+ */
+class PoissonSolverMultigrid
+{
+protected:
+
+    /**
+     * @brief The PoissonLevel struct
+     */
+    struct PoissonLevel
+    {
+        int width, height;
+        float scale, border;
+        std::vector<float> u, b;
+        std::vector<unsigned char> domain;
+    };
+
+    std::vector<PoissonLevel> levels;
+    float *u0, *b0;
+    const unsigned char *domain0;
+
+    int maxCycles, nPre, nPost;
+    float tolerance;
+    bool bNeumann;
+
+    /**
+     * @brief getU
+     * @param l
+     * @return
+     */
+    inline float *getU(int l)
+    {
+        return (l == 0) ? u0 : &levels[l].u[0];
+    }
+
+    /**
+     * @brief getB
+     * @param l
+     * @return
+     */
+    inline float *getB(int l)
+    {
+        return (l == 0) ? b0 : &levels[l].b[0];
+    }
+
+    /**
+     * @brief getDomain
+     * @param l
+     * @return
+     */
+    inline const unsigned char *getDomain(int l)
+    {
+        return (l == 0) ? domain0 : &levels[l].domain[0];
+    }
+
+    /**
+     * @brief getGrain
+     * @param width
+     * @return This function returns the number of rows of a parallel task.
+     */
+    static inline int getGrain(int width)
+    {
+        return MAX(1, 32768 / MAX(width, 1));
+    }
+
+    /**
+     * @brief neighbors computes the neighbor sum and the diagonal of the
+     * stencil at (x, y).
+     * @param u
+     * @param level
+     * @param x
+     * @param y
+     * @param diag
+     * @return
+     */
+    inline float neighbors(const float *u, const PoissonLevel &level, int x, int y, float &diag)
+    {
+        int width = level.width;
+        int ind = y * width + x;
+        float sum = 0.0f;
+        int n = 0;
+
+        if(x > 0) {
+            sum += u[ind - 1];
+            n++;
+        }
+
+        if(x < (width - 1)) {
+            sum += u[ind + 1];
+            n++;
+        }
+
+        if(y > 0) {
+            sum += u[ind - width];
+            n++;
+        }
+
+        if(y < (level.height - 1)) {
+            sum += u[ind + width];
+            n++;
+        }
+
+        diag = float(n) + float(4 - n) * level.border;
+
+        return sum;
+    }
+
+    /**
+     * @brief smooth runs red-black Gauss-Seidel sweeps; rows of the same
+     * color are updated in parallel.
+     * @param l
+     * @param nSweeps
+     */
+    void smooth(int l, int nSweeps)
+    {
+        int width = levels[l].width;
+        int height = levels[l].height;
+        float inv_scale = 1.0f / levels[l].scale;
+
+        float *u = getU(l);
+        float *b = getB(l);
+        const unsigned char *domain = getDomain(l);
+
+        ThreadPool *tp = ThreadPool::getInstance();
+
+        for(int s = 0; s < nSweeps; s++) {
+            for(int color = 0; color < 2; color++) {
+                tp->parallelFor(0, height, [&](int y0, int y1) {
+                    for(int y = y0; y < y1; y++) {
+                        for(int x = (y + color) & 1; x < width; x += 2) {
+                            int ind = y * width + x;
+
+                            if(!domain[ind]) {
+                                continue;
+                            }
+
+                            float diag;
+                            float sum = neighbors(u, levels[l], x, y, diag);
+
+                            if(diag > 0.0f) {
+                                u[ind] = (b[ind] * inv_scale + sum) / diag;
+                            }
+                        }
+                    }
+                }, getGrain(width));
+            }
+        }
+    }
+
+    /**
+     * @brief residualNorm
+     * @param l
+     * @param magnitude if it is not NULL, it is set to the squared L2 norm
+     * of the sum of the magnitudes of the terms of the residual; this
+     * bounds the error of evaluating the residual in float.
+     * @return This function returns the squared L2 norm of the residual
+     * of the l-th level.
+     */
+    double residualNorm(int l, double *magnitude = NULL)
+    {
+        int width = levels[l].width;
+        int height = levels[l].height;
+        float scale = levels[l].scale;
+
+        float *u = getU(l);
+        float *b = getB(l);
+        const unsigned char *domain = getDomain(l);
+
+        //a fixed number of blocks makes sums independent of threads
+        int nBlocks = MIN(64, height);
+        std::vector<double> partial(nBlocks, 0.0), partial_mag(nBlocks, 0.0);
+
+        ThreadPool::getInstance()->run(nBlocks, [&](int k) {
+            int y0 = (height * k) / nBlocks;
+            int y1 = (height * (k + 1)) / nBlocks;
+
+            double acc = 0.0, acc_mag = 0.0;
+            for(int y = y0; y < y1; y++) {
+                for(int x = 0; x < width; x++) {
+                    int ind = y * width + x;
+
+                    if(!domain[ind]) {
+                        continue;
+                    }
+
+                    float diag;
+                    float sum = neighbors(u, levels[l], x, y, diag);
+                    double r = double(b[ind] - scale * (diag * u[ind] - sum));
+                    acc += r * r;
+
+                    double m = double(fabsf(b[ind]) + scale * (diag * fabsf(u[ind]) + fabsf(sum)));
+                    acc_mag += m * m;
+                }
+            }
+
+            partial[k] = acc;
+            partial_mag[k] = acc_mag;
+        });
+
+        double ret = 0.0;
+        for(int k = 0; k < nBlocks; k++) {
+            ret += partial[k];
+        }
+
+        if(magnitude != NULL) {
+            *magnitude = 0.0;
+            for(int k = 0; k < nBlocks; k++) {
+                *magnitude += partial_mag[k];
+            }
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief restrictResidual averages the residual of the l-th level
+     * into the right-hand side of the (l + 1)-th level, whose solution is
+     * set to zero.
+     * @param l
+     */
+    void restrictResidual(int l)
+    {
+        int width = levels[l].width;
+        int height = levels[l].height;
+        float scale = levels[l].scale;
+
+        float *u = getU(l);
+        float *b = getB(l);
+        const unsigned char *domain = getDomain(l);
+
+        PoissonLevel &coarse = levels[l + 1];
+
+        ThreadPool::getInstance()->parallelFor(0, coarse.height, [&](int y0, int y1) {
+            for(int Y = y0; Y < y1; Y++) {
+                for(int X = 0; X < coarse.width; X++) {
+                    int indC = Y * coarse.width + X;
+                    coarse.u[indC] = 0.0f;
+
+                    float acc = 0.0f;
+                    for(int k = 0; k < 4; k++) {
+                        int x = 2 * X + (k & 1);
+                        int y = 2 * Y + (k >> 1);
+
+                        if((x >= width) || (y >= height)) {
+                            continue;
+                        }
+
+                        int ind = y * width + x;
+
+                        if(!domain[ind]) {
+                            continue;
+                        }
+
+                        float diag;
+                        float sum = neighbors(u, levels[l], x, y, diag);
+                        acc += b[ind] - scale * (diag * u[ind] - sum);
+                    }
+
+                    coarse.b[indC] = acc * 0.25f;
+                }
+            }
+        }, getGrain(coarse.width));
+    }
+
+    /**
+     * @brief prolongate interpolates bilinearly the solution of the
+     * (l + 1)-th level and adds it to the l-th level.
+     * @param l
+     */
+    void prolongate(int l)
+    {
+        int width = levels[l].width;
+        int height = levels[l].height;
+
+        float *u = getU(l);
+        const unsigned char *domain = getDomain(l);
+
+        PoissonLevel &coarse = levels[l + 1];
+        const float *uc = &coarse.u[0];
+
+        ThreadPool::getInstance()->parallelFor(0, height, [&](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                int Y = y >> 1;
+                int Yn = (y & 1) ? (Y + 1) : (Y - 1);
+                Yn = CLAMP(Yn, coarse.height);
+
+                for(int x = 0; x < width; x++) {
+                    int ind = y * width + x;
+
+                    if(!domain[ind]) {
+                        continue;
+                    }
+
+                    int X = x >> 1;
+                    int Xn = (x & 1) ? (X + 1) : (X - 1);
+                    Xn = CLAMP(Xn, coarse.width);
+
+                    u[ind] += 0.5625f * uc[Y  * coarse.width + X ] +
+                              0.1875f * uc[Y  * coarse.width + Xn] +
+                              0.1875f * uc[Yn * coarse.width + X ] +
+                              0.0625f * uc[Yn * coarse.width + Xn];
+                }
+            }
+        }, getGrain(width));
+    }
+
+    /**
+     * @brief vCycle
+     * @param l
+     */
+    void vCycle(int l)
+    {
+        int nLevels = int(levels.size());
+
+        if(l == (nLevels - 1)) {
+            smooth(l, 64);
+            return;
+        }
+
+        smooth(l, nPre);
+        restrictResidual(l);
+        vCycle(l + 1);
+        prolongate(l);
+        smooth(l, nPost);
+    }
+
+    /**
+     * @brief allocate builds the hierarchy of levels.
+     * @param width
+     * @param height
+     */
+    void allocate(int width, int height)
+    {
+        levels.clear();
+
+        PoissonLevel level;
+        level.width = width;
+        level.height = height;
+        level.scale = 1.0f;
+        level.border = bNeumann ? 0.0f : 1.0f;
+        levels.push_back(level);
+
+        //with Dirichlet borders, the zero of the finest level is one cell
+        //outside the image; on coarser levels it is delta < 1 cells away
+        //from the center of border cells, and the missing neighbor is
+        //weighted by 1 / delta^2
+        float delta = 1.0f;
+
+        while((width > 2) || (height > 2)) {
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+
+            PoissonLevel coarse;
+            coarse.width = width;
+            coarse.height = height;
+            coarse.scale = levels.back().scale * 0.25f;
+
+            delta = (delta + 0.5f) * 0.5f;
+            coarse.border = bNeumann ? 0.0f : (1.0f / (delta * delta));
+            coarse.u.assign(width * height, 0.0f);
+            coarse.b.assign(width * height, 0.0f);
+            coarse.domain.assign(width * height, 0);
+            levels.push_back(coarse);
+        }
+
+        for(unsigned int l = 1; l < levels.size(); l++) {
+            PoissonLevel &fine = levels[l - 1];
+            PoissonLevel &coarse = levels[l];
+            const unsigned char *domain = getDomain(l - 1);
+
+            //larger coarse domains over-correct near the boundary
+            for(int Y = 0; Y < coarse.height; Y++) {
+                for(int X = 0; X < coarse.width; X++) {
+                    unsigned char value = 1;
+
+                    for(int k = 0; k < 4; k++) {
+                        int x = 2 * X + (k & 1);
+                        int y = 2 * Y + (k >> 1);
+
+                        if((x < fine.width) && (y < fine.height)) {
+                            value &= domain[y * fine.width + x];
+                        } else {
+                            //a cell cut by an odd border is not centered
+                            //where 1 / delta^2 assumes, so with Dirichlet
+                            //borders it is out of the domain
+                            value = bNeumann ? value : 0;
+                        }
+                    }
+
+                    coarse.domain[Y * coarse.width + X] = value;
+                }
+            }
+        }
+    }
+
+#ifndef PIC_DISABLE_EIGEN
+
+    /**
+     * @brief solveDirect solves the finest level with a sparse Cholesky
+     * factorization in double; it is the fallback of solve.
+     * @param u
+     * @param b
+     * @param width
+     * @param height
+     * @param domain
+     * @return This function returns true if the factorization succeeded.
+     */
+    bool solveDirect(float *u, float *b, int width, int height, const unsigned char *domain)
+    {
+        int nPixels = width * height;
+        float border = bNeumann ? 0.0f : 1.0f;
+
+        std::vector<int> index(nPixels, -1);
+        int n = 0;
+        for(int i = 0; i < nPixels; i++) {
+            if(domain[i]) {
+                index[i] = n;
+                n++;
+            }
+        }
+
+        std::vector< Eigen::Triplet< double > > tL;
+        Eigen::VectorXd rhs(n);
+
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                int ind = y * width + x;
+
+                if(index[ind] < 0) {
+                    continue;
+                }
+
+                int neighbors[4];
+                int nNeighbors = 0;
+
+                if(x > 0) {
+                    neighbors[nNeighbors++] = ind - 1;
+                }
+
+                if(x < (width - 1)) {
+                    neighbors[nNeighbors++] = ind + 1;
+                }
+
+                if(y > 0) {
+                    neighbors[nNeighbors++] = ind - width;
+                }
+
+                if(y < (height - 1)) {
+                    neighbors[nNeighbors++] = ind + width;
+                }
+
+                double value = double(b[ind]);
+
+                for(int k = 0; k < nNeighbors; k++) {
+                    int j = neighbors[k];
+
+                    if(index[j] < 0) {
+                        value += double(u[j]);
+                    } else {
+                        tL.push_back(Eigen::Triplet< double > (index[ind], index[j], -1.0));
+                    }
+                }
+
+                double diag = double(nNeighbors) + double(4 - nNeighbors) * double(border);
+                tL.push_back(Eigen::Triplet< double > (index[ind], index[ind], diag));
+                rhs[index[ind]] = value;
+            }
+        }
+
+        Eigen::SparseMatrix<double> A = Eigen::SparseMatrix<double>(n, n);
+        A.setFromTriplets(tL.begin(), tL.end());
+        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > solver(A);
+
+        if(solver.info() != Eigen::Success) {
+            #ifdef PIC_DEBUG
+                printf("direct solve failed.\n");
+            #endif
+
+            return false;
+        }
+
+        Eigen::VectorXd x = solver.solve(rhs);
+
+        for(int i = 0; i < nPixels; i++) {
+            if(index[i] >= 0) {
+                u[i] = float(x[index[i]]);
+            }
+        }
+
+        #ifdef PIC_DEBUG
+            printf("direct solve done.\n");
+        #endif
+
+        return true;
+    }
+
+#endif
+
+public:
+
+    /**
+     * @brief PoissonSolverMultigrid
+     * @param bNeumann if it is true, the boundary of the image is a
+     * Neumann boundary; otherwise, u is zero outside the image.
+     * @param maxCycles is the maximum number of V-cycles after FMG.
+     * @param tolerance is the target ratio between the final and the
+     * initial residual norms.
+     */
+    PoissonSolverMultigrid(bool bNeumann = false, int maxCycles = 20, float tolerance = 1e-5f)
+    {
+        this->bNeumann = bNeumann;
+        this->maxCycles = maxCycles;
+        this->tolerance = tolerance;
+        nPre = 2;
+        nPost = 2;
+
+        u0 = NULL;
+        b0 = NULL;
+        domain0 = NULL;
+    }
+
+    /**
+     * @brief solve
+     * @param u is an array of width x height values; values of pixels
+     * in the domain are the initial guess, the others are the boundary.
+     * It is overwritten with the solution.
+     * @param b is the right-hand side; it is an array of width x height
+     * values.
+     * @param width
+     * @param height
+     * @param domain is an array of width x height values; if it is NULL,
+     * the domain is the whole image.
+     * @return This function returns true if the residual reached the
+     * tolerance (or the float round-off level), either with V-cycles or,
+     * when they stagnate or diverge, with a direct solve.
+     */
+    bool solve(float *u, float *b, int width, int height, const unsigned char *domain = NULL)
+    {
+        if((u == NULL) || (b == NULL) || (width < 1) || (height < 1)) {
+            return false;
+        }
+
+        std::vector<unsigned char> domain_all;
+        if(domain == NULL) {
+            domain_all.assign(width * height, 1);
+            domain = &domain_all[0];
+        }
+
+        u0 = u;
+        b0 = b;
+        domain0 = domain;
+
+        allocate(width, height);
+
+        int nLevels = int(levels.size());
+
+        double norm0 = residualNorm(0);
+
+        if(norm0 <= 0.0) {
+            levels.clear();
+            return true;
+        }
+
+        //FMG on the error equation: the initial residual is
+        //restricted to all levels and solved from coarse to fine
+        if(nLevels > 1) {
+            restrictResidual(0);
+
+            for(int l = 1; l < (nLevels - 1); l++) {
+                restrictResidual(l);
+            }
+
+            smooth(nLevels - 1, 64);
+
+            for(int l = nLevels - 2; l >= 1; l--) {
+                std::fill(levels[l].u.begin(), levels[l].u.end(), 0.0f);
+                prolongate(l);
+                vCycle(l);
+            }
+
+            prolongate(0);
+        }
+
+        int cycles = 0;
+        double target = norm0 * double(tolerance) * double(tolerance);
+        double mag;
+        double norm = residualNorm(0, &mag);
+        double norm_old = norm;
+
+        bool bConverged = (norm <= target);
+
+        while((cycles < maxCycles) && !bConverged) {
+            vCycle(0);
+            cycles++;
+
+            norm = residualNorm(0, &mag);
+
+            if(norm <= target) {
+                bConverged = true;
+                break;
+            }
+
+            //the residual stagnates at the float round-off level
+            if(norm > (0.81 * norm_old)) {
+                break;
+            }
+
+            norm_old = norm;
+        }
+
+        //stagnation is accepted close to the tolerance or when the residual
+        //is a few float ulps of its terms; otherwise, it is a failure
+        if(!bConverged) {
+            double eps = double(FLT_EPSILON);
+            bConverged = (norm <= (target * 100.0)) || (norm <= (16.0 * eps * eps * mag));
+        }
+
+        #ifdef PIC_DEBUG
+            printf("Multigrid V-cycles: %d residual: %e\n", cycles, sqrt(norm / norm0));
+        #endif
+
+        levels.clear();
+
+        if(!bConverged) {
+            #ifdef PIC_DEBUG
+                printf("Multigrid did not converge; ");
+            #endif
+
+            #ifndef PIC_DISABLE_EIGEN
+                bConverged = solveDirect(u, b, width, height, domain);
+            #endif
+        }
+
+        return bConverged;
+    }
+
+    /**
+     * @brief Process solves the Poisson equation lap(u) = f for each
+     * channel.
+     * @param f is the Laplacian of the solution.
+     * @param mask is the domain; if it is NULL, the domain is the whole
+     * image.
+     * @param ret contains the boundary values (and the initial guess)
+     * and it is overwritten with the solution; if it is NULL, it is
+     * allocated and set to zero.
+     * @return
+     */
+    Image *Process(Image *f, bool *mask, Image *ret)
+    {
+        if(f == NULL) {
+            return ret;
+        }
+
+        if(ret == NULL) {
+            ret = f->allocateSimilarOne();
+            ret->setZero();
+        }
+
+        int width = f->width;
+        int height = f->height;
+        int nPixels = width * height;
+
+        std::vector<unsigned char> domain;
+        if(mask != NULL) {
+            domain.resize(nPixels);
+            for(int i = 0; i < nPixels; i++) {
+                domain[i] = mask[i] ? 1 : 0;
+            }
+        }
+
+        std::vector<float> u(nPixels), b(nPixels);
+
+        for(int k = 0; k < f->channels; k++) {
+            for(int i = 0; i < nPixels; i++) {
+                u[i] = ret->data[i * ret->channels + k];
+                b[i] = -f->data[i * f->channels + k];
+            }
+
+            if(!solve(&u[0], &b[0], width, height, (mask != NULL) ? &domain[0] : NULL)) {
+                #ifdef PIC_DEBUG
+                    printf("PoissonSolverMultigrid: channel %d did not converge.\n", k);
+                #endif
+            }
+
+            for(int i = 0; i < nPixels; i++) {
+                ret->data[i * ret->channels + k] = u[i];
+            }
+        }
+
+        return ret;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_ALGORITHMS_POISSON_SOLVER_MULTIGRID_HPP */
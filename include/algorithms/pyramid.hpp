@@ -18,39 +18,49 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_ALGORITHMS_PYRAMID_HPP
 #define PIC_ALGORITHMS_PYRAMID_HPP
 
+#include <vector>
+#include <string.h>
+
 #include "../base.hpp"
 #include "../image.hpp"
 #include "../image_vec.hpp"
 #include "../util/std_util.hpp"
-#include "../filtering/filter.hpp"
-#include "../filtering/filter_gaussian_2d.hpp"
-#include "../filtering/filter_sampler_2d.hpp"
-#include "../filtering/filter_sampler_2dsub.hpp"
-#include "../filtering/filter_sampler_2dadd.hpp"
+#include "../util/thread_pool.hpp"
 
 namespace pic {
 
 /**
- * @brief The Pyramid class
+ * @brief The Pyramid class is a Gaussian/Laplacian pyramid (Burt and
+ * Adelson) with the 5-tap binomial kernel [1 4 6 4 1] / 16. Levels are
+ * stored in a single buffer; reduce only computes the retained samples
+ * and expand is fused with the difference/sum of levels.
  */
 class Pyramid
 {
 protected:
-    bool lapGauss, bCreated;
+    bool lapGauss;
     int limitLevel;
 
-    FilterGaussian2D *flt_gauss;
-    FilterSampler2D *flt_sampler;
-    FilterSampler2DSub *flt_sub;
-    FilterSampler2DAdd *flt_add;
-    std::vector< Filter* > filters;
+    std::vector<float> arena, arenaRec, scratch;
+    int nBands;
 
-    ImageVec trackerRec, trackerUp;
+    ImageVec trackerRec;
 
     /**
-     * @brief initFilters
+     * @brief allocate sets the levels of a width x height x channels
+     * image in the buffer.
+     * @param width
+     * @param height
+     * @param channels
+     * @param levels
      */
-    void initFilters();
+    void allocate(int width, int height, int channels, int levels);
+
+    /**
+     * @brief compute
+     * @param img
+     */
+    void compute(Image *img);
 
     /**
      * @brief create
@@ -63,15 +73,31 @@ protected:
      */
     void create(Image *img, bool lapGauss, int limitLevel);
 
+    /**
+     * @brief reduce blurs and decimates src into dst, which is half its size.
+     * @param src
+     * @param dst
+     */
+    void reduce(Image *src, Image *dst);
+
+    /**
+     * @brief expand computes dst = base + sign * expand(coarse); dst
+     * can be base.
+     * @param base
+     * @param coarse
+     * @param dst
+     * @param sign
+     */
+    void expand(Image *base, Image *coarse, Image *dst, float sign);
+
     /**
      * @brief release
      */
     void release()
     {
-        stdVectorClear<Image>(trackerUp);
         stdVectorClear<Image>(trackerRec);
         stdVectorClear<Image>(stack);
-        stdVectorClear<Filter>(filters);
+        arenaRec.clear();
     }
 
 public:
@@ -111,7 +137,8 @@ public:
     }
 
     /**
-     * @brief update recomputes the pyramid given a compatible image, img.
+     * @brief update recomputes the pyramid given a compatible image, img;
+     * levels are overwritten in place without allocations.
      * @param img
      */
     void update(Image *img);
@@ -174,12 +201,9 @@ public:
     {
         release();
 
-        flt_gauss = NULL;
-        flt_sampler = NULL;
-        flt_sub = NULL;
-        flt_add = NULL;
-
-        bCreated = false;
+        arena.clear();
+        scratch.clear();
+        nBands = 0;
     }
 };
 
@@ -194,12 +218,13 @@ PIC_INLINE Pyramid::Pyramid(int width, int height, int channels, bool lapGauss,
 {
     setNULL();
 
-    Image *img = new Image(1, width, height, channels);
-    *img = 0.0f;
+    limitLevel = MAX(limitLevel, 0);
 
-    create(img, lapGauss, limitLevel);
+    this->limitLevel = limitLevel;
+    this->lapGauss  = lapGauss;
 
-    delete img;
+    //the pyramid of a black image is black
+    allocate(width, height, channels, log2(MIN(width, height)) - limitLevel);
 }
 
 PIC_INLINE Pyramid::~Pyramid()
@@ -207,22 +232,189 @@ PIC_INLINE Pyramid::~Pyramid()
     release();
 }
 
-PIC_INLINE void Pyramid::initFilters()
+PIC_INLINE void Pyramid::allocate(int width, int height, int channels, int levels)
 {
-    if(!bCreated) {
-        flt_gauss = new FilterGaussian2D(1.0f);
-        filters.push_back(flt_gauss);
+    release();
+
+    if(levels < 1) {
+        return;
+    }
+
+    std::vector<int> offsets;
+    size_t tot = 0;
 
-        flt_sampler = new FilterSampler2D(0.5f);
-        filters.push_back(flt_sampler);
+    int w = width;
+    int h = height;
+    for(int i = 0; i <= levels; i++) {
+        offsets.push_back(int(tot));
+        tot += size_t(w) * size_t(h) * size_t(channels);
 
-        flt_sub = new FilterSampler2DSub(NULL);
-        filters.push_back(flt_sub);
+        w = w >> 1;
+        h = h >> 1;
+    }
+
+    arena.assign(tot, 0.0f);
 
-        flt_add = new FilterSampler2DAdd(NULL);
-        filters.push_back(flt_add);
+    w = width;
+    h = height;
+    for(int i = 0; i <= levels; i++) {
+        stack.push_back(new Image(1, w, h, channels, &arena[offsets[i]]));
 
-        bCreated = true;
+        w = w >> 1;
+        h = h >> 1;
+    }
+
+    //each band keeps 5 rows of the first level
+    nBands = MIN(32, height);
+    scratch.assign(size_t(nBands) * 5 * size_t(width) * size_t(channels), 0.0f);
+}
+
+PIC_INLINE void Pyramid::reduce(Image *src, Image *dst)
+{
+    int width = src->width;
+    int height = src->height;
+    int channels = src->channels;
+
+    int wd = dst->width;
+    int hd = dst->height;
+
+    int rowSize = wd * channels;
+    int nTasks = MIN(nBands, hd);
+
+    ThreadPool::getInstance()->run(nTasks, [&](int k) {
+        int y0 = (hd * k) / nTasks;
+        int y1 = (hd * (k + 1)) / nTasks;
+
+        //rows reduced along x; fine row r is in slot (r + 10) % 5
+        float *rows = &scratch[size_t(k) * 5 * size_t(src->width) * channels];
+
+        int rLast = 2 * y0 - 3;
+
+        for(int y = y0; y < y1; y++) {
+            for(int r = MAX(rLast + 1, 2 * y - 2); r <= (2 * y + 2); r++) {
+                int rc = CLAMPi(r, 0, height - 1);
+                float *in = &src->data[size_t(rc) * width * channels];
+                float *row = rows + ((r + 10) % 5) * rowSize;
+
+                for(int x = 0; x < wd; x++) {
+                    int xm2 = MAX(2 * x - 2, 0) * channels;
+                    int xm1 = MAX(2 * x - 1, 0) * channels;
+                    int x0  = (2 * x) * channels;
+                    int xp1 = MIN(2 * x + 1, width - 1) * channels;
+                    int xp2 = MIN(2 * x + 2, width - 1) * channels;
+
+                    float *out = row + x * channels;
+                    for(int c = 0; c < channels; c++) {
+                        out[c] = (in[xm2 + c] + in[xp2 + c]) * 0.0625f +
+                                 (in[xm1 + c] + in[xp1 + c]) * 0.25f +
+                                  in[x0 + c] * 0.375f;
+                    }
+                }
+            }
+
+            rLast = 2 * y + 2;
+
+            const float *r0 = rows + ((2 * y + 8) % 5) * rowSize;
+            const float *r1 = rows + ((2 * y + 9) % 5) * rowSize;
+            const float *r2 = rows + ((2 * y + 10) % 5) * rowSize;
+            const float *r3 = rows + ((2 * y + 11) % 5) * rowSize;
+            const float *r4 = rows + ((2 * y + 12) % 5) * rowSize;
+
+            float *out = &dst->data[size_t(y) * rowSize];
+            for(int i = 0; i < rowSize; i++) {
+                out[i] = (r0[i] + r4[i]) * 0.0625f +
+                         (r1[i] + r3[i]) * 0.25f +
+                          r2[i] * 0.375f;
+            }
+        }
+    });
+}
+
+PIC_INLINE void Pyramid::expand(Image *base, Image *coarse, Image *dst, float sign)
+{
+    int width = dst->width;
+    int height = dst->height;
+    int channels = dst->channels;
+
+    int wc = coarse->width;
+    int hc = coarse->height;
+
+    int rowSize = wc * channels;
+    int nTasks = MIN(nBands, height);
+
+    ThreadPool::getInstance()->run(nTasks, [&](int k) {
+        int y0 = (height * k) / nTasks;
+        int y1 = (height * (k + 1)) / nTasks;
+
+        float *row = &scratch[size_t(k) * 5 * size_t(stack[0]->width) * channels];
+
+        for(int y = y0; y < y1; y++) {
+            //expand along y: [1 6 1] / 8 for even rows, [1 1] / 2 for odd ones
+            int Y = y >> 1;
+            const float *c0 = &coarse->data[size_t(CLAMPi(Y, 0, hc - 1)) * rowSize];
+
+            if((y & 1) == 0) {
+                const float *cm = &coarse->data[size_t(CLAMPi(Y - 1, 0, hc - 1)) * rowSize];
+                const float *cp = &coarse->data[size_t(CLAMPi(Y + 1, 0, hc - 1)) * rowSize];
+
+                for(int i = 0; i < rowSize; i++) {
+                    row[i] = (cm[i] + cp[i]) * 0.125f + c0[i] * 0.75f;
+                }
+            } else {
+                const float *cp = &coarse->data[size_t(CLAMPi(Y + 1, 0, hc - 1)) * rowSize];
+
+                for(int i = 0; i < rowSize; i++) {
+                    row[i] = (c0[i] + cp[i]) * 0.5f;
+                }
+            }
+
+            //expand along x
+            const float *in = &base->data[size_t(y) * width * channels];
+            float *out = &dst->data[size_t(y) * width * channels];
+
+            for(int x = 0; x < width; x++) {
+                int X = x >> 1;
+                int i0 = CLAMPi(X, 0, wc - 1) * channels;
+                int ip = CLAMPi(X + 1, 0, wc - 1) * channels;
+
+                int ind = x * channels;
+
+                if((x & 1) == 0) {
+                    int im = CLAMPi(X - 1, 0, wc - 1) * channels;
+
+                    for(int c = 0; c < channels; c++) {
+                        float e = (row[im + c] + row[ip + c]) * 0.125f + row[i0 + c] * 0.75f;
+                        out[ind + c] = in[ind + c] + sign * e;
+                    }
+                } else {
+                    for(int c = 0; c < channels; c++) {
+                        float e = (row[i0 + c] + row[ip + c]) * 0.5f;
+                        out[ind + c] = in[ind + c] + sign * e;
+                    }
+                }
+            }
+        }
+    });
+}
+
+PIC_INLINE void Pyramid::compute(Image *img)
+{
+    int levels = int(stack.size()) - 1;
+
+    if(!lapGauss) {
+        memcpy(stack[0]->data, img->data, sizeof(float) * stack[0]->size());
+    }
+
+    Image *tmpImg = img;
+
+    for(int i = 0; i < levels; i++) {
+        reduce(tmpImg, stack[i + 1]);
+
+        if(lapGauss) { //Laplacian Pyramid
+            expand(tmpImg, stack[i + 1], stack[i], -1.0f);
+        }
+
+        tmpImg = stack[i + 1];
     }
 }
 
@@ -241,35 +433,12 @@ PIC_INLINE void Pyramid::create(Image *img, bool lapGauss, int limitLevel = 1)
     this->limitLevel = limitLevel;
     this->lapGauss  = lapGauss;
 
-    initFilters();
-
     int levels = log2(MIN(img->width, img->height)) - limitLevel;
 
-    Image *tmpImg = img;
-    Image *tmpG = NULL;
-    Image *tmpD = NULL;
-
-    for(int i = 0; i < levels; i++) {
-        tmpG = flt_gauss->Process(Single(tmpImg), NULL);
-        tmpD = flt_sampler->Process(Single(tmpG), NULL);
+    allocate(img->width, img->height, img->channels, levels);
 
-        if(lapGauss) { //Laplacian Pyramid
-            flt_sub->Process(Double(tmpImg, tmpD), tmpG);
-            stack.push_back(tmpG);
-        } else { //Gaussian Pyramid
-            *tmpG = *tmpImg;
-            stack.push_back(tmpG);
-        }
-
-        if(i < (levels - 1)) {
-            trackerUp.push_back(tmpD);
-        }
-
-        tmpImg = tmpD;
-    }
-
-    if(tmpD != NULL) {
-        stack.push_back(tmpD);
+    if(!stack.empty()) {
+        compute(img);
     }
 
 #ifdef PIC_DEBUG
@@ -291,30 +460,7 @@ PIC_INLINE void Pyramid::update(Image *img)
         return;
     }
 
-    Image *tmpG = NULL;
-    Image *tmpD = NULL;
-    Image *tmpImg = img;
-
-    int levels = MAX(log2(MIN(img->width, img->height)) - limitLevel, 1);
-
-    for(int i = 0; i < levels; i++) {
-
-        tmpG = flt_gauss->Process(Single(tmpImg), stack[i]);
-
-        if(i == (levels - 1)) {
-            tmpD = flt_sampler->Process(Double(tmpG, stack[i + 1]), stack[i + 1]);
-        } else {
-            tmpD = flt_sampler->Process(Double(tmpG, trackerUp[i]), trackerUp[i]);
-        }
-
-        if(lapGauss) {	//Laplacian Pyramid
-            flt_sub->Process(Double(tmpImg, tmpD), tmpG);
-        } else { //Gaussian Pyramid
-            *tmpG = *tmpImg;
-        }
-
-        tmpImg = tmpD;
-    }
+    compute(img);
 }
 
 PIC_INLINE Image *Pyramid::reconstruct(Image *imgOut = NULL)
@@ -324,25 +470,41 @@ PIC_INLINE Image *Pyramid::reconstruct(Image *imgOut = NULL)
     }
 
     int n = int(stack.size()) - 1;
-    Image *tmp = stack[n];
 
     if(trackerRec.empty()) {
-        for(int i = n; i >= 2; i--) {
-            Image *tmp2 = flt_add->Process(Double(stack[i - 1], tmp), NULL);
-            trackerRec.push_back(tmp2);
-            tmp = tmp2;
+        size_t tot = 0;
+        for(int i = 1; i < n; i++) {
+            tot += size_t(stack[i]->size());
         }
-    } else {
-        int c = 0;
 
-        for(int i = n; i >= 2; i--) {
-            flt_add->Process(Double(stack[i - 1], tmp), trackerRec[c]);
-            tmp = trackerRec[c];
-            c++;
+        arenaRec.assign(tot, 0.0f);
+
+        tot = 0;
+        for(int i = n - 1; i >= 1; i--) {
+            trackerRec.push_back(new Image(1, stack[i]->width, stack[i]->height,
+                                           stack[i]->channels, &arenaRec[tot]));
+            tot += size_t(stack[i]->size());
+        }
+    }
+
+    Image *tmp = stack[n];
+
+    int c = 0;
+    for(int i = n; i >= 2; i--) {
+        expand(stack[i - 1], tmp, trackerRec[c], 1.0f);
+        tmp = trackerRec[c];
+        c++;
+    }
+
+    if(imgOut == NULL) {
+        imgOut = stack[0]->allocateSimilarOne();
+    } else {
+        if(!imgOut->isSimilarType(stack[0])) {
+            imgOut = stack[0]->allocateSimilarOne();
         }
-    }    
+    }
 
-    imgOut = flt_add->Process(Double(stack[0], tmp), imgOut);
+    expand(stack[0], tmp, imgOut, 1.0f);
 
     return imgOut;
 }
@@ -18,216 +18,473 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_ALGORITHMS_SUPERPIXELS_SLIC_HPP
 #define PIC_ALGORITHMS_SUPERPIXELS_SLIC_HPP
 
+#include <vector>
+
 #include "../image.hpp"
-#include "../filtering/filter_laplacian.hpp"
+#include "../colors/color_conv_rgb_to_xyz.hpp"
+#include "../colors/color_conv_xyz_to_cielab.hpp"
+#include "../util/thread_pool.hpp"
+#include "../util/simd.hpp"
 
 namespace pic {
 
 /**
- * @brief The SlicoCenter struct
- */
-struct SlicoCenter {
-    float			*value;
-    unsigned int	x, y;
-};
-
-/**
- * @brief The Slic class
+ * @brief The Slic class computes SLIC superpixels with adaptive color
+ * compactness (SLICO). The image is split into horizontal strips which are
+ * processed in parallel: each strip visits the clusters whose 2S x 2S window
+ * overlaps it, in cluster order, so labels do not depend on the number of
+ * threads.
  */
 class Slic
 {
 protected:
 
-    int             nSuperPixels;
-    Image           *labels_distance, *lap_img;
-    SlicoCenter     *centers;
-    unsigned int    *prevX, *prevY, *counter;
-    float           *col_values, *mPixel;
-    int             width, height, channels;
+    int                 nSuperPixels, S;
+    int                 width, height, channels;
+    int                 maxIter;
+    float               threshold;
+    bool                bLab;
+
+    std::vector<int>    labels;
+    std::vector<float>  distances;
+    std::vector<float>  planes;
+    std::vector<float>  cx, cy, cval, mPixel, colors;
 
     /**
-     * @brief distanceC
-     * @param a1
-     * @param a2
+     * @brief distanceRow updates labels and distances of a row segment
+     * with the distance from a cluster.
+     * @param col is the first pixel of the segment in the first color plane.
+     * @param nPixels is the number of pixels of a color plane.
      * @param channels
-     * @return
+     * @param center is the color of the cluster.
+     * @param dx is the horizontal distance of the first pixel from the cluster.
+     * @param dy2 is the squared vertical distance of the row from the cluster.
+     * @param invS2
+     * @param invM
+     * @param label
+     * @param n is the number of pixels of the segment.
+     * @param lab
+     * @param dist
      */
-    inline float distanceC(float *a1, float *a2, int channels)
+    static void distanceRow(const float *col, int nPixels, int channels, const float *center,
+                            float dx, float dy2, float invS2, float invM, int label,
+                            int n, int *lab, float *dist)
     {
-        float acc = 0.0f;
+        int i = 0;
 
-        for(int i = 0; i < channels; i++) {
-            float tmp = (a1[i] - a2[i]);
-            acc += tmp * tmp;
+#ifdef PIC_SIMD_X86
+        if(SIMD::get() >= SIMD_AVX2) {
+            i = distanceRowAVX2(col, nPixels, channels, center, dx, dy2, invS2, invM, label, n, lab, dist);
         }
+#endif
 
-        return acc;
+        for(; i < n; i++) {
+            float dc = 0.0f;
+            for(int c = 0; c < channels; c++) {
+                float tmp = col[c * nPixels + i] - center[c];
+                dc += tmp * tmp;
+            }
+
+            float tx = dx + float(i);
+            float D = dc * invM + (tx * tx + dy2) * invS2;
+
+            if(D < dist[i]) {
+                dist[i] = D;
+                lab[i] = label;
+            }
+        }
     }
 
+#ifdef PIC_SIMD_X86
     /**
-     * @brief distanceS
-     * @param x1
-     * @param y1
-     * @param x2
-     * @param y2
-     * @return
+     * @brief distanceRowAVX2 is distanceRow on eight pixels at a time.
+     * @return This function returns the number of processed pixels.
      */
-    inline int distanceS(int x1, int y1, int x2, int y2)
+    PIC_SIMD_TARGET_AVX2 static int distanceRowAVX2(const float *col, int nPixels, int channels, const float *center,
+                                                    float dx, float dy2, float invS2, float invM, int label,
+                                                    int n, int *lab, float *dist)
     {
-        int tx = x1 - x2;
-        int ty = y1 - y2;
-        return tx * tx + ty * ty;
+        __m256 v_step = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+        __m256 v_dy2 = _mm256_set1_ps(dy2);
+        __m256 v_invS2 = _mm256_set1_ps(invS2);
+        __m256 v_invM = _mm256_set1_ps(invM);
+        __m256 v_label = _mm256_castsi256_ps(_mm256_set1_epi32(label));
+
+        int i = 0;
+        for(; i <= (n - 8); i += 8) {
+            __m256 v_dc = _mm256_setzero_ps();
+            for(int c = 0; c < channels; c++) {
+                __m256 tmp = _mm256_sub_ps(_mm256_loadu_ps(col + c * nPixels + i), _mm256_set1_ps(center[c]));
+                v_dc = _mm256_add_ps(v_dc, _mm256_mul_ps(tmp, tmp));
+            }
+
+            __m256 tx = _mm256_add_ps(_mm256_set1_ps(dx + float(i)), v_step);
+            __m256 ds = _mm256_add_ps(_mm256_mul_ps(tx, tx), v_dy2);
+            __m256 D = _mm256_add_ps(_mm256_mul_ps(v_dc, v_invM), _mm256_mul_ps(ds, v_invS2));
+
+            __m256 v_dist = _mm256_loadu_ps(dist + i);
+            __m256 mask = _mm256_cmp_ps(D, v_dist, _CMP_LT_OQ);
+
+            _mm256_storeu_ps(dist + i, _mm256_blendv_ps(v_dist, D, mask));
+
+            __m256 v_lab = _mm256_loadu_ps((float *) (lab + i));
+            _mm256_storeu_ps((float *) (lab + i), _mm256_blendv_ps(v_lab, v_label, mask));
+        }
+
+        return i;
     }
+#endif
 
     /**
-     * @brief pass
+     * @brief setPlanes caches the image in planar format, optionally
+     * converted to CIE L*a*b*.
      * @param img
-     * @param S
-     * @return
      */
-    bool pass(Image *img, int S)
+    void setPlanes(Image *img)
     {
-        float Sf = float(S);
-        float Sf2 = Sf * Sf;
+        int nPixels = width * height;
+        planes.resize(size_t(nPixels) * channels);
 
-        for(int i = 0; i < nSuperPixels; i++) {
-            prevX[i] = centers[i].x;
-            prevY[i] = centers[i].y;
+        bool bConv = bLab && (channels == 3);
+
+        ThreadPool::getInstance()->parallelFor(0, height, [&](int y0, int y1) {
+            ColorConvRGBtoXYZ rgb2xyz;
+            ColorConvXYZtoCIELAB xyz2lab;
+            float xyz[3], lab[3];
+
+            for(int y = y0; y < y1; y++) {
+                for(int x = 0; x < width; x++) {
+                    float *pixel = (*img)(x, y);
+                    int ind = y * width + x;
+
+                    if(bConv) {
+                        rgb2xyz.direct(pixel, xyz);
+                        xyz2lab.direct(xyz, lab);
+                        pixel = lab;
+                    }
+
+                    for(int c = 0; c < channels; c++) {
+                        planes[size_t(c) * nPixels + ind] = pixel[c];
+                    }
+                }
+            }
+        }, 16);
+    }
+
+    /**
+     * @brief getLaplacian
+     * @param img
+     * @param x
+     * @param y
+     * @return This function returns the sum over the channels of the
+     * absolute value of the Laplacian of img at (x, y).
+     */
+    static float getLaplacian(Image *img, int x, int y)
+    {
+        float *cur = (*img)(x, y);
+
+        //neighbors
+        float *N = (*img)(x    , y + 1);
+        float *S = (*img)(x    , y - 1);
+        float *E = (*img)(x + 1, y);
+        float *W = (*img)(x - 1, y);
+
+        float acc = 0.0f;
+        for(int k = 0; k < img->channels; k++) {
+            acc += fabsf((-4.0f * cur[k]) + N[k] + S[k] + E[k] + W[k]);
         }
 
-        //for each cluster
-        for(int i = 0; i < nSuperPixels; i++) {
-            float i_f = float(i);
+        return acc;
+    }
+
+    /**
+     * @brief initCenters places a cluster on each cell of a grid with step
+     * S, moving it to the lowest gradient position of its 3x3 neighborhood.
+     * @param img
+     */
+    void initCenters(Image *img)
+    {
+        int nX = width / S;
+        int nY = height / S;
+        nSuperPixels = nX * nY;
 
-            //Search in Sx2 radius
-            for(int j = -S; j < S; j++) {
-                int vY = centers[i].y + j;
+        cx.resize(nSuperPixels);
+        cy.resize(nSuperPixels);
+        cval.assign(size_t(nSuperPixels) * channels, 0.0f);
+        mPixel.assign(nSuperPixels, bLab ? 10.0f * 10.0f : 0.35f * 0.35f);
 
-                for(int k = -S; k < S; k++) {
-                    int vX = centers[i].x + k;
+        int nPixels = width * height;
+        int S_half = S >> 1;
 
-                    float *pixel = (*img)(vX, vY);
-                    float *l_d   = (*labels_distance)(vX, vY);
+        for(int i = 0; i < nY; i++) {
+            for(int j = 0; j < nX; j++) {
+                int ind = i * nX + j;
+                int pX = S_half + j * S;
+                int pY = S_half + i * S;
 
-                    float dS = float(distanceS(vX, vY, centers[i].x, centers[i].y)) / Sf2;
-                    float dC = distanceC(pixel, centers[i].value, img->channels) / mPixel[i];
-                    float D = dC + dS;
+                float bValue = FLT_MAX;
+                int bX = pX;
+                int bY = pY;
 
-                    if(D < l_d[1]) {
-                        l_d[0] = i_f;
-                        l_d[1] = D;
-                        l_d[2] = dC;
+                for(int y = -1; y <= 1; y++) {
+                    for(int x = -1; x <= 1; x++) {
+                        int ix = CLAMPi(pX + x, 0, width - 1);
+                        int iy = CLAMPi(pY + y, 0, height - 1);
+
+                        float acc = getLaplacian(img, ix, iy);
+
+                        if(acc < bValue) {
+                            bValue = acc;
+                            bX = ix;
+                            bY = iy;
+                        }
                     }
                 }
-            }
-        }
 
-        //update mPixel
-        for(int i = 0; i < labels_distance->size(); i += labels_distance->channels) {
-            int label = int(labels_distance->data[i]);
+                cx[ind] = float(bX);
+                cy[ind] = float(bY);
 
-            if(label < 0) {
-                continue;
-            }
+                //mean color of the cell
+                int x0 = MAX(bX - S_half, 0);
+                int x1 = MIN(bX + S_half + 1, width);
+                int y0 = MAX(bY - S_half, 0);
+                int y1 = MIN(bY + S_half + 1, height);
+
+                float *value = &cval[size_t(ind) * channels];
+                for(int c = 0; c < channels; c++) {
+                    float *plane = &planes[size_t(c) * nPixels];
+
+                    float acc = 0.0f;
+                    for(int y = y0; y < y1; y++) {
+                        for(int x = x0; x < x1; x++) {
+                            acc += plane[y * width + x];
+                        }
+                    }
 
-            if(mPixel[label] < labels_distance->data[i + 2]) {
-                mPixel[label] = labels_distance->data[i + 2];
+                    value[c] = acc / float((x1 - x0) * (y1 - y0));
+                }
             }
         }
+    }
 
-        //update clusters
-        for(int i = 0; i < nSuperPixels; i++) {
-            centers[i].x = 0;
-            centers[i].y = 0;
-            counter[i]   = 0;
+    /**
+     * @brief assign labels each pixel with the closest cluster whose
+     * window contains it.
+     */
+    void assign()
+    {
+        int nPixels = width * height;
+        int nStrips = (height + S - 1) / S;
 
-            int ind = i * img->channels;
+        std::fill(labels.begin(), labels.end(), -1);
+        std::fill(distances.begin(), distances.end(), FLT_MAX);
 
-            for(int j = 0; j < img->channels; j++) {
-                col_values[ind + j] = 0.0f;
+        //clusters overlapping each strip, in ascending order
+        std::vector< std::vector<int> > strips(nStrips);
+        for(int i = 0; i < nSuperPixels; i++) {
+            int y0 = MAX(int(cy[i]) - S, 0);
+            int y1 = MIN(int(cy[i]) + S, height);
+
+            for(int s = y0 / S; s <= ((y1 - 1) / S); s++) {
+                strips[s].push_back(i);
             }
         }
 
-        for(int j = 0; j < img->height; j++) {
-            for(int k = 0; k < img->width; k++) {
-                float *l_d = (*labels_distance)(k, j);
-                int label = int(l_d[0]);
+        float invS2 = 1.0f / float(S * S);
+
+        ThreadPool::getInstance()->parallelFor(0, nStrips, [&](int s0, int s1) {
+            for(int s = s0; s < s1; s++) {
+                int strip_y0 = s * S;
+                int strip_y1 = MIN(strip_y0 + S, height);
 
-                if(label > -1) {
-                    centers[label].x += k;
-                    centers[label].y += j;
-                    counter[label]++;
+                for(unsigned int k = 0; k < strips[s].size(); k++) {
+                    int i = strips[s][k];
+                    int cxi = int(cx[i]);
+                    int cyi = int(cy[i]);
 
-                    int ind = label * img->channels;
-                    float *col = (*img)(k, j);
+                    int x0 = MAX(cxi - S, 0);
+                    int x1 = MIN(cxi + S, width);
+                    int y0 = MAX(cyi - S, strip_y0);
+                    int y1 = MIN(cyi + S, strip_y1);
 
-                    for(int p = 0; p < img->channels; p++) {
-                        col_values[ind + p] += col[p];
+                    float invM = 1.0f / mPixel[i];
+                    float *value = &cval[size_t(i) * channels];
+
+                    for(int y = y0; y < y1; y++) {
+                        float ty = float(y) - cy[i];
+                        int ind = y * width + x0;
+
+                        distanceRow(&planes[ind], nPixels, channels, value,
+                                    float(x0) - cx[i], ty * ty, invS2, invM, i,
+                                    x1 - x0, &labels[ind], &distances[ind]);
                     }
                 }
             }
+        }, 1);
+    }
+
+    /**
+     * @brief accumulate computes, in parallel, the number of pixels, the
+     * position sum, and the color sum of each cluster.
+     * @param col is the interleaved image to sum; if it is NULL, the
+     * cached planes are summed.
+     * @param sums is the output with nSuperPixels * (3 + channels) values.
+     * @param dcMax is the optional output of the largest squared color
+     * distance of each cluster.
+     */
+    void accumulate(Image *col, std::vector<double> &sums, std::vector<float> *dcMax)
+    {
+        int nPixels = width * height;
+        int nSums = 3 + channels;
+
+        //a fixed number of blocks makes sums independent of threads
+        int nBlocks = MIN(16, height);
+
+        std::vector<double> sums_b(size_t(nBlocks) * nSuperPixels * nSums, 0.0);
+        std::vector<float> dcMax_b;
+
+        if(dcMax != NULL) {
+            dcMax_b.assign(size_t(nBlocks) * nSuperPixels, 0.0f);
         }
 
-        float E = 0.0f;
+        ThreadPool::getInstance()->run(nBlocks, [&](int b) {
+            int y0 = (height * b) / nBlocks;
+            int y1 = (height * (b + 1)) / nBlocks;
 
-        for(int i = 0; i < nSuperPixels; i++) {
-            if(counter[i] <= 0) {
-                continue;
-            }
+            double *sum = &sums_b[size_t(b) * nSuperPixels * nSums];
+
+            for(int y = y0; y < y1; y++) {
+                int *lab = &labels[y * width];
+
+                //runs of pixels with the same label are summed together
+                int x = 0;
+                while(x < width) {
+                    int label = lab[x];
+                    int xe = x + 1;
+
+                    while((xe < width) && (lab[xe] == label)) {
+                        xe++;
+                    }
+
+                    if(label < 0) {
+                        x = xe;
+                        continue;
+                    }
+
+                    double len = double(xe - x);
+                    double *sum_l = &sum[size_t(label) * nSums];
+                    sum_l[0] += len;
+                    sum_l[1] += double(x + xe - 1) * len * 0.5;
+                    sum_l[2] += double(y) * len;
+
+                    if(col != NULL) {
+                        for(int k = x; k < xe; k++) {
+                            float *pixel = (*col)(k, y);
+                            for(int c = 0; c < channels; c++) {
+                                sum_l[3 + c] += double(pixel[c]);
+                            }
+                        }
+                    } else {
+                        float *value = &cval[size_t(label) * channels];
+                        float dc_max = 0.0f;
 
-            centers[i].x /= counter[i];
-            centers[i].y /= counter[i];
-            int ind = i * img->channels;
+                        if(dcMax != NULL) {
+                            for(int k = x; k < xe; k++) {
+                                float dc = 0.0f;
 
-            for(int j = 0; j < img->channels; j++) {
-                centers[i].value[j] = col_values[ind + j] / float(counter[i]);
+                                for(int c = 0; c < channels; c++) {
+                                    float tmp = planes[size_t(c) * nPixels + y * width + k] - value[c];
+                                    dc += tmp * tmp;
+                                }
+
+                                dc_max = MAX(dc_max, dc);
+                            }
+
+                            float &m = dcMax_b[size_t(b) * nSuperPixels + label];
+                            m = MAX(m, dc_max);
+                        }
+
+                        for(int c = 0; c < channels; c++) {
+                            float *plane = &planes[size_t(c) * nPixels + y * width];
+
+                            float acc = 0.0f;
+                            for(int k = x; k < xe; k++) {
+                                acc += plane[k];
+                            }
+
+                            sum_l[3 + c] += double(acc);
+                        }
+                    }
+
+                    x = xe;
+                }
             }
+        });
 
-            //Error
-            int tx = prevX[i] - centers[i].x;
-            int ty = prevY[i] - centers[i].y;
-            float tmpErr = sqrtf(float(tx * tx + ty * ty));
-            E += tmpErr;
+        sums.assign(size_t(nSuperPixels) * nSums, 0.0);
+
+        if(dcMax != NULL) {
+            dcMax->assign(nSuperPixels, 0.0f);
         }
 
-        return (E > (0.0001f * float(nSuperPixels)));
-    }
+        for(int b = 0; b < nBlocks; b++) {
+            double *sum = &sums_b[size_t(b) * nSuperPixels * nSums];
 
+            for(int i = 0; i < (nSuperPixels * nSums); i++) {
+                sums[i] += sum[i];
+            }
 
+            if(dcMax != NULL) {
+                for(int i = 0; i < nSuperPixels; i++) {
+                    float m = dcMax_b[size_t(b) * nSuperPixels + i];
+                    dcMax->at(i) = MAX(dcMax->at(i), m);
+                }
+            }
+        }
+    }
 
     /**
-     * @brief allocate
-     * @param nSuperPixels
-     * @param channels
+     * @brief pass runs an iteration: assignment and update of the clusters.
+     * @return This function returns the mean displacement of the clusters.
      */
-    void allocate(int nSuperPixels, int channels)
+    float pass()
     {
+        assign();
 
-        this->nSuperPixels = nSuperPixels;
+        std::vector<double> sums;
+        std::vector<float> dcMax;
+        accumulate(NULL, sums, &dcMax);
 
-        release();
+        int nSums = 3 + channels;
 
-        centers		= new SlicoCenter[nSuperPixels];
-        prevX		= new unsigned int [nSuperPixels];
-        prevY		= new unsigned int [nSuperPixels];
-        counter		= new unsigned int [nSuperPixels];
-        mPixel		= new float [nSuperPixels];
-        col_values	= new float [nSuperPixels * channels];
-    }
+        double E = 0.0;
+        for(int i = 0; i < nSuperPixels; i++) {
+            //update the color compactness
+            mPixel[i] = MAX(mPixel[i], dcMax[i]);
 
-    /**
-     * @brief release
-     */
-    void release()
-    {
-        delete lap_img;
-        delete labels_distance;
-        delete[] centers;
-        delete[] prevX;
-        delete[] prevY;
-        delete[] counter;
-        delete[] col_values;
-        delete[] mPixel;
+            double *sum = &sums[size_t(i) * nSums];
+
+            if(sum[0] <= 0.0) {
+                continue;
+            }
+
+            float x = float(sum[1] / sum[0]);
+            float y = float(sum[2] / sum[0]);
+
+            float tx = x - cx[i];
+            float ty = y - cy[i];
+            E += sqrt(double(tx * tx + ty * ty));
+
+            cx[i] = x;
+            cy[i] = y;
+
+            float *value = &cval[size_t(i) * channels];
+            for(int c = 0; c < channels; c++) {
+                value[c] = float(sum[3 + c] / sum[0]);
+            }
+        }
+
+        return float(E / double(MAX(nSuperPixels, 1)));
     }
 
 public:
@@ -237,14 +494,10 @@ public:
      */
     Slic()
     {
-        lap_img = NULL;
-        labels_distance = NULL;
-        centers = NULL;
-        prevX = NULL;
-        prevY = NULL;
-        counter = NULL;
-        col_values = NULL;
-        mPixel = NULL;
+        nSuperPixels = 0;
+        S = 0;
+        width = height = channels = 0;
+        setup();
     }
 
     /**
@@ -254,23 +507,30 @@ public:
      */
     Slic(Image *img, int nSuperPixels = 64)
     {
-        lap_img = NULL;
-        labels_distance = NULL;
-        centers = NULL;
-        prevX = NULL;
-        prevY = NULL;
-        counter = NULL;
-        col_values = NULL;
-        mPixel = NULL;
+        this->nSuperPixels = 0;
+        S = 0;
+        width = height = channels = 0;
+        setup();
 
         execute(img, nSuperPixels);
     }
 
-    ~Slic()
+    /**
+     * @brief setup
+     * @param maxIter is the maximum number of iterations.
+     * @param threshold if it is greater than zero, the iterations stop
+     * when the mean displacement of the clusters, in pixels, is lower
+     * than it.
+     * @param bLab if it is true, three-channel images are clustered in
+     * CIE L*a*b*.
+     */
+    void setup(int maxIter = 10, float threshold = 0.0f, bool bLab = false)
     {
-        release();
+        this->maxIter = MAX(maxIter, 1);
+        this->threshold = threshold;
+        this->bLab = bLab;
     }
-    
+
     /**
      * @brief execute
      * @param img
@@ -283,99 +543,64 @@ public:
         }
 
         //Init
-        int S = int(sqrtf(img->widthf * img->heightf) / float(nSuperPixels));
+        S = int(sqrtf(img->widthf * img->heightf) / float(nSuperPixels));
 
         if(S < 1) {
             return;
         }
 
-        nSuperPixels = (img->width / S) * (img->height / S);
-
-        allocate(nSuperPixels, img->channels);
-
-        if(labels_distance == NULL) {
-            labels_distance = new Image(1, img->width, img->height, 3);
-        }
-
-        for(int i = 0; i < labels_distance->size(); i += labels_distance->channels) {
-            labels_distance->data[i    ] = -1.0f;
-            labels_distance->data[i + 1] = FLT_MAX;
-            labels_distance->data[i + 2] = FLT_MAX;
-        }
-
         width = img->width;
         height = img->height;
         channels = img->channels;
 
-        FilterLaplacian lap;
-        lap_img = lap.Process(Single(img), lap_img);
-
-        for(int i = 0; i < nSuperPixels; i++) {
-            mPixel[i] = 0.35f * 0.35f;    //10.0f*10.0f;
+        if(((width / S) * (height / S)) < 1) {
+            return;
         }
 
-        #ifdef PIC_DEBUG
-            printf("nSuperPixels: %d S: %d\n", nSuperPixels, S);
-        #endif
-        
-        int ind = 0;
-        int S_half = S >> 1;
-
-        for(int i = S_half; i < (img->height - S_half + 1); i += S) {
-            for(int j = S_half; j < (img->width - S_half + 1); j += S) {
+        labels.resize(width * height);
+        distances.resize(width * height);
 
-                float bValue = FLT_MAX;
-                int bX, bY;
+        setPlanes(img);
+        initCenters(img);
 
-                for(int y = -1; y <= 1; y++) {
-                    for(int x = -1; x <= 1; x++) {
-                        int ix = (j + x);
-                        int iy = (i + y);
-                        float *data = (*lap_img)(ix, iy);
-
-                        float acc = 0.0f;
-
-                        for(int c = 0; c < img->channels; c++) {
-                            acc += fabsf(data[c]);
-                        }
-
-                        if(acc < bValue) {
-                            bValue = acc;
-                            bX = ix;
-                            bY = iy;
-                        }
-                    }
-                }
-
-                centers[ind].x = bX;
-                centers[ind].y = bY;
-                centers[ind].value = new float [img->channels];
-
-                BBox box(centers[ind].x - S_half, centers[ind].x + S_half + 1,
-                         centers[ind].y - S_half, centers[ind].y + S_half + 1);
-
-                img->getMeanVal(&box, centers[ind].value);
-                ind++;
-            }
-        }
+        #ifdef PIC_DEBUG
+            printf("nSuperPixels: %d S: %d\n", this->nSuperPixels, S);
+        #endif
 
         //For each pass
         int iter = 0;
-        bool bCheck = true;
-
-        while(bCheck) {
-            bCheck = pass(img, S);
+        while(iter < maxIter) {
+            float E = pass();
+            iter++;
 
-            if(!bCheck && iter <= 10) {
-                bCheck = true;
+            if((threshold > 0.0f) && (E < threshold)) {
+                break;
             }
-
-            iter++;
         }
 
         #ifdef PIC_DEBUG
             printf("Iterations: %d\n", iter);
         #endif
+
+        //colors of the clusters in the color space of img
+        if(bLab && (channels == 3)) {
+            std::vector<double> sums;
+            accumulate(img, sums, NULL);
+
+            colors.assign(size_t(this->nSuperPixels) * channels, 0.0f);
+
+            for(int i = 0; i < this->nSuperPixels; i++) {
+                double *sum = &sums[size_t(i) * (3 + channels)];
+
+                if(sum[0] > 0.0) {
+                    for(int c = 0; c < channels; c++) {
+                        colors[size_t(i) * channels + c] = float(sum[3 + c] / sum[0]);
+                    }
+                }
+            }
+        } else {
+            colors = cval;
+        }
     }
 
     /**
@@ -385,11 +610,7 @@ public:
      */
     int *getLabelsBuffer(int *out = NULL)
     {
-        if(labels_distance == NULL) {
-            return NULL;
-        }
-
-        int size = labels_distance->width * labels_distance->height;
+        int size = int(labels.size());
 
         if(size < 1) {
             return NULL;
@@ -399,13 +620,20 @@ public:
             out = new int[size];
         }
 
-        for(int i = 0; i < size; i++) {
-            out[i] = int(labels_distance->data[i << 1]);
-        }
+        memcpy(out, &labels[0], size * sizeof(int));
 
         return out;
     }
 
+    /**
+     * @brief getNumberOfSuperPixels
+     * @return
+     */
+    int getNumberOfSuperPixels()
+    {
+        return nSuperPixels;
+    }
+
     /**
      * @brief getMeanImage
      * @param imgOut
@@ -413,24 +641,29 @@ public:
      */
     Image *getMeanImage(Image *imgOut)
     {
+        if(labels.empty()) {
+            return imgOut;
+        }
+
         if(imgOut == NULL) {
             imgOut = new Image(1, width, height, channels);
         }
 
-        for(int i = 0; i < height; i++) {
-            for(int j = 0; j < width; j++) {
-                float *pixel = (*imgOut)(j, i);
-                float *l_d   = (*labels_distance)(j, i);
+        ThreadPool::getInstance()->parallelFor(0, height, [&](int y0, int y1) {
+            for(int i = y0; i < y1; i++) {
+                for(int j = 0; j < width; j++) {
+                    float *pixel = (*imgOut)(j, i);
 
-                int label = int(l_d[0]);
+                    int label = labels[i * width + j];
 
-                if(label > -1) {
-                    for(int k = 0; k < channels; k++) {
-                        pixel[k] = centers[label].value[k];
+                    if(label > -1) {
+                        for(int k = 0; k < channels; k++) {
+                            pixel[k] = colors[size_t(label) * channels + k];
+                        }
                     }
                 }
             }
-        }
+        }, 16);
 
         return imgOut;
     }
@@ -439,4 +672,3 @@ public:
 } // end namespace pic
 
 #endif /* PIC_ALGORITHMS_SUPERPIXELS_SLIC_HPP */
-
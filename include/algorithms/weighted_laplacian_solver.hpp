@@ -0,0 +1,531 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_ALGORITHMS_WEIGHTED_LAPLACIAN_SOLVER_HPP
+#define PIC_ALGORITHMS_WEIGHTED_LAPLACIAN_SOLVER_HPP
+
+#include <vector>
+#include <math.h>
+
+#include "../base.hpp"
+#include "../util/math.hpp"
+#include "../util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The WeightedLaplacianSolver class is a matrix-free solver for
+ * spatially-varying 5-point systems on a width x height grid:
+ *
+ *      (m_p + sum_q w_pq) x_p - sum_q w_pq x_q = b_p
+ *
+ * where q are the neighbors of p in the image, m_p >= 0 is a data term, and
+ * w_pq = w_qp >= 0. These are the systems of edge-preserving smoothing
+ * (e.g., WLS) and of Lischinski et al.'s propagation.
+ *
+ * The system is solved by the conjugate gradient method preconditioned
+ * with a multigrid V-cycle: coarse levels aggregate 2x2 cells (their
+ * operator is again a 5-point one) and they are smoothed by symmetric
+ * red-black Gauss-Seidel sweeps. Data is stored in float and the stencil
+ * is applied in parallel.
+ */
+class WeightedLaplacianSolver
+{
+protected:
+
+    /**
+     * @brief The WeightedLaplacianLevel struct; wx is the weight between
+     * (x, y) and (x + 1, y), and wy is the one between (x, y) and (x, y + 1).
+     */
+    struct WeightedLaplacianLevel
+    {
+        int width, height;
+        std::vector<float> mass, wx, wy;
+        std::vector<float> u, b;
+    };
+
+    std::vector<WeightedLaplacianLevel> levels;
+    std::vector<float> r, z, p, q;
+
+    int maxIter, nSweeps;
+    float tolerance;
+
+    /**
+     * @brief getGrain
+     * @param width
+     * @return This function returns the number of rows of a parallel task.
+     */
+    static inline int getGrain(int width)
+    {
+        return MAX(1, 32768 / MAX(width, 1));
+    }
+
+    /**
+     * @brief neighbors computes the weighted sum of the neighbors of
+     * (x, y) and the diagonal of the stencil.
+     * @param level
+     * @param u
+     * @param x
+     * @param y
+     * @param diag
+     * @return
+     */
+    static inline float neighbors(const WeightedLaplacianLevel &level, const float *u,
+                                  int x, int y, float &diag)
+    {
+        int width = level.width;
+        int ind = y * width + x;
+
+        const float *wx = &level.wx[0];
+        const float *wy = &level.wy[0];
+
+        float sum = 0.0f;
+        diag = level.mass[ind];
+
+        if(x > 0) {
+            sum += wx[ind - 1] * u[ind - 1];
+            diag += wx[ind - 1];
+        }
+
+        if(x < (width - 1)) {
+            sum += wx[ind] * u[ind + 1];
+            diag += wx[ind];
+        }
+
+        if(y > 0) {
+            sum += wy[ind - width] * u[ind - width];
+            diag += wy[ind - width];
+        }
+
+        if(y < (level.height - 1)) {
+            sum += wy[ind] * u[ind + width];
+            diag += wy[ind];
+        }
+
+        return sum;
+    }
+
+    /**
+     * @brief dot
+     * @param a
+     * @param b
+     * @param n
+     * @return This function returns the dot product of a and b; a fixed
+     * number of blocks makes it independent of threads.
+     */
+    static double dot(const float *a, const float *b, int n)
+    {
+        int nBlocks = MIN(64, n);
+        std::vector<double> partial(nBlocks, 0.0);
+
+        ThreadPool::getInstance()->run(nBlocks, [&](int k) {
+            int i0 = int((long long)(n) * k / nBlocks);
+            int i1 = int((long long)(n) * (k + 1) / nBlocks);
+
+            double acc = 0.0;
+            for(int i = i0; i < i1; i++) {
+                acc += double(a[i]) * double(b[i]);
+            }
+
+            partial[k] = acc;
+        });
+
+        double ret = 0.0;
+        for(int k = 0; k < nBlocks; k++) {
+            ret += partial[k];
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief apply computes out = A * u on the l-th level.
+     * @param l
+     * @param u
+     * @param out
+     */
+    void apply(int l, const float *u, float *out)
+    {
+        WeightedLaplacianLevel &level = levels[l];
+        int width = level.width;
+
+        ThreadPool::getInstance()->parallelFor(0, level.height, [&](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                for(int x = 0; x < width; x++) {
+                    int ind = y * width + x;
+
+                    float diag;
+                    float sum = neighbors(level, u, x, y, diag);
+                    out[ind] = diag * u[ind] - sum;
+                }
+            }
+        }, getGrain(width));
+    }
+
+    /**
+     * @brief sweep runs a Gauss-Seidel sweep on the cells of a color.
+     * @param l
+     * @param color
+     */
+    void sweep(int l, int color)
+    {
+        WeightedLaplacianLevel &level = levels[l];
+        int width = level.width;
+
+        float *u = &level.u[0];
+        const float *b = &level.b[0];
+
+        ThreadPool::getInstance()->parallelFor(0, level.height, [&](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                for(int x = (y + color) & 1; x < width; x += 2) {
+                    int ind = y * width + x;
+
+                    float diag;
+                    float sum = neighbors(level, u, x, y, diag);
+
+                    if(diag > 0.0f) {
+                        u[ind] = (b[ind] + sum) / diag;
+                    }
+                }
+            }
+        }, getGrain(width));
+    }
+
+    /**
+     * @brief restrictResidual sums the residual of the l-th level into
+     * the right-hand side of the (l + 1)-th level.
+     * @param l
+     */
+    void restrictResidual(int l)
+    {
+        WeightedLaplacianLevel &level = levels[l];
+        WeightedLaplacianLevel &coarse = levels[l + 1];
+
+        int width = level.width;
+        int height = level.height;
+
+        const float *u = &level.u[0];
+        const float *b = &level.b[0];
+
+        ThreadPool::getInstance()->parallelFor(0, coarse.height, [&](int y0, int y1) {
+            for(int Y = y0; Y < y1; Y++) {
+                for(int X = 0; X < coarse.width; X++) {
+                    float acc = 0.0f;
+
+                    for(int k = 0; k < 4; k++) {
+                        int x = 2 * X + (k & 1);
+                        int y = 2 * Y + (k >> 1);
+
+                        if((x < width) && (y < height)) {
+                            int ind = y * width + x;
+
+                            float diag;
+                            float sum = neighbors(level, u, x, y, diag);
+                            acc += b[ind] - (diag * u[ind] - sum);
+                        }
+                    }
+
+                    int indC = Y * coarse.width + X;
+                    coarse.b[indC] = acc;
+                    coarse.u[indC] = 0.0f;
+                }
+            }
+        }, getGrain(coarse.width));
+    }
+
+    /**
+     * @brief prolongate adds the solution of the (l + 1)-th level to
+     * the children cells of the l-th level.
+     * @param l
+     */
+    void prolongate(int l)
+    {
+        WeightedLaplacianLevel &level = levels[l];
+        WeightedLaplacianLevel &coarse = levels[l + 1];
+
+        int width = level.width;
+        float *u = &level.u[0];
+
+        ThreadPool::getInstance()->parallelFor(0, level.height, [&](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                const float *uc = &coarse.u[(y >> 1) * coarse.width];
+
+                for(int x = 0; x < width; x++) {
+                    u[y * width + x] += uc[x >> 1];
+                }
+            }
+        }, getGrain(width));
+    }
+
+    /**
+     * @brief vCycle is a symmetric V-cycle; the pre-smoothing sweeps are
+     * red-black and the post-smoothing ones are black-red.
+     * @param l
+     */
+    void vCycle(int l)
+    {
+        int nLevels = int(levels.size());
+
+        int n = (l == (nLevels - 1)) ? 16 : nSweeps;
+
+        for(int s = 0; s < n; s++) {
+            sweep(l, 0);
+            sweep(l, 1);
+        }
+
+        if(l < (nLevels - 1)) {
+            restrictResidual(l);
+            vCycle(l + 1);
+            prolongate(l);
+        }
+
+        for(int s = 0; s < n; s++) {
+            sweep(l, 1);
+            sweep(l, 0);
+        }
+    }
+
+    /**
+     * @brief buildHierarchy aggregates 2x2 cells into coarser levels; this
+     * is the Galerkin operator of piecewise constant interpolation: the
+     * weight between two aggregates is the sum of the fine weights
+     * across them, and masses are summed.
+     */
+    void buildHierarchy()
+    {
+        levels.resize(1);
+
+        while((levels.back().width > 2) || (levels.back().height > 2)) {
+            WeightedLaplacianLevel coarse;
+            WeightedLaplacianLevel &fine = levels.back();
+
+            int width = fine.width;
+            int height = fine.height;
+
+            coarse.width = (width + 1) / 2;
+            coarse.height = (height + 1) / 2;
+
+            int n = coarse.width * coarse.height;
+            coarse.mass.assign(n, 0.0f);
+            coarse.wx.assign(n, 0.0f);
+            coarse.wy.assign(n, 0.0f);
+            coarse.u.assign(n, 0.0f);
+            coarse.b.assign(n, 0.0f);
+
+            for(int y = 0; y < height; y++) {
+                for(int x = 0; x < width; x++) {
+                    int ind = y * width + x;
+                    int indC = (y >> 1) * coarse.width + (x >> 1);
+
+                    coarse.mass[indC] += fine.mass[ind];
+
+                    if(((x & 1) == 1) && (x < (width - 1))) {
+                        coarse.wx[indC] += fine.wx[ind];
+                    }
+
+                    if(((y & 1) == 1) && (y < (height - 1))) {
+                        coarse.wy[indC] += fine.wy[ind];
+                    }
+                }
+            }
+
+            levels.push_back(coarse);
+        }
+    }
+
+    /**
+     * @brief precondition computes z = M^-1 * r with a V-cycle.
+     */
+    void precondition()
+    {
+        WeightedLaplacianLevel &level = levels[0];
+
+        level.b.swap(r);
+        std::fill(level.u.begin(), level.u.end(), 0.0f);
+
+        vCycle(0);
+
+        level.b.swap(r);
+        level.u.swap(z);
+    }
+
+public:
+
+    /**
+     * @brief WeightedLaplacianSolver
+     * @param maxIter is the maximum number of conjugate gradient iterations.
+     * @param tolerance is the target ratio between the norms of the
+     * residual and of the right-hand side.
+     */
+    WeightedLaplacianSolver(int maxIter = 200, float tolerance = 1e-4f)
+    {
+        this->maxIter = maxIter;
+        this->tolerance = tolerance;
+        nSweeps = 2;
+    }
+
+    /**
+     * @brief setup allocates the weights of a width x height grid; they
+     * are set to zero.
+     * @param width
+     * @param height
+     */
+    void setup(int width, int height)
+    {
+        levels.resize(1);
+
+        WeightedLaplacianLevel &level = levels[0];
+        level.width = width;
+        level.height = height;
+
+        int n = width * height;
+        level.mass.assign(n, 0.0f);
+        level.wx.assign(n, 0.0f);
+        level.wy.assign(n, 0.0f);
+    }
+
+    /**
+     * @brief getMass
+     * @return This function returns the data term of each pixel.
+     */
+    float *getMass()
+    {
+        return levels.empty() ? NULL : &levels[0].mass[0];
+    }
+
+    /**
+     * @brief getWeightX
+     * @return This function returns the weights between (x, y) and
+     * (x + 1, y); the last column is ignored.
+     */
+    float *getWeightX()
+    {
+        return levels.empty() ? NULL : &levels[0].wx[0];
+    }
+
+    /**
+     * @brief getWeightY
+     * @return This function returns the weights between (x, y) and
+     * (x, y + 1); the last row is ignored.
+     */
+    float *getWeightY()
+    {
+        return levels.empty() ? NULL : &levels[0].wy[0];
+    }
+
+    /**
+     * @brief solve
+     * @param x is the initial guess (e.g., the solution of the previous
+     * frame of a video) and it is overwritten with the solution.
+     * @param b is the right-hand side.
+     * @return This function returns the number of iterations.
+     */
+    int solve(float *x, const float *b)
+    {
+        if(levels.empty() || (x == NULL) || (b == NULL)) {
+            return 0;
+        }
+
+        int n = levels[0].width * levels[0].height;
+
+        if(n < 1) {
+            return 0;
+        }
+
+        buildHierarchy();
+
+        levels[0].u.resize(n);
+        levels[0].b.resize(n);
+        r.resize(n);
+        z.resize(n);
+        p.resize(n);
+        q.resize(n);
+
+        ThreadPool *tp = ThreadPool::getInstance();
+        int grain = 65536;
+
+        //r = b - A x
+        apply(0, x, &q[0]);
+        tp->parallelFor(0, n, [&](int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                r[i] = b[i] - q[i];
+            }
+        }, grain);
+
+        double bb = dot(b, b, n);
+        double target = bb * double(tolerance) * double(tolerance);
+
+        double rr = dot(&r[0], &r[0], n);
+
+        int iter = 0;
+
+        if((bb > 0.0) && (rr > target)) {
+            precondition();
+            p = z;
+
+            double rz = dot(&r[0], &z[0], n);
+
+            while(iter < maxIter) {
+                apply(0, &p[0], &q[0]);
+
+                double pq = dot(&p[0], &q[0], n);
+
+                if(pq <= 0.0) {
+                    break;
+                }
+
+                float alpha = float(rz / pq);
+
+                tp->parallelFor(0, n, [&](int i0, int i1) {
+                    for(int i = i0; i < i1; i++) {
+                        x[i] += alpha * p[i];
+                        r[i] -= alpha * q[i];
+                    }
+                }, grain);
+
+                iter++;
+
+                rr = dot(&r[0], &r[0], n);
+                if(rr <= target) {
+                    break;
+                }
+
+                precondition();
+
+                double rz_new = dot(&r[0], &z[0], n);
+                float beta = float(rz_new / rz);
+                rz = rz_new;
+
+                tp->parallelFor(0, n, [&](int i0, int i1) {
+                    for(int i = i0; i < i1; i++) {
+                        p[i] = z[i] + beta * p[i];
+                    }
+                }, grain);
+            }
+        }
+
+        #ifdef PIC_DEBUG
+            printf("PCG iterations: %d residual: %e\n", iter, bb > 0.0 ? sqrt(rr / bb) : 0.0);
+        #endif
+
+        return iter;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_ALGORITHMS_WEIGHTED_LAPLACIAN_SOLVER_HPP */
@@ -26,6 +26,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 *
 **/
 
+#include <math.h>
+
 #include "../base.hpp"
 
 namespace pic {
@@ -121,6 +123,56 @@ PIC_INLINE void fromRGBEToFloat(unsigned char *colRGBE, float *colFloat)
     *(colFloat + 2) = (float(*(colRGBE + 2)) + 0.5f) * f;
 }
 
+/**
+ * @brief The RGBEExponentTable struct stores the scale 2^(E - 136) for each
+ * exponent E of the RGBE encoding.
+ */
+struct RGBEExponentTable
+{
+    float scale[256];
+
+    RGBEExponentTable()
+    {
+        for(int i = 0; i < 256; i++) {
+            scale[i] = ldexpf(1.0f, i - 128 - 8);
+        }
+    }
+};
+
+/**
+ * @brief getRGBEExponentTable
+ * @return This function returns the exponent table of the RGBE encoding.
+ */
+PIC_INLINE const float *getRGBEExponentTable()
+{
+    static RGBEExponentTable table;
+    return table.scale;
+}
+
+/**
+ * @brief fromRGBEToFloat converts a color using the exponent table;
+ * the result is the same of fromRGBEToFloat without the table.
+ * @param colRGBE
+ * @param colFloat
+ * @param table is the output of getRGBEExponentTable.
+ */
+PIC_INLINE void fromRGBEToFloat(const unsigned char *colRGBE, float *colFloat,
+                                const float *table)
+{
+    if((colRGBE[0] | colRGBE[1] | colRGBE[2]) == 0) { //if it is small
+        colFloat[0] = 0.0f;
+        colFloat[1] = 0.0f;
+        colFloat[2] = 0.0f;
+        return;
+    }
+
+    float f = table[colRGBE[3]];
+
+    colFloat[0] = (float(colRGBE[0]) + 0.5f) * f;
+    colFloat[1] = (float(colRGBE[1]) + 0.5f) * f;
+    colFloat[2] = (float(colRGBE[2]) + 0.5f) * f;
+}
+
 } // end namespace pic
 
 #endif /* PIC_COLORS_RGBE_HPP */
@@ -42,9 +42,12 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "features_matching/motion_estimation.hpp"
 
 //binary feature matcher
+#include "features_matching/hamming_distance.hpp"
 #include "features_matching/feature_matcher.hpp"
 #include "features_matching/binary_feature_brute_force_matcher.hpp"
 #include "features_matching/binary_feature_lsh_matcher.hpp"
+#include "features_matching/float_feature_brute_force_matcher.hpp"
+#include "features_matching/float_feature_kd_forest_matcher.hpp"
 
 #endif /* PIC_FEATURES_MATCHING_HPP */
 
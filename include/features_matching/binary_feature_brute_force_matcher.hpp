@@ -20,6 +20,9 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <vector>
 
+#include "../util/thread_pool.hpp"
+#include "../features_matching/hamming_distance.hpp"
+#include "../features_matching/brief_descriptor.hpp"
 #include "../features_matching/feature_matcher.hpp"
 
 namespace pic{
@@ -73,6 +76,78 @@ public:
 
         return ((dist_1 * 100 > dist_2 * 105) && matched_j != -1);
     }
+
+    /**
+     * @brief getAllMatches matches all descriptors of descs0 at once, with
+     * the same result of calling getMatch for each of them. Descriptors are
+     * packed and compared in tiles of queries x train descriptors, which
+     * stay in cache; tiles of queries are processed in parallel.
+     * @param descs0
+     * @param matches
+     */
+    void getAllMatches(std::vector<unsigned int *> &descs0, std::vector< Eigen::Vector3i > &matches)
+    {
+        matches.clear();
+
+        BinaryDescriptorSet query(descs0, desc_size);
+        BinaryDescriptorSet train(*descs, desc_size);
+
+        int nQuery = query.size();
+        int nTrain = train.size();
+
+        if((nQuery == 0) || (nTrain == 0)) {
+            return;
+        }
+
+        //scores are the number of equal bits as in BRIEFDescriptor::match
+        unsigned int nBits = train.nBits;
+        std::vector<int> matched_j(nQuery, -1);
+        std::vector<unsigned int> dist_1(nQuery, 0), dist_2(nQuery, 0);
+
+        const int tileQuery = 64;
+        const int tileTrain = 1024;
+
+        ThreadPool::getInstance()->parallelFor(0, nQuery, [&](int q0, int q1) {
+            std::vector<unsigned int> dist(tileTrain);
+
+            for(int t0 = 0; t0 < nTrain; t0 += tileTrain) {
+                int n = MIN(tileTrain, nTrain - t0);
+
+                for(int q = q0; q < q1; q++) {
+                    HammingDistance::distances(query.get(q), train.get(t0), n,
+                                               train.stride, &dist[0]);
+
+                    unsigned int d1 = dist_1[q];
+                    unsigned int d2 = dist_2[q];
+                    int j1 = matched_j[q];
+
+                    for(int k = 0; k < n; k++) {
+                        unsigned int d = nBits - dist[k];
+
+                        if(d > d1) {
+                            d2 = d1;
+                            d1 = d;
+                            j1 = t0 + k;
+                        } else {
+                            if(d > d2) {
+                                d2 = d;
+                            }
+                        }
+                    }
+
+                    dist_1[q] = d1;
+                    dist_2[q] = d2;
+                    matched_j[q] = j1;
+                }
+            }
+        }, tileQuery);
+
+        for(int q = 0; q < nQuery; q++) {
+            if((matched_j[q] != -1) && (dist_1[q] * 100 > dist_2[q] * 105)) {
+                matches.push_back(Eigen::Vector3i(query.index[q], train.index[matched_j[q]], dist_1[q]));
+            }
+        }
+    }
 };
 
 #endif
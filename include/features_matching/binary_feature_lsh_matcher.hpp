@@ -19,8 +19,12 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_FEATURES_MATCHING_BINARY_FEATURE_LSH_MATCHER_HPP
 
 #include <vector>
+#include <string>
+#include <algorithm>
+#include <fstream>
 
 #include "../base.hpp"
+#include "../util/thread_pool.hpp"
 #include "../features_matching/hash_table_lsh.hpp"
 #include "../features_matching/feature_matcher.hpp"
 
@@ -29,33 +33,129 @@ namespace pic {
 #ifndef PIC_DISABLE_EIGEN
 
 /**
- * @brief The LSH class
+ * @brief The LSH class is a multi-table and multi-probe LSH index for
+ * binary descriptors; descriptors can be inserted and removed after
+ * the index build, and the index can be saved and loaded.
  */
 class BinaryFeatureLSHMatcher: public FeatureMatcher<uint>
 {
 protected:
     std::vector< HashTableLSH* > tables;
     uint R;
+    bool bValid;
+
+    std::vector< uint > visited;
+    uint stamp;
+
+    /**
+     * @brief search
+     * @param desc
+     * @param matched_j
+     * @param dist_1
+     * @param visited
+     * @param stamp
+     */
+    void search(uint *desc, int &matched_j, uint &dist_1, std::vector<uint> &visited, uint &stamp)
+    {
+        uint dist_2 = 0;
+
+        dist_1 = R;
+        matched_j = -1;
+
+        if(desc == NULL) {
+            return;
+        }
+
+        if(visited.size() < descs->size()) {
+            visited.resize(descs->size(), 0);
+        }
+
+        stamp++;
+        if(stamp == 0) {
+            std::fill(visited.begin(), visited.end(), 0);
+            stamp = 1;
+        }
+
+        for(uint i = 0; i < tables.size(); i++) {
+            tables[i]->getNearest(desc, matched_j, dist_1, dist_2, &visited, stamp);
+        }
+    }
+
+    /**
+     * @brief release
+     */
+    void release()
+    {
+        for(uint i = 0; i < tables.size(); i++) {
+            delete tables[i];
+        }
+
+        tables.clear();
+    }
 
 public:
 
     /**
      * @brief LSH
+     * @param descs
+     * @param desc_size
+     * @param nTables
+     * @param hash_size
+     * @param probe_radius is the Hamming radius of the probed buckets
+     * around the one of a query in each table; probing neighbouring
+     * buckets allows to use fewer tables.
      */
-    BinaryFeatureLSHMatcher(std::vector< uint *> *descs, uint desc_size, uint nTables = 32, uint hash_size = 8) : FeatureMatcher<uint>(descs, desc_size)
+    BinaryFeatureLSHMatcher(std::vector< uint *> *descs, uint desc_size, uint nTables = 32, uint hash_size = 8, uint probe_radius = 0) : FeatureMatcher<uint>(descs, desc_size)
     {
         this->R = ((desc_size * sizeof(uint) * 8) * 90) / 100;
+        this->stamp = 0;
+        this->bValid = true;
 
         std::mt19937 m_rnd(1);
 
         for(uint i=0; i < nTables; i++) {
             uint n = desc_size * sizeof(uint) * 8;
             uint *g_f = getHash(m_rnd, n, hash_size);
-            HashTableLSH *tmp = new HashTableLSH(hash_size, g_f, descs, desc_size);
+            HashTableLSH *tmp = new HashTableLSH(hash_size, g_f, descs, desc_size, probe_radius);
             tables.push_back(tmp);
         }
     }
 
+    /**
+     * @brief LSH loads an index written by Write; isValid returns false
+     * if the index could not be read.
+     * @param descs are the indexed descriptors.
+     * @param nameFile
+     */
+    BinaryFeatureLSHMatcher(std::vector< uint *> *descs, std::string nameFile) : FeatureMatcher<uint>(descs, 0)
+    {
+        this->R = 0;
+        this->stamp = 0;
+
+        Read(nameFile);
+
+        #ifdef PIC_DEBUG
+        if(!bValid) {
+            printf("BinaryFeatureLSHMatcher: the index %s could not be read.\n", nameFile.c_str());
+        }
+        #endif
+    }
+
+    ~BinaryFeatureLSHMatcher()
+    {
+        release();
+    }
+
+    /**
+     * @brief isValid
+     * @return This function returns false if the last Read failed; an
+     * invalid index has no tables and it does not match anything.
+     */
+    bool isValid()
+    {
+        return bValid;
+    }
+
     /**
      * @brief getHash
      * @param dim
@@ -87,6 +187,57 @@ public:
         return out;
     }
 
+    /**
+     * @brief setProbeRadius
+     * @param probe_radius
+     */
+    void setProbeRadius(uint probe_radius)
+    {
+        for(uint i = 0; i < tables.size(); i++) {
+            tables[i]->setProbeRadius(probe_radius);
+        }
+    }
+
+    /**
+     * @brief insert appends a descriptor to the indexed ones.
+     * @param desc
+     * @return This function returns the index of desc.
+     */
+    int insert(uint *desc)
+    {
+        uint j = uint(descs->size());
+        descs->push_back(desc);
+
+        for(uint i = 0; i < tables.size(); i++) {
+            tables[i]->insert(j);
+        }
+
+        return int(j);
+    }
+
+    /**
+     * @brief remove removes the j-th descriptor from the index; its entry
+     * in descs is set to NULL, so the indices of the others do not change.
+     * The memory of the descriptor is not freed.
+     * @param j
+     */
+    void remove(int j)
+    {
+        if((j < 0) || (j >= int(descs->size()))) {
+            return;
+        }
+
+        for(uint i = 0; i < tables.size(); i++) {
+            tables[i]->remove(j);
+        }
+
+        descs->at(j) = NULL;
+
+        for(uint i = 0; i < tables.size(); i++) {
+            tables[i]->compact();
+        }
+    }
+
     /**
      * @brief getMatch
      * @param desc0
@@ -96,16 +247,142 @@ public:
      */
     bool getMatch(uint *desc, int &matched_j, uint &dist_1)
     {
-        uint dist_2 = 0;
+        search(desc, matched_j, dist_1, visited, stamp);
 
-        dist_1 = R;
-        matched_j = -1;
+        return (matched_j != -1);// && (dist_1 * 100 > dist_2 * 105);
+    }
 
-        for(uint i = 0; i < tables.size(); i++) {
-            tables[i]->getNearest(desc, matched_j, dist_1, dist_2);
+    /**
+     * @brief getAllMatches matches all descriptors of descs0; queries are
+     * processed in parallel.
+     * @param descs0
+     * @param matches
+     */
+    void getAllMatches(std::vector<uint *> &descs0, std::vector< Eigen::Vector3i > &matches)
+    {
+        matches.clear();
+
+        int n = int(descs0.size());
+
+        std::vector<int> matched_j(n, -1);
+        std::vector<uint> dist_1(n, 0);
+
+        ThreadPool::getInstance()->parallelFor(0, n, [&](int i0, int i1) {
+            std::vector<uint> visited_block(descs->size(), 0);
+            uint stamp_block = 0;
+
+            for(int i = i0; i < i1; i++) {
+                search(descs0[i], matched_j[i], dist_1[i], visited_block, stamp_block);
+            }
+        }, 64);
+
+        for(int i = 0; i < n; i++) {
+            if(matched_j[i] != -1) {
+                matches.push_back(Eigen::Vector3i(i, matched_j[i], dist_1[i]));
+            }
         }
+    }
 
-        return (matched_j != -1);// && (dist_1 * 100 > dist_2 * 105);
+    /**
+     * @brief Write saves the index; descriptors are not saved.
+     * @param nameFile
+     * @return
+     */
+    bool Write(std::string nameFile)
+    {
+        std::ofstream file;
+        file.open(nameFile.c_str(), std::ios::binary);
+
+        if(!file.is_open()) {
+            return false;
+        }
+
+        uint header[7];
+        header[0] = 0x48534c50; //PLSH
+        header[1] = 1; //version
+        header[2] = desc_size;
+        header[3] = uint(tables.size());
+        header[4] = tables.empty() ? 0 : tables[0]->hash_size;
+        header[5] = tables.empty() ? 0 : tables[0]->probe_radius;
+        header[6] = uint(descs->size());
+
+        file.write((char *) header, sizeof(header));
+
+        bool bOut = file.good();
+        for(uint i = 0; i < tables.size() && bOut; i++) {
+            bOut = tables[i]->Write(file);
+        }
+
+        file.close();
+
+        return bOut;
+    }
+
+    /**
+     * @brief Read loads an index written by Write; descs has to contain
+     * the same descriptors of the saved index.
+     * @param nameFile
+     * @return
+     */
+    bool Read(std::string nameFile)
+    {
+        release();
+        bValid = false;
+
+        std::ifstream file;
+        file.open(nameFile.c_str(), std::ios::in | std::ios::binary);
+
+        if(!file.is_open()) {
+            return false;
+        }
+
+        uint header[7];
+        file.read((char *) header, sizeof(header));
+
+        if(!file.good() || (header[0] != 0x48534c50) || (header[1] != 1) ||
+           (header[4] == 0) || (header[4] > 24) || (header[6] != descs->size())) {
+            file.close();
+            return false;
+        }
+
+        desc_size = header[2];
+        R = ((desc_size * sizeof(uint) * 8) * 90) / 100;
+
+        uint hash_size = header[4];
+        uint n = desc_size * sizeof(uint) * 8;
+
+        bool bOut = true;
+        for(uint i = 0; i < header[3] && bOut; i++) {
+            uint *g_f = new uint[hash_size];
+            file.read((char *) g_f, hash_size * sizeof(uint));
+
+            for(uint j = 0; j < hash_size; j++) {
+                bOut = bOut && (g_f[j] < n);
+            }
+
+            if(!file.good() || !bOut) {
+                delete[] g_f;
+                bOut = false;
+                break;
+            }
+
+            //the table owns g_f; it is built on an empty list and then read
+            std::vector< uint *> empty;
+            HashTableLSH *tmp = new HashTableLSH(hash_size, g_f, &empty, desc_size, header[5]);
+            tmp->descs = descs;
+            tables.push_back(tmp);
+
+            bOut = tmp->Read(file);
+        }
+
+        file.close();
+
+        if(!bOut) {
+            release();
+        }
+
+        bValid = bOut;
+        return bOut;
     }
 };
 
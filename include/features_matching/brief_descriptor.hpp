@@ -26,6 +26,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "../util/std_util.hpp"
 #include "../util/math.hpp"
 #include "../image.hpp"
+#include "../util/thread_pool.hpp"
+#include "../features_matching/hamming_distance.hpp"
 
 #ifndef PIC_DISABLE_EIGEN
 
@@ -55,6 +57,9 @@ protected:
     //samples coordinates
     int *x, *y;
 
+    //the maximum offset of a sample from the center
+    int radius;
+
     /**
      * @brief generateSample
      * @param sample
@@ -86,28 +91,50 @@ protected:
             generateSample(&x[i]);
             generateSample(&y[i]);
         }
+
+        radius = getRadius(x, y);
     }
 
     /**
-     * @brief countZeros
+     * @brief getRadius
      * @param x
-     * @return
+     * @param y
+     * @return This function returns the maximum offset of samples x and y.
      */
-    static unsigned int countZeros(unsigned int x)
+    int getRadius(int *x, int *y)
     {
-        unsigned int n = sizeof(unsigned int) * 8;
-
-        unsigned int ret = 0;
-
-        for(unsigned int i = 0; i < n; i++) {
-            if((x & (1 << i)) == 0) {
-                ret++;
-            }
+        int ret = 0;
+        for(unsigned int i = 0; i < (n * 2); i++) {
+            ret = MAX(ret, MAX(abs(x[i]), abs(y[i])));
         }
 
         return ret;
     }
 
+    /**
+     * @brief getPattern returns the samples to use at (x0, y0).
+     * @param img
+     * @param x0
+     * @param y0
+     * @param x_out
+     * @param y_out
+     */
+    virtual void getPattern(Image *, int, int, int *&x_out, int *&y_out)
+    {
+        x_out = x;
+        y_out = y;
+    }
+
+    /**
+     * @brief countZeros
+     * @param x
+     * @return
+     */
+    static unsigned int countZeros(unsigned int x)
+    {
+        return 32 - HammingDistance::bitCount(x);
+    }
+
     /**
      * @brief getAux computes a descriptor at position (x0,y0) with size n.
      * @param img
@@ -157,6 +184,84 @@ protected:
         return desc;
     }
 
+    /**
+     * @brief getAuxPlane is getAux on a single channel plane with the sum
+     * of the channels of an image (see getPlane).
+     * @param plane
+     * @param width
+     * @param height
+     * @param x0
+     * @param y0
+     * @param x
+     * @param y
+     * @param desc
+     */
+    void getAuxPlane(const float *plane, int width, int height, int x0, int y0, int *x, int *y, uint *desc)
+    {
+        unsigned int bits = sizeof(unsigned int) * 8;
+        unsigned int subBlock = n / bits;
+
+        bool bInside = (x0 - radius >= 0) && (y0 - radius >= 0) &&
+                       (x0 + radius < width) && (y0 + radius < height);
+
+        int c = 0;
+
+        for(unsigned int i = 0; i < subBlock; i++) {
+            unsigned int value = 0;
+
+            for(unsigned int j = 0; j < bits; j++) {
+                int cShifted = c * 2;
+
+                int xx = x0 + x[cShifted];
+                int xy = y0 + x[cShifted + 1];
+                int yx = x0 + y[cShifted];
+                int yy = y0 + y[cShifted + 1];
+
+                if(!bInside) {
+                    xx = CLAMP(xx, width);
+                    xy = CLAMP(xy, height);
+                    yx = CLAMP(yx, width);
+                    yy = CLAMP(yy, height);
+                }
+
+                unsigned int ret = (plane[xy * width + xx] < plane[yy * width + yx]) ? 1 : 0;
+
+                value += (ret << j);
+
+                c++;
+            }
+
+            desc[i] = value;
+        }
+    }
+
+    /**
+     * @brief getPlane sums the channels of the first frame of img.
+     * @param img
+     * @param plane
+     */
+    static void getPlane(Image *img, std::vector<float> &plane)
+    {
+        int width = img->width;
+        int channels = img->channels;
+        plane.resize(size_t(img->width) * img->height);
+
+        ThreadPool::getInstance()->parallelFor(0, img->height, [&](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                for(int x = 0; x < width; x++) {
+                    float *val = (*img)(x, y);
+
+                    float p = 0.0f;
+                    for(int k = 0; k < channels; k++) {
+                        p += val[k];
+                    }
+
+                    plane[size_t(y) * width + x] = p;
+                }
+            }
+        }, 16);
+    }
+
 public:
 
     /**
@@ -191,8 +296,8 @@ public:
     void release()
     {
         m = delete_s(m);
-        x = delete_s(x);
-        y = delete_s(y);
+        x = delete_vec_s(x);
+        y = delete_vec_s(y);
     }
 
     /**
@@ -213,12 +318,16 @@ public:
             return NULL;
         }
 
-        return getAux(img, x0, y0, x, y, desc);
+        int *x_p, *y_p;
+        getPattern(img, x0, y0, x_p, y_p);
+
+        return getAux(img, x0, y0, x_p, y_p, desc);
     }
 
     #ifndef PIC_DISABLE_EIGEN
     /**
-     * @brief getAll
+     * @brief getAll computes the descriptors of all corners in parallel;
+     * corners outside img have a NULL descriptor.
      * @param descs
      * @param corners
      * @param img
@@ -229,11 +338,76 @@ public:
     {
         descs.clear();
 
-        for(unsigned int i = 0; i < corners.size(); i++) {
-            int x0 = int(corners[i][0]);
-            int y0 = int(corners[i][1]);
-            descs.push_back(get(img, x0, y0, NULL));
+        if(img == NULL) {
+            return;
         }
+
+        std::vector<float> plane;
+        getPlane(img, plane);
+
+        descs.resize(corners.size(), NULL);
+        unsigned int subBlock = getDescriptorSize();
+
+        ThreadPool::getInstance()->parallelFor(0, int(corners.size()), [&](int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                int x0 = int(corners[i][0]);
+                int y0 = int(corners[i][1]);
+
+                if(img->checkCoordinates(x0, y0)) {
+                    int *x_p, *y_p;
+                    getPattern(img, x0, y0, x_p, y_p);
+
+                    descs[i] = new uint[subBlock];
+                    getAuxPlane(&plane[0], img->width, img->height, x0, y0, x_p, y_p, descs[i]);
+                }
+            }
+        }, 64);
+    }
+
+    /**
+     * @brief getAll computes the descriptors of all corners in parallel.
+     * @param img
+     * @param corners
+     * @param descs is the output; it is a contiguous array of
+     * corners.size() descriptors, where the ones of corners outside img
+     * are set to zero. If it is NULL, memory will be allocated.
+     * @return it returns a pointer to the descriptors.
+     */
+    uint *getAll(Image *img,
+                 std::vector< Eigen::Vector2f > &corners,
+                 uint *descs)
+    {
+        if((img == NULL) || corners.empty()) {
+            return descs;
+        }
+
+        unsigned int subBlock = getDescriptorSize();
+
+        if(descs == NULL) {
+            descs = new uint[corners.size() * subBlock];
+        }
+
+        std::vector<float> plane;
+        getPlane(img, plane);
+
+        ThreadPool::getInstance()->parallelFor(0, int(corners.size()), [&](int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                int x0 = int(corners[i][0]);
+                int y0 = int(corners[i][1]);
+
+                uint *desc = &descs[size_t(i) * subBlock];
+
+                if(img->checkCoordinates(x0, y0)) {
+                    int *x_p, *y_p;
+                    getPattern(img, x0, y0, x_p, y_p);
+                    getAuxPlane(&plane[0], img->width, img->height, x0, y0, x_p, y_p, desc);
+                } else {
+                    memset(desc, 0, subBlock * sizeof(uint));
+                }
+            }
+        }, 64);
+
+        return descs;
     }
     #endif
 
@@ -258,12 +432,7 @@ public:
             return 0;
         }
 
-        uint ret = 0;
-        for(uint i = 0; i < nfv; i++) {
-            ret += countZeros(fv0[i] ^ fv1[i]);
-        }
-
-        return ret;
+        return nfv * 32 - HammingDistance::distance(fv0, fv1, nfv);
     }
 };
 
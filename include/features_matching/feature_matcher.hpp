@@ -78,7 +78,12 @@ public:
     }
 
 #ifndef PIC_DISABLE_EIGEN
-    void getAllMatches(std::vector<unsigned int *> &descs0, std::vector< Eigen::Vector3i > &matches)
+    /**
+     * @brief getAllMatches matches each descriptor of descs0.
+     * @param descs0
+     * @param matches is a list of (index in descs0, index in descs, distance).
+     */
+    virtual void getAllMatches(std::vector<T *> &descs0, std::vector< Eigen::Vector3i > &matches)
     {
         matches.clear();
 
@@ -0,0 +1,439 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FEATURES_MATCHING_FLOAT_FEATURE_KD_FOREST_MATCHER
+#define PIC_FEATURES_MATCHING_FLOAT_FEATURE_KD_FOREST_MATCHER
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+#include "../util/math.hpp"
+#include "../util/thread_pool.hpp"
+#include "../features_matching/feature_matcher.hpp"
+
+namespace pic{
+
+#ifndef PIC_DISABLE_EIGEN
+
+/**
+ * @brief The KDForestNode struct is a node of a k-d tree; leaves have
+ * dim == -1 and they store the range [start, start + count) of the
+ * permutation of their tree.
+ */
+struct KDForestNode
+{
+    int dim;
+    float split;
+    int child[2];
+    int start, count;
+};
+
+/**
+ * @brief The FloatFeatureKDForestMatcher class is an approximate nearest
+ * neighbour matcher for float descriptors (e.g., SIFT) based on a forest of
+ * randomized k-d trees, which are searched together in best-bin-first
+ * order up to a budget of distance computations.
+ */
+class FloatFeatureKDForestMatcher : public FeatureMatcher<float>
+{
+protected:
+    std::vector<float> data;
+    std::vector<int> index;
+    int n, dim;
+
+    std::vector<int> perm;
+    std::vector<KDForestNode> nodes;
+    std::vector<int> roots;
+
+    int nTrees, leafSize, maxChecks;
+    float ratio;
+
+    std::vector<unsigned int> visited;
+    unsigned int stamp;
+
+    typedef std::pair<float, int> Branch;
+
+    /**
+     * @brief distanceSq
+     * @param a
+     * @param b
+     * @param n
+     * @return
+     */
+    static inline float distanceSq(const float *a, const float *b, int n)
+    {
+        float d0 = 0.0f, d1 = 0.0f, d2 = 0.0f, d3 = 0.0f;
+
+        int i = 0;
+        for(; i <= (n - 4); i += 4) {
+            float t0 = a[i    ] - b[i    ];
+            float t1 = a[i + 1] - b[i + 1];
+            float t2 = a[i + 2] - b[i + 2];
+            float t3 = a[i + 3] - b[i + 3];
+            d0 += t0 * t0;
+            d1 += t1 * t1;
+            d2 += t2 * t2;
+            d3 += t3 * t3;
+        }
+
+        for(; i < n; i++) {
+            float t = a[i] - b[i];
+            d0 += t * t;
+        }
+
+        return (d0 + d1) + (d2 + d3);
+    }
+
+    /**
+     * @brief buildNode splits perm[lo, hi) along one of the dimensions
+     * with the highest variance, chosen at random.
+     * @param lo
+     * @param hi
+     * @param m
+     * @return This function returns the index of the node.
+     */
+    int buildNode(int lo, int hi, std::mt19937 &m)
+    {
+        KDForestNode node;
+        node.dim = -1;
+        node.split = 0.0f;
+        node.child[0] = node.child[1] = -1;
+        node.start = lo;
+        node.count = hi - lo;
+
+        int id = int(nodes.size());
+        nodes.push_back(node);
+
+        if(node.count <= leafSize) {
+            return id;
+        }
+
+        //mean and variance on a subset of the points
+        int nSamples = MIN(node.count, 128);
+        int step = node.count / nSamples;
+
+        std::vector<float> mean(dim, 0.0f), var(dim, 0.0f);
+        for(int i = 0; i < nSamples; i++) {
+            const float *p = &data[size_t(perm[lo + i * step]) * dim];
+            for(int k = 0; k < dim; k++) {
+                mean[k] += p[k];
+            }
+        }
+
+        for(int k = 0; k < dim; k++) {
+            mean[k] /= float(nSamples);
+        }
+
+        for(int i = 0; i < nSamples; i++) {
+            const float *p = &data[size_t(perm[lo + i * step]) * dim];
+            for(int k = 0; k < dim; k++) {
+                float t = p[k] - mean[k];
+                var[k] += t * t;
+            }
+        }
+
+        //random choice among the top 5 dimensions
+        std::vector<int> order(dim);
+        for(int k = 0; k < dim; k++) {
+            order[k] = k;
+        }
+
+        int nTop = MIN(5, dim);
+        std::partial_sort(order.begin(), order.begin() + nTop, order.end(),
+                          [&var](int a, int b) { return var[a] > var[b]; });
+
+        int d = order[m() % nTop];
+
+        if(var[d] <= 0.0f) {
+            return id;
+        }
+
+        float split = mean[d];
+        int *first = &perm[0] + lo;
+        int *last = &perm[0] + hi;
+        const float *pData = &data[0];
+        int dim_l = dim;
+
+        int *mid = std::partition(first, last, [pData, dim_l, d, split](int i) {
+            return pData[size_t(i) * dim_l + d] < split;
+        });
+
+        //degenerate splits are replaced by the median
+        if((mid == first) || (mid == last)) {
+            mid = first + (node.count / 2);
+            std::nth_element(first, mid, last, [pData, dim_l, d](int a, int b) {
+                return pData[size_t(a) * dim_l + d] < pData[size_t(b) * dim_l + d];
+            });
+
+            split = pData[size_t(*mid) * dim_l + d];
+        }
+
+        int c0 = buildNode(lo, int(mid - &perm[0]), m);
+        int c1 = buildNode(int(mid - &perm[0]), hi, m);
+
+        nodes[id].dim = d;
+        nodes[id].split = split;
+        nodes[id].child[0] = c0;
+        nodes[id].child[1] = c1;
+
+        return id;
+    }
+
+    /**
+     * @brief descend visits a tree from node to a leaf, pushing the
+     * skipped branches into heap.
+     * @param query
+     * @param node
+     * @param mindist is a lower bound of the distance of node from query.
+     * @param checks
+     * @param heap
+     * @param matched_j
+     * @param dist_1
+     * @param dist_2
+     * @param visited
+     * @param stamp
+     */
+    inline void descend(const float *query, int node, float mindist, int &checks,
+                        std::vector<Branch> &heap, int &matched_j, float &dist_1, float &dist_2,
+                        std::vector<unsigned int> &visited, unsigned int stamp)
+    {
+        while(nodes[node].dim >= 0) {
+            const KDForestNode &nd = nodes[node];
+            float diff = query[nd.dim] - nd.split;
+            int near_c = diff < 0.0f ? 0 : 1;
+
+            //the distance from the split plane is a lower bound
+            float far_dist = MAX(mindist, diff * diff);
+
+            if(far_dist < dist_2) {
+                heap.push_back(Branch(far_dist, nd.child[1 - near_c]));
+                std::push_heap(heap.begin(), heap.end(), std::greater<Branch>());
+            }
+
+            node = nd.child[near_c];
+        }
+
+        const KDForestNode &leaf = nodes[node];
+        for(int i = leaf.start; i < (leaf.start + leaf.count); i++) {
+            int j = perm[i];
+
+            if(visited[j] == stamp) {
+                continue;
+            }
+
+            visited[j] = stamp;
+            checks++;
+
+            float dist = distanceSq(query, &data[size_t(j) * dim], dim);
+
+            if(dist < dist_1) {
+                dist_2 = dist_1;
+                dist_1 = dist;
+                matched_j = j;
+             } else {
+                if(dist < dist_2) {
+                    dist_2 = dist;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief search looks for the two nearest neighbours of query.
+     * @param query
+     * @param matched_j
+     * @param dist_1
+     * @param dist_2
+     * @param visited
+     * @param stamp
+     */
+    void search(const float *query, int &matched_j, float &dist_1, float &dist_2,
+                std::vector<unsigned int> &visited, unsigned int &stamp)
+    {
+        dist_1 = 1e32f;
+        dist_2 = 1e32f;
+        matched_j = -1;
+
+        if((query == NULL) || (n == 0)) {
+            return;
+        }
+
+        if(int(visited.size()) < n) {
+            visited.assign(n, 0);
+            stamp = 0;
+        }
+
+        stamp++;
+        if(stamp == 0) {
+            std::fill(visited.begin(), visited.end(), 0);
+            stamp = 1;
+        }
+
+        std::vector<Branch> heap;
+        int checks = 0;
+
+        for(unsigned int t = 0; t < roots.size(); t++) {
+            descend(query, roots[t], 0.0f, checks, heap, matched_j, dist_1, dist_2, visited, stamp);
+        }
+
+        while(!heap.empty() && ((maxChecks <= 0) || (checks < maxChecks))) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<Branch>());
+            Branch b = heap.back();
+            heap.pop_back();
+
+            if(b.first >= dist_2) {
+                break;
+            }
+
+            descend(query, b.second, b.first, checks, heap, matched_j, dist_1, dist_2, visited, stamp);
+        }
+
+        if(matched_j != -1) {
+            matched_j = index[matched_j];
+        }
+    }
+
+public:
+
+    /**
+     * @brief FloatFeatureKDForestMatcher
+     * @param descs
+     * @param desc_size
+     * @param nTrees is the number of randomized k-d trees.
+     * @param maxChecks is the maximum number of distance computations
+     * for a query; if it is lower than 1, the search is exact.
+     * @param ratio is the minimum ratio between the squared distances of
+     * the second and the first neighbour for accepting a match.
+     */
+    FloatFeatureKDForestMatcher(std::vector<float *> *descs, unsigned int desc_size,
+                                int nTrees = 4, int maxChecks = 128, float ratio = 1.2f) : FeatureMatcher<float>(descs, float(desc_size))
+    {
+        this->nTrees = MAX(nTrees, 1);
+        this->maxChecks = maxChecks;
+        this->ratio = ratio;
+        this->leafSize = 4;
+        this->stamp = 0;
+
+        build();
+    }
+
+    /**
+     * @brief setMaxChecks
+     * @param maxChecks
+     */
+    void setMaxChecks(int maxChecks)
+    {
+        this->maxChecks = maxChecks;
+    }
+
+    /**
+     * @brief build packs descriptors in a contiguous matrix and it
+     * builds the trees; it has to be called if descs changes.
+     */
+    void build()
+    {
+        dim = int(desc_size);
+
+        index.clear();
+        for(unsigned int i = 0; i < descs->size(); i++) {
+            if(descs->at(i) != NULL) {
+                index.push_back(int(i));
+            }
+        }
+
+        n = int(index.size());
+
+        data.resize(size_t(n) * dim);
+        for(int i = 0; i < n; i++) {
+            memcpy(&data[size_t(i) * dim], descs->at(index[i]), dim * sizeof(float));
+        }
+
+        nodes.clear();
+        roots.clear();
+        perm.resize(size_t(n) * nTrees);
+
+        if(n == 0) {
+            return;
+        }
+
+        std::mt19937 m(1);
+
+        for(int t = 0; t < nTrees; t++) {
+            for(int i = 0; i < n; i++) {
+                perm[t * n + i] = i;
+            }
+
+            roots.push_back(buildNode(t * n, (t + 1) * n, m));
+        }
+    }
+
+    /**
+     * @brief getMatch
+     * @param desc0
+     * @param matched_j
+     * @param dist_1
+     * @return
+     */
+    bool getMatch(float *desc, int &matched_j, float &dist_1)
+    {
+        float dist_2;
+
+        search(desc, matched_j, dist_1, dist_2, visited, stamp);
+
+        return ((dist_1 * ratio < dist_2) && matched_j != -1);
+    }
+
+    /**
+     * @brief getAllMatches matches all descriptors of descs0; queries are
+     * processed in parallel.
+     * @param descs0
+     * @param matches
+     */
+    void getAllMatches(std::vector<float *> &descs0, std::vector< Eigen::Vector3i > &matches)
+    {
+        matches.clear();
+
+        int nQuery = int(descs0.size());
+
+        std::vector<int> matched_j(nQuery, -1);
+        std::vector<float> dist_1(nQuery, 1e32f), dist_2(nQuery, 1e32f);
+
+        ThreadPool::getInstance()->parallelFor(0, nQuery, [&](int i0, int i1) {
+            std::vector<unsigned int> visited_block;
+            unsigned int stamp_block = 0;
+
+            for(int i = i0; i < i1; i++) {
+                search(descs0[i], matched_j[i], dist_1[i], dist_2[i], visited_block, stamp_block);
+            }
+        }, 64);
+
+        for(int i = 0; i < nQuery; i++) {
+            if((dist_1[i] * ratio < dist_2[i]) && matched_j[i] != -1) {
+                matches.push_back(Eigen::Vector3i(i, matched_j[i], int(dist_1[i])));
+            }
+        }
+    }
+};
+
+#endif
+
+}
+
+#endif // PIC_FEATURES_MATCHING_FLOAT_FEATURE_KD_FOREST_MATCHER
@@ -0,0 +1,372 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FEATURES_MATCHING_HAMMING_DISTANCE_HPP
+#define PIC_FEATURES_MATCHING_HAMMING_DISTANCE_HPP
+
+#include <string.h>
+#include <vector>
+
+#include "../base.hpp"
+#include "../util/math.hpp"
+#include "../util/simd.hpp"
+
+namespace pic {
+
+/**
+ * @brief The HammingDistance class computes Hamming distances between binary
+ * descriptors with the best instruction set of the machine: AVX-512 VPOPCNTDQ,
+ * AVX2 (nibble look-up with vpshufb), POPCNT, or a portable bit count.
+ */
+class HammingDistance
+{
+protected:
+
+    /**
+     * @brief distanceScalar
+     */
+    static unsigned int distanceScalar(const unsigned long long *a, const unsigned long long *b, int nWords)
+    {
+        unsigned int ret = 0;
+        for(int i = 0; i < nWords; i++) {
+            ret += bitCount(a[i] ^ b[i]);
+        }
+
+        return ret;
+    }
+
+#ifdef PIC_SIMD_X86
+    /**
+     * @brief distancePOPCNT
+     */
+    PIC_SIMD_TARGET_POPCNT static unsigned int distancePOPCNT(const unsigned long long *a, const unsigned long long *b, int nWords)
+    {
+        unsigned long long ret = 0;
+        for(int i = 0; i < nWords; i++) {
+        #ifdef _MSC_VER
+            ret += __popcnt64(a[i] ^ b[i]);
+        #else
+            ret += (unsigned long long) __builtin_popcountll(a[i] ^ b[i]);
+        #endif
+        }
+
+        return (unsigned int) ret;
+    }
+
+    /**
+     * @brief distanceAVX2 needs nWords to be a multiple of 4.
+     */
+    PIC_SIMD_TARGET_AVX2 static unsigned int distanceAVX2(const unsigned long long *a, const unsigned long long *b, int nWords)
+    {
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low_mask = _mm256_set1_epi8(0x0f);
+        __m256i acc = _mm256_setzero_si256();
+
+        for(int i = 0; i < nWords; i += 4) {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                         _mm256_loadu_si256((const __m256i *)(b + i)));
+
+            __m256i lo = _mm256_and_si256(x, low_mask);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask);
+            __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                          _mm256_shuffle_epi8(lookup, hi));
+
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+        }
+
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+        return (unsigned int) _mm_cvtsi128_si64(sum);
+    }
+
+    /**
+     * @brief distancesAVX2 is the one-vs-many version of distanceAVX2.
+     */
+    PIC_SIMD_TARGET_AVX2 static void distancesAVX2(const unsigned long long *query, const unsigned long long *train,
+                                                   int n, int stride, unsigned int *out)
+    {
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+        for(int j = 0; j < n; j++) {
+            const unsigned long long *b = train + size_t(j) * stride;
+            __m256i acc = _mm256_setzero_si256();
+
+            for(int i = 0; i < stride; i += 4) {
+                __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(query + i)),
+                                             _mm256_loadu_si256((const __m256i *)(b + i)));
+
+                __m256i lo = _mm256_and_si256(x, low_mask);
+                __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask);
+                __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                              _mm256_shuffle_epi8(lookup, hi));
+
+                acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+            }
+
+            __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+            out[j] = (unsigned int) _mm_cvtsi128_si64(sum);
+        }
+    }
+
+    /**
+     * @brief distanceAVX512 needs nWords to be a multiple of 4.
+     */
+    PIC_SIMD_TARGET_AVX512_POPCNT static unsigned int distanceAVX512(const unsigned long long *a, const unsigned long long *b, int nWords)
+    {
+        __m512i acc = _mm512_setzero_si512();
+
+        int i = 0;
+        for(; i <= (nWords - 8); i += 8) {
+            __m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void *)(a + i)),
+                                         _mm512_loadu_si512((const void *)(b + i)));
+            acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+        }
+
+        if(i < nWords) {
+            __m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi64(0x0f, (const void *)(a + i)),
+                                         _mm512_maskz_loadu_epi64(0x0f, (const void *)(b + i)));
+            acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+        }
+
+        return (unsigned int) _mm512_reduce_add_epi64(acc);
+    }
+
+    /**
+     * @brief distancesAVX512 is the one-vs-many version of distanceAVX512;
+     * 256-bit descriptors are compared two at a time.
+     */
+    PIC_SIMD_TARGET_AVX512_POPCNT static void distancesAVX512(const unsigned long long *query, const unsigned long long *train,
+                                                              int n, int stride, unsigned int *out)
+    {
+        int j = 0;
+
+        if(stride == 4) {
+            __m512i q = _mm512_broadcast_i64x4(_mm256_loadu_si256((const __m256i *)query));
+
+            for(; j <= (n - 2); j += 2) {
+                __m512i x = _mm512_xor_si512(q, _mm512_loadu_si512((const void *)(train + size_t(j) * 4)));
+                __m512i c = _mm512_popcnt_epi64(x);
+
+                //lanes 0-3 belong to j and lanes 4-7 to j + 1
+                c = _mm512_add_epi64(c, _mm512_shuffle_epi32(c, _MM_PERM_BADC));
+                c = _mm512_add_epi64(c, _mm512_shuffle_i64x2(c, c, _MM_SHUFFLE(2, 3, 0, 1)));
+
+                out[j] = (unsigned int) _mm_cvtsi128_si64(_mm512_castsi512_si128(c));
+                out[j + 1] = (unsigned int) _mm_cvtsi128_si64(_mm512_extracti32x4_epi32(c, 2));
+            }
+        }
+
+        for(; j < n; j++) {
+            out[j] = distanceAVX512(query, train + size_t(j) * stride, stride);
+        }
+    }
+#endif
+
+public:
+
+    /**
+     * @brief bitCount is a portable bit count.
+     * @param x
+     * @return
+     */
+    static inline unsigned int bitCount(unsigned long long x)
+    {
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        return (unsigned int)((x * 0x0101010101010101ULL) >> 56);
+    }
+
+    /**
+     * @brief distance computes the Hamming distance between two descriptors
+     * of n 32-bit words.
+     * @param a
+     * @param b
+     * @param n
+     * @return
+     */
+    static unsigned int distance(const unsigned int *a, const unsigned int *b, unsigned int n)
+    {
+        unsigned int n2 = n >> 1;
+        unsigned long long a64[16], b64[16];
+        unsigned int ret = 0;
+
+        //words are paired in 64-bit blocks
+        for(unsigned int i = 0; i < n2; i += 16) {
+            unsigned int m = MIN(16, n2 - i);
+            memcpy(a64, a + i * 2, m * sizeof(unsigned long long));
+            memcpy(b64, b + i * 2, m * sizeof(unsigned long long));
+            ret += distance(a64, b64, int(m), false);
+        }
+
+        if(n & 1) {
+            ret += bitCount((unsigned long long)(a[n - 1] ^ b[n - 1]));
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief distance computes the Hamming distance between two descriptors
+     * of nWords 64-bit words.
+     * @param a
+     * @param b
+     * @param nWords
+     * @param bPadded has to be true only if nWords is a multiple of 4 (e.g.,
+     * descriptors of a BinaryDescriptorSet); it enables vector kernels.
+     * @return
+     */
+    static unsigned int distance(const unsigned long long *a, const unsigned long long *b,
+                                 int nWords, bool bPadded)
+    {
+#ifdef PIC_SIMD_X86
+        if(bPadded) {
+            if(SIMD::hasVPOPCNTDQ()) {
+                return distanceAVX512(a, b, nWords);
+            }
+
+            if(SIMD::get() >= SIMD_AVX2) {
+                return distanceAVX2(a, b, nWords);
+            }
+        }
+
+        if(SIMD::hasPOPCNT()) {
+            return distancePOPCNT(a, b, nWords);
+        }
+#endif
+        return distanceScalar(a, b, nWords);
+    }
+
+    /**
+     * @brief distances computes the Hamming distances between a descriptor
+     * and n consecutive descriptors; all of them have stride 64-bit words,
+     * which is a multiple of 4.
+     * @param query
+     * @param train
+     * @param n
+     * @param stride
+     * @param out
+     */
+    static void distances(const unsigned long long *query, const unsigned long long *train,
+                          int n, int stride, unsigned int *out)
+    {
+#ifdef PIC_SIMD_X86
+        if(SIMD::hasVPOPCNTDQ()) {
+            distancesAVX512(query, train, n, stride, out);
+            return;
+        }
+
+        if(SIMD::get() >= SIMD_AVX2) {
+            distancesAVX2(query, train, n, stride, out);
+            return;
+        }
+
+        if(SIMD::hasPOPCNT()) {
+            for(int i = 0; i < n; i++) {
+                out[i] = distancePOPCNT(query, train + size_t(i) * stride, stride);
+            }
+            return;
+        }
+#endif
+
+        for(int i = 0; i < n; i++) {
+            out[i] = distanceScalar(query, train + size_t(i) * stride, stride);
+        }
+    }
+};
+
+/**
+ * @brief The BinaryDescriptorSet class packs binary descriptors in a
+ * contiguous buffer; each descriptor is padded with zeros to a multiple of
+ * 256 bits, so distances are computed with whole vector registers. NULL
+ * descriptors are skipped; index maps packed descriptors to the input ones.
+ */
+class BinaryDescriptorSet
+{
+public:
+    std::vector<unsigned long long> data;
+    std::vector<int> index;
+    int stride;
+    unsigned int nBits;
+
+    BinaryDescriptorSet()
+    {
+        stride = 0;
+        nBits = 0;
+    }
+
+    /**
+     * @brief BinaryDescriptorSet
+     * @param descs
+     * @param desc_size is the number of 32-bit words of a descriptor.
+     */
+    BinaryDescriptorSet(std::vector<unsigned int *> &descs, unsigned int desc_size)
+    {
+        set(descs, desc_size);
+    }
+
+    /**
+     * @brief set packs a list of descriptors.
+     * @param descs
+     * @param desc_size is the number of 32-bit words of a descriptor.
+     */
+    void set(std::vector<unsigned int *> &descs, unsigned int desc_size)
+    {
+        nBits = desc_size * 32;
+        stride = ((int(desc_size) + 7) / 8) * 4;
+
+        index.clear();
+        for(unsigned int i = 0; i < descs.size(); i++) {
+            if(descs[i] != NULL) {
+                index.push_back(int(i));
+            }
+        }
+
+        data.assign(index.size() * size_t(stride), 0);
+
+        for(unsigned int i = 0; i < index.size(); i++) {
+            memcpy(&data[i * size_t(stride)], descs[index[i]], desc_size * sizeof(unsigned int));
+        }
+    }
+
+    /**
+     * @brief size
+     * @return This function returns the number of packed descriptors.
+     */
+    int size()
+    {
+        return int(index.size());
+    }
+
+    /**
+     * @brief get
+     * @param i
+     * @return This function returns the i-th packed descriptor.
+     */
+    const unsigned long long *get(int i)
+    {
+        return &data[size_t(i) * size_t(stride)];
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_FEATURES_MATCHING_HAMMING_DISTANCE_HPP */
@@ -21,27 +21,108 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <vector>
 #include <math.h>
 #include <set>
+#include <fstream>
+#include <unordered_map>
 
 #include "../features_matching/brief_descriptor.hpp"
+#include "../features_matching/hamming_distance.hpp"
 
 namespace pic {
 
 #ifndef PIC_DISABLE_EIGEN
 
 /**
- * @brief The Hash class
+ * @brief The Hash class is a locality-sensitive hash table for binary
+ * descriptors. Buckets are stored in compressed sparse row (CSR) format:
+ * the entries of bucket b are entries[offsets[b]], ..., entries[offsets[b + 1] - 1].
+ * Descriptors inserted after the table build are kept in pending buckets,
+ * and removed ones are marked with a tombstone; the table is rebuilt when
+ * they grow too much.
  */
 class HashTableLSH
 {
+protected:
+
+    /**
+     * @brief updateEntry
+     * @param j
+     * @param desc
+     * @param matched_j
+     * @param dist_1
+     * @param dist_2
+     * @param visited
+     * @param stamp
+     */
+    inline void updateEntry(unsigned int j, unsigned int *desc, int &matched_j, unsigned int &dist_1, unsigned int &dist_2,
+                            std::vector<unsigned int> *visited, unsigned int stamp)
+    {
+        unsigned int *desc_j = descs->at(j);
+
+        if(desc_j == NULL) {
+            return;
+        }
+
+        //a descriptor can be in more than a bucket of different tables
+        if(visited != NULL) {
+            if(visited->at(j) == stamp) {
+                return;
+            }
+
+            visited->at(j) = stamp;
+        }
+
+        unsigned int dist = desc_size * size_ui - HammingDistance::distance(desc, desc_j, desc_size);
+
+        if(dist > dist_1) {
+            dist_2 = dist_1;
+            dist_1 = dist;
+            matched_j = j;
+         } else {
+            if(dist > dist_2) {
+                dist_2 = dist;
+            }
+        }
+    }
+
+    /**
+     * @brief setProbes computes the perturbation masks of the buckets
+     * to probe, sorted by Hamming distance from the query bucket.
+     */
+    void setProbes()
+    {
+        probes.clear();
+
+        for(unsigned int r = 0; r <= probe_radius; r++) {
+            for(unsigned int mask = 0; mask < nTable; mask++) {
+                if(HammingDistance::bitCount(mask) == r) {
+                    probes.push_back(mask);
+                }
+            }
+        }
+    }
+
 public:
     unsigned int *g_f;
 
     std::vector< unsigned int *> *descs;
-    std::vector< unsigned int > *table;
-    unsigned int nTable;
-    unsigned int hash_size, desc_size, size_ui;
+    std::vector< unsigned int > offsets, entries;
+    std::unordered_map< unsigned int, std::vector< unsigned int > > pending;
+    std::vector< unsigned int > probes;
+    unsigned int nTable, nRemoved, nPending;
+    unsigned int hash_size, desc_size, size_ui, probe_radius;
 
-    HashTableLSH(unsigned int hash_size, unsigned int *g_f, std::vector< unsigned int *> *descs, unsigned int desc_size)
+    /**
+     * @brief HashTableLSH
+     * @param hash_size is the number of bits of an address.
+     * @param g_f is the list of the hash_size bits of a descriptor used
+     * as address; it is owned by the table.
+     * @param descs
+     * @param desc_size
+     * @param probe_radius is the maximum Hamming distance of the probed
+     * buckets from the one of the query.
+     */
+    HashTableLSH(unsigned int hash_size, unsigned int *g_f, std::vector< unsigned int *> *descs, unsigned int desc_size,
+                 unsigned int probe_radius = 0)
     {
         if(hash_size == 0) {
             hash_size = 8;
@@ -50,7 +131,6 @@ public:
         this->hash_size = hash_size;
 
         nTable = 1 << hash_size;
-        table = new std::vector< unsigned int >[nTable];
 
         //hash function
         this->g_f = g_f;
@@ -60,9 +140,129 @@ public:
         this->desc_size = desc_size;
         size_ui = sizeof(unsigned int) * 8;
 
-        for(unsigned int i = 0; i < descs->size();  i++) {
-            unsigned int address = getAddress(descs->at(i));
-            table[address].push_back(i);
+        setProbeRadius(probe_radius);
+
+        build();
+    }
+
+    ~HashTableLSH()
+    {
+        delete_vec_s(g_f);
+    }
+
+    /**
+     * @brief setProbeRadius
+     * @param probe_radius
+     */
+    void setProbeRadius(unsigned int probe_radius)
+    {
+        this->probe_radius = MIN(probe_radius, hash_size);
+        setProbes();
+    }
+
+    /**
+     * @brief build inserts all non NULL descriptors in the table.
+     */
+    void build()
+    {
+        unsigned int n = (unsigned int) descs->size();
+
+        std::vector< unsigned int > address(n);
+
+        offsets.assign(nTable + 1, 0);
+
+        for(unsigned int i = 0; i < n;  i++) {
+            unsigned int *desc = descs->at(i);
+
+            if(desc != NULL) {
+                address[i] = getAddress(desc);
+                offsets[address[i] + 1]++;
+            }
+        }
+
+        for(unsigned int i = 0; i < nTable; i++) {
+            offsets[i + 1] += offsets[i];
+        }
+
+        entries.resize(offsets[nTable]);
+
+        std::vector< unsigned int > pos(offsets.begin(), offsets.end() - 1);
+        for(unsigned int i = 0; i < n;  i++) {
+            if(descs->at(i) != NULL) {
+                entries[pos[address[i]]++] = i;
+            }
+        }
+
+        pending.clear();
+        nPending = 0;
+        nRemoved = 0;
+    }
+
+    /**
+     * @brief insert adds the i-th descriptor to the table.
+     * @param i
+     */
+    void insert(unsigned int i)
+    {
+        unsigned int *desc = descs->at(i);
+
+        if(desc == NULL) {
+            return;
+        }
+
+        pending[getAddress(desc)].push_back(i);
+        nPending++;
+
+        if(nPending > MAX(64u, (unsigned int)(entries.size() / 8))) {
+            build();
+        }
+    }
+
+    /**
+     * @brief remove removes the i-th descriptor from the table; the
+     * descriptor has to be still valid.
+     * @param i
+     */
+    void remove(unsigned int i)
+    {
+        unsigned int *desc = descs->at(i);
+
+        if(desc == NULL) {
+            return;
+        }
+
+        unsigned int address = getAddress(desc);
+
+        for(unsigned int k = offsets[address]; k < offsets[address + 1]; k++) {
+            if(entries[k] == i) {
+                entries[k] = 0xffffffff;
+                nRemoved++;
+                break;
+            }
+        }
+
+        auto bucket = pending.find(address);
+        if(bucket != pending.end()) {
+            std::vector< unsigned int > &p = bucket->second;
+
+            for(unsigned int k = 0; k < p.size(); k++) {
+                if(p[k] == i) {
+                    p.erase(p.begin() + k);
+                    nPending--;
+                    break;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief compact rebuilds the table when there are too many
+     * removed descriptors.
+     */
+    void compact()
+    {
+        if(nRemoved > (entries.size() / 4)) {
+            build();
         }
     }
 
@@ -91,31 +291,115 @@ public:
     }
 
     /**
-     * @brief getNearest
+     * @brief getNearest probes the bucket of desc and its neighbours.
      * @param desc
      * @param matched_j
      * @param dist_1
      * @param dist_2
+     * @param visited is an optional array, as large as descs, used for
+     * skipping descriptors already compared for the same stamp.
+     * @param stamp
      */
-    void getNearest(unsigned int * desc, int &matched_j, unsigned int &dist_1, unsigned int &dist_2)
+    void getNearest(unsigned int * desc, int &matched_j, unsigned int &dist_1, unsigned int &dist_2,
+                    std::vector<unsigned int> *visited = NULL, unsigned int stamp = 0)
     {
         unsigned int address = getAddress(desc);
 
-        for(unsigned int i=0; i<table[address].size(); i++) {
-            unsigned int j = table[address].at(i);
-            unsigned int dist = BRIEFDescriptor::match(desc, descs->at(j), desc_size);
-
-            if(dist > dist_1) {
-                dist_2 = dist_1;
-                dist_1 = dist;
-                matched_j = j;
-             } else {
-                if(dist > dist_2) {
-                    dist_2 = dist;
+        for(unsigned int p = 0; p < probes.size(); p++) {
+            unsigned int address_p = address ^ probes[p];
+
+            for(unsigned int k = offsets[address_p]; k < offsets[address_p + 1]; k++) {
+                unsigned int j = entries[k];
+
+                if(j != 0xffffffff) {
+                    updateEntry(j, desc, matched_j, dist_1, dist_2, visited, stamp);
+                }
+            }
+
+            if(nPending > 0) {
+                auto bucket = pending.find(address_p);
+
+                if(bucket != pending.end()) {
+                    const std::vector< unsigned int > &bucket_entries = bucket->second;
+
+                    for(unsigned int k = 0; k < bucket_entries.size(); k++) {
+                        updateEntry(bucket_entries[k], desc, matched_j, dist_1, dist_2, visited, stamp);
+                    }
                 }
             }
         }
     }
+
+    /**
+     * @brief Write writes the hash function and the buckets.
+     * @param file
+     * @return
+     */
+    bool Write(std::ofstream &file)
+    {
+        if((nPending > 0) || (nRemoved > 0)) {
+            build();
+        }
+
+        unsigned int nEntries = (unsigned int) entries.size();
+
+        file.write((char *) g_f, hash_size * sizeof(unsigned int));
+        file.write((char *) &nEntries, sizeof(unsigned int));
+        file.write((char *) &offsets[0], offsets.size() * sizeof(unsigned int));
+
+        if(nEntries > 0) {
+            file.write((char *) &entries[0], nEntries * sizeof(unsigned int));
+        }
+
+        return file.good();
+    }
+
+    /**
+     * @brief Read reads the buckets written by Write; the hash function
+     * has been read by the caller.
+     * @param file
+     * @return
+     */
+    bool Read(std::ifstream &file)
+    {
+        unsigned int nEntries = 0;
+        file.read((char *) &nEntries, sizeof(unsigned int));
+
+        if(!file.good()) {
+            return false;
+        }
+
+        offsets.resize(nTable + 1);
+        file.read((char *) &offsets[0], offsets.size() * sizeof(unsigned int));
+
+        if(!file.good() || (offsets[0] != 0) || (offsets[nTable] != nEntries)) {
+            return false;
+        }
+
+        for(unsigned int i = 0; i < nTable; i++) {
+            if(offsets[i] > offsets[i + 1]) {
+                return false;
+            }
+        }
+
+        entries.resize(nEntries);
+
+        if(nEntries > 0) {
+            file.read((char *) &entries[0], nEntries * sizeof(unsigned int));
+        }
+
+        for(unsigned int i = 0; i < nEntries; i++) {
+            if(entries[i] >= descs->size()) {
+                return false;
+            }
+        }
+
+        pending.clear();
+        nPending = 0;
+        nRemoved = 0;
+
+        return file.good();
+    }
 };
 
 #endif
@@ -123,4 +407,3 @@ public:
 } // end namespace pic
 
 #endif /* PIC_FEATURES_MATCHING_HASH_TABLE_LSH_HPP */
-
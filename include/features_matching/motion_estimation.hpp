@@ -22,6 +22,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "../image.hpp"
 #include "../util/std_util.hpp"
+#include "../util/tile_list.hpp"
+#include "../util/thread_pool.hpp"
 #include "../features_matching/patch_comp.hpp"
 
 namespace pic {
@@ -168,20 +170,12 @@ public:
 
         TileList lst(blockSize, width, height);
 
-        //create threads
-        int numCores = std::thread::hardware_concurrency();
+        //run one tile consumer per thread of the pool
+        ThreadPool *pool = ThreadPool::getInstance();
 
-        std::thread **thrd = new std::thread*[numCores];
-
-        for(int i = 0; i < numCores; i++) {
-            thrd[i] = new std::thread(
-                std::bind(&MotionEstimation::processAux, this, &lst, imgOut));
-        }
-
-        //threads join
-        for(int i = 0; i < numCores; i++) {
-            thrd[i]->join();
-        }
+        pool->run(pool->getNumThreads(), [this, &lst, imgOut](int) {
+            processAux(&lst, imgOut);
+        });
 
         return imgOut;
     }
@@ -76,7 +76,64 @@ protected:
 
             x_theta.push_back(X_r);
             y_theta.push_back(Y_r);
+
+            radius = MAX(radius, getRadius(X_r, Y_r));
+        }
+    }
+
+    /**
+     * @brief getPattern returns the samples rotated by the orientation
+     * of the patch at (x0, y0).
+     * @param img
+     * @param x0
+     * @param y0
+     * @param x_out
+     * @param y_out
+     */
+    void getPattern(Image *img, int x0, int y0, int *&x_out, int *&y_out)
+    {
+        float grad[2];
+        grad[0] = 0.0f;
+        grad[1] = 0.0f;
+
+        if((x0 - S >= 0) && (y0 - S >= 0) && (x0 + S < img->width) && (y0 + S < img->height)) {
+            //same as getMomentsVal for the first channel, without clamping
+            for(int j = -S; j <= S; j++) {
+                float *row = (*img)(x0 - S, y0 + j);
+
+                for(int i = -S; i <= S; i++) {
+                    float val = row[(i + S) * img->channels];
+                    grad[0] += j * val;
+                    grad[1] += i * val;
+                }
+            }
+        } else {
+            //first channel, with clamped coordinates
+            for(int j = -S; j <= S; j++) {
+                for(int i = -S; i <= S; i++) {
+                    float val = (*img)(x0 + i, y0 + j)[0];
+                    grad[0] += j * val;
+                    grad[1] += i * val;
+                }
+            }
         }
+
+        float theta = atan2f(grad[1], grad[0]);
+
+        if(theta < 0.0f) {
+            theta = CLAMPi(C_PI_2 + theta, 0.0f, C_PI_2);
+        }
+
+        //float theta_nor = CLAMPi(theta / C_PI_2, 0.0f, 1.0f);
+
+        uint theta_nor = CLAMPi(uint(theta * 255.0f / C_PI_2), 0, 255);
+
+        uint n = x_theta.size() - 1;
+
+        uint index = (n * theta_nor) >> 8;
+
+        x_out = x_theta[index];
+        y_out = y_theta[index];
     }
 
     int halfS;
@@ -90,6 +147,9 @@ public:
      */
     ORBDescriptor(int S = 31, int n = 256, unsigned int seed = 1)
     {
+        //the samples of the default BRIEFDescriptor are replaced
+        release();
+
         m = new std::mt19937(seed);
 
         this->S = S;
@@ -103,47 +163,11 @@ public:
 
     ~ORBDescriptor()
     {
+        stdVectorArrayClear(x_theta);
+        stdVectorArrayClear(y_theta);
         release();
     }
 
-    /**
-     * @brief get computes a descriptor at position (x0,y0) with size n.
-     * @param img
-     * @param x0
-     * @param y0
-     * @param desc
-     * @return
-     */
-    uint *get(Image *img, int x0, int y0, uint* desc = NULL)
-    {
-        if(img == NULL){
-            return NULL;
-        }
-
-        if(!img->checkCoordinates(x0, y0)) {
-            return NULL;
-        }
-
-        float grad[2];
-
-        img->getMomentsVal(x0, y0, S, grad);
-
-        float theta = atan2f(grad[1], grad[0]);
-
-        if(theta < 0.0f) {
-            theta = CLAMPi(C_PI_2 + theta, 0.0f, C_PI_2);
-        }
-
-        //float theta_nor = CLAMPi(theta / C_PI_2, 0.0f, 1.0f);
-
-        uint theta_nor = CLAMPi(uint(theta * 255.0f / C_PI_2), 0, 255);
-
-        uint n = x_theta.size() - 1;
-
-        uint index = (n * theta_nor) >> 8;
-
-        return getAux(img, x0, y0, x_theta[index], y_theta[index], desc);
-    }
 };
 
 #endif
@@ -18,8 +18,21 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_SIFT_DESCRIPTOR_HPP
 #define PIC_SIFT_DESCRIPTOR_HPP
 
+#include <vector>
+
 #include "../image.hpp"
 #include "../util/array.hpp"
+#include "../util/thread_pool.hpp"
+
+#ifndef PIC_DISABLE_EIGEN
+
+#ifndef PIC_EIGEN_NOT_BUNDLED
+    #include "../externals/Eigen/Dense"
+#else
+    #include <Eigen/Dense>
+#endif
+
+#endif
 
 namespace pic {
 
@@ -36,6 +49,135 @@ protected:
 
     int patchSize, half_patchSize, subPatchSize, subPatchSize_sq, nBin, tot;
 
+    //Gaussian weights indexed by the squared distance from the center
+    std::vector<float> weights;
+
+    /**
+     * @brief getBin computes the two bins of an angle in [0, 2pi] and
+     * the interpolation weight of the second one.
+     * @param angle
+     * @param nBin
+     * @param reference
+     * @param sector
+     * @param index
+     * @param index_1
+     * @return
+     */
+    static inline float getBin(float angle, int nBin, float *reference, float sector, int &index, int &index_1)
+    {
+        float index_f = float(nBin) * (angle / C_PI_2);
+        index = int(floorf(index_f));
+        index = CLAMPi(index, 0, nBin - 1);
+        index_1 = (index + 1) % nBin;
+
+        float dist = (angle - reference[index]) / sector;
+        return CLAMPi(dist, 0.0f, 1.0f);
+    }
+
+    /**
+     * @brief finalize normalizes a descriptor.
+     * @param desc
+     */
+    void finalize(float *desc)
+    {
+        //normalize desc
+        Array<float>::normalize(desc, tot);
+
+        //remove strong edges; i.e., over 0.2
+        for(int i = 0; i < tot; i++) {
+            desc[i] = desc[i] > 0.2f ? desc[i] : 0.2f;
+        }
+
+        //re-normalize desc
+        Array<float>::normalize(desc, tot);
+    }
+
+    /**
+     * @brief getFromPlanes computes a descriptor from the orientation and
+     * magnitude planes of the gradient (see getAll).
+     * @param planes
+     * @param width
+     * @param height
+     * @param x0
+     * @param y0
+     * @param desc
+     */
+    void getFromPlanes(const float *planes, int width, int height, int x0, int y0, float *desc)
+    {
+        memset(desc, 0, sizeof(float) * tot);
+
+        int r = MAX(half_patchSize, subPatchSize_sq - half_patchSize);
+        bool bInside = (x0 - r >= 0) && (y0 - r >= 0) &&
+                       (x0 + r < width) && (y0 + r < height);
+
+        //patch orientation
+        float orientation[36];
+        Arrayf::assign(0.0f, orientation, 36);
+
+        for(int i = 0; i < patchSize; i ++) {
+            int y_local = i - half_patchSize;
+            int y = bInside ? (y_local + y0) : CLAMP(y_local + y0, height);
+
+            for(int j = 0; j < patchSize; j ++) {
+                int x_local = j  - half_patchSize;
+                int x = bInside ? (x_local + x0) : CLAMP(x_local + x0, width);
+
+                const float *p = &planes[(y * width + x) * 2];
+
+                int index, index_1;
+                float dist = getBin(p[0], 36, reference_angles_orientation, sector_angle_orientation, index, index_1);
+
+                float mag = p[1] * weights[x_local * x_local + y_local * y_local];
+
+                orientation[index]   += mag * (1.0f - dist);
+                orientation[index_1] += mag * dist;
+            }
+        }
+
+        int index_max;
+        Arrayf::getMax(orientation, 36, index_max);
+        float kp_angle = reference_angles_orientation[index_max];
+
+        //descriptor: rotating gradients by -kp_angle shifts their angles
+        int counter = 0;
+
+        for(int i = 0; i < subPatchSize_sq; i += subPatchSize) {
+            for(int j = 0; j < subPatchSize_sq; j += subPatchSize) {
+
+                for(int k = 0; k < subPatchSize; k++) {
+                    int y_local = i + k - half_patchSize;
+                    int y = bInside ? (y_local + y0) : CLAMP(y_local + y0, height);
+
+                    for(int l = 0; l < subPatchSize; l++) {
+                        int x_local = j + l - half_patchSize;
+                        int x = bInside ? (x_local + x0) : CLAMP(x_local + x0, width);
+
+                        const float *p = &planes[(y * width + x) * 2];
+
+                        if(p[1] <= thr_weak) {
+                            continue;
+                        }
+
+                        float angle = p[0] - kp_angle;
+                        angle = (angle >= 0.0f) ? angle : angle + C_PI_2;
+
+                        int index, index_1;
+                        float dist = getBin(angle, nBin, reference_angles, sector_angle, index, index_1);
+
+                        float mag = p[1] * weights[x_local * x_local + y_local * y_local];
+
+                        desc[counter + index]   += mag * (1.0f - dist);
+                        desc[counter + index_1] += mag * dist;
+                    }
+                }
+
+                counter += nBin;
+            }
+        }
+
+        finalize(desc);
+    }
+
 public:
 
     SIFTDescriptor(float thr_weak = 0.01f, int patchSize = 16, int subPatchSize = 4, int nBin = 8)
@@ -83,6 +225,11 @@ public:
         }
         sector_angle_orientation = C_PI_2 / 36.0f;
 
+        int r = MAX(half_patchSize, subPatchSize_sq - half_patchSize);
+        weights.resize(2 * r * r + 1);
+        for(unsigned int i = 0; i < weights.size(); i++) {
+            weights[i] = expf(-float(i) / sigma_sq_2);
+        }
     }
 
     /**
@@ -106,9 +253,6 @@ public:
         float orientation[36];
         Arrayf::assign(0.0f, orientation, 36);
 
-        int nBin = 36;
-        float nBinf = float(nBin);
-
         for(int i = 0; i < patchSize; i ++) {
             int y_local = i - half_patchSize;
             int y = y_local + y0;
@@ -125,16 +269,10 @@ public:
                 angle = CLAMPi(angle, 0.0f, C_PI_2);
 
                 //place it in the bin
-                float index_f = nBinf * (angle / C_PI_2);
-                int index = int(floorf(index_f));
-                int index_1 = (index + 1) % nBin;
-
-                float dist = (angle - reference_angles_orientation[index]) / sector_angle_orientation;
-                dist = CLAMPi(dist, 0.0f, 1.0f);
+                int index, index_1;
+                float dist = getBin(angle, 36, reference_angles_orientation, sector_angle_orientation, index, index_1);
 
-                int squared = x_local * x_local + y_local * y_local;
-
-                float mag = grad[2] * expf(-float(squared) / sigma_sq_2);
+                float mag = grad[2] * weights[x_local * x_local + y_local * y_local];
 
                 orientation[index]   += mag * (1.0f - dist);
                 orientation[index_1] += mag * dist;
@@ -172,13 +310,14 @@ public:
         float cosAngle = cosf(-kp_angle);
         float sinAngle = sinf(-kp_angle);
 
-        //compute the descriptor
+        //compute the descriptor; it has subPatchSize x subPatchSize
+        //blocks of subPatchSize x subPatchSize pixels
         int counter = 0;
 
-        for(int i = 0; i < patchSize; i += subPatchSize) {
+        for(int i = 0; i < subPatchSize_sq; i += subPatchSize) {
             int tmp_y = y0 + i - half_patchSize;
 
-            for(int j = 0; j < patchSize; j += subPatchSize) {
+            for(int j = 0; j < subPatchSize_sq; j += subPatchSize) {
                 int tmp_x = x0 + j - half_patchSize;
 
                 for(int k = 0; k < subPatchSize; k++) {
@@ -202,18 +341,13 @@ public:
                         angle = CLAMPi(angle, 0.0f, C_PI_2);
 
                         //find the bin
-                        float index_f = nBinf * (angle / C_PI_2);
-                        int index = int(floorf(index_f));
-                        int index_1 = (index + 1) % nBin;
-
-                        float dist = (angle - reference_angles[index]) / sector_angle;
-                        dist = CLAMPi(dist, 0.0f, 1.0f);
+                        int index, index_1;
+                        float dist = getBin(angle, nBin, reference_angles, sector_angle, index, index_1);
 
                         int y_local = i + k - half_patchSize;
                         int x_local = j + l - half_patchSize;
-                        int squared = x_local * x_local + y_local * y_local;
 
-                        float mag = grad[2] * expf(-float(squared) / sigma_sq_2);
+                        float mag = grad[2] * weights[x_local * x_local + y_local * y_local];
 
                         desc[counter + index]   += mag * (1.0f - dist);
                         desc[counter + index_1] += mag * dist;
@@ -225,20 +359,106 @@ public:
             }
         }
 
-        //normalize desc
-        Array<float>::normalize(desc, tot);
+        finalize(desc);
 
-        //remove strong edges; i.e., over 0.2
-        for(int i = 0; i < tot; i++) {
-            desc[i] = desc[i] > 0.2f ? desc[i] : 0.2f;
+        return desc;
+    }
+
+    /**
+     * @brief getPlanes computes the orientation and magnitude planes of
+     * a gradient image (the first frame), which are shared by all keypoints.
+     * @param imgGrad
+     * @param planes
+     */
+    static void getPlanes(Image *imgGrad, std::vector<float> &planes)
+    {
+        int width = imgGrad->width;
+        planes.resize(size_t(imgGrad->width) * imgGrad->height * 2);
+
+        ThreadPool::getInstance()->parallelFor(0, imgGrad->height, [&](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                for(int x = 0; x < width; x++) {
+                    float *grad = (*imgGrad)(x, y);
+                    float *p = &planes[(size_t(y) * width + x) * 2];
+
+                    float angle = atan2f(grad[1], grad[0]);
+                    angle = (angle >= 0.0f) ? angle : angle + C_PI_2;
+                    p[0] = CLAMPi(angle, 0.0f, C_PI_2);
+                    p[1] = grad[2];
+                }
+            }
+        }, 16);
+    }
+
+#ifndef PIC_DISABLE_EIGEN
+    /**
+     * @brief getAll computes the descriptors of all corners in parallel.
+     * Gradient orientations are computed once per pixel, so results can
+     * slightly differ from get.
+     * @param imgGrad is the gradient of the input image.
+     * @param corners
+     * @param descs is the output; it is a contiguous array of
+     * corners.size() descriptors. If it is NULL, memory will be allocated.
+     * @return it returns a pointer to the descriptors.
+     */
+    float *getAll(Image *imgGrad, std::vector< Eigen::Vector2f > &corners, float *descs = NULL)
+    {
+        if((imgGrad == NULL) || corners.empty()) {
+            return descs;
         }
 
-        //re-normalize desc
-        Array<float>::normalize(desc, tot);
+        if(descs == NULL) {
+            descs = new float[corners.size() * tot];
+        }
 
-        return desc;
+        std::vector<float> planes;
+        getPlanes(imgGrad, planes);
+
+        int width = imgGrad->width;
+        int height = imgGrad->height;
+
+        ThreadPool::getInstance()->parallelFor(0, int(corners.size()), [&](int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                getFromPlanes(&planes[0], width, height, int(corners[i][0]), int(corners[i][1]),
+                              &descs[size_t(i) * tot]);
+            }
+        }, 32);
+
+        return descs;
     }
 
+    /**
+     * @brief getAll computes the descriptors of all corners in parallel;
+     * each descriptor is allocated as with get.
+     * @param imgGrad is the gradient of the input image.
+     * @param corners
+     * @param descs
+     */
+    void getAll(Image *imgGrad, std::vector< Eigen::Vector2f > &corners, std::vector< float* > &descs)
+    {
+        descs.clear();
+
+        if(imgGrad == NULL) {
+            return;
+        }
+
+        std::vector<float> planes;
+        getPlanes(imgGrad, planes);
+
+        int width = imgGrad->width;
+        int height = imgGrad->height;
+
+        descs.resize(corners.size(), NULL);
+
+        ThreadPool::getInstance()->parallelFor(0, int(corners.size()), [&](int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                descs[i] = new float[tot];
+                getFromPlanes(&planes[0], width, height, int(corners[i][0]), int(corners[i][1]), descs[i]);
+            }
+        }, 32);
+    }
+#endif
+
     /***match: matches two descriptors*/
     static float match(float *fv0, float *fv1, int nfv)
     {
@@ -253,4 +473,3 @@ public:
 } // end namespace NSF
 
 #endif /* NSF_SIFT_DESCRIPTOR_HPP */
-
@@ -35,6 +35,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "filtering/filter_bilateral_2das.hpp"
 #include "filtering/filter_bilateral_2df.hpp"
 #include "filtering/filter_bilateral_2dg.hpp"
+#include "filtering/filter_bilateral_2dpl.hpp"
 #include "filtering/filter_bilateral_2ds.hpp"
 #include "filtering/filter_bilateral_2dsp.hpp"
 #include "filtering/filter_channel.hpp"
@@ -75,6 +76,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "filtering/filter_demosaic.hpp"
 #include "filtering/filter_normal.hpp"
 #include "filtering/filter_npasses.hpp"
+#include "filtering/filter_stream.hpp"
+#include "filtering/filter_graph.hpp"
 #include "filtering/filter_nswe.hpp"
 #include "filtering/filter_zero_crossing.hpp"
 #include "filtering/filter_remove_nuked.hpp"
@@ -18,21 +18,21 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_HPP
 #define PIC_FILTERING_FILTER_HPP
 
-#ifndef PIC_DISABLE_THREAD
-#include <thread>
-#endif
-
 #include <functional>
 
 #include "../image.hpp"
 #include "../image_vec.hpp"
 #include "../util/tile_list.hpp"
+#include "../util/thread_pool.hpp"
 #include "../util/string.hpp"
 
 namespace pic {
 
-//NOTE: This depends on the architecture!
+//NOTE: This depends on the architecture! It is the default tile size;
+//each filter can override it with Filter::setTileSize.
+#ifndef TILE_SIZE
 #define TILE_SIZE 64
+#endif
 
 struct FilterFData
 {
@@ -44,17 +44,46 @@ struct FilterFData
     int nSrc;
 };
 
+#define PIC_FILTER_SPAN_MAX_SRC 4
+
+/**
+ * @brief The FilterSpanData struct describes a contiguous run of n pixels
+ * of a row starting at (x, y, z). out and in[i] point to the first pixel
+ * of the span in the output and i-th input images.
+ */
+struct FilterSpanData
+{
+    int x, y, z, n;
+
+    float *out;
+    int outChannels;
+
+    float *in[PIC_FILTER_SPAN_MAX_SRC];
+    int inChannels[PIC_FILTER_SPAN_MAX_SRC];
+    int nSrc;
+
+    ImageVec *src;
+};
+
 /**
  * @brief The Filter class
  */
 class Filter
 {
+    friend class FilterGraph;
+
 protected:
     float scale;
     std::vector< float > param_f;
 
     int minInputImages;
 
+    int tileSize;
+    TILE_ORDER tileOrder;
+
+    //if true, the default ProcessBBox calls fSpan once per row span
+    bool bSpan;
+
     /**
      * @brief checkInput
      * @param imgIn
@@ -71,6 +100,75 @@ protected:
 
     }
 
+    /**
+     * @brief fSpan is the row kernel of point-wise filters; it has to process
+     * data->n contiguous pixels. It is called when bSpan is true.
+     * @param data
+     */
+    virtual void fSpan(FilterSpanData *data)
+    {
+
+    }
+
+    /**
+     * @brief ProcessBBoxSpan calls fSpan for each row of box. When inputs
+     * do not have the output size, fSpan is called per pixel with
+     * clamped coordinates.
+     * @param dst
+     * @param src
+     * @param box
+     */
+    void ProcessBBoxSpan(Image *dst, ImageVec &src, BBox *box)
+    {
+        FilterSpanData s_data;
+        s_data.src = &src;
+        s_data.outChannels = dst->channels;
+        s_data.nSrc = MIN(int(src.size()), PIC_FILTER_SPAN_MAX_SRC);
+
+        bool bRows = true;
+        for(int i = 0; i < s_data.nSrc; i++) {
+            s_data.inChannels[i] = src[i]->channels;
+            bRows = bRows && (src[i]->width == dst->width) &&
+                             (src[i]->height == dst->height) &&
+                             (src[i]->frames >= box->z1);
+        }
+
+        int width = box->x1 - box->x0;
+
+        for(int k = box->z0; k < box->z1; k++) {
+            s_data.z = k;
+
+            for(int j = box->y0; j < box->y1; j++) {
+                s_data.y = j;
+
+                if(bRows) {
+                    s_data.x = box->x0;
+                    s_data.n = width;
+                    s_data.out = (*dst)(box->x0, j, k);
+
+                    for(int l = 0; l < s_data.nSrc; l++) {
+                        s_data.in[l] = (*src[l])(box->x0, j, k);
+                    }
+
+                    fSpan(&s_data);
+                } else {
+                    s_data.n = 1;
+
+                    for(int i = box->x0; i < box->x1; i++) {
+                        s_data.x = i;
+                        s_data.out = (*dst)(i, j, k);
+
+                        for(int l = 0; l < s_data.nSrc; l++) {
+                            s_data.in[l] = (*src[l])(i, j, k);
+                        }
+
+                        fSpan(&s_data);
+                    }
+                }
+            }
+        }
+    }
+
     /**
      * @brief ProcessBBox
      * @param dst
@@ -79,6 +177,11 @@ protected:
      */
     virtual void ProcessBBox(Image *dst, ImageVec src, BBox *box)
     {
+        if(bSpan) {
+            ProcessBBoxSpan(dst, src, box);
+            return;
+        }
+
         FilterFData f_data;
         f_data.src = src;
         f_data.dst = dst;
@@ -129,6 +232,9 @@ public:
         minInputImages = 1;
         cachedOnly = false;
         scale = 1.0f;
+        tileSize = TILE_SIZE;
+        tileOrder = TO_ROW_MAJOR;
+        bSpan = false;
     }
 
     ~Filter()
@@ -151,6 +257,27 @@ public:
      */
     virtual void changePass(int pass, int tPass) {}
 
+    /**
+     * @brief getHalo returns how far from a pixel the filter reads its inputs;
+     * it is used when images are processed in bands of rows (see FilterStream).
+     * @return It returns the halo in pixels, or -1 if it is unknown.
+     */
+    virtual int getHalo()
+    {
+        return bSpan ? 0 : -1;
+    }
+
+    /**
+     * @brief isPointWise returns true if each output pixel depends only on
+     * the input pixels at the same position and if OutputSize reads only
+     * the size of the inputs; such filters can be fused by FilterGraph.
+     * @return
+     */
+    virtual bool isPointWise()
+    {
+        return bSpan && (getHalo() == 0);
+    }
+
     /**
      * @brief signature returns the signature for the filter.
      * @return
@@ -258,6 +385,26 @@ public:
         }
     }
 
+    /**
+     * @brief setTileSize sets the size of the tiles processed by each thread.
+     * @param tileSize is the width and height of a tile in pixels.
+     * @param tileOrder is the order in which tiles are dispensed to threads.
+     */
+    void setTileSize(int tileSize, TILE_ORDER tileOrder = TO_ROW_MAJOR)
+    {
+        this->tileSize = tileSize > 0 ? tileSize : TILE_SIZE;
+        this->tileOrder = tileOrder;
+    }
+
+    /**
+     * @brief getTileSize
+     * @return This function returns the size of the tiles in pixels.
+     */
+    int getTileSize()
+    {
+        return tileSize;
+    }
+
     /**
      * @brief setFloatParameters sets float parameters.
      * @param param_f
@@ -335,49 +482,40 @@ PIC_INLINE Image *Filter::cachedProcess(ImageVec imgIn, Image *imgOut,
 PIC_INLINE void Filter::ProcessAux(ImageVec imgIn, Image *imgOut,
                                     TileList *tiles)
 {
-    bool state = true;
-    while(state) {
-        unsigned int currentTile = tiles->getNext();
-
-        if(currentTile < tiles->tiles.size()) {
-            BBox box = tiles->getBBox(currentTile);
+    //tiles are claimed in small batches to reduce contention on the counter
+    uint batch = tiles->size() / uint(ThreadPool::getInstance()->getNumThreads() * 16);
+    batch = batch > 0 ? batch : 1;
+
+    uint first = 0;
+    uint n = 0;
+    while((n = tiles->getNextBatch(batch, first)) > 0) {
+        for(uint k = 0; k < n; k++) {
+            BBox box = tiles->getBBox(tiles->getScheduled(first + k));
             box.z0 = 0;
             box.z1 = imgOut->frames;
             ProcessBBox(imgOut, imgIn, &box);
-        } else {
-            state = false;
         }
     }
 }
 
 PIC_INLINE Image *Filter::ProcessP(ImageVec imgIn, Image *imgOut)
 {
-    if((imgOut->width  < TILE_SIZE) &&
-       (imgOut->height < TILE_SIZE)) {
+    if((imgOut->width  < tileSize) &&
+       (imgOut->height < tileSize)) {
         BBox box(imgOut->width, imgOut->height, imgOut->frames);
 
         ProcessBBox(imgOut, imgIn, &box);
         return imgOut;
     }
 
-    //create threads
-    int numCores = std::thread::hardware_concurrency();
-
-    std::thread **thrd = new std::thread*[numCores];
-    TileList lst(TILE_SIZE, imgOut->width, imgOut->height);
-
-    for(int i = 0; i < numCores; i++) {
-        thrd[i] = new std::thread(
-            std::bind(&Filter::ProcessAux, this, imgIn, imgOut, &lst));
-    }
-
-    //join threads
-    for(int i = 0; i < numCores; i++) {
-        thrd[i]->join();
-        delete thrd[i];
-    }
+    //run one tile consumer per thread of the pool
+    ThreadPool *pool = ThreadPool::getInstance();
+    TileList lst(tileSize, imgOut->width, imgOut->height);
+    lst.setOrder(tileOrder);
 
-    delete[] thrd;
+    pool->run(pool->getNumThreads(), [this, &imgIn, imgOut, &lst](int) {
+        ProcessAux(imgIn, imgOut, &lst);
+    });
 
     return imgOut;
 }
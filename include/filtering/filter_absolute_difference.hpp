@@ -30,16 +30,35 @@ class FilterAbsoluteDifference: public Filter
 protected:
 
     /**
-     * @brief f
+     * @brief fSpan
      * @param data
      */
-    void f(FilterFData *data)
+    void fSpan(FilterSpanData *data)
     {
-        float *dataIn0 = (*data->src[0])(data->x, data->y);
-        float *dataIn1 = (*data->src[1])(data->x, data->y);
-
-        for(int k = 0; k < data->dst->channels; k++) {
-            data->out[k] = fabsf(dataIn1[k] - dataIn0[k]);
+        float *out = data->out;
+        float *in0 = data->in[0];
+        float *in1 = data->in[1];
+        int channels = data->outChannels;
+        int channels0 = data->inChannels[0];
+        int channels1 = data->inChannels[1];
+
+        if((channels0 == channels) && (channels1 == channels)) {
+            int n = data->n * channels;
+
+            for(int i = 0; i < n; i++) {
+                out[i] = fabsf(in1[i] - in0[i]);
+            }
+        } else {
+            //an input with fewer channels repeats its last one
+            for(int i = 0; i < data->n; i++) {
+                float *out_i = &out[i * channels];
+                float *in0_i = &in0[i * channels0];
+                float *in1_i = &in1[i * channels1];
+
+                for(int k = 0; k < channels; k++) {
+                    out_i[k] = fabsf(in1_i[MIN(k, channels1 - 1)] - in0_i[MIN(k, channels0 - 1)]);
+                }
+            }
         }
     }
 
@@ -50,7 +69,8 @@ public:
      */
     FilterAbsoluteDifference() : Filter()
     {
-
+        minInputImages = 2;
+        bSpan = true;
     }
 
     /**
@@ -18,6 +18,9 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_ASSEMBLE_HDR_HPP
 #define PIC_FILTERING_FILTER_ASSEMBLE_HDR_HPP
 
+#include <vector>
+#include <algorithm>
+
 #include "../filtering/filter.hpp"
 
 #include "../util/array.hpp"
@@ -48,40 +51,45 @@ protected:
     CRF_WEIGHT weight_type;
     float delta_value;
 
+    std::vector<CRF_WEIGHT> weight_type_vec;
+    std::vector<float> lut;
+    int lut_size;
+
     /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
+     * @brief linearize removes the CRF from x using the LUT.
+     * @param x
+     * @param channel
+     * @return
      */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
+    inline float linearize(float x, int channel)
     {
-        int width = dst->width;
-        int channels = dst->channels;
+        float t = CLAMPi(x, 0.0f, 1.0f) * float(lut_size - 1);
+        int i = MIN(int(t), lut_size - 2);
+        float a = t - float(i);
 
-        int n = int(src.size());
+        const float *l = &lut[channel * lut_size + i];
+        return l[0] + a * (l[1] - l[0]);
+    }
 
-        float t_min = src[0]->exposure;
-        int i_min = 0;
+    /**
+     * @brief setupAux
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *setupAux(ImageVec imgIn, Image *imgOut)
+    {
+        imgOut = allocateOutputMemory(imgIn, imgOut, bDelete);
 
-        float t_max = src[0]->exposure;
-        int i_max = 0;
+        std::vector<float> exposures;
+        ImageVecGetExposureTimesAsArray(imgIn, exposures, false);
+
+        int i_min, i_max;
+        getExposureRange(exposures, i_min, i_max);
 
-        for(int j = 1; j < n; j++) {
-            if(src[j]->exposure < t_min) {
-                t_min = src[j]->exposure;
-                i_min = j;
-            }
-            
-            if(src[j]->exposure > t_max) {
-                t_max = src[j]->exposure;
-                i_max = j;
-            }
-        }
-        
         //check i_min
         bool bMin = false;
-        Image *img_min = src[i_min];
+        Image *img_min = imgIn[i_min];
         for(int i = 0; i < img_min->size(); i++) {
             if(img_min->data[i] > 0.9f) {
                 bMin = true;
@@ -91,7 +99,7 @@ protected:
 
         //check i_max
         bool bMax = false;
-        Image *img_max = src[i_max];
+        Image *img_max = imgIn[i_max];
         for(int i = 0; i < img_max->size(); i++) {
             if(img_max->data[i] < 0.1f) {
                 bMax = true;
@@ -99,79 +107,43 @@ protected:
             }
         }
 
-        CRF_WEIGHT *weight_type_arr = new CRF_WEIGHT[n];
-        for(int l = 0; l < n; l++) {
+        setupWeights(exposures, bMin, bMax);
+        setupLUT(imgIn[0]->channels);
 
-            weight_type_arr[l] = weight_type;
+        return imgOut;
+    }
 
-            if((l == i_min) && bMin) {
-                weight_type_arr[l] = CW_IDENTITY;
-            }
+    /**
+     * @brief ProcessBBox
+     * @param dst
+     * @param src
+     * @param box
+     */
+    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
+    {
+        int width = dst->width;
+        int channels = dst->channels;
 
-            if((l == i_max) && bMax) {
-                weight_type_arr[l] = CW_REVERSE;
-            }
-        }
+        int n = int(src.size());
+        int nPixels = box->x1 - box->x0;
 
-        float *acc = new float[channels];
-        float *totWeight = new float[channels];
+        std::vector<float> acc(nPixels * channels);
+        std::vector<float> totWeight(nPixels);
 
         for(int j = box->y0; j < box->y1; j++) {
-            int ind = j * width;
-
-            for(int i = box->x0; i < box->x1; i++) {
-                int c = (ind + i) * channels;
-
-                Arrayf::assign(0.0f, acc, channels);
-                Arrayf::assign(0.0f, totWeight, channels);
-
-                //for each exposure...
-
-                for(int l = 0; l < n; l++) {
-
-                    float x = Arrayf::sum(&src[l]->data[c], channels) / dst->channelsf;
-                    
-                    float weight = weightFunction(x, weight_type_arr[l]);
-
-                    if(domain == HRD_SQ) {
-                        weight *= (src[l]->exposure * src[l]->exposure);
-                    }
-
-                    for(int k = 0; k < channels; k++) {
-                        float x_lin = crf->remove(src[l]->data[c + k], k);
+            int c = (j * width + box->x0) * channels;
 
-                        //merge HDR pixels
-                        switch(domain) {
-                            case HRD_LIN: {
-                                acc[k] += (weight * x_lin) / src[l]->exposure;
-                            } break;
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            std::fill(totWeight.begin(), totWeight.end(), 0.0f);
 
-                            case HRD_LOG: {
-                                acc[k] += weight * (logf(x_lin + delta_value) - logf(src[l]->exposure));
-                            } break;
-
-                            case HRD_SQ: {
-                                acc[k] += (weight * x_lin) * src[l]->exposure;
-                            } break;
-                        }
-
-                        totWeight[k] += weight;
-                    }
-                }
-
-                for(int k = 0; k < channels; k++) {
-                    acc[k] /= totWeight[k];
-                    if(domain == HRD_LOG) {
-                        acc[k] = expf(acc[k]);
-                    }
-                    dst->data[c + k] = acc[k];
-                }
+            //for each exposure...
+            for(int l = 0; l < n; l++) {
+                accumulate(&src[l]->data[c], nPixels, channels, src[l]->exposure,
+                           weight_type_vec[l], &acc[0], &totWeight[0]);
             }
-        }
 
-        delete[] weight_type_arr;
-        delete[] totWeight;
-        delete[] acc;
+            normalize(&acc[0], &totWeight[0], nPixels, channels, &dst->data[c]);
+        }
     }
 
 public:
@@ -187,6 +159,8 @@ public:
         update(crf, weight_type, domain);
         minInputImages = 2;
 
+        lut_size = 4096;
+
         //a numerical stability value when assembling images in the log-domain
         this->delta_value = 1.0f / 65535.0f;
     }
@@ -205,6 +179,159 @@ public:
 
         this->domain = domain;
     }
+
+    /**
+     * @brief getExposureRange
+     * @param exposures
+     * @param i_min is the index of the shortest exposure.
+     * @param i_max is the index of the longest exposure.
+     */
+    static void getExposureRange(std::vector<float> &exposures, int &i_min, int &i_max)
+    {
+        i_min = 0;
+        i_max = 0;
+
+        for(int j = 1; j < int(exposures.size()); j++) {
+            if(exposures[j] < exposures[i_min]) {
+                i_min = j;
+            }
+
+            if(exposures[j] > exposures[i_max]) {
+                i_max = j;
+            }
+        }
+    }
+
+    /**
+     * @brief setupWeights sets the weight function of each exposure. The
+     * shortest exposure weights bright pixels more if bMin is true, and the
+     * longest one weights dark pixels more if bMax is true.
+     * @param exposures
+     * @param bMin is true if the shortest exposure has values over 0.9.
+     * @param bMax is true if the longest exposure has values below 0.1.
+     */
+    void setupWeights(std::vector<float> &exposures, bool bMin, bool bMax)
+    {
+        int i_min, i_max;
+        getExposureRange(exposures, i_min, i_max);
+
+        int n = int(exposures.size());
+        weight_type_vec.assign(n, weight_type);
+
+        for(int l = 0; l < n; l++) {
+            if((l == i_min) && bMin) {
+                weight_type_vec[l] = CW_IDENTITY;
+            }
+
+            if((l == i_max) && bMax) {
+                weight_type_vec[l] = CW_REVERSE;
+            }
+        }
+    }
+
+    /**
+     * @brief getWeightType
+     * @param l
+     * @return It returns the weight function of the l-th exposure.
+     */
+    CRF_WEIGHT getWeightType(int l)
+    {
+        return weight_type_vec.at(l);
+    }
+
+    /**
+     * @brief setupLUT samples the inverse CRF in a LUT; values are
+     * linearly interpolated between samples.
+     * @param channels
+     */
+    void setupLUT(int channels)
+    {
+        lut.resize(channels * lut_size);
+
+        float div = float(lut_size - 1);
+        for(int k = 0; k < channels; k++) {
+            for(int i = 0; i < lut_size; i++) {
+                float x = float(i) / div;
+                lut[k * lut_size + i] = (crf != NULL) ? crf->remove(x, k) : x;
+            }
+        }
+    }
+
+    /**
+     * @brief accumulate adds an exposure to the weighted sums of a run of
+     * pixels; setupLUT has to be called before.
+     * @param data is the exposure (nPixels * channels values).
+     * @param nPixels
+     * @param channels
+     * @param exposure is the exposure time.
+     * @param type is the weight function of the exposure.
+     * @param acc is the sum of the weighted radiance (nPixels * channels values).
+     * @param totWeight is the sum of the weights (nPixels values).
+     */
+    void accumulate(float *data, int nPixels, int channels, float exposure,
+                    CRF_WEIGHT type, float *acc, float *totWeight)
+    {
+        float channelsf = float(channels);
+        float log_exposure = logf(exposure);
+
+        for(int i = 0; i < nPixels; i++) {
+            float *p = &data[i * channels];
+            float *a = &acc[i * channels];
+
+            float x = Arrayf::sum(p, channels) / channelsf;
+
+            float weight = weightFunction(x, type);
+
+            if(domain == HRD_SQ) {
+                weight *= (exposure * exposure);
+            }
+
+            for(int k = 0; k < channels; k++) {
+                float x_lin = linearize(p[k], k);
+
+                //merge HDR pixels
+                switch(domain) {
+                    case HRD_LIN: {
+                        a[k] += (weight * x_lin) / exposure;
+                    } break;
+
+                    case HRD_LOG: {
+                        a[k] += weight * (logf(x_lin + delta_value) - log_exposure);
+                    } break;
+
+                    case HRD_SQ: {
+                        a[k] += (weight * x_lin) * exposure;
+                    } break;
+                }
+            }
+
+            totWeight[i] += weight;
+        }
+    }
+
+    /**
+     * @brief normalize computes the HDR values from the weighted sums.
+     * @param acc
+     * @param totWeight
+     * @param nPixels
+     * @param channels
+     * @param out (nPixels * channels values); it can be acc.
+     */
+    void normalize(float *acc, float *totWeight, int nPixels, int channels, float *out)
+    {
+        for(int i = 0; i < nPixels; i++) {
+            for(int k = 0; k < channels; k++) {
+                int c = i * channels + k;
+                float value = acc[c] / totWeight[i];
+
+                if(domain == HRD_LOG) {
+                    value = expf(value);
+                }
+
+                out[c] = value;
+            }
+        }
+    }
 };
 
 } // end namespace pic
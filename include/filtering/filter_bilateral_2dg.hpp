@@ -18,47 +18,69 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_BILATERAL_2DG_HPP
 #define PIC_FILTERING_FILTER_BILATERAL_2DG_HPP
 
-//#define BILATERAL_GRID_MULTI_PASS
+#include <vector>
 
 #include "../util/std_util.hpp"
+#include "../util/thread_pool.hpp"
+#include "../util/precomputed_gaussian.hpp"
 
 #include "../filtering/filter.hpp"
-#include "../filtering/filter_gaussian_3d.hpp"
-#include "../image_samplers/image_sampler_bilinear.hpp"
 
 namespace pic {
 
 /**
- * @brief The FilterBilateral2DG class
+ * @brief The FilterBilateral2DG class is the bilateral grid. The grid is
+ * stored as a list of range slabs, and only the slabs that are populated
+ * (or reached by the blur) are allocated, so memory does not depend on
+ * sigma_r but on the number of distinct range values.
  */
 class FilterBilateral2DG: public Filter
 {
 protected:
-    ImageSamplerBilinear isb;
-    FilterGaussian3D *fltG;
-    int width, height, range;
+    PrecomputedGaussian *pg;
+    int width, height, range, nSlabs;
     float sigma_s, sigma_r;
+    float minE;
 
-    Image *grid, *gridBlur;
-    bool parallel;
+    std::vector< std::vector<float> > grid, gridBlur;
+
+    /**
+     * @brief getRange
+     * @param edge
+     * @param edgeChannels
+     * @return This function returns the range coordinate of a pixel
+     * in the grid.
+     */
+    inline float getRange(float *edge, int edgeChannels)
+    {
+        float E = 0.0f;
+
+        for(int k = 0; k < edgeChannels; k++) {
+            E += edge[k];
+        }
+
+        return (E - minE) * mul_E;
+    }
 
     /**
      * @brief Splat splats values into the grid.
      * @param base
      * @param edge
-     * @param channel
-     * @return
      */
-    Image *Splat(Image *base, Image *edge, int channel);
+    void Splat(Image *base, Image *edge);
+
+    /**
+     * @brief Blur blurs the grid with a separable Gaussian kernel.
+     * @param channels
+     */
+    void Blur(int channels);
 
     /**
      * @brief Slice slices the grid into the output image
      * @param out
-     * @param base
      * @param edge
-     * @param channels
      */
-    void Slice(Image *out, Image *base, Image *edge, int channels);
+    void Slice(Image *out, Image *edge);
 
 public:
 
@@ -82,6 +104,16 @@ public:
         return genBilString("G", sigma_s, sigma_r);
     }
 
+    /**
+     * @brief getNumberOfSlabs
+     * @return This function returns the number of allocated range slabs
+     * of the last Process.
+     */
+    int getNumberOfSlabs()
+    {
+        return nSlabs;
+    }
+
     /**
      * @brief Process
      * @param imgIn
@@ -105,7 +137,7 @@ public:
 
         //long t0 = timeGetTime();
 
-        imgOut = filter.Process(Single(imgIn), NULL); //Filtering
+        imgOut = filter.Process(Single(imgIn), imgOut); //Filtering
 
         //long t1 = timeGetTime();
         //printf("Bilateral Grid Filter time: %f\n", float(t1 - t0) / 1000.0f);
@@ -120,150 +152,272 @@ PIC_INLINE FilterBilateral2DG::FilterBilateral2DG(float sigma_s, float sigma_r)
     this->sigma_s = sigma_s;
     this->sigma_r = sigma_r;
 
-    parallel = false;
+    width = height = range = nSlabs = 0;
+    minE = 0.0f;
 
-    grid = NULL;
-    gridBlur = NULL;
-
-    fltG = new FilterGaussian3D(1.0f);
+    pg = new PrecomputedGaussian(1.0f);
 }
 
 PIC_INLINE FilterBilateral2DG::~FilterBilateral2DG()
 {
-    delete_s(grid);
-    delete_s(gridBlur);
-    delete_s(fltG);
+    delete_s(pg);
 }
 
-PIC_INLINE Image *FilterBilateral2DG::Splat(Image *base, Image *edge, int channels)
+PIC_INLINE void FilterBilateral2DG::Splat(Image *base, Image *edge)
 {
-    if(grid == NULL) {
-        #ifdef PIC_DEBUG
-            printf("S Rate: %f R Rate: %f Mul E: %f\n", s_S, s_R, mul_E);
-        #endif
-
-        width =  int(ceilf(float(base->width) * s_S));
-        height = int(ceilf(float(base->height) * s_S));
-        range =  int(ceilf(s_R));
-
-        #ifdef PIC_DEBUG
-            printf("Grid Size: %d %d %d\n", width, height, range);
-        #endif
-
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-        #ifdef PIC_DEBUG
-        printf("Grid - Memory Mb: %3.2f\n",
-               float(width + 1)*float(height + 1)*float(range + 1) * 8.0f /
-               (1024.0f * 1024.0f));
-        #endif
-
-        grid = new Image(range + 1, width + 1, height + 1, 2);
-        gridBlur = new Image(range + 1, width + 1, height + 1, 2);
-#else
-        #ifdef PIC_DEBUG
-        printf("Grid - Memory Mb: %3.2f\n",
-               float(width + 1)*float(height + 1)*float(range + 1) * 16.0f /
-               (1024.0f * 1024.0f));
-        #endif
-
-        grid = new Image(range + 1, width + 1, height + 1, base->channels + 1);
-        gridBlur = new Image(range + 1, width + 1, height + 1, base->channels + 1);
-#endif
+    int channels = base->channels;
+    int gChannels = channels + 1;
+    int edgeChannels = edge->channels;
+
+    width =  int(ceilf(float(base->width) * s_S));
+    height = int(ceilf(float(base->height) * s_S));
+
+    ThreadPool *tp = ThreadPool::getInstance();
+
+    //range bins of the pixels
+    std::vector<int> bins(base->width * base->height);
+
+    tp->parallelFor(0, base->height, [&](int j0, int j1) {
+        for(int j = j0; j < j1; j++) {
+            for(int i = 0; i < base->width; i++) {
+                int r = int(lround(getRange((*edge)(i, j), edgeChannels)));
+                bins[j * base->width + i] = MAX(r, 0);
+            }
+        }
+    }, 16);
+
+    range = 0;
+    for(unsigned int i = 0; i < bins.size(); i++) {
+        range = MAX(range, bins[i]);
     }
 
-    grid->setZero();
+    //populated slabs and their neighbors within the blur kernel
+    std::vector<bool> populated(range + 1, false);
+    for(unsigned int i = 0; i < bins.size(); i++) {
+        populated[bins[i]] = true;
+    }
 
-    for(int j = 0; j < base->height; j++) {
-        int y = int(lround(float(j) * s_S));
+    int gridSize = (width + 1) * (height + 1) * gChannels;
 
-        for(int i = 0; i < base->width; i++) {
+    grid.clear();
+    grid.resize(range + 1);
+    nSlabs = 0;
 
-            int ind = i * base->xstride + j * base->ystride;
+    for(int r = 0; r <= range; r++) {
+        if(!populated[r]) {
+            continue;
+        }
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-            float E = edge->data[ind + channel];
-#else
-            float E = 0.0f;
+        for(int k = -pg->halfKernelSize; k <= pg->halfKernelSize; k++) {
+            int r_k = r + k;
 
-            for(int k = 0; k < edge->channels; k++) {
-                E += edge->data[ind + k];
+            if((r_k >= 0) && (r_k <= range) && grid[r_k].empty()) {
+                grid[r_k].assign(gridSize, 0.0f);
+                nSlabs++;
             }
+        }
+    }
 
-#endif
-            E *= mul_E;
+    #ifdef PIC_DEBUG
+        printf("Grid Size: %d %d %d Slabs: %d\n", width, height, range, nSlabs);
+    #endif
 
-            int x = int(lround(float(i) * s_S));
-            int r = int(lround(E));
+    //each task owns the image rows of a set of grid rows, so that
+    //no cell is written by two threads
+    int nTasks = MIN(height + 1, tp->getNumThreads() * 4);
+    nTasks = MAX(nTasks, 1);
 
-            int grdInd = x * grid->xstride + y * grid->ystride + r * grid->tstride;
+    tp->run(nTasks, [&](int t) {
+        int gy0 = ((height + 1) * t) / nTasks;
+        int gy1 = ((height + 1) * (t + 1)) / nTasks;
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-            grid->data[grdInd + 0] += base->data[ind + channels];
-            grid->data[grdInd + 1] += 1.0f;
-#else
+        for(int j = 0; j < base->height; j++) {
+            int y = int(lround(float(j) * s_S));
 
-            for(int k = 0; k < base->channels; k++) {
-                grid->data[grdInd + k] += base->data[ind + k];
+            if((y < gy0) || (y >= gy1)) {
+                continue;
             }
 
-            grid->data[grdInd + base->channels] += 1.0f;	//Counter
-#endif
+            for(int i = 0; i < base->width; i++) {
+                int x = int(lround(float(i) * s_S));
+                int r = bins[j * base->width + i];
+
+                float *cell = &grid[r][(y * (width + 1) + x) * gChannels];
+                float *pixel = (*base)(i, j);
+
+                for(int k = 0; k < channels; k++) {
+                    cell[k] += pixel[k];
+                }
+
+                cell[channels] += 1.0f;	//Counter
+            }
         }
-    }
-    return grid;
+    });
 }
 
-PIC_INLINE void FilterBilateral2DG::Slice(Image *out, Image *base, Image *edge,
-                               int channels)
+PIC_INLINE void FilterBilateral2DG::Blur(int channels)
 {
-    float widthf = float(grid->width);
-    float heightf = float(grid->height);
-    float rangef = float(grid->frames);
+    int gChannels = channels + 1;
+    int gWidth = width + 1;
+    int gHeight = height + 1;
+    int half = pg->halfKernelSize;
+    float *coeff = pg->coeff;
+
+    ThreadPool *tp = ThreadPool::getInstance();
+
+    //slabs along x and y; borders are clamped
+    tp->run(range + 1, [&](int r) {
+        if(grid[r].empty()) {
+            return;
+        }
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-    float vOut[2];
-#else
-    float *vOut = new float [out->channels + 1];
-#endif
+        std::vector<float> tmp(grid[r].size());
+        float *slab = &grid[r][0];
 
-    for(int j = 0; j < out->height; j++) {
-        for(int i = 0; i < out->width; i++) {
-            int ind = i * out->xstride + j * out->ystride;
+        for(int y = 0; y < gHeight; y++) {
+            for(int x = 0; x < gWidth; x++) {
+                float *out = &tmp[(y * gWidth + x) * gChannels];
 
-            float x = float(i) * s_S;
-            float y = float(j) * s_S;
+                for(int c = 0; c < gChannels; c++) {
+                    out[c] = 0.0f;
+                }
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-            float E = edge->data[ind + channels];
-#else
-            float E = Arrayf::sum(&edge->data[ind], out->channels);
+                for(int k = -half; k <= half; k++) {
+                    int x_k = CLAMP(x + k, gWidth);
+                    float *in = &slab[(y * gWidth + x_k) * gChannels];
+                    float w = coeff[k + half];
 
-#endif
-            E *= mul_E;
+                    for(int c = 0; c < gChannels; c++) {
+                        out[c] += in[c] * w;
+                    }
+                }
+            }
+        }
 
-            //Trilinear filtering
-            isb.SampleImage(gridBlur, x / widthf, y / heightf, E / rangef, vOut);
+        for(int y = 0; y < gHeight; y++) {
+            for(int x = 0; x < gWidth; x++) {
+                float *out = &slab[(y * gWidth + x) * gChannels];
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
+                for(int c = 0; c < gChannels; c++) {
+                    out[c] = 0.0f;
+                }
+
+                for(int k = -half; k <= half; k++) {
+                    int y_k = CLAMP(y + k, gHeight);
+                    float *in = &tmp[(y_k * gWidth + x) * gChannels];
+                    float w = coeff[k + half];
 
-            if(vOut[1] > 0.0f) {
-                out->data[ind + channels] = vOut[0] / vOut[1];
-            } else {
-                out->data[ind + channels] = 0.0f;
+                    for(int c = 0; c < gChannels; c++) {
+                        out[c] += in[c] * w;
+                    }
+                }
             }
+        }
+    });
+
+    //range; missing slabs are zero, and slabs are released as soon
+    //as no output slab needs them
+    gridBlur.clear();
+    gridBlur.resize(range + 1);
+
+    for(int r = 0; r <= range; r++) {
+        if(!grid[r].empty()) {
+            std::vector<float> &out = gridBlur[r];
+            out.assign(grid[r].size(), 0.0f);
 
-#else
-            if(vOut[out->channels] > 0.0f) {
-                for(int k = 0; k < out->channels; k++) {
-                    out->data[ind + k] = vOut[k] / vOut[out->channels];
+            for(int k = -half; k <= half; k++) {
+                int r_k = CLAMP(r + k, range + 1);
+
+                if(grid[r_k].empty()) {
+                    continue;
                 }
-            } else {
-                Arrayf::assign(0.0f, &out->data[ind], out->channels);
+
+                float w = coeff[k + half];
+                float *in = &grid[r_k][0];
+                float *out_data = &out[0];
+
+                tp->parallelFor(0, int(out.size()), [in, out_data, w](int i0, int i1) {
+                    for(int i = i0; i < i1; i++) {
+                        out_data[i] += in[i] * w;
+                    }
+                }, 65536);
             }
+        }
 
-#endif
+        if((r - half) > 0) {
+            std::vector<float>().swap(grid[r - half - 1]);
         }
     }
+
+    grid.clear();
+}
+
+PIC_INLINE void FilterBilateral2DG::Slice(Image *out, Image *edge)
+{
+    int channels = out->channels;
+    int gChannels = channels + 1;
+    int edgeChannels = edge->channels;
+    int gWidth = width + 1;
+
+    ThreadPool::getInstance()->parallelFor(0, out->height, [&](int j0, int j1) {
+        std::vector<float> vOut(gChannels);
+
+        for(int j = j0; j < j1; j++) {
+            float y = float(j) * s_S;
+            int y0 = MIN(int(y), height);
+            int y1 = MIN(y0 + 1, height);
+            float dy = y - float(y0);
+
+            for(int i = 0; i < out->width; i++) {
+                float x = float(i) * s_S;
+                int x0 = MIN(int(x), width);
+                int x1 = MIN(x0 + 1, width);
+                float dx = x - float(x0);
+
+                float E = getRange((*edge)(i, j), edgeChannels);
+                E = CLAMPi(E, 0.0f, float(range));
+                int r0 = MIN(int(E), range);
+                int r1 = MIN(r0 + 1, range);
+                float dr = E - float(r0);
+
+                for(int c = 0; c < gChannels; c++) {
+                    vOut[c] = 0.0f;
+                }
+
+                //trilinear interpolation
+                for(int k = 0; k < 8; k++) {
+                    int r = (k & 4) ? r1 : r0;
+
+                    if(gridBlur[r].empty()) {
+                        continue;
+                    }
+
+                    int xk = (k & 1) ? x1 : x0;
+                    int yk = (k & 2) ? y1 : y0;
+
+                    float w = ((k & 1) ? dx : (1.0f - dx)) *
+                              ((k & 2) ? dy : (1.0f - dy)) *
+                              ((k & 4) ? dr : (1.0f - dr));
+
+                    float *cell = &gridBlur[r][(yk * gWidth + xk) * gChannels];
+
+                    for(int c = 0; c < gChannels; c++) {
+                        vOut[c] += cell[c] * w;
+                    }
+                }
+
+                float *pixel = (*out)(i, j);
+
+                if(vOut[channels] > 0.0f) {
+                    for(int c = 0; c < channels; c++) {
+                        pixel[c] = vOut[c] / vOut[channels];
+                    }
+                } else {
+                    Arrayf::assign(0.0f, pixel, channels);
+                }
+            }
+        }
+    }, 8);
 }
 
 PIC_INLINE Image *FilterBilateral2DG::Process(ImageVec imgIn, Image *imgOut)
@@ -281,56 +435,32 @@ PIC_INLINE Image *FilterBilateral2DG::Process(ImageVec imgIn, Image *imgOut)
     Image *base, *edge;
 
     base = imgIn[0];
+    edge = (imgIn.size() == 2) ? imgIn[1] : imgIn[0];
 
-    int ind;
-    float *baseMaxmaxVal = base->getMaxVal(NULL, NULL);
-    float maxVal = Arrayf::getMax(baseMaxmaxVal, base->channels, ind);
-    delete[] baseMaxmaxVal;
-
-    if(imgIn.size() == 2) {
-        edge = imgIn[1];
-
-        float *edgeMaxVal = edge->getMaxVal(NULL, NULL);
-
-        maxVal = MAX(maxVal, Arrayf::getMax(edgeMaxVal, edge->channels, ind));
-
-        delete[] edgeMaxVal;
-
-        *edge /= maxVal;
-    } else {
-        edge = imgIn[0];
+    //the range axis starts at the minimum of the edge
+    float *edgeMinVal = edge->getMinVal(NULL, NULL);
+    minE = 0.0f;
+    for(int k = 0; k < edge->channels; k++) {
+        minE += edgeMinVal[k];
     }
-
-    //Range in [0,1]
-    *base /= maxVal;
-    float tmpSigma_r = sigma_r;
-    sigma_r /= maxVal;
+    delete[] edgeMinVal;
 
     //Grid's Initialization
     s_S = 1.0f / sigma_s;	//Spatial Sampling rate
     s_R = 1.0f / sigma_r; //Range Sampling rate
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-    int n = imgIn[0]->channels;
-    mul_E = s_R;
-#else
-    int n = 1;
-    mul_E = s_R / float(imgIn[0]->channels);
-#endif
+    mul_E = s_R / float(edge->channels);
 
-    for(int i = 0; i < n; i++) {
-        //splat
-        Splat(base, edge, i);
+    //splat
+    Splat(base, edge);
 
-        //blur
-        fltG->Process(Single(grid), gridBlur);
+    //blur
+    Blur(base->channels);
 
-        //slice
-        Slice(imgOut, base, edge, i);
-    }
+    //slice
+    Slice(imgOut, edge);
 
-    *imgOut *= maxVal;
-    sigma_r = tmpSigma_r;
+    gridBlur.clear();
 
     return imgOut;
 }
@@ -338,4 +468,3 @@ PIC_INLINE Image *FilterBilateral2DG::Process(ImageVec imgIn, Image *imgOut)
 } // end namespace pic
 
 #endif /* PIC_FILTERING_FILTER_BILATERAL_2DG_HPP */
-
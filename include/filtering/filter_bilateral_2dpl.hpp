@@ -0,0 +1,180 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FILTERING_FILTER_BILATERAL_2DPL_HPP
+#define PIC_FILTERING_FILTER_BILATERAL_2DPL_HPP
+
+#include "../base.hpp"
+#include "../util/string.hpp"
+#include "../util/std_util.hpp"
+#include "../util/permutohedral_lattice.hpp"
+
+#include "../filtering/filter.hpp"
+
+namespace pic {
+
+/**
+ * @brief The FilterBilateral2DPL class is a bilateral filter on the
+ * permutohedral lattice; its cost is linear in the number of pixels and
+ * the range can have any number of channels (e.g., an RGB edge image for
+ * joint filtering).
+ */
+class FilterBilateral2DPL: public Filter
+{
+protected:
+    float sigma_s, sigma_r;
+
+public:
+
+    /**
+     * @brief FilterBilateral2DPL
+     */
+    FilterBilateral2DPL() : Filter()
+    {
+        update(1.0f, 0.01f);
+    }
+
+    /**
+     * @brief FilterBilateral2DPL
+     * @param sigma_s
+     * @param sigma_r
+     */
+    FilterBilateral2DPL(float sigma_s, float sigma_r) : Filter()
+    {
+        update(sigma_s, sigma_r);
+    }
+
+    /**
+     * @brief update
+     * @param sigma_s
+     * @param sigma_r
+     */
+    void update(float sigma_s, float sigma_r)
+    {
+        this->sigma_s = sigma_s > 0.0f ? sigma_s : 1.0f;
+        this->sigma_r = sigma_r > 0.0f ? sigma_r : 0.01f;
+    }
+
+    /**
+     * @brief signature
+     * @return
+     */
+    std::string signature()
+    {
+        return genBilString("PL", sigma_s, sigma_r);
+    }
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *Process(ImageVec imgIn, Image *imgOut)
+    {
+        if(!checkInput(imgIn)) {
+            return imgOut;
+        }
+
+        imgOut = setupAux(imgIn, imgOut);
+
+        if(imgOut == NULL) {
+            return imgOut;
+        }
+
+        Image *base = imgIn[0];
+        Image *edge = (imgIn.size() > 1) ? imgIn[1] : imgIn[0];
+
+        if((edge->width != base->width) || (edge->height != base->height)) {
+            return imgOut;
+        }
+
+        int width = base->width;
+        int height = base->height;
+        int edgeChannels = edge->channels;
+
+        //positions are (x, y, edge) scaled by the inverse of the sigmas
+        float inv_s = 1.0f / sigma_s;
+        float inv_r = 1.0f / sigma_r;
+
+        PermutohedralLattice lattice(2 + edgeChannels, base->channels);
+
+        for(int f = 0; f < base->frames; f++) {
+            int f_e = MIN(f, edge->frames - 1);
+
+            lattice.init(width * height, [&](int i, float *pos) {
+                int x = i % width;
+                int y = i / width;
+
+                float *edge_data = (*edge)(x, y, f_e);
+
+                pos[0] = float(x) * inv_s;
+                pos[1] = float(y) * inv_s;
+
+                for(int c = 0; c < edgeChannels; c++) {
+                    pos[2 + c] = edge_data[c] * inv_r;
+                }
+            });
+
+            lattice.splat((*base)(0, 0, f));
+            lattice.blur();
+            lattice.slice((*imgOut)(0, 0, f));
+        }
+
+        return imgOut;
+    }
+
+    /**
+     * @brief execute
+     * @param imgIn
+     * @param sigma_s
+     * @param sigma_r
+     * @return
+     */
+    static Image *execute(Image *imgIn,
+                             float sigma_s, float sigma_r)
+    {
+        FilterBilateral2DPL filter(sigma_s, sigma_r);
+        return filter.Process(Single(imgIn), NULL);
+    }
+
+    /**
+     * @brief execute
+     * @param imgIn
+     * @param imgEdge
+     * @param sigma_s
+     * @param sigma_r
+     * @return
+     */
+    static Image *execute(Image *imgIn, Image *imgEdge,
+                             float sigma_s, float sigma_r)
+    {
+        FilterBilateral2DPL filter(sigma_s, sigma_r);
+        Image *imgOut;
+
+        if(imgEdge == NULL) {
+            imgOut = filter.Process(Single(imgIn), NULL);
+        } else {
+            imgOut = filter.Process(Double(imgIn, imgEdge), NULL);
+        }
+        return imgOut;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_FILTER_BILATERAL_2DPL_HPP */
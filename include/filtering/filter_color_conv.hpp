@@ -44,54 +44,50 @@ protected:
     bool bEven;
 
     /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
+     * @brief fSpan
+     * @param data
      */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
+    void fSpan(FilterSpanData *data)
     {
         if(n < 1) {
             return;
         }
 
-        int channels = src[0]->channels;
+        int channels = data->inChannels[0];
 
-        float *tmpCol = new float [channels];
+        float tmpBuf[16];
+        float *tmpCol = channels <= 16 ? tmpBuf : new float [channels];
         float *tmp[2];
 
-        tmp[1] = tmpCol;
+        for(int i = 0; i < data->n; i++) {
 
-        for(int j = box->y0; j < box->y1; j++) {
+            float *dataIn  = &data->in[0][i * channels];
+            float *dataOut = &data->out[i * data->outChannels];
 
-            for(int i = box->x0; i < box->x1; i++) {
-
-                float *dataIn  = (*src[0])(i, j);
-                float *dataOut = (*dst) (i, j);
+            if(bEven) {
+                tmp[1] = dataOut;
+                tmp[0] = tmpCol;
+            } else {
+                tmp[0] = dataOut;
+                tmp[1] = tmpCol;
+            }
 
-                if(bEven) {
-                    tmp[1] = dataOut;
-                    tmp[0] = tmpCol;
-                } else {
-                    tmp[0] = dataOut;
-                    tmp[1] = tmpCol;
+            if(bDirection) { //direct color transform
+                list[0].f->transform(dataIn, tmp[0], list[0].bDirection);
+                for(unsigned int k = 1; k < n; k++) {
+                    list[k].f->transform(tmp[(k + 1) % 2], tmp[k % 2], list[k].bDirection);
                 }
-
-                if(bDirection) { //direct color transform
-                    list[0].f->transform(dataIn, tmp[0], list[0].bDirection);
-                    for(unsigned int k = 1; k < n; k++) {
-                        list[k].f->transform(tmp[(k + 1) % 2], tmp[k % 2], list[k].bDirection);
-                    }
-                } else { //inverse color transform
-                    list[n - 1].f->transform(dataIn, tmp[0], !list[n - 1].bDirection);
-                    for(unsigned int k = 1; k < n; k++) {
-                        list[n - k - 1].f->transform(tmp[(k + 1) % 2], tmp[k % 2], !list[n - k - 1].bDirection);
-                    }
+            } else { //inverse color transform
+                list[n - 1].f->transform(dataIn, tmp[0], !list[n - 1].bDirection);
+                for(unsigned int k = 1; k < n; k++) {
+                    list[n - k - 1].f->transform(tmp[(k + 1) % 2], tmp[k % 2], !list[n - k - 1].bDirection);
                 }
             }
         }
 
-        delete[] tmpCol;
+        if(tmpCol != tmpBuf) {
+            delete[] tmpCol;
+        }
     }
 
 public:
@@ -102,7 +98,8 @@ public:
     FilterColorConv() : Filter()
     {
         this->bDirection = true;
-        n = -1;
+        n = 0;
+        bSpan = true;
     }
 
     /**
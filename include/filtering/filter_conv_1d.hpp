@@ -84,6 +84,15 @@ public:
      */
     void changePass(int x, int y, int z);
 
+    /**
+     * @brief getHalo
+     * @return
+     */
+    int getHalo()
+    {
+        return MAX(halfKernelSize, 0);
+    }
+
     /**
      * @brief execute
      * @param imgIn
@@ -19,6 +19,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_FILTERING_FILTER_CONV_2D_HPP
 
 #include "../util/array.hpp"
+#include "../util/fft_2d.hpp"
 
 #include "../filtering/filter.hpp"
 
@@ -71,12 +72,57 @@ protected:
 
 public:
 
+    /**
+     * @brief fftThreshold is the kernel area (in pixels) from which
+     * the convolution is computed in the frequency domain.
+     */
+    int fftThreshold;
+
     /**
      * @brief FilterConv2D
      */
     FilterConv2D() : Filter()
     {
         minInputImages = 2;
+        fftThreshold = 121;
+    }
+
+    /**
+     * @brief useFFT
+     * @param conv
+     * @return This function returns true if conv is large enough to be
+     * applied in the frequency domain.
+     */
+    bool useFFT(Image *conv)
+    {
+        return (fftThreshold > 0) && ((conv->width * conv->height) >= fftThreshold);
+    }
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *Process(ImageVec imgIn, Image *imgOut)
+    {
+        if(!checkInput(imgIn)) {
+            return imgOut;
+        }
+
+        if(!useFFT(imgIn[1])) {
+            return Filter::Process(imgIn, imgOut);
+        }
+
+        imgOut = setupAux(imgIn, imgOut);
+
+        if(imgOut == NULL) {
+            return imgOut;
+        }
+
+        FFTConvolver2D fft_conv;
+        fft_conv.setup(imgIn[0]->width, imgIn[0]->height, imgIn[1]);
+        return fft_conv.process(imgIn[0], imgOut);
     }
 
     /**
@@ -36,6 +36,7 @@ protected:
     Image *img_err;
     Image *img_rel_blur;
     FilterConv2D *flt_conv;
+    FFTConvolver2D *fft_psf, *fft_psf_hat;
 
     int nIterations;
 
@@ -53,11 +54,32 @@ public:
         img_err = NULL;
         img_rel_blur = NULL;
         flt_conv = new FilterConv2D();
+        fft_psf = NULL;
+        fft_psf_hat = NULL;
 
         this->nIterations = 0;
         setup(nIterations);
     }
 
+    ~FilterDeconvolution()
+    {
+        release();
+        flt_conv = delete_s(flt_conv);
+    }
+
+    /**
+     * @brief release
+     */
+    void release()
+    {
+        psf_hat = delete_s(psf_hat);
+        img_est_conv = delete_s(img_est_conv);
+        img_err = delete_s(img_err);
+        img_rel_blur = delete_s(img_rel_blur);
+        fft_psf = delete_s(fft_psf);
+        fft_psf_hat = delete_s(fft_psf_hat);
+    }
+
     /**
      * @brief setup
      * @param nIterations
@@ -108,18 +130,39 @@ public:
         ImageVec vec = Double(imgOut, psf);
         ImageVec vec_err = Double(img_rel_blur, psf_hat);
 
+        //large PSFs: their spectra are computed once for all iterations
+        bool bFFT = flt_conv->useFFT(psf);
+
+        if(bFFT) {
+            if(fft_psf == NULL) {
+                fft_psf = new FFTConvolver2D();
+                fft_psf_hat = new FFTConvolver2D();
+            }
+
+            fft_psf->setup(imgOut->width, imgOut->height, psf);
+            fft_psf_hat->setup(imgOut->width, imgOut->height, psf_hat);
+        }
+
         for(int i = 0; i < nIterations; i++) {
 
             #ifdef PIC_DEBUG
                 printf("%d\n", i);
             #endif
 
-            img_est_conv = flt_conv->Process(vec, img_est_conv);
+            if(bFFT) {
+                img_est_conv = fft_psf->process(imgOut, img_est_conv);
+            } else {
+                img_est_conv = flt_conv->Process(vec, img_est_conv);
+            }
 
             img_rel_blur->assign(imgIn[0]);
             *img_rel_blur /= *img_est_conv;
 
-            img_err = flt_conv->Process(vec_err, img_err);
+            if(bFFT) {
+                img_err = fft_psf_hat->process(img_rel_blur, img_err);
+            } else {
+                img_err = flt_conv->Process(vec_err, img_err);
+            }
 
             *imgOut *= *img_err;
         }
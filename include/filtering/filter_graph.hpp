@@ -0,0 +1,740 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FILTERING_FILTER_GRAPH_HPP
+#define PIC_FILTERING_FILTER_GRAPH_HPP
+
+#include <vector>
+
+#include "../util/std_util.hpp"
+#include "../util/thread_pool.hpp"
+#include "../filtering/filter.hpp"
+
+namespace pic {
+
+/**
+ * @brief The FilterGraphNode struct is a node of a FilterGraph; flt is NULL
+ * for the inputs of the graph.
+ */
+struct FilterGraphNode
+{
+    Filter *flt;
+    std::vector<int> inputs;
+    int index;
+};
+
+/**
+ * @brief The FilterGraphGroup struct is a chain of nodes executed in a
+ * single pass; only the output of its last node is stored in memory.
+ */
+struct FilterGraphGroup
+{
+    std::vector<int> nodes;
+    int level, lastLevel;
+    bool bFused;
+    Image *out, *candidate;
+    std::vector<ImageVec> src;
+    ImageVec proxies;
+};
+
+/**
+ * @brief The FilterGraph class executes a DAG of filters; differently from
+ * FilterNPasses, a node can have many inputs and its output can feed many nodes.
+ * Nodes are executed in this way:
+ * - chains of point-wise filters (see Filter::isPointWise), e.g. color
+ *   conversion -> luminance -> sigmoid TMO, are fused and run in a single
+ *   pass over rows; intermediate values live in small per-thread buffers;
+ * - the outputs of the other nodes are stored in a pool of images; an image
+ *   goes back to the pool after its last consumer, and it is reused by later
+ *   nodes of the same size;
+ * - nodes that do not depend on each other are executed concurrently.
+ * A Filter object can appear in many nodes; such nodes are never executed
+ * concurrently. Filters are not owned by the graph.
+ */
+class FilterGraph
+{
+protected:
+    std::vector<FilterGraphNode> nodes;
+    int output, nInputs, spanSize;
+    bool bFusion;
+
+    ImageVec pool;
+    std::vector<bool> poolFree;
+
+    /**
+     * @brief acquire takes a free image of the pool with a given size.
+     * @param width
+     * @param height
+     * @param channels
+     * @param frames
+     * @param bAllocate if it is true and there is no free image of such size,
+     * a new one is allocated.
+     * @return
+     */
+    Image *acquire(int width, int height, int channels, int frames, bool bAllocate)
+    {
+        for(unsigned int i = 0; i < pool.size(); i++) {
+            if(poolFree[i] &&
+               (pool[i]->width == width) && (pool[i]->height == height) &&
+               (pool[i]->channels == channels) && (pool[i]->frames == frames)) {
+                poolFree[i] = false;
+                return pool[i];
+            }
+        }
+
+        if(!bAllocate) {
+            return NULL;
+        }
+
+        Image *img = new Image(frames, width, height, channels);
+        pool.push_back(img);
+        poolFree.push_back(false);
+        return img;
+    }
+
+    /**
+     * @brief giveBack puts an image back in the pool.
+     * @param img
+     */
+    void giveBack(Image *img)
+    {
+        for(unsigned int i = 0; i < pool.size(); i++) {
+            if(pool[i] == img) {
+                poolFree[i] = true;
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief keep adds an image allocated by a filter to the pool as in use.
+     * @param img
+     */
+    void keep(Image *img)
+    {
+        if(img == NULL) {
+            return;
+        }
+
+        for(unsigned int i = 0; i < pool.size(); i++) {
+            if(pool[i] == img) {
+                poolFree[i] = false;
+                return;
+            }
+        }
+
+        pool.push_back(img);
+        poolFree.push_back(false);
+    }
+
+    /**
+     * @brief canExtend checks if node can be fused at the end of group.
+     * @param groups
+     * @param g is the index of the group in groups.
+     * @param node
+     * @param nConsumers
+     * @param groupOf
+     * @return
+     */
+    bool canExtend(std::vector<FilterGraphGroup> &groups, int g, int node,
+                   std::vector<int> &nConsumers, std::vector<int> &groupOf)
+    {
+        FilterGraphGroup &group = groups[g];
+        int tail = group.nodes.back();
+        Filter *flt = nodes[node].flt;
+
+        if((nodes[tail].flt == NULL) || (tail == output) ||
+           (nConsumers[tail] != 1) || !nodes[tail].flt->bSpan ||
+           !flt->isPointWise()) {
+            return false;
+        }
+
+        if(int(nodes[node].inputs.size()) > PIC_FILTER_SPAN_MAX_SRC) {
+            return false;
+        }
+
+        //groups only depend on groups created before them, so their
+        //indices are a topological order
+        for(unsigned int i = 1; i < nodes[node].inputs.size(); i++) {
+            if(groupOf[nodes[node].inputs[i]] > g) {
+                return false;
+            }
+        }
+
+        //a filter keeps state computed in OutputSize, so it cannot appear twice
+        for(unsigned int i = 0; i < group.nodes.size(); i++) {
+            if(nodes[group.nodes[i]].flt == flt) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief sameFilters checks if two groups share a Filter object.
+     * @param a
+     * @param b
+     * @return
+     */
+    bool sameFilters(FilterGraphGroup &a, FilterGraphGroup &b)
+    {
+        for(unsigned int i = 0; i < a.nodes.size(); i++) {
+            for(unsigned int j = 0; j < b.nodes.size(); j++) {
+                if(nodes[a.nodes[i]].flt == nodes[b.nodes[j]].flt) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief setupCandidate picks the image where the last node of a group
+     * that is not fused writes; most filters keep the size of their first input.
+     * @param group
+     * @param bOutput
+     * @param imgOut
+     */
+    void setupCandidate(FilterGraphGroup &group, bool bOutput, Image *imgOut)
+    {
+        if(bOutput) {
+            group.candidate = imgOut;
+        } else {
+            if(group.nodes.size() == 1) {
+                Image *img = group.src[0][0];
+                group.candidate = acquire(img->width, img->height, img->channels,
+                                          img->frames, false);
+            }
+        }
+    }
+
+    /**
+     * @brief setupGroup computes the sizes of a fused group, and it decides
+     * if the group can be fused for the current inputs.
+     * @param group
+     * @param values
+     * @param bOutput
+     * @param imgOut
+     */
+    void setupGroup(FilterGraphGroup &group, ImageVec &values, bool bOutput,
+                    Image *imgOut)
+    {
+        int m = int(group.nodes.size());
+        group.src.clear();
+        group.src.resize(m);
+        stdVectorClear<Image>(group.proxies);
+
+        for(int i = 0; i < m; i++) {
+            std::vector<int> &inputs = nodes[group.nodes[i]].inputs;
+
+            for(unsigned int j = 0; j < inputs.size(); j++) {
+                group.src[i].push_back(values[inputs[j]]);
+            }
+        }
+
+        group.bFused = (m > 1);
+        group.out = NULL;
+        group.candidate = NULL;
+
+        if(!group.bFused) {
+            setupCandidate(group, bOutput, imgOut);
+            return;
+        }
+
+        //the chain input of a member is a proxy with the size of the previous
+        //output; point-wise filters do not read its pixels in OutputSize
+        int width, height, channels, frames;
+
+        for(int i = 0; i < m; i++) {
+            if(i > 0) {
+                Image *proxy = new Image();
+                proxy->width = width;
+                proxy->height = height;
+                proxy->channels = channels;
+                proxy->frames = frames;
+                proxy->changeOwnership(true);
+                proxy->allocateAux();
+
+                group.proxies.push_back(proxy);
+                group.src[i][0] = proxy;
+            }
+
+            nodes[group.nodes[i]].flt->OutputSize(group.src[i], width, height, channels, frames);
+        }
+
+        //inputs that are read in place need the size of the output
+        for(int i = 0; i < m; i++) {
+            for(unsigned int j = (i > 0) ? 1 : 0; j < group.src[i].size(); j++) {
+                Image *img = group.src[i][j];
+
+                if((img->width != width) || (img->height != height) ||
+                   (img->frames < frames)) {
+                    group.bFused = false;
+                }
+            }
+        }
+
+        if(!group.bFused) {
+            for(int i = 1; i < m; i++) {
+                group.src[i][0] = NULL;
+            }
+
+            setupCandidate(group, bOutput, imgOut);
+            return;
+        }
+
+        if(bOutput) {
+            if(imgOut != NULL) {
+                if((imgOut->width == width) && (imgOut->height == height) &&
+                   (imgOut->channels == channels) && (imgOut->frames == frames)) {
+                    group.out = imgOut;
+                }
+            }
+
+            if(group.out == NULL) {
+                group.out = new Image(frames, width, height, channels);
+            }
+        } else {
+            group.out = acquire(width, height, channels, frames, true);
+        }
+    }
+
+    /**
+     * @brief processFused runs a fused group: spans of rows go through all
+     * filters of the group while they are in cache.
+     * @param group
+     */
+    void processFused(FilterGraphGroup &group)
+    {
+        Image *out = group.out;
+        int m = int(group.nodes.size());
+        int width = out->width;
+        int height = out->height;
+
+        int maxChannels = out->channels;
+        for(int i = 1; i < m; i++) {
+            maxChannels = MAX(maxChannels, group.proxies[i - 1]->channels);
+        }
+
+        int spanSize = this->spanSize;
+        std::vector<int> &groupNodes = group.nodes;
+        std::vector<ImageVec> &src = group.src;
+        ImageVec &proxies = group.proxies;
+        std::vector<FilterGraphNode> &nodes = this->nodes;
+
+        ThreadPool::getInstance()->parallelFor(0, height * out->frames,
+            [&](int r0, int r1) {
+            std::vector<float> scratch[2];
+            scratch[0].resize(size_t(spanSize) * size_t(maxChannels));
+            scratch[1].resize(size_t(spanSize) * size_t(maxChannels));
+
+            FilterSpanData s_data;
+
+            for(int r = r0; r < r1; r++) {
+                s_data.z = r / height;
+                s_data.y = r % height;
+
+                for(int x = 0; x < width; x += spanSize) {
+                    s_data.x = x;
+                    s_data.n = MIN(spanSize, width - x);
+
+                    float *prev = NULL;
+
+                    for(int i = 0; i < m; i++) {
+                        ImageVec &src_i = src[i];
+                        s_data.src = &src_i;
+                        s_data.nSrc = int(src_i.size());
+
+                        for(int l = 0; l < s_data.nSrc; l++) {
+                            s_data.inChannels[l] = src_i[l]->channels;
+
+                            if((i > 0) && (l == 0)) {
+                                s_data.in[0] = prev;
+                            } else {
+                                s_data.in[l] = (*src_i[l])(x, s_data.y, s_data.z);
+                            }
+                        }
+
+                        if(i == (m - 1)) {
+                            s_data.out = (*out)(x, s_data.y, s_data.z);
+                            s_data.outChannels = out->channels;
+                        } else {
+                            s_data.out = &scratch[i % 2][0];
+                            s_data.outChannels = proxies[i]->channels;
+                        }
+
+                        nodes[groupNodes[i]].flt->fSpan(&s_data);
+                        prev = s_data.out;
+                    }
+                }
+            }
+        }, MAX(1, (64 * 1024) / MAX(width, 1)));
+    }
+
+    /**
+     * @brief processGroup runs a group; groups that cannot be fused are run
+     * node by node. The pool is not touched here, since groups of the same
+     * level run concurrently.
+     * @param group
+     */
+    void processGroup(FilterGraphGroup &group)
+    {
+        if(group.bFused) {
+            processFused(group);
+            return;
+        }
+
+        int m = int(group.nodes.size());
+        Image *prev = NULL;
+
+        for(int i = 0; i < m; i++) {
+            ImageVec src = group.src[i];
+
+            if(i > 0) {
+                src[0] = prev;
+            }
+
+            Image *ret = nodes[group.nodes[i]].flt->Process(src, (i == (m - 1)) ? group.candidate : NULL);
+
+            if(i > 0) {
+                delete_s(prev);
+            }
+
+            prev = ret;
+        }
+
+        group.out = prev;
+    }
+
+public:
+
+    /**
+     * @brief FilterGraph
+     */
+    FilterGraph()
+    {
+        output = -1;
+        nInputs = 0;
+        spanSize = 256;
+        bFusion = true;
+    }
+
+    ~FilterGraph()
+    {
+        release();
+    }
+
+    /**
+     * @brief release frees the images of the pool.
+     */
+    void release()
+    {
+        stdVectorClear<Image>(pool);
+        poolFree.clear();
+    }
+
+    /**
+     * @brief insertInput adds an input of the graph; the i-th input is
+     * imgIn[i] in Process.
+     * @return It returns the index of the node.
+     */
+    int insertInput()
+    {
+        FilterGraphNode node;
+        node.flt = NULL;
+        node.index = nInputs;
+        nodes.push_back(node);
+
+        nInputs++;
+        return int(nodes.size()) - 1;
+    }
+
+    /**
+     * @brief insertFilter adds a node.
+     * @param flt is the filter of the node.
+     * @param inputs are the nodes whose outputs are the inputs of flt;
+     * they have to be inserted before.
+     * @return It returns the index of the node, or -1 if it is not valid.
+     */
+    int insertFilter(Filter *flt, std::vector<int> inputs)
+    {
+        if((flt == NULL) || inputs.empty()) {
+            return -1;
+        }
+
+        for(unsigned int i = 0; i < inputs.size(); i++) {
+            if((inputs[i] < 0) || (inputs[i] >= int(nodes.size()))) {
+                return -1;
+            }
+        }
+
+        FilterGraphNode node;
+        node.flt = flt;
+        node.inputs = inputs;
+        node.index = -1;
+        nodes.push_back(node);
+
+        output = int(nodes.size()) - 1;
+        return output;
+    }
+
+    /**
+     * @brief insertFilter adds a node with a single input.
+     * @param flt
+     * @param input
+     * @return It returns the index of the node, or -1 if it is not valid.
+     */
+    int insertFilter(Filter *flt, int input)
+    {
+        return insertFilter(flt, std::vector<int>(1, input));
+    }
+
+    /**
+     * @brief insertFilter adds a node with two inputs.
+     * @param flt
+     * @param input0
+     * @param input1
+     * @return It returns the index of the node, or -1 if it is not valid.
+     */
+    int insertFilter(Filter *flt, int input0, int input1)
+    {
+        std::vector<int> inputs;
+        inputs.push_back(input0);
+        inputs.push_back(input1);
+        return insertFilter(flt, inputs);
+    }
+
+    /**
+     * @brief setOutput sets the node whose output is returned by Process;
+     * by default, it is the last inserted node.
+     * @param node
+     */
+    void setOutput(int node)
+    {
+        if((node > -1) && (node < int(nodes.size()))) {
+            output = node;
+        }
+    }
+
+    /**
+     * @brief setFusion enables or disables the fusion of point-wise filters.
+     * @param bFusion
+     */
+    void setFusion(bool bFusion)
+    {
+        this->bFusion = bFusion;
+    }
+
+    /**
+     * @brief setSpanSize sets how many pixels of a row go through a fused
+     * chain at once.
+     * @param spanSize
+     */
+    void setSpanSize(int spanSize)
+    {
+        this->spanSize = MAX(spanSize, 1);
+    }
+
+    /**
+     * @brief Process executes the graph.
+     * @param imgIn are the inputs of the graph.
+     * @param imgOut is the output; it can be NULL.
+     * @return It returns the output of the output node.
+     */
+    Image *Process(ImageVec imgIn, Image *imgOut)
+    {
+        if((output < 0) || (int(imgIn.size()) < nInputs)) {
+            return imgOut;
+        }
+
+        if(nodes[output].flt == NULL) {
+            return imgOut;
+        }
+
+        int n = int(nodes.size());
+
+        //nodes that do not reach the output are skipped
+        std::vector<bool> bUsed(n, false);
+        bUsed[output] = true;
+        for(int i = output; i >= 0; i--) {
+            if(bUsed[i]) {
+                for(unsigned int j = 0; j < nodes[i].inputs.size(); j++) {
+                    bUsed[nodes[i].inputs[j]] = true;
+                }
+            }
+        }
+
+        std::vector<int> nConsumers(n, 0);
+        for(int i = 0; i < n; i++) {
+            if(bUsed[i]) {
+                for(unsigned int j = 0; j < nodes[i].inputs.size(); j++) {
+                    nConsumers[nodes[i].inputs[j]]++;
+                }
+            }
+        }
+
+        //chains of point-wise filters are fused into groups
+        std::vector<FilterGraphGroup> groups;
+        std::vector<int> groupOf(n, -1);
+
+        for(int i = 0; i < n; i++) {
+            if(!bUsed[i] || (nodes[i].flt == NULL)) {
+                continue;
+            }
+
+            int p = nodes[i].inputs[0];
+            int g = groupOf[p];
+
+            if(bFusion && (g > -1)) {
+                if(canExtend(groups, g, i, nConsumers, groupOf)) {
+                    groups[g].nodes.push_back(i);
+                    groupOf[i] = g;
+                    continue;
+                }
+            }
+
+            FilterGraphGroup group;
+            group.nodes.push_back(i);
+            group.level = 0;
+            group.lastLevel = 0;
+            group.bFused = false;
+            group.out = NULL;
+            group.candidate = NULL;
+            groups.push_back(group);
+            groupOf[i] = int(groups.size()) - 1;
+        }
+
+        //a group runs after the groups of its inputs and never together
+        //with a group that uses the same Filter object; input groups have
+        //lower indices, so their levels are already set
+        int nGroups = int(groups.size());
+        int nLevels = 0;
+        std::vector< std::vector<int> > levels;
+
+        for(int g = 0; g < nGroups; g++) {
+            int level = 0;
+
+            for(unsigned int i = 0; i < groups[g].nodes.size(); i++) {
+                std::vector<int> &inputs = nodes[groups[g].nodes[i]].inputs;
+
+                for(unsigned int j = 0; j < inputs.size(); j++) {
+                    int g_j = groupOf[inputs[j]];
+
+                    if((g_j > -1) && (g_j != g)) {
+                        level = MAX(level, groups[g_j].level + 1);
+                    }
+                }
+            }
+
+            bool bConflict = true;
+            while(bConflict) {
+                bConflict = false;
+
+                if(level < nLevels) {
+                    for(unsigned int i = 0; i < levels[level].size(); i++) {
+                        if(sameFilters(groups[g], groups[levels[level][i]])) {
+                            bConflict = true;
+                            level++;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if(level >= nLevels) {
+                nLevels = level + 1;
+                levels.resize(nLevels);
+            }
+
+            groups[g].level = level;
+            groups[g].lastLevel = level;
+            levels[level].push_back(g);
+        }
+
+        //liveness: an output is needed until its last consumer has run
+        for(int g = 0; g < nGroups; g++) {
+            for(unsigned int i = 0; i < groups[g].nodes.size(); i++) {
+                std::vector<int> &inputs = nodes[groups[g].nodes[i]].inputs;
+
+                for(unsigned int j = 0; j < inputs.size(); j++) {
+                    int g_j = groupOf[inputs[j]];
+
+                    if((g_j > -1) && (g_j != g)) {
+                        groups[g_j].lastLevel = MAX(groups[g_j].lastLevel, groups[g].level);
+                    }
+                }
+            }
+        }
+
+        int gOutput = groupOf[output];
+
+        ImageVec values(n, NULL);
+        for(int i = 0; i < n; i++) {
+            if(bUsed[i] && (nodes[i].flt == NULL)) {
+                values[i] = imgIn[nodes[i].index];
+            }
+        }
+
+        for(unsigned int i = 0; i < poolFree.size(); i++) {
+            poolFree[i] = true;
+        }
+
+        ThreadPool *threadPool = ThreadPool::getInstance();
+
+        for(int l = 0; l < nLevels; l++) {
+            std::vector<int> &level = levels[l];
+            int m = int(level.size());
+
+            for(int i = 0; i < m; i++) {
+                FilterGraphGroup &group = groups[level[i]];
+                setupGroup(group, values, level[i] == gOutput, imgOut);
+            }
+
+            threadPool->run(m, [&](int i) {
+                processGroup(groups[level[i]]);
+            });
+
+            for(int i = 0; i < m; i++) {
+                FilterGraphGroup &group = groups[level[i]];
+                stdVectorClear<Image>(group.proxies);
+
+                if(level[i] != gOutput) {
+                    if(group.out != group.candidate) {
+                        giveBack(group.candidate);
+                        keep(group.out);
+                    }
+                }
+
+                values[group.nodes.back()] = group.out;
+            }
+
+            for(int g = 0; g < nGroups; g++) {
+                if((groups[g].lastLevel == l) && (g != gOutput)) {
+                    giveBack(groups[g].out);
+                }
+            }
+        }
+
+        return groups[gOutput].out;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_FILTER_GRAPH_HPP */
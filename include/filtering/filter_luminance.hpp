@@ -20,6 +20,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "../util/array.hpp"
 #include "../util/std_util.hpp"
+#include "../util/thread_pool.hpp"
+#include "../image_t.hpp"
 
 #include "../filtering/filter.hpp"
 
@@ -38,21 +40,28 @@ protected:
     float *weights;
 
     /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
+     * @brief fSpan
+     * @param data
      */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
+    void fSpan(FilterSpanData *data)
     {
-        for(int j = box->y0; j < box->y1; j++) {
+        float *out = data->out;
+        float *in = data->in[0];
+        int n = data->n;
+        int channels = data->inChannels[0];
 
-            for(int i = box->x0; i < box->x1; i++) {
-
-                float *data_src = (*src[0])(i, j);
-                float *data_dst = (*dst)(i, j);
+        if(channels == 3) {
+            float w0 = weights[0];
+            float w1 = weights[1];
+            float w2 = weights[2];
 
-                data_dst[0] = Arrayf::dot(data_src, weights, src[0]->channels);
+            for(int i = 0; i < n; i++) {
+                int j = i * 3;
+                out[i] = in[j] * w0 + in[j + 1] * w1 + in[j + 2] * w2;
+            }
+        } else {
+            for(int i = 0; i < n; i++) {
+                out[i] = Arrayf::dot(&in[i * channels], weights, channels);
             }
         }
     }
@@ -66,6 +75,7 @@ public:
     FilterLuminance(LUMINANCE_TYPE type = LT_CIE_LUMINANCE) : Filter()
     {
         weights = NULL;
+        bSpan = true;
         update(type);
     }
 
@@ -168,6 +178,59 @@ public:
         FilterLuminance fltLum(type);
         return fltLum.Process(Single(imgIn), imgOut);
     }
+
+    /**
+     * @brief execute computes the luminance of an image with compact storage;
+     * rows are decoded on the fly, so no float copy of imgIn is allocated.
+     * @param imgIn
+     * @param imgOut
+     * @param type
+     * @return
+     */
+    template<class T>
+    static Image *execute(ImageT<T> *imgIn, Image *imgOut, LUMINANCE_TYPE type = LT_CIE_LUMINANCE)
+    {
+        if(imgIn == NULL) {
+            return imgOut;
+        }
+
+        if(!imgIn->isValid()) {
+            return imgOut;
+        }
+
+        if(imgOut == NULL) {
+            imgOut = new Image(imgIn->frames, imgIn->width, imgIn->height, 1);
+        } else {
+            if((imgOut->width != imgIn->width) || (imgOut->height != imgIn->height) ||
+               (imgOut->channels != 1) || (imgOut->frames != imgIn->frames)) {
+                return imgOut;
+            }
+        }
+
+        int channels = imgIn->channels;
+        int width = imgIn->width;
+        int height = imgIn->height;
+
+        std::vector<float> weights(channels);
+        computeWeights(type, channels, &weights[0]);
+        float *w = &weights[0];
+
+        ThreadPool::getInstance()->parallelFor(0, imgIn->frames * height, [imgIn, imgOut, w, channels, width, height](int start, int end) {
+            std::vector<float> row(width * channels);
+
+            for(int i = start; i < end; i++) {
+                imgIn->decodeRow(i % height, &row[0], i / height);
+
+                float *out = imgOut->data + size_t(i) * width;
+
+                for(int j = 0; j < width; j++) {
+                    out[j] = Arrayf::dot(&row[j * channels], w, channels);
+                }
+            }
+        });
+
+        return imgOut;
+    }
 };
 
 } // end namespace pic
@@ -18,17 +18,26 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_MED_HPP
 #define PIC_FILTERING_FILTER_MED_HPP
 
+#include <algorithm>
+#include <vector>
+
+#include "../util/median.hpp"
+
 #include "../filtering/filter.hpp"
 
 namespace pic {
 
 /**
- * @brief The FilterMed class
+ * @brief The FilterMed class computes the median filter. 3x3 and 5x5
+ * windows use sorting networks and larger windows use a selection; both are
+ * exact. When the histogram mode is on, the median is computed in constant
+ * time per pixel on quantized values (see MedianHistogram).
  */
 class FilterMed: public Filter
 {
 protected:
-    int halfSize, areaKernel, midValue;
+    int halfSize, areaKernel, midValue, histogramBits;
+    std::vector<MedianHistogram> histograms;
 
     /**
      * @brief ProcessBBox
@@ -39,6 +48,19 @@ protected:
     void ProcessBBox(Image *dst, ImageVec src, BBox *box)
     {
         Image *in = src[0];
+
+        if(histogramBits > 0) {
+            //the buffers are owned by the tile; histograms only store ranges
+            MedianHistogram hist(halfSize, histogramBits);
+
+            for(int ch = 0; ch < in->channels; ch++) {
+                hist.copyRange(histograms[ch]);
+                hist.Process(in, dst, ch, box);
+            }
+
+            return;
+        }
+
         float *values = new float[areaKernel * in->channels];
 
         for(int j = box->y0; j < box->y1; j++) {
@@ -62,9 +84,21 @@ protected:
 
                 for(int ch = 0; ch < in->channels; ch++) {
                     float *tmp_v_ch = &values[areaKernel * ch];
-                    std::sort(tmp_v_ch, tmp_v_ch + areaKernel);
 
-                    out[ch] = tmp_v_ch[midValue];
+                    switch(halfSize) {
+                    case 1: {
+                        out[ch] = median9(tmp_v_ch);
+                    } break;
+
+                    case 2: {
+                        out[ch] = median25(tmp_v_ch);
+                    } break;
+
+                    default: {
+                        std::nth_element(tmp_v_ch, tmp_v_ch + midValue, tmp_v_ch + areaKernel);
+                        out[ch] = tmp_v_ch[midValue];
+                    } break;
+                    }
                 }
             }
         }
@@ -76,22 +110,72 @@ public:
     /**
      * @brief FilterMed
      * @param size
+     * @param histogramBits is the number of bits of the bins of the
+     * histogram mode; 0 disables it.
      */
-    FilterMed(int size) : Filter()
+    FilterMed(int size, int histogramBits = 0) : Filter()
     {
-        update(size);
+        update(size, histogramBits);
     }
 
     /**
      * @brief update
      * @param size
+     * @param histogramBits
      */
-    void update(int size)
+    void update(int size, int histogramBits = 0)
     {
         this->halfSize = checkHalfSize(size);
         size = (halfSize << 1) + 1;
         this->areaKernel = size * size;
         this->midValue = areaKernel >> 1;
+        //MedianHistogram supports radii up to 127
+        this->histogramBits = (halfSize > 127) ? 0 : MAX(histogramBits, 0);
+    }
+
+    /**
+     * @brief getHalo
+     * @return
+     */
+    int getHalo()
+    {
+        return halfSize;
+    }
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    Image *Process(ImageVec imgIn, Image *imgOut)
+    {
+        if(!checkInput(imgIn)) {
+            return imgOut;
+        }
+
+        if(histogramBits < 1) {
+            return Filter::Process(imgIn, imgOut);
+        }
+
+        //the quantization is the same for all tiles
+        histograms.clear();
+
+        for(int ch = 0; ch < imgIn[0]->channels; ch++) {
+            histograms.push_back(MedianHistogram(halfSize, histogramBits));
+            histograms[ch].setRange(imgIn[0], ch);
+        }
+
+        //wider tiles amortize the setup of the column histograms; the
+        //tile size set by the user is restored afterwards
+        int tileSize_user = tileSize;
+        setTileSize(MAX(tileSize, 128), tileOrder);
+
+        imgOut = Filter::Process(imgIn, imgOut);
+
+        setTileSize(tileSize_user, tileOrder);
+
+        return imgOut;
     }
 
     /**
@@ -99,11 +183,13 @@ public:
      * @param imgIn
      * @param imgOut
      * @param size
+     * @param histogramBits is the number of bits of the bins of the
+     * histogram mode (e.g., 12); 0 computes the exact median.
      * @return
      */
-    static Image *execute(Image *imgIn, Image *imgOut, int size)
+    static Image *execute(Image *imgIn, Image *imgOut, int size, int histogramBits = 0)
     {
-        FilterMed filter(size);
+        FilterMed filter(size, histogramBits);
         return filter.Process(Single(imgIn), imgOut);
     }
 };
@@ -102,6 +102,12 @@ public:
 
     ~FilterNPasses();
 
+    /**
+     * @brief getHalo
+     * @return It returns the sum of the halos of all passes.
+     */
+    int getHalo();
+
     /**
      * @brief OutputSize
      * @param imgIn
@@ -161,6 +167,24 @@ PIC_INLINE int FilterNPasses::getIterations()
     return int(filters.size());
 }
 
+PIC_INLINE int FilterNPasses::getHalo()
+{
+    int n = getIterations();
+    int halo = 0;
+
+    for(int i = 0; i < n; i++) {
+        int halo_i = getFilter(i)->getHalo();
+
+        if(halo_i < 0) {
+            return -1;
+        }
+
+        halo += halo_i;
+    }
+
+    return halo;
+}
+
 PIC_INLINE void FilterNPasses::OutputSize(ImageVec imgIn, int &width, int &height, int &frames, int &channels)
 {
     Image *imgIn0 = new Image(imgIn[0], false);
@@ -18,6 +18,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_REMOVE_INF_NAN_HPP
 #define PIC_FILTERING_FILTER_REMOVE_INF_NAN_HPP
 
+#include <algorithm>
+
 #include "../filtering/filter.hpp"
 
 namespace pic {
@@ -30,56 +32,60 @@ class FilterRemoveInfNaN: public Filter
 protected:
 
     /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
+     * @brief fSpan copies finite values, and it replaces +/-Inf and NaN
+     * values with the median of the finite values of their 3x3 neighborhood.
+     * @param data
      */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
+    void fSpan(FilterSpanData *data)
     {
-        float values[9];
-
-        int channels = dst->channels;
-
-        for(int j = box->y0; j < box->y1; j++) {
-            for(int i = box->x0; i < box->x1; i++) {
-
-                float *tmp_data = (*src[0])(i, j);
-                float *tmp_dst  = (*dst   )(i, j);
+        float *out = data->out;
+        float *in = data->in[0];
+        int channels = data->outChannels;
+        int n = data->n * channels;
+
+        bool bSpecial = false;
+        for(int i = 0; i < n; i++) {
+            float val = in[i];
+            bool bNotFinite = isinf(val) || isnan(val);
+            out[i] = bNotFinite ? 0.0f : val;
+            bSpecial = bSpecial || bNotFinite;
+        }
 
-                for(int ch = 0; ch < channels; ch++) {
+        if(!bSpecial) {
+            return;
+        }
 
-                    float val = tmp_data[ch];
+        Image *img = (*data->src)[0];
+        float values[9];
 
-                    if(isinf(val) || isnan(val)) {
-                        int c2 = 0;
+        for(int i = 0; i < n; i++) {
+            float val = in[i];
 
-                        for(int k = -1; k <= 1; k++) {
-                            for(int l = -1; l <= 1; l++) {
+            if(!(isinf(val) || isnan(val))) {
+                continue;
+            }
 
-                                float *tmp_val = (*src[0])(i + l, j + k);
+            int x = data->x + i / channels;
+            int ch = i % channels;
+            int c2 = 0;
 
-                                if(!(isnan(tmp_val[ch]) || isinf(tmp_val[ch]))) {
-                                    values[c2] = tmp_val[ch];
-                                    c2++;
-                                }
-                            }
-                        }
+            for(int k = -1; k <= 1; k++) {
+                for(int l = -1; l <= 1; l++) {
+                    float tmp_val = (*img)(x + l, data->y + k, data->z)[ch];
 
-                        if(c2 == 0) {
-                            tmp_dst[ch] = 0.0f;
-                        } else {
-                            std::sort(values, values + c2);
-                            tmp_dst[ch] = values[5];
-                        }
-                    } else {
-                        tmp_dst[ch] = val;
+                    if(!(isnan(tmp_val) || isinf(tmp_val))) {
+                        values[c2] = tmp_val;
+                        c2++;
                     }
                 }
             }
+
+            if(c2 > 0) {
+                std::nth_element(values, values + (c2 >> 1), values + c2);
+                out[i] = values[c2 >> 1];
+            }
         }
     }
-     
 
 public:
     /**
@@ -87,6 +93,16 @@ public:
      */
     FilterRemoveInfNaN() : Filter()
     {
+        bSpan = true;
+    }
+
+    /**
+     * @brief getHalo
+     * @return
+     */
+    int getHalo()
+    {
+        return 1;
     }
 
     /**
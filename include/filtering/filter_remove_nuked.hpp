@@ -18,6 +18,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_REMOVE_NUKED_HPP
 #define PIC_FILTERING_FILTER_REMOVE_NUKED_HPP
 
+#include "../util/median.hpp"
+
 #include "../filtering/filter.hpp"
 
 namespace pic {
@@ -72,7 +74,7 @@ protected:
                     }
 
                     if(nuked > 5) {//are nuked pixels the majority?
-                        std::sort(values, values + 9);
+                        sortNetwork9(values);
                         tmp_dst[ch] = values[5];
                     } else {
                         tmp_dst[ch] = val;
@@ -47,12 +47,10 @@ protected:
     float calculateEpsilon(ImageVec imgIn);
 
     /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
+     * @brief fSpan
+     * @param data
      */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box);
+    void fSpan(FilterSpanData *data);
 
 public:
 \
@@ -117,6 +115,15 @@ public:
         frames      = imgIn[0]->frames;
     }
 
+    /**
+     * @brief isPointWise
+     * @return It returns false when epsilon is computed from the input.
+     */
+    bool isPointWise()
+    {
+        return bSpan && (epsilon > 0.0f) && !temporal;
+    }
+
     /**
      * @brief execute
      * @param imgIn
@@ -134,6 +141,7 @@ PIC_INLINE FilterSigmoidTMO::FilterSigmoidTMO() : Filter()
 {
     lum_weights = NULL;
     lum_weights_flt = NULL;
+    bSpan = true;
     update(SIG_TMO, 0.18f, 1e6f, -1.0f, false);
 }
 
@@ -142,6 +150,7 @@ PIC_INLINE FilterSigmoidTMO::FilterSigmoidTMO(SIGMOID_MODE type, float alpha,
 {
     lum_weights = NULL;
     lum_weights_flt = NULL;
+    bSpan = true;
     update(type, alpha, wp, epsilon, temporal);
 }
 
@@ -191,51 +200,48 @@ PIC_INLINE float FilterSigmoidTMO::calculateEpsilon(ImageVec imgIn)
     return retEpsilon;
 }
 
-PIC_INLINE void FilterSigmoidTMO::ProcessBBox(Image *dst, ImageVec src, BBox *box)
+PIC_INLINE void FilterSigmoidTMO::fSpan(FilterSpanData *data)
 {
+    int whichImage = (data->nSrc > 1) ? 1 : 0;
 
-    Image *img, *img_flt;
-
-    img = src[0];
+    float *in = data->in[0];
+    float *in_flt = data->in[whichImage];
+    float *out = data->out;
 
-    if(src.size() > 1) {
-        img_flt = src[1];
-    } else {
-        img_flt = src[0];
-    }
+    int channels = data->inChannels[0];
+    int channels_flt = data->inChannels[whichImage];
+    int channels_out = data->outChannels;
+    int n = data->n;
 
     float alpha_over_epsilon = alpha / epsilon;
+    bool bWP = (type == SIG_TMO_WP);
 
-    for(int j = box->y0; j < box->y1; j++) {
+    for(int i = 0; i < n; i++) {
+        float *p = &in[i * channels];
+        float *p_flt = &in_flt[i * channels_flt];
+        float *dstOut = &out[i * channels_out];
 
-        for(int i = box->x0; i < box->x1; i++) {
+        float L = Arrayf::dot(p, lum_weights, channels);
 
-            float *p = (*img)(i, j);
-            float *p_flt = (*img_flt)(i, j);
+        if(L > 0.0f) {
+            float L_flt = Arrayf::dot(p_flt, lum_weights_flt, channels_flt);
 
-            float *dstOut = (*dst)(i, j);
+            float Lm = L * alpha_over_epsilon;
+            float Lm_flt = L_flt * alpha_over_epsilon;
+            float Ld;
 
-            float L = Arrayf::dot(p, lum_weights, img->channels);
-
-            if(L > 0.0f) {
-                float L_flt = Arrayf::dot(p_flt, lum_weights_flt, img_flt->channels);
-
-                float Lm = L * alpha_over_epsilon;
-                float Lm_flt = L_flt * alpha_over_epsilon;
-                float Ld;
-
-                if(type == SIG_TMO_WP) {
-                    Ld = L * (1.0f + L / wp_sq) / (1.0f + Lm_flt);
-                } else {
-                    Ld = Lm / (1.0f + Lm_flt);
-                }
-
-                for(int k = 0; k < dst->channels; k++) {
-                    dstOut[k] = (p[k] * Ld) / L;
-                }
+            if(bWP) {
+                Ld = L * (1.0f + L / wp_sq) / (1.0f + Lm_flt);
             } else {
-                Arrayf::assign(0.0f, dstOut, dst->channels);
+                Ld = Lm / (1.0f + Lm_flt);
             }
+
+            float scale = Ld / L;
+            for(int k = 0; k < channels_out; k++) {
+                dstOut[k] = p[k] * scale;
+            }
+        } else {
+            Arrayf::assign(0.0f, dstOut, channels_out);
         }
     }
 }
@@ -18,6 +18,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_FILTERING_FILTER_SIMPLE_TMO_HPP
 #define PIC_FILTERING_FILTER_SIMPLE_TMO_HPP
 
+#include "../util/thread_pool.hpp"
+#include "../image_t.hpp"
 #include "../filtering/filter.hpp"
 
 namespace pic {
@@ -31,15 +33,17 @@ protected:
     float gamma, fstop, exposure;
 
     /**
-     * @brief f
+     * @brief fSpan
      * @param data
      */
-    void f(FilterFData *data)
+    void fSpan(FilterSpanData *data)
     {
-        float *dataIn = (*data->src[0])(data->x, data->y);
+        float *out = data->out;
+        float *in = data->in[0];
+        int n = data->n * data->outChannels;
 
-        for(int k = 0; k < data->dst->channels; k++) {
-            data->out[k] = powf((dataIn[k] * exposure), gamma);
+        for(int i = 0; i < n; i++) {
+            out[i] = powf((in[i] * exposure), gamma);
         }
     }
 
@@ -51,6 +55,7 @@ public:
      */
     FilterSimpleTMO(float gamma, float fstop) : Filter()
     {
+        bSpan = true;
         update(gamma, fstop);
     }
 
@@ -80,6 +85,60 @@ public:
         FilterSimpleTMO filter(gamma, fstop);
         return filter.Process(Single(imgIn), imgOut);
     }
+
+    /**
+     * @brief executeLDR tone maps an image directly into 8-bit codes, i.e.,
+     * the same codes of execute followed by Image::Write with LT_NOR,
+     * without a float output image.
+     * @param imgIn
+     * @param imgOut
+     * @param gamma
+     * @param fstop
+     * @return
+     */
+    static ImageU8 *executeLDR(Image *imgIn, ImageU8 *imgOut, float gamma,
+                               float fstop)
+    {
+        if(imgIn == NULL) {
+            return imgOut;
+        }
+
+        if(!imgIn->isValid()) {
+            return imgOut;
+        }
+
+        if(imgOut == NULL) {
+            imgOut = new ImageU8();
+        }
+
+        //the gamma of the encoding is the one of the tone mapping
+        imgOut->setEncoding(LT_NOR_GAMMA, gamma);
+
+        if((imgOut->width != imgIn->width) || (imgOut->height != imgIn->height) ||
+           (imgOut->channels != imgIn->channels) || (imgOut->frames != imgIn->frames) ||
+           (imgOut->data == NULL)) {
+            imgOut->allocate(imgIn->width, imgIn->height, imgIn->channels, imgIn->frames);
+        }
+
+        float exposure = powf(2.0f, fstop);
+        int n = imgIn->ystride;
+
+        ThreadPool::getInstance()->parallelFor(0, imgIn->frames * imgIn->height, [imgIn, imgOut, exposure, n](int start, int end) {
+            std::vector<float> row(n);
+
+            for(int i = start; i < end; i++) {
+                float *in = imgIn->data + size_t(i) * n;
+
+                for(int j = 0; j < n; j++) {
+                    row[j] = in[j] * exposure;
+                }
+
+                imgOut->encode(&row[0], imgOut->data + size_t(i) * n, n);
+            }
+        });
+
+        return imgOut;
+    }
 };
 
 } // end namespace pic
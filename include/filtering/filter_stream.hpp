@@ -0,0 +1,242 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_FILTERING_FILTER_STREAM_HPP
+#define PIC_FILTERING_FILTER_STREAM_HPP
+
+#include <string.h>
+#include <vector>
+
+#include "../util/std_util.hpp"
+#include "../io/image_stream.hpp"
+#include "../filtering/filter.hpp"
+
+namespace pic {
+
+/**
+ * @brief The FilterStream class applies a chain of filters to an image
+ * file that does not fit in memory, writing the result into another file.
+ * The input is read in bands of rows plus a halo above and below, which
+ * is the sum of the halos of the filters (see Filter::getHalo); each band
+ * is filtered in memory and its central rows are written. Rows of the halo
+ * are kept between consecutive bands, so each input row is read once.
+ * Peak memory is O(width * (bandHeight + 2 * halo)).
+ * Filters have to keep the size of the image; only the first frame is processed.
+ */
+class FilterStream
+{
+protected:
+    std::vector<Filter *> filters;
+    ImageVec stages;
+    int bandHeight, halo;
+
+public:
+
+    /**
+     * @brief FilterStream
+     * @param bandHeight is the number of rows written for each band.
+     */
+    FilterStream(int bandHeight = 256)
+    {
+        this->bandHeight = MAX(bandHeight, 1);
+        halo = -1;
+    }
+
+    ~FilterStream()
+    {
+        release();
+    }
+
+    /**
+     * @brief release frees the images of the stages.
+     */
+    void release()
+    {
+        stdVectorClear<Image>(stages);
+    }
+
+    /**
+     * @brief insertFilter appends a filter to the chain.
+     * @param flt
+     */
+    void insertFilter(Filter *flt)
+    {
+        if(flt != NULL) {
+            filters.push_back(flt);
+        }
+    }
+
+    /**
+     * @brief setHalo sets the halo of the chain.
+     * @param halo is the halo in rows; if it is negative, it is computed
+     * from the filters.
+     */
+    void setHalo(int halo)
+    {
+        this->halo = halo;
+    }
+
+    /**
+     * @brief getHalo
+     * @return It returns the halo of the chain, or -1 if it is unknown.
+     */
+    int getHalo()
+    {
+        if(halo > -1) {
+            return halo;
+        }
+
+        int ret = 0;
+        for(unsigned int i = 0; i < filters.size(); i++) {
+            int halo_i = filters[i]->getHalo();
+
+            if(halo_i < 0) {
+                return -1;
+            }
+
+            ret += halo_i;
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief Process filters a file into another file.
+     * @param nameIn is the input file (PFM, TMP or HDR).
+     * @param nameOut is the output file (PFM, TMP or HDR).
+     * @return This function returns true if it is successfull.
+     */
+    bool Process(std::string nameIn, std::string nameOut)
+    {
+        ImageStreamReader reader;
+
+        if(!reader.open(nameIn)) {
+            return false;
+        }
+
+        ImageStreamWriter writer;
+        bool bRet = Process(&reader, &writer, nameOut);
+        writer.close();
+        return bRet;
+    }
+
+    /**
+     * @brief Process filters an opened stream into a file.
+     * @param reader is the input stream.
+     * @param writer is the output stream; it is opened on nameOut once the
+     * number of output channels is known.
+     * @param nameOut is the output file.
+     * @return This function returns true if it is successfull.
+     */
+    bool Process(ImageStreamReader *reader, ImageStreamWriter *writer,
+                 std::string nameOut)
+    {
+        int H = getHalo();
+
+        if((reader == NULL) || (writer == NULL) || (H < 0)) {
+            #ifdef PIC_DEBUG
+                printf("FilterStream::Process: the halo of the filters is unknown; use setHalo.\n");
+            #endif
+            return false;
+        }
+
+        int width = reader->width;
+        int height = reader->height;
+        int channels = reader->channels;
+
+        if(width < 1 || height < 1 || channels < 1) {
+            return false;
+        }
+
+        int B = MIN(bandHeight, height);
+        size_t rowSize = size_t(width) * size_t(channels);
+
+        //rows [wy0, wy1) of the input are in window
+        std::vector<float> window(rowSize * size_t(MIN(B + 2 * H, height)));
+        int wy0 = 0;
+        int wy1 = 0;
+
+        if(stages.size() != filters.size()) {
+            release();
+            setToANullVector<Image>(stages, int(filters.size()));
+        }
+
+        for(int y0 = 0; y0 < height; y0 += B) {
+            int y1 = MIN(y0 + B, height);
+            int ny0 = MAX(y0 - H, 0);
+            int ny1 = MIN(y1 + H, height);
+
+            //rows of the halo are moved to the top of the window
+            int drop = ny0 - wy0;
+            if(drop > 0) {
+                memmove(&window[0], &window[size_t(drop) * rowSize],
+                        size_t(wy1 - ny0) * rowSize * sizeof(float));
+                wy0 = ny0;
+            }
+
+            if(ny1 > wy1) {
+                if(!reader->readRows(ny1 - wy1, &window[size_t(wy1 - wy0) * rowSize])) {
+                    return false;
+                }
+
+                wy1 = ny1;
+            }
+
+            Image band(1, width, wy1 - wy0, channels, &window[0]);
+            Image *out = &band;
+
+            for(unsigned int i = 0; i < filters.size(); i++) {
+                //bands at the borders have a different size
+                if(stages[i] != NULL) {
+                    if((stages[i]->width != out->width) || (stages[i]->height != out->height)) {
+                        stages[i] = delete_s(stages[i]);
+                    }
+                }
+
+                stages[i] = filters[i]->Process(Single(out), stages[i]);
+                out = stages[i];
+
+                if(out == NULL) {
+                    return false;
+                }
+            }
+
+            if((out->width != width) || (out->height != (wy1 - wy0))) {
+                #ifdef PIC_DEBUG
+                    printf("FilterStream::Process: filters have to keep the size of the image.\n");
+                #endif
+                return false;
+            }
+
+            if(y0 == 0) {
+                if(!writer->open(nameOut, width, height, out->channels)) {
+                    return false;
+                }
+            }
+
+            if(!writer->writeRows(y1 - y0, (*out)(0, y0 - wy0))) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_FILTER_STREAM_HPP */
@@ -35,41 +35,32 @@ protected:
     bool bAdaptive;
 
     /**
-     * @brief ProcessBBox
-     * @param dst
-     * @param src
-     * @param box
+     * @brief fSpan
+     * @param data
      */
-    void ProcessBBox(Image *dst, ImageVec src, BBox *box)
+    void fSpan(FilterSpanData *data)
     {
-        Image* img = src[0];
+        float *out = data->out;
+        float *in = data->in[0];
+        int n = data->n;
+        int channels = data->inChannels[0];
 
         if(bAdaptive) {
-            if(src.size() < 2) {
+            if(data->nSrc < 2) {
                 return;
             }
 
-            Image* img_ada = src[1];
+            float *in_ada = data->in[1];
+            int channels_ada = data->inChannels[1];
 
-            for(int j = box->y0; j < box->y1; j++) {
-
-                for(int i = box->x0; i < box->x1; i++) {
-                    float *dst_val = (*dst)(i, j);
-                    float *img_val = (*img)(i, j);
-                    float *img_ada_val = (*img_ada)(i, j);
-
-                    dst_val[0] = img_val[0] > img_ada_val[0] ? 1.0f : 0.0f;
-                }
+            for(int i = 0; i < n; i++) {
+                out[i] = in[i * channels] > in_ada[i * channels_ada] ? 1.0f : 0.0f;
             }
         } else {
-            for(int j = box->y0; j < box->y1; j++) {
-
-                for(int i = box->x0; i < box->x1; i++) {
-                    float *dst_val = (*dst)(i, j);
-                    float *img_val = (*img)(i, j);
+            float thr = threshold;
 
-                    dst_val[0] = img_val[0] > threshold ? 1.0f : 0.0f;
-                }
+            for(int i = 0; i < n; i++) {
+                out[i] = in[i * channels] > thr ? 1.0f : 0.0f;
             }
         }
     }
@@ -83,6 +74,7 @@ public:
      */
     FilterThreshold(float threshold = 0.5f, bool bAdaptive = false) : Filter()
     {
+        bSpan = true;
         update(threshold, bAdaptive);
     }
 
@@ -19,273 +19,78 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_FILTERING_FILTER_WLS_HPP
 
 #include "../filtering/filter.hpp"
-
-#ifndef PIC_DISABLE_EIGEN
-
-#ifndef PIC_EIGEN_NOT_BUNDLED
-    #include "../externals/Eigen/Sparse"
-    #include "../externals/Eigen/src/SparseCore/SparseMatrix.h"
-#else
-    #include <Eigen/Sparse>
-    #include <Eigen/src/SparseCore/SparseMatrix.h>
-#endif
-
-#endif
+#include "../algorithms/weighted_laplacian_solver.hpp"
 
 namespace pic {
 
-#ifndef PIC_DISABLE_EIGEN
-
+/**
+ * @brief The FilterWLS class is the weighted least squares (WLS)
+ * edge-preserving smoothing filter.
+ */
 class FilterWLS: public Filter
 {
 protected:
-    /**
-     * @brief singleChannel applies WLS smoothing filter for gray-scale images.
-     * @param imgIn
-     * @param imgOut
-     * @return
-     */
-    Image *singleChannel(ImageVec imgIn, Image *imgOut)
-    {
-        Image *L = imgIn[0];
-
-        int width  = L->width;
-        int height = L->height;
-        int tot    = height * width;
-
-        Eigen::VectorXd b, x;
-        b = Eigen::VectorXd::Zero(tot);
-
-        #ifdef PIC_DEBUG
-            printf("Init matrix...");
-        #endif
-
-        std::vector< Eigen::Triplet< double > > tL;
-
-        for(int i = 0; i < height; i++) {
-            int tmpInd = i * width;
-
-            for(int j = 0; j < width; j++) {
-
-                float Ltmp, tmp;
-                int indJ;
-                int indI = tmpInd + j;
-                float Lref = L->data[indI];
-
-                b[indI] = Lref;
-
-                float sum = 0.0f;
-
-                if((i - 1) >= 0) {
-                    indJ = indI - width;
-                    Ltmp = L->data[indJ];
-                    tmp  = -lambda / (powf(fabsf(Ltmp - Lref), alpha) + epsilon);
-                    tL.push_back(Eigen::Triplet< double > (indI, indJ, tmp));
-                    sum += tmp;
-                }
-
-                if((i + 1) < height) {
-                    indJ = indI + width;
-                    Ltmp = L->data[indJ];
-                    tmp  = -lambda / (powf(fabsf(Ltmp - Lref), alpha) + epsilon);
-                    tL.push_back(Eigen::Triplet< double > (indI, indJ, tmp));
-                    sum += tmp;
-                }
-
-                if((j - 1) >= 0) {
-                    indJ = indI - 1;
-                    Ltmp = L->data[indJ];
-                    tmp  = -lambda / (powf(fabsf(Ltmp - Lref), alpha) + epsilon);
-                    tL.push_back(Eigen::Triplet< double > (indI, indJ, tmp));
-                    sum += tmp;
-                }
-
-                if((j + 1) < width) {
-                    indJ = indI + 1;
-                    Ltmp = L->data[indJ];
-                    tmp  = -lambda / (powf(fabsf(Ltmp - Lref), alpha) + epsilon);
-                    tL.push_back(Eigen::Triplet< double > (indI, indJ, tmp));
-                    sum += tmp;
-                }
-
-                tL.push_back(Eigen::Triplet< double > (indI, indI, 1.0f - sum));
-            }
-        }
-
-        #ifdef PIC_DEBUG
-            printf("Ok\n");
-        #endif
-
-        Eigen::SparseMatrix<double> A = Eigen::SparseMatrix<double>(tot, tot);
-        A.setFromTriplets(tL.begin(), tL.end());
-
-        Eigen::SimplicialCholesky<Eigen::SparseMatrix<double> > solver(A);
-        x = solver.solve(b);
-
-        if(solver.info() != Eigen::Success) {
-            #ifdef PIC_DEBUG
-                printf("SOLVER FAILED!\n");
-            #endif
-            return NULL;
-        }
-
-        #ifdef PIC_DEBUG
-            printf("SOLVER SUCCESS!\n");
-        #endif
-
-        #pragma omp parallel for
-
-        for(int i = 0; i < tot; i++) {
-            imgOut->data[i] = float(x(i));
-        }
+    float alpha, lambda, epsilon;
+    bool bWarmStart;
 
-        return imgOut;
-    }
+    WeightedLaplacianSolver solver;
 
     /**
-     * @brief multiChannel applies WLS filter for color images.
-     * @param imgIn
-     * @param imgOut
-     * @return
+     * @brief setWeights computes the smoothness weights; for color images
+     * the difference between two pixels is the Euclidean distance.
+     * @param img
      */
-    Image *multiChannel(ImageVec imgIn, Image *imgOut)
+    void setWeights(Image *img)
     {
-        Image *img = imgIn[0];
-
-        int width  = img->width;
+        int width = img->width;
         int height = img->height;
-        int tot    = height * width;
-
-        alpha /= 2.0f;
+        int channels = img->channels;
 
-        int stridex = width * img->channels;
+        solver.setup(width, height);
 
-        #ifdef PIC_DEBUG
-            printf("Init matrix...");
-        #endif
+        float *mass = solver.getMass();
+        float *wx = solver.getWeightX();
+        float *wy = solver.getWeightY();
 
-        std::vector< Eigen::Triplet< double > > tL;
+        //|d|^alpha = (d^2)^(alpha / 2)
+        float alpha_h = alpha * 0.5f;
 
-        for(int i = 0; i < height; i++) {
-            int tmpInd = i * width;
+        ThreadPool::getInstance()->parallelFor(0, height, [&](int y0, int y1) {
+            for(int i = y0; i < y1; i++) {
+                for(int j = 0; j < width; j++) {
+                    int indI = i * width + j;
+                    float *ref = &img->data[indI * channels];
 
-            for(int j = 0; j < width; j++) {
+                    mass[indI] = 1.0f;
 
-                float sum = 0.0f;
-                float tmp;
-                int indJ;
-                int indI = tmpInd + j;
-                int indImg = indI * img->channels;
+                    if((j + 1) < width) {
+                        float *cur = ref + channels;
+                        float diff = 0.0f;
 
-                if((i - 1) >= 0) {
-                    indJ = indImg - stridex;
-                    float diff = 0.0f;
+                        for(int p = 0; p < channels; p++) {
+                            float tmpDiff = cur[p] - ref[p];
+                            diff += tmpDiff * tmpDiff;
+                        }
 
-                    for(int p = 0; p < img->channels; p++) {
-                        float tmpDiff = img->data[indJ + p] - img->data[indImg + p];
-                        diff += tmpDiff * tmpDiff;
+                        wx[indI] = lambda / (powf(diff, alpha_h) + epsilon);
                     }
 
-                    tmp  = -lambda / (powf(diff, alpha) + epsilon);
-
-                    tL.push_back(Eigen::Triplet< double > (indI, indI - width , tmp));
+                    if((i + 1) < height) {
+                        float *cur = ref + width * channels;
+                        float diff = 0.0f;
 
-                    sum += tmp;
-                }
-
-                if((i + 1) < height) {
-                    indJ = indImg + stridex;
-                    float diff = 0.0f;
+                        for(int p = 0; p < channels; p++) {
+                            float tmpDiff = cur[p] - ref[p];
+                            diff += tmpDiff * tmpDiff;
+                        }
 
-                    for(int p = 0; p < img->channels; p++) {
-                        float tmpDiff = img->data[indJ + p] - img->data[indImg + p];
-                        diff += tmpDiff * tmpDiff;
+                        wy[indI] = lambda / (powf(diff, alpha_h) + epsilon);
                     }
-
-                    tmp  = -lambda / (powf(diff, alpha) + epsilon);
-                    tL.push_back(Eigen::Triplet< double > (indI, indI + width , tmp));
-                    sum += tmp;
                 }
-
-                if((j - 1) >= 0) {
-                    indJ = indImg - img->channels;
-                    float diff = 0.0f;
-
-                    for(int p = 0; p < img->channels; p++) {
-                        float tmpDiff = img->data[indJ + p] - img->data[indImg + p];
-                        diff += tmpDiff * tmpDiff;
-                    }
-
-                    tmp  = -lambda / (powf(diff, alpha) + epsilon);
-                    tL.push_back(Eigen::Triplet< double > (indI, indI - 1 , tmp));
-                    sum += tmp;
-                }
-
-                if((j + 1) < width) {
-                    indJ = indImg + img->channels;
-                    float diff = 0.0f;
-
-                    for(int p = 0; p < img->channels; p++) {
-                        float tmpDiff = img->data[indJ + p] - img->data[indImg + p];
-                        diff += tmpDiff * tmpDiff;
-                    }
-
-                    tmp  = -lambda / (powf(diff, alpha) + epsilon);
-
-                    tL.push_back(Eigen::Triplet< double > (indI, indI + 1 , tmp));
-                    sum += tmp;
-                }
-
-                tL.push_back(Eigen::Triplet< double > (indI, indI, 1.0f - sum));
-            }
-        }
-
-        #ifdef PIC_DEBUG
-            printf("Ok\n");
-        #endif
-
-        Eigen::SparseMatrix<double> A = Eigen::SparseMatrix<double>(tot, tot);
-
-        A.setFromTriplets(tL.begin(), tL.end());
-
-        Eigen::SimplicialCholesky< Eigen::SparseMatrix< double > > solver(A);
-
-        for(int i = 0; i < imgOut->channels; i++) {
-            Eigen::VectorXd b, x;
-
-            b = Eigen::VectorXd::Zero(tot);
-            #pragma omp parallel for
-
-            for(int j = 0; j < tot; j++) {
-                b[j] = img->data[j * img->channels + i];
             }
-
-            x = solver.solve(b);
-
-            if(solver.info() == Eigen::Success) {
-
-                #ifdef PIC_DEBUG
-                    printf("SOLVER SUCCESS!\n");
-                #endif
-
-                #pragma omp parallel for
-
-                for(int j = 0; j < tot; j++) {
-                    imgOut->data[j * imgOut->channels + i] = float(x(j));
-                }
-            } else {
-                #ifdef PIC_DEBUG
-                    printf("SOLVER FAILED!\n");
-                #endif
-            }
-
-        }
-
-        return imgOut;
+        }, MAX(1, 16384 / width));
     }
 
-    float alpha, lambda, epsilon;
-
 public:
 
     /**
@@ -293,6 +98,7 @@ public:
      */
     FilterWLS() : Filter()
     {
+        bWarmStart = false;
         update(1.2f, 1.0f);
     }
 
@@ -303,6 +109,7 @@ public:
      */
     FilterWLS(float alpha, float lambda) : Filter()
     {
+        bWarmStart = false;
         update(alpha, lambda);
     }
 
@@ -327,6 +134,17 @@ public:
         this->lambda = lambda;
     }
 
+    /**
+     * @brief setWarmStart
+     * @param bWarmStart if it is true, the content of imgOut passed to
+     * Process is the initial guess of the solver; e.g., the filtered
+     * previous frame of a video for temporally coherent results.
+     */
+    void setWarmStart(bool bWarmStart)
+    {
+        this->bWarmStart = bWarmStart;
+    }
+
     /**
      * @brief Process
      * @param imgIn
@@ -343,18 +161,38 @@ public:
             return imgOut;
         }
 
+        Image *img = imgIn[0];
+
+        bool bGuess = bWarmStart && (imgOut != NULL);
+        if(bGuess) {
+            bGuess = imgOut->isSimilarType(img);
+        }
+
         imgOut = setupAux(imgIn, imgOut);
 
         if(imgOut == NULL) {
             return imgOut;
         }
 
-        //convolution
-        if(imgIn[0]->channels == 1) {
-            return singleChannel(imgIn, imgOut);
-        } else {
-            return multiChannel(imgIn, imgOut);
+        setWeights(img);
+
+        int tot = img->nPixels();
+        std::vector<float> b(tot), x(tot);
+
+        for(int k = 0; k < img->channels; k++) {
+            for(int i = 0; i < tot; i++) {
+                b[i] = img->data[i * img->channels + k];
+                x[i] = bGuess ? imgOut->data[i * imgOut->channels + k] : b[i];
+            }
+
+            solver.solve(&x[0], &b[0]);
+
+            for(int i = 0; i < tot; i++) {
+                imgOut->data[i * imgOut->channels + k] = x[i];
+            }
         }
+
+        return imgOut;
     }
 
     /**
@@ -388,7 +226,6 @@ public:
         return 0;
     }
 };
-#endif
 
 } // end namespace pic
 
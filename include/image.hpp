@@ -36,6 +36,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "util/array.hpp"
 #include "util/indexed_array.hpp"
 #include "util/std_util.hpp"
+#include "util/mapped_file.hpp"
 
 //IO formats
 #include "io/bmp.hpp"
@@ -71,6 +72,9 @@ protected:
     int  readerCounter;
     bool notOwned;
 
+    //the file mapping that data points into (see ReadMapped)
+    MappedFile *mapped;
+
     BBox fullBox;
 
     LDR_type typeLoad;
@@ -719,6 +723,40 @@ public:
      */
     bool Read (std::string nameFile, LDR_type typeLoad);
 
+    /**
+     * @brief ReadMapped opens an Image mapping its file in memory. For TMP files,
+     * data points directly into the mapped pages; the mapping is private and
+     * copy-on-write so pages are read from disk on demand and the file is
+     * never modified. The other formats are read with Read.
+     * @param nameFile is the file name.
+     * @return This returns true if the reading succeeds, false otherwise.
+     */
+    bool ReadMapped(std::string nameFile);
+
+    /**
+     * @brief ReadMappedRAW opens a raw dump of floats (interleaved channels,
+     * native byte order) mapping its file in memory. When offset is a multiple
+     * of sizeof(float), data points directly into the mapped pages.
+     * @param nameFile is the file name.
+     * @param width
+     * @param height
+     * @param channels
+     * @param frames
+     * @param offset is the offset in bytes of the first pixel.
+     * @return This returns true if the reading succeeds, false otherwise.
+     */
+    bool ReadMappedRAW(std::string nameFile, int width, int height, int channels,
+                       int frames, size_t offset);
+
+    /**
+     * @brief isMapped
+     * @return This returns true if data points into a file mapping.
+     */
+    bool isMapped()
+    {
+        return mapped != NULL;
+    }
+
     /**
      * @brief Write saves an Image into a file on the disk.
      * @param nameFile is the file name.
@@ -886,6 +924,7 @@ PIC_INLINE void Image::setNULL()
 {
     nameFile = "";
     notOwned = false;
+    mapped = NULL;
 
     alpha = -1;
     tstride = -1;
@@ -1015,6 +1054,12 @@ PIC_INLINE Image::~Image()
 PIC_INLINE void Image::release()
 {
     //release all allocated resources
+    if(mapped != NULL) {
+        delete mapped;
+        mapped = NULL;
+        data = NULL;
+    }
+
     if(!notOwned) {
         data = delete_vec_s(data);
         dataUC = delete_vec_s(dataUC);
@@ -1334,6 +1379,11 @@ PIC_INLINE void Image::blend(Image *img, Image *weight)
 
     int size = height * width;
 
+    if(weight->channels == channels) {
+        Buffer<float>::blend(data, img->data, weight->data, size * channels);
+        return;
+    }
+
     #pragma omp parallel for
     for(int ind = 0; ind < size; ind++) {
         int i = ind * channels;
@@ -1357,13 +1407,7 @@ PIC_INLINE void Image::minimum(Image *img)
         return;
     }
 
-    int n = size();
-
-    #pragma omp parallel for
-
-    for(int i = 0; i < n; i++) {
-        data[i] = data[i] > img->data[i] ? img->data[i] : data[i];
-    }
+    Buffer<float>::minimum(data, img->data, size());
 }
 
 PIC_INLINE void Image::maximum(Image *img)
@@ -1372,12 +1416,7 @@ PIC_INLINE void Image::maximum(Image *img)
         return;
     }
 
-    int n = size();
-
-    #pragma omp parallel for
-    for(int i = 0; i < n; i++) {
-        data[i] = data[i] < img->data[i] ? img->data[i] : data[i];
-    }
+    Buffer<float>::maximum(data, img->data, size());
 }
 
 PIC_INLINE void Image::setZero()
@@ -1540,8 +1579,9 @@ PIC_INLINE float *Image::getMomentsVal(int x0, int y0, int radius, float *ret =
             float *tmp_data = (*this)(x, y);
 
             for(int l = 0; l < channels_2; l += 2) {
-                ret[l    ] += j * tmp_data[l];
-                ret[l + 1] += i * tmp_data[l];
+                float val = tmp_data[l >> 1];
+                ret[l    ] += j * val;
+                ret[l + 1] += i * val;
             }
         }
     }
@@ -1921,6 +1961,79 @@ PIC_INLINE bool Image::Read(std::string nameFile,
     return bReturn;
 }
 
+PIC_INLINE bool Image::ReadMapped(std::string nameFile)
+{
+    if(getLabelHDRExtension(nameFile) != IO_TMP) {
+        return Read(nameFile, LT_NOR_GAMMA);
+    }
+
+    MappedFile *file = new MappedFile(nameFile);
+
+    int width, height, channels, frames;
+    float *tmp = ReadTMPMapped(file, width, height, channels, frames);
+
+    if(tmp == NULL) {
+        delete file;
+        return false;
+    }
+
+    release();
+    setNULL();
+
+    this->nameFile = nameFile;
+    this->width = width;
+    this->height = height;
+    this->channels = channels;
+    this->frames = frames;
+    this->notOwned = true;
+    this->mapped = file;
+    this->data = tmp;
+
+    allocateAux();
+    return true;
+}
+
+PIC_INLINE bool Image::ReadMappedRAW(std::string nameFile, int width, int height,
+                                     int channels, int frames = 1, size_t offset = 0)
+{
+    if(width < 1 || height < 1 || channels < 1 || frames < 1) {
+        return false;
+    }
+
+    MappedFile *file = new MappedFile(nameFile);
+
+    size_t n = size_t(width) * size_t(height) * size_t(channels) * size_t(frames);
+
+    if(!file->isValid() || (file->getSize() < (offset + n * sizeof(float)))) {
+        delete file;
+        return false;
+    }
+
+    release();
+    setNULL();
+
+    this->nameFile = nameFile;
+
+    if((offset % sizeof(float)) == 0) {
+        this->width = width;
+        this->height = height;
+        this->channels = channels;
+        this->frames = frames;
+        this->notOwned = true;
+        this->mapped = file;
+        this->data = (float *)(file->getData() + offset);
+
+        allocateAux();
+    } else {
+        //misaligned pixels are copied
+        allocate(width, height, channels, frames);
+        memcpy(data, file->getData() + offset, n * sizeof(float));
+        delete file;
+    }
+
+    return true;
+}
+
 PIC_INLINE bool Image::Write(std::string nameFile, LDR_type typeWrite = LT_NOR_GAMMA,
                                 int writerCounter = 0)
 {
@@ -1928,6 +2041,18 @@ PIC_INLINE bool Image::Write(std::string nameFile, LDR_type typeWrite = LT_NOR_G
         return false;
     }
 
+    //overwriting the mapped file would invalidate the pages not read yet
+    if((mapped != NULL) && (nameFile == this->nameFile)) {
+        int n = size();
+        float *tmp = new float[n];
+        memcpy(tmp, data, n * sizeof(float));
+
+        delete mapped;
+        mapped = NULL;
+        data = tmp;
+        notOwned = false;
+    }
+
     LABEL_IO_EXTENSION label;
 
     //read an image in an HDR format
@@ -0,0 +1,759 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_IMAGE_T_HPP
+#define PIC_IMAGE_T_HPP
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <limits>
+
+#include "base.hpp"
+#include "image.hpp"
+#include "util/half.hpp"
+#include "util/thread_pool.hpp"
+#include "io/image_stream.hpp"
+
+namespace pic {
+
+/**
+ * @brief The ImageT class stores an image with a compact element type:
+ * unsigned char, unsigned short, or Half. Values are converted to and from
+ * float on access. Integer types store codes of the given encoding
+ * (see LDR_type; e.g., LT_NOR_GAMMA stores gamma corrected values in [0,1]),
+ * and they are decoded through a table; Half stores float values.
+ * Pixels are interleaved as in Image.
+ */
+template<class T>
+class ImageT
+{
+protected:
+    bool notOwned;
+    std::vector<float> lut;
+
+    /**
+     * @brief setupLUT computes the decoding table of integer types.
+     */
+    void setupLUT();
+
+    /**
+     * @brief ReadLDR reads an 8-bit image.
+     * @param nameFile
+     * @param label
+     * @return
+     */
+    bool ReadLDR(std::string nameFile, LABEL_IO_EXTENSION label);
+
+    /**
+     * @brief processRows calls func(row_start, row_end) on all rows of all
+     * frames in parallel.
+     * @param func
+     */
+    void processRows(std::function<void(int, int)> func)
+    {
+        ThreadPool::getInstance()->parallelFor(0, frames * height, func);
+    }
+
+public:
+    int width, height, channels, frames;
+    int tstride, ystride, xstride;
+
+    LDR_type encoding;
+    float gamma;
+
+    T *data;
+
+    /**
+     * @brief ImageT
+     */
+    ImageT()
+    {
+        notOwned = false;
+        width = height = channels = frames = -1;
+        tstride = ystride = xstride = -1;
+        data = NULL;
+        setEncoding(LT_NOR_GAMMA);
+    }
+
+    /**
+     * @brief ImageT
+     * @param frames
+     * @param width
+     * @param height
+     * @param channels
+     * @param encoding
+     */
+    ImageT(int frames, int width, int height, int channels,
+           LDR_type encoding = LT_NOR_GAMMA) : ImageT()
+    {
+        setEncoding(encoding);
+        allocate(width, height, channels, frames);
+    }
+
+    /**
+     * @brief ImageT converts an Image.
+     * @param img
+     * @param encoding
+     */
+    ImageT(Image *img, LDR_type encoding = LT_NOR_GAMMA) : ImageT()
+    {
+        setEncoding(encoding);
+        fromImage(img);
+    }
+
+    /**
+     * @brief ImageT loads an image from a file.
+     * @param nameFile
+     * @param encoding
+     */
+    ImageT(std::string nameFile, LDR_type encoding = LT_NOR_GAMMA) : ImageT()
+    {
+        setEncoding(encoding);
+        Read(nameFile);
+    }
+
+    ImageT(const ImageT &) = delete;
+
+    ImageT &operator =(const ImageT &) = delete;
+
+    ~ImageT()
+    {
+        release();
+    }
+
+    /**
+     * @brief allocate
+     * @param width
+     * @param height
+     * @param channels
+     * @param frames
+     * @return
+     */
+    bool allocate(int width, int height, int channels, int frames)
+    {
+        if(width < 1 || height < 1 || channels < 1 || frames < 1) {
+            return false;
+        }
+
+        release();
+
+        this->width = width;
+        this->height = height;
+        this->channels = channels;
+        this->frames = frames;
+
+        xstride = channels;
+        ystride = width * channels;
+        tstride = ystride * height;
+
+        notOwned = false;
+        data = new T[size()];
+        return true;
+    }
+
+    /**
+     * @brief release
+     */
+    void release()
+    {
+        if(!notOwned) {
+            data = delete_vec_s(data);
+        }
+
+        data = NULL;
+        notOwned = false;
+    }
+
+    /**
+     * @brief setEncoding sets how values of integer types are encoded;
+     * it has to be set before writing values.
+     * @param encoding
+     * @param gamma
+     */
+    void setEncoding(LDR_type encoding, float gamma = 2.2f)
+    {
+        this->encoding = (encoding == LT_LDR) ? LT_NOR_GAMMA : encoding;
+        this->gamma = gamma > 0.0f ? gamma : 2.2f;
+        setupLUT();
+    }
+
+    /**
+     * @brief isValid
+     * @return
+     */
+    bool isValid()
+    {
+        return (data != NULL) && (width > 0) && (height > 0) && (channels > 0) && (frames > 0);
+    }
+
+    /**
+     * @brief size
+     * @return This function returns the number of values.
+     */
+    int size()
+    {
+        return width * height * channels * frames;
+    }
+
+    /**
+     * @brief sizeBytes
+     * @return This function returns the size of data in bytes.
+     */
+    size_t sizeBytes()
+    {
+        return size_t(size()) * sizeof(T);
+    }
+
+    /**
+     * @brief encode converts floats into values of type T.
+     * @param in
+     * @param out
+     * @param n
+     */
+    void encode(const float *in, T *out, int n);
+
+    /**
+     * @brief decode converts values of type T into floats.
+     * @param in
+     * @param out
+     * @param n
+     */
+    void decode(const T *in, float *out, int n);
+
+    /**
+     * @brief operator () returns a pointer to a pixel at (x, y, t).
+     * @param x
+     * @param y
+     * @param t
+     * @return
+     */
+    T *operator()(int x, int y, int t = 0)
+    {
+        return data + CLAMP(t, frames) * tstride +
+                      CLAMP(x, width)  * xstride +
+                      CLAMP(y, height) * ystride;
+    }
+
+    /**
+     * @brief get returns the value of a channel of the pixel at (x, y, t).
+     * @param x
+     * @param y
+     * @param c
+     * @param t
+     * @return
+     */
+    float get(int x, int y, int c, int t = 0)
+    {
+        float ret;
+        decode((*this)(x, y, t) + c, &ret, 1);
+        return ret;
+    }
+
+    /**
+     * @brief getPixel decodes the pixel at (x, y, t).
+     * @param x
+     * @param y
+     * @param out is an array of channels floats.
+     * @param t
+     */
+    void getPixel(int x, int y, float *out, int t = 0)
+    {
+        decode((*this)(x, y, t), out, channels);
+    }
+
+    /**
+     * @brief setPixel encodes the pixel at (x, y, t).
+     * @param x
+     * @param y
+     * @param in is an array of channels floats.
+     * @param t
+     */
+    void setPixel(int x, int y, const float *in, int t = 0)
+    {
+        encode(in, (*this)(x, y, t), channels);
+    }
+
+    /**
+     * @brief getBilinear samples the image with bilinear interpolation as
+     * ImageSamplerBilinear does.
+     * @param x is the horizontal coordinate in [0, 1].
+     * @param y is the vertical coordinate in [0, 1].
+     * @param out is an array of channels floats.
+     * @param t
+     */
+    void getBilinear(float x, float y, float *out, int t = 0)
+    {
+        x = CLAMPi(x, 0.0f, 1.0f) * float(width - 1);
+        y = CLAMPi(y, 0.0f, 1.0f) * float(height - 1);
+
+        float xx = floorf(x);
+        float yy = floorf(y);
+        float dx = x - xx;
+        float dy = y - yy;
+
+        int ix = int(xx);
+        int iy = int(yy);
+
+        T *p0 = (*this)(ix,     iy,     t);
+        T *p1 = (*this)(ix + 1, iy,     t);
+        T *p2 = (*this)(ix,     iy + 1, t);
+        T *p3 = (*this)(ix + 1, iy + 1, t);
+
+        float w0 = (1.0f - dx) * (1.0f - dy);
+        float w1 = dx * (1.0f - dy);
+        float w2 = (1.0f - dx) * dy;
+        float w3 = dx * dy;
+
+        for(int c = 0; c < channels; c++) {
+            float v[4];
+            decode(p0 + c, &v[0], 1);
+            decode(p1 + c, &v[1], 1);
+            decode(p2 + c, &v[2], 1);
+            decode(p3 + c, &v[3], 1);
+
+            out[c] = v[0] * w0 + v[1] * w1 + v[2] * w2 + v[3] * w3;
+        }
+    }
+
+    /**
+     * @brief decodeRow decodes a row.
+     * @param y
+     * @param out is an array of width * channels floats.
+     * @param t
+     */
+    void decodeRow(int y, float *out, int t = 0)
+    {
+        decode(data + t * tstride + y * ystride, out, ystride);
+    }
+
+    /**
+     * @brief encodeRow encodes a row.
+     * @param y
+     * @param in is an array of width * channels floats.
+     * @param t
+     */
+    void encodeRow(int y, const float *in, int t = 0)
+    {
+        encode(in, data + t * tstride + y * ystride, ystride);
+    }
+
+    /**
+     * @brief fromImage converts an Image; rows are converted in parallel.
+     * @param img
+     * @return
+     */
+    bool fromImage(Image *img)
+    {
+        if(img == NULL) {
+            return false;
+        }
+
+        if(!img->isValid()) {
+            return false;
+        }
+
+        if((width != img->width) || (height != img->height) ||
+           (channels != img->channels) || (frames != img->frames) || (data == NULL)) {
+            allocate(img->width, img->height, img->channels, img->frames);
+        }
+
+        int n = ystride;
+        processRows([this, img, n](int start, int end) {
+            for(int i = start; i < end; i++) {
+                encode(img->data + size_t(i) * n, data + size_t(i) * n, n);
+            }
+        });
+
+        return true;
+    }
+
+    /**
+     * @brief toImage converts into an Image; rows are converted in parallel.
+     * @param imgOut
+     * @return
+     */
+    Image *toImage(Image *imgOut = NULL)
+    {
+        if(!isValid()) {
+            return imgOut;
+        }
+
+        if(imgOut == NULL) {
+            imgOut = new Image(frames, width, height, channels);
+        } else {
+            if((imgOut->width != width) || (imgOut->height != height) ||
+               (imgOut->channels != channels) || (imgOut->frames != frames)) {
+                return imgOut;
+            }
+        }
+
+        int n = ystride;
+        processRows([this, imgOut, n](int start, int end) {
+            for(int i = start; i < end; i++) {
+                decode(data + size_t(i) * n, imgOut->data + size_t(i) * n, n);
+            }
+        });
+
+        return imgOut;
+    }
+
+    /**
+     * @brief Read loads an image from a file. LDR files are decoded without
+     * float buffers (8-bit codes are kept as they are by ImageT<unsigned char>);
+     * PFM, TMP and HDR files are read in bands of rows; other formats are
+     * read through Image.
+     * @param nameFile
+     * @return
+     */
+    bool Read(std::string nameFile)
+    {
+        LABEL_IO_EXTENSION label = getLabelHDRExtension(nameFile);
+
+        if(label == IO_NULL) {
+            return ReadLDR(nameFile, getLabelLDRExtension(nameFile));
+        }
+
+        if((label == IO_PFM) || (label == IO_TMP) || (label == IO_HDR)) {
+            ImageStreamReader reader;
+
+            if(!reader.open(nameFile)) {
+                return false;
+            }
+
+            if(!allocate(reader.width, reader.height, reader.channels, 1)) {
+                return false;
+            }
+
+            int band = 64;
+            std::vector<float> buffer(size_t(band) * size_t(ystride));
+
+            for(int y = 0; y < height; y += band) {
+                int n = MIN(band, height - y);
+
+                if(!reader.readRows(n, &buffer[0])) {
+                    release();
+                    return false;
+                }
+
+                encode(&buffer[0], data + size_t(y) * ystride, n * ystride);
+            }
+
+            return true;
+        }
+
+        Image img;
+        if(!img.Read(nameFile, LT_NOR_GAMMA)) {
+            return false;
+        }
+
+        return fromImage(&img);
+    }
+
+    /**
+     * @brief Write saves the image into a file. ImageT<unsigned char> with
+     * LT_NOR_GAMMA encoding writes its codes directly into LDR files; PFM, TMP and HDR files are written
+     * in bands of rows; other formats are written through Image.
+     * @param nameFile
+     * @return
+     */
+    bool Write(std::string nameFile);
+};
+
+/**
+ * @brief ImageU8 is an image of 8-bit codes.
+ */
+typedef ImageT<unsigned char> ImageU8;
+
+/**
+ * @brief ImageU16 is an image of 16-bit codes.
+ */
+typedef ImageT<unsigned short> ImageU16;
+
+/**
+ * @brief ImageHalf is an image of half-precision floats.
+ */
+typedef ImageT<Half> ImageHalf;
+
+template<class T>
+PIC_INLINE void ImageT<T>::setupLUT()
+{
+    int n = int(std::numeric_limits<T>::max()) + 1;
+    float maxValue = float(n - 1);
+
+    lut.resize(n);
+
+    for(int i = 0; i < n; i++) {
+        float i_f = float(i);
+
+        switch(encoding) {
+        case LT_NONE: {
+            lut[i] = i_f;
+        } break;
+
+        case LT_NOR: {
+            lut[i] = i_f / maxValue;
+        } break;
+
+        default: {
+            lut[i] = powf(i_f / maxValue, gamma);
+        } break;
+        }
+    }
+}
+
+template<>
+PIC_INLINE void ImageT<Half>::setupLUT()
+{
+    //halves do not need a table
+}
+
+template<class T>
+PIC_INLINE void ImageT<T>::encode(const float *in, T *out, int n)
+{
+    int maxValue = int(std::numeric_limits<T>::max());
+    float maxValuef = float(maxValue);
+
+    //values are clamped before lround, which is undefined for NaN and
+    //values out of the range of long; NaN is clamped to 0
+    switch(encoding) {
+    case LT_NONE: {
+        for(int i = 0; i < n; i++) {
+            float tmp = MAX(in[i], 0.0f);
+            out[i] = T(lround(MIN(tmp, maxValuef)));
+        }
+    } break;
+
+    case LT_NOR: {
+        for(int i = 0; i < n; i++) {
+            float tmp = MAX(in[i] * maxValuef, 0.0f);
+            out[i] = T(lround(MIN(tmp, maxValuef)));
+        }
+    } break;
+
+    default: {
+        float invGamma = 1.0f / gamma;
+
+        for(int i = 0; i < n; i++) {
+            float tmp = powf(MAX(in[i], 0.0f), invGamma) * maxValuef;
+            out[i] = T(lround(MIN(tmp, maxValuef)));
+        }
+    } break;
+    }
+}
+
+template<>
+PIC_INLINE void ImageT<Half>::encode(const float *in, Half *out, int n)
+{
+    Half::convert(in, out, n);
+}
+
+template<class T>
+PIC_INLINE void ImageT<T>::decode(const T *in, float *out, int n)
+{
+    const float *table = &lut[0];
+
+    for(int i = 0; i < n; i++) {
+        out[i] = table[in[i]];
+    }
+}
+
+template<>
+PIC_INLINE void ImageT<Half>::decode(const Half *in, float *out, int n)
+{
+    Half::convert(in, out, n);
+}
+
+template<class T>
+PIC_INLINE bool ImageT<T>::ReadLDR(std::string nameFile, LABEL_IO_EXTENSION label)
+{
+    int w, h, c;
+    unsigned char *codes = NULL;
+
+    switch(label) {
+    case IO_BMP: {
+        codes = ReadBMP(nameFile, NULL, w, h, c);
+    } break;
+
+    case IO_PPM: {
+        codes = ReadPPM(nameFile, NULL, w, h, c);
+    } break;
+
+    case IO_PGM: {
+        codes = ReadPGM(nameFile, NULL, w, h, c);
+    } break;
+
+    case IO_TGA: {
+        codes = ReadTGA(nameFile, NULL, w, h, c);
+    } break;
+
+    case IO_JPG:
+    case IO_PNG: {
+        unsigned char *tmp = ReadSTB(nameFile, w, h, c);
+
+        if(tmp != NULL) {
+            //stb allocates with malloc
+            codes = new unsigned char[w * h * c];
+            memcpy(codes, tmp, w * h * c);
+            free(tmp);
+        }
+    } break;
+
+    default: {
+    } break;
+    }
+
+    if(codes == NULL) {
+        return false;
+    }
+
+    release();
+
+    width = w;
+    height = h;
+    channels = c;
+    frames = 1;
+    xstride = channels;
+    ystride = width * channels;
+    tstride = ystride * height;
+
+    if(sizeof(T) == 1) {
+        //8-bit codes are kept as they are
+        data = (T *) codes;
+        notOwned = false;
+        return true;
+    }
+
+    data = new T[size()];
+
+    //codes are decoded as Image does with encoding as typeLoad, and then encoded
+    float LUT[256];
+    for(int i = 0; i < 256; i++) {
+        float i_f = float(i);
+
+        switch(encoding) {
+        case LT_NONE: {
+            LUT[i] = i_f;
+        } break;
+
+        case LT_NOR: {
+            LUT[i] = i_f / 255.0f;
+        } break;
+
+        default: {
+            LUT[i] = powf(i_f / 255.0f, gamma);
+        } break;
+        }
+    }
+
+    int n = ystride;
+    processRows([this, codes, &LUT, n](int start, int end) {
+        std::vector<float> row(n);
+
+        for(int i = start; i < end; i++) {
+            const unsigned char *in = codes + size_t(i) * n;
+
+            for(int j = 0; j < n; j++) {
+                row[j] = LUT[in[j]];
+            }
+
+            encode(&row[0], data + size_t(i) * n, n);
+        }
+    });
+
+    delete[] codes;
+    return true;
+}
+
+template<class T>
+PIC_INLINE bool ImageT<T>::Write(std::string nameFile)
+{
+    if(!isValid()) {
+        return false;
+    }
+
+    LABEL_IO_EXTENSION label = getLabelHDRExtension(nameFile);
+
+    if((label == IO_PFM) || (label == IO_TMP) || (label == IO_HDR)) {
+        ImageStreamWriter writer;
+
+        if(!writer.open(nameFile, width, height, channels)) {
+            return false;
+        }
+
+        int band = 64;
+        std::vector<float> buffer(size_t(band) * size_t(ystride));
+
+        for(int y = 0; y < height; y += band) {
+            int n = MIN(band, height - y);
+
+            decode(data + size_t(y) * ystride, &buffer[0], n * ystride);
+
+            if(!writer.writeRows(n, &buffer[0])) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    //codes match the ones of Image::Write with LT_NOR_GAMMA
+    if((label == IO_NULL) && (sizeof(T) == 1) && (encoding == LT_NOR_GAMMA) && (gamma == 2.2f)) {
+        unsigned char *codes = (unsigned char *) data;
+
+        switch(getLabelLDRExtension(nameFile)) {
+        case IO_BMP: {
+            return WriteBMP(nameFile, codes, width, height, channels);
+        } break;
+
+        case IO_PPM: {
+            return WritePPM(nameFile, codes, width, height, channels);
+        } break;
+
+        case IO_PGM: {
+            return WritePGM(nameFile, codes, width, height, channels);
+        } break;
+
+        case IO_TGA: {
+            //values are stored with a vertical flip and as BGR
+            std::vector<unsigned char> tmp(codes, codes + size());
+            Buffer<unsigned char>::flipV(&tmp[0], width, height, channels, 1);
+            Buffer<unsigned char>::BGRtoRGB(&tmp[0], width, height, channels, 1);
+            return WriteTGA(nameFile, &tmp[0], width, height, channels);
+        } break;
+
+        case IO_JPG:
+        case IO_PNG: {
+            return WriteSTB(nameFile, codes, width, height, channels);
+        } break;
+
+        default: {
+            return false;
+        }
+        }
+    }
+
+    Image *img = toImage(NULL);
+    bool bRet = img->Write(nameFile, LT_NOR_GAMMA, 0);
+    delete img;
+    return bRet;
+}
+
+} // end namespace pic
+
+#endif /* PIC_IMAGE_T_HPP */
@@ -30,6 +30,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "io/vol.hpp"
 #include "io/stb.hpp"
 #include "io/exif.hpp"
+#include "io/image_stream.hpp"
 
 #endif /* PIC_IO_HPP */
 
@@ -19,6 +19,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_IO_BMP_HPP
 
 #include <stdio.h>
+#include <string.h>
 #include <string>
 
 #ifdef PIC_WIN32
@@ -245,6 +246,7 @@ PIC_INLINE bool WriteBMP(std::string nameFile, const unsigned char *data,
 
     if(padding > 0) {
         pads = new unsigned char[padding];
+        memset(pads, 0, padding);
     }
 
     unsigned char tmp[3];
@@ -20,65 +20,84 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <stdio.h>
 #include <string.h>
+#include <string>
+#include <vector>
 
 #include "../colors/rgbe.hpp"
 #include "../base.hpp"
+#include "../util/mapped_file.hpp"
+#include "../util/thread_pool.hpp"
 //SYSTEM: X NEG Y POS
 
 namespace pic {
 
 /**
- * @brief ReadHDR reads a .hdr/.pic file.
- * @param nameFile
- * @param data
- * @param width
- * @param height
- * @return
+ * @brief getLineHDR reads a line of text from a buffer.
+ * @param buffer
+ * @param size is the size of buffer in bytes.
+ * @param pos is the position of the line; it is moved to the next line.
+ * @param line is the line without the new line character.
+ * @return It returns false if there are no more lines.
  */
-PIC_INLINE float *ReadHDR(std::string nameFile, float *data, int &width,
-                          int &height)
+PIC_INLINE bool getLineHDR(const unsigned char *buffer, size_t size, size_t &pos,
+                           std::string &line)
 {
-    FILE *file = fopen(nameFile.c_str(), "rb");
-
-    if(file == NULL) {
-        return NULL;
+    if(pos >= size) {
+        return false;
     }
 
-    char tmp[512];
+    size_t start = pos;
 
-    //Is it a Radiance file?
-    fscanf(file, "%s\n", tmp);
+    while((pos < size) && (buffer[pos] != '\n')) {
+        pos++;
+    }
 
-    if(strcmp(tmp, "#?RADIANCE") != 0) {
-        return NULL;
+    if(pos >= size) {
+        return false;
     }
 
-    while(true) { //Reading Radiance Header
-        std::string line = "";
+    line.assign((const char *) &buffer[start], pos - start);
+    pos++;
+    return true;
+}
 
-        while(true) { //read property line
-            char *tmp2 = fgets(tmp, 512, file);
+/**
+ * @brief ReadHeaderHDR parses the header of a .hdr/.pic file in memory.
+ * @param buffer is the file content.
+ * @param size is the size of buffer in bytes.
+ * @param width
+ * @param height
+ * @return It returns the offset of the first scanline in bytes, or -1 if
+ * the header is not valid.
+ */
+PIC_INLINE long ReadHeaderHDR(const unsigned char *buffer, size_t size,
+                              int &width, int &height)
+{
+    size_t pos = 0;
+    std::string line;
 
-            if(tmp2 == NULL) {
-                return NULL;
-            }
+    //Is it a Radiance file?
+    if(!getLineHDR(buffer, size, pos, line)) {
+        return -1;
+    }
 
-            line += tmp2;
-            size_t pos = line.find("\n");
+    if((line.compare(0, 10, "#?RADIANCE") != 0) && (line.compare(0, 6, "#?RGBE") != 0)) {
+        return -1;
+    }
 
-            if(pos != std::string::npos) {
-                break;
-            }
+    while(true) { //Reading Radiance Header
+        if(!getLineHDR(buffer, size, pos, line)) {
+            return -1;
         }
 
-        if(line.compare("\n") == 0) {
+        if(line.empty()) {
             break;
         }
 
         //Properties:
         if(line.find("FORMAT") != std::string::npos) { //Format
             if(line.find("32-bit_rle_rgbe") == std::string::npos) {
-                return NULL;
+                return -1;
             }
         }
 
@@ -88,122 +107,203 @@ PIC_INLINE float *ReadHDR(std::string nameFile, float *data, int &width,
     }
 
     //width and height
-    fscanf(file, "-Y %d +X %d", &height, &width);
-    fgetc(file);
+    if(!getLineHDR(buffer, size, pos, line)) {
+        return -1;
+    }
 
-    if(data == NULL) {
-        data = new float[width * height * 3];
+    int w, h;
+    if(sscanf(line.c_str(), "-Y %d +X %d", &h, &w) != 2) {
+        return -1;
     }
 
-    //File size
-    long int s_cur = ftell(file);
-    fseek(file, 0 , SEEK_END);
-    long int s_end = ftell(file);
-    fseek(file, s_cur, SEEK_SET);
-    int total = s_end - s_cur;
+    if((w < 1) || (h < 1)) {
+        return -1;
+    }
 
-#ifdef PIC_DEBUG
-    printf("%d %d\n", total, width * height * 4);
-#endif
+    width = w;
+    height = h;
+    return long(pos);
+}
 
-    //Compressed?
-    if(total == (width * height * 4)) { //uncompressed
-        unsigned char colRGBE[4];
+/**
+ * @brief DecodeLineHDR decodes an RLE scanline into RGBE pixels.
+ * @param buffer is the start of the scanline; it is moved to the next scanline.
+ * @param end is the end of the buffer.
+ * @param buffer_line is the output scanline (width * 4 unsigned char).
+ * @param width
+ * @return It returns false if the scanline is not valid.
+ */
+PIC_INLINE bool DecodeLineHDR(const unsigned char *&buffer, const unsigned char *end,
+                              unsigned char *buffer_line, int width)
+{
+    if((end - buffer) < 4) {
+        return false;
+    }
 
-        int c = 0;
+    bool b1 = buffer[0] != 2;
+    bool b2 = buffer[1] != 2;
+    bool b3 = buffer[2] != (width >> 8);
+    bool b4 = buffer[3] != (width & 0xFF);
 
-        for(int i = 0; i < width; i++) {
-            for(int j = 0; j < height; j++) {
-                fread(colRGBE, 1, 4, file);
-                fromRGBEToFloat(colRGBE, &data[c]);
-                c += 3;
+    if(b1 || b2 || b3 || b4) {
+        return false;
+    }
+
+    const unsigned char *ptr = buffer + 4;
+
+    for(int j = 0; j < 4; j++) {
+        int k = 0;
+
+        //decompression of a single channel line
+        while(k < width) {
+            if(ptr >= end) {
+                return false;
             }
-        }
-    } else { //RLE compressed
-        unsigned char *buffer = new unsigned char[total];
-        fread(buffer, sizeof(unsigned char)*total, 1, file);
 
-        int line_width3 = width * 3;
-        int line_width4 = width * 4;
+            int num = *ptr++;
 
-        unsigned char *buffer_line_start;
-        unsigned char *buffer_line = new unsigned char[line_width4];
-        int c = 4;
-        int c_buffer_line = 0;
+            if(num > 128) {
+                num -= 128;
 
-        //for each line
-        for(int i = 0; i < height; i++) {
-            buffer_line_start = &buffer[c - 4];
+                if((num > (width - k)) || (ptr >= end)) {
+                    return false;
+                }
 
-            int width_check  = buffer_line_start[2];
-            int width_check2 = buffer_line_start[3];
+                unsigned char value = *ptr++;
+                unsigned char *out = &buffer_line[k * 4 + j];
 
-            bool b1 = buffer_line_start[0] != 2;
-            bool b2 = buffer_line_start[1] != 2;
-            bool b3 = width_check  != (width >> 8); 
-            bool b4 = width_check2 != (width & 0xFF);
+                for(int l = 0; l < num; l++) {
+                    out[l * 4] = value;
+                }
+            } else {
+                if((num == 0) || (num > (width - k)) || ((end - ptr) < num)) {
+                    return false;
+                }
 
-            if(b1 || b2 || b3 || b4) {
-                #ifdef PIC_DEBUG
-                    printf("ReadHDR ERROR: the file is not a RLE encoded .hdr file.\n");
-                #endif
+                unsigned char *out = &buffer_line[k * 4 + j];
 
-                fclose(file);
+                for(int l = 0; l < num; l++) {
+                    out[l * 4] = ptr[l];
+                }
 
-                return NULL;
+                ptr += num;
             }
 
-            for(int j = 0; j < 4; j++) {
-                int k = 0;
+            k += num;
+        }
+    }
 
-                //decompression of a single channel line
-                while(k < width) {
-                    int num = buffer[c];
+    buffer = ptr;
+    return true;
+}
 
-                    if(num > 128) {
-                        num -= 128;
+/**
+ * @brief ReadHDR reads a .hdr/.pic file. The file is mapped in memory,
+ * scanlines are decoded from memory, and RGBE pixels are converted using
+ * an exponent table.
+ * @param nameFile
+ * @param data
+ * @param width
+ * @param height
+ * @return
+ */
+PIC_INLINE float *ReadHDR(std::string nameFile, float *data, int &width,
+                          int &height)
+{
+    MappedFile file(nameFile);
 
-                        for(int l = k; l < (k + num); l++) {
-                            buffer_line[l * 4 + j] = buffer[c + 1];
-                        }
+    if(!file.isValid()) {
+        return NULL;
+    }
 
-                        c += 2;
-                        k += num;
-                    } else {
-                        for(int l = 0; l < num; l++) {
-                            buffer_line[(l + k) * 4 + j] = buffer[c + 1 + l];
-                        }
+    const unsigned char *buffer = file.getData();
+    size_t size = file.getSize();
 
-                        c += num + 1;
-                        k += num;
-                    }
+    int w, h;
+    long pos = ReadHeaderHDR(buffer, size, w, h);
+
+    if(pos < 0) {
+        return NULL;
+    }
+
+    const unsigned char *ptr = buffer + pos;
+    const unsigned char *end = buffer + size;
+    size_t total = size - size_t(pos);
+    size_t line_width4 = size_t(w) * 4;
+
+    //RLE is not allowed in some cases
+    bool bRLE = (w >= 8) && (w <= 32767) && (total != (line_width4 * size_t(h)));
+
+    if(!bRLE && (total < (line_width4 * size_t(h)))) {
+        return NULL;
+    }
+
+    width = w;
+    height = h;
+
+    bool bAllocated = false;
+    if(data == NULL) {
+        data = new float[width * height * 3];
+        bAllocated = true;
+    }
+
+    const float *table = getRGBEExponentTable();
+
+    if(!bRLE) { //uncompressed
+        float *out = data;
+
+        ThreadPool::getInstance()->parallelFor(0, height, [ptr, out, table, w](int start, int end) {
+            for(int i = start; i < end; i++) {
+                const unsigned char *in = ptr + size_t(i) * size_t(w) * 4;
+                float *row = out + size_t(i) * size_t(w) * 3;
+
+                for(int j = 0; j < w; j++) {
+                    fromRGBEToFloat(&in[j * 4], &row[j * 3], table);
                 }
             }
+        });
+    } else { //RLE compressed
+        unsigned char *buffer_line = new unsigned char[line_width4];
+        float *row = data;
+
+        //for each line
+        for(int i = 0; i < height; i++) {
+            if(!DecodeLineHDR(ptr, end, buffer_line, width)) {
+                #ifdef PIC_DEBUG
+                    printf("ReadHDR ERROR: the file is not a RLE encoded .hdr file.\n");
+                #endif
+
+                delete[] buffer_line;
+
+                if(bAllocated) {
+                    delete[] data;
+                }
+
+                return NULL;
+            }
 
             //From RGBE to Float
             for(int j = 0; j < width; j++) {
-                fromRGBEToFloat(&buffer_line[j * 4], &data[c_buffer_line + j * 3]);
+                fromRGBEToFloat(&buffer_line[j * 4], &row[j * 3], table);
             }
 
-            c += 4;
-            c_buffer_line += line_width3;
+            row += width * 3;
         }
 
         delete[] buffer_line;
-        delete[] buffer;
     }
 
-    fclose(file);
     return data;
 }
 
 /**
- * @brief WriteLineHDR writes a scanline of an image using RLE and RGBE encoding.
- * @param file
- * @param buffer_line
+ * @brief EncodeLineHDR encodes a single channel of a scanline using RLE.
+ * @param buffer_line is the channel of the scanline.
  * @param width
+ * @param out is the output; encoded bytes are appended to it.
  */
-PIC_INLINE void WriteLineHDR(FILE *file, unsigned char *buffer_line, int width)
+PIC_INLINE void EncodeLineHDR(unsigned char *buffer_line, int width,
+                              std::vector<unsigned char> &out)
 {
     int cur_pointer = 0;
 
@@ -235,10 +335,8 @@ PIC_INLINE void WriteLineHDR(FILE *file, unsigned char *buffer_line, int width)
 
         //do we have a short run <4 before a long one?
         if((run_length_old > 1) && (run_length_old == (run_start - cur_pointer))){
-            unsigned char length_to_write = run_length_old + 128;
-            unsigned char value_to_write = buffer_line[cur_pointer];
-            fwrite(&length_to_write, sizeof(unsigned char), 1, file);
-            fwrite(&value_to_write, sizeof(unsigned char), 1, file);
+            out.push_back((unsigned char)(run_length_old + 128));
+            out.push_back(buffer_line[cur_pointer]);
 
             cur_pointer = run_start;
         }
@@ -248,25 +346,19 @@ PIC_INLINE void WriteLineHDR(FILE *file, unsigned char *buffer_line, int width)
             int non_run_length = run_start - cur_pointer;
 
             if(non_run_length > 128) {
-                unsigned char length_to_write = 128;
-                fwrite(&length_to_write, sizeof(unsigned char), 1, file);
-                fwrite(&buffer_line[cur_pointer], sizeof(unsigned char)*length_to_write, 1, file);
+                non_run_length = 128;
+            }
 
-                cur_pointer += length_to_write;
-            } else {
-                fwrite(&non_run_length, sizeof(unsigned char), 1, file);
-                fwrite(&buffer_line[cur_pointer], sizeof(unsigned char)*non_run_length, 1, file);
+            out.push_back((unsigned char) non_run_length);
+            out.insert(out.end(), &buffer_line[cur_pointer], &buffer_line[cur_pointer] + non_run_length);
 
-                cur_pointer += non_run_length;
-            }
+            cur_pointer += non_run_length;
         }
 
         //writing the found long run
         if(run_length > 3) {
-            unsigned char length_to_write = run_length + 128;
-            unsigned char value_to_write = buffer_line[run_start];
-            fwrite(&length_to_write, sizeof(unsigned char), 1, file);
-            fwrite(&value_to_write, sizeof(unsigned char), 1, file);
+            out.push_back((unsigned char)(run_length + 128));
+            out.push_back(buffer_line[run_start]);
 
             cur_pointer += run_length;
         }
@@ -275,109 +367,172 @@ PIC_INLINE void WriteLineHDR(FILE *file, unsigned char *buffer_line, int width)
 }
 
 /**
- * @brief WriteHDR  writes a .hdr/.pic file
- * @param nameFile
- * @param data
+ * @brief WriteLineHDR writes a scanline of an image using RLE and RGBE encoding.
+ * @param file
+ * @param buffer_line
  * @param width
- * @param height
- * @param channels
- * @param appliedExposure
- * @param bRLE
- * @return
  */
-PIC_INLINE bool WriteHDR(std::string nameFile, float *data, int width,
-                         int height, int channels, float appliedExposure = 1.0f, bool bRLE = true)
+PIC_INLINE void WriteLineHDR(FILE *file, unsigned char *buffer_line, int width)
 {
-    FILE *file;
+    std::vector<unsigned char> out;
+    EncodeLineHDR(buffer_line, width, out);
 
-    if(data==NULL) {
-        return false;
-    }
-    
-    file = fopen(nameFile.c_str(), "wb");
-
-    if( file == NULL) {
-        return false;
-    }
-
-    if((channels == 2) || (channels == 0)) {
-        return false;
+    if(!out.empty()) {
+        fwrite(&out[0], sizeof(unsigned char), out.size(), file);
     }
+}
 
-    //writing the header...
+/**
+ * @brief WriteHeaderHDR writes the header of a .hdr/.pic file.
+ * @param file
+ * @param width
+ * @param height
+ * @param appliedExposure
+ */
+PIC_INLINE void WriteHeaderHDR(FILE *file, int width, int height, float appliedExposure = 1.0f)
+{
     fprintf(file, "#?RADIANCE\n");
     fprintf(file, "#Spiced by Piccante\n");
     fprintf(file, "FORMAT=32-bit_rle_rgbe\n");
     fprintf(file, "EXPOSURE= %f\n\n", appliedExposure);
     fprintf(file, "-Y %d +X %d\n", height, width);
+}
 
-    //RLE encoding is not allowed in some cases
-    if(((width < 8) || (width > 32767)) && bRLE) {
-        bRLE = false;
-    }
+/**
+ * @brief WriteScanlinesHDR writes scanlines using RGBE encoding.
+ * Scanlines are encoded in parallel in blocks, and each block is written in order.
+ * @param file
+ * @param data
+ * @param width
+ * @param height is the number of scanlines.
+ * @param channels
+ * @param bRLE enables RLE encoding; it is ignored if width is not in [8, 32767].
+ */
+PIC_INLINE void WriteScanlinesHDR(FILE *file, float *data, int width, int height,
+                                  int channels, bool bRLE = true)
+{
+    ThreadPool *pool = ThreadPool::getInstance();
+
+    if((width < 8) || (width > 32767) || !bRLE) {
+        unsigned char *buffer = new unsigned char[width * height * 4];
 
-    if(bRLE) {
-        //buffers
-        unsigned char *buffer_line = new unsigned char[width * 4];
-        unsigned char buffer_rgbe[4];
-        unsigned char buffer_line_start[4];
+        pool->parallelFor(0, height, [buffer, data, width, channels](int start, int end) {
+            for(int j = start; j < end; j++) {
+                int ind = j * width;
 
-        //new line start "header"
-        buffer_line_start[0] = 2;
-        buffer_line_start[1] = 2;
-        buffer_line_start[2] = width >> 8;
-        buffer_line_start[3] = width & 0xFF;
+                for(int i = 0; i < width; i++) {
+                    int c = (ind + i);
 
-        int width2 = width * 2;
-        int width3 = width * 3;
+                    if(channels == 1) {
+                        fromSingleFloatToRGBE(&data[c], &buffer[c * 4]);
+                    } else {
+                        fromFloatToRGBE(&data[c * channels], &buffer[c * 4]);
+                    }
+                }
+            }
+        });
 
-        for(int i=0; i<height; i++) {
-            int ind = i * width;
+        fwrite(buffer, sizeof(unsigned char), width * height * 4, file);
 
-            //Converting the line data into the RGBE format
-            for(int j = 0; j < width; j++) {
-                int ind2 = (ind + j) * channels;
+        delete[] buffer;
+        return;
+    }
 
-                if(channels == 1) {
-                    fromSingleFloatToRGBE(&data[ind2], buffer_rgbe);
-                } else {
-                    fromFloatToRGBE(&data[ind2], buffer_rgbe);
-                }
+    int block = pool->getNumThreads() * 16;
+    block = MIN(block, height);
 
-                buffer_line[         j] = buffer_rgbe[0];
-                buffer_line[width  + j] = buffer_rgbe[1];
-                buffer_line[width2 + j] = buffer_rgbe[2];
-                buffer_line[width3 + j] = buffer_rgbe[3];
-            }
+    //encoded scanlines of the current block
+    std::vector< std::vector<unsigned char> > encoded(block);
 
-            //Here a new line start
-            fwrite(buffer_line_start, sizeof(unsigned char)*4, 1, file);
+    for(int i0 = 0; i0 < height; i0 += block) {
+        int i1 = MIN(i0 + block, height);
 
-            //RLE encoding for each line
-            for(int j=0; j<4; j++) {
-                WriteLineHDR(file, &buffer_line[j * width], width);
-            }
-        }
+        pool->parallelFor(i0, i1, [&encoded, data, width, channels, i0](int start, int end) {
+            //buffers
+            std::vector<unsigned char> buffer_line(width * 4);
+            unsigned char buffer_rgbe[4];
 
-    } else {
-        unsigned char colRGBE[4];
-        for(int j = 0; j < height; j++) {
-            int ind = j * width;
+            int width2 = width * 2;
+            int width3 = width * 3;
 
-            for(int i = 0; i < width; i++) {
-                int c = (ind + i);
+            for(int i = start; i < end; i++) {
+                std::vector<unsigned char> &out = encoded[i - i0];
+                out.clear();
 
-                if(channels == 3) {
-                    c *= 3;
-                    fromFloatToRGBE(&data[c], colRGBE);
-                } else {
-                    fromSingleFloatToRGBE(&data[c], colRGBE);
+                //new line start "header"
+                out.push_back(2);
+                out.push_back(2);
+                out.push_back((unsigned char)(width >> 8));
+                out.push_back((unsigned char)(width & 0xFF));
+
+                int ind = i * width;
+
+                //Converting the line data into the RGBE format
+                for(int j = 0; j < width; j++) {
+                    int ind2 = (ind + j) * channels;
+
+                    if(channels == 1) {
+                        fromSingleFloatToRGBE(&data[ind2], buffer_rgbe);
+                    } else {
+                        fromFloatToRGBE(&data[ind2], buffer_rgbe);
+                    }
+
+                    buffer_line[         j] = buffer_rgbe[0];
+                    buffer_line[width  + j] = buffer_rgbe[1];
+                    buffer_line[width2 + j] = buffer_rgbe[2];
+                    buffer_line[width3 + j] = buffer_rgbe[3];
                 }
 
-                fwrite(colRGBE, 1, 4 * sizeof(unsigned char), file);
+                //RLE encoding for each channel
+                for(int j = 0; j < 4; j++) {
+                    EncodeLineHDR(&buffer_line[j * width], width, out);
+                }
             }
+        });
+
+        for(int i = i0; i < i1; i++) {
+            std::vector<unsigned char> &out = encoded[i - i0];
+            fwrite(&out[0], sizeof(unsigned char), out.size(), file);
         }
     }
+}
+
+/**
+ * @brief WriteHDR  writes a .hdr/.pic file. Scanlines are encoded in parallel
+ * in blocks, and each block is written in order.
+ * @param nameFile
+ * @param data
+ * @param width
+ * @param height
+ * @param channels
+ * @param appliedExposure
+ * @param bRLE
+ * @return
+ */
+PIC_INLINE bool WriteHDR(std::string nameFile, float *data, int width,
+                         int height, int channels, float appliedExposure = 1.0f, bool bRLE = true)
+{
+    FILE *file;
+
+    if(data == NULL) {
+        return false;
+    }
+
+    if((channels == 2) || (channels < 1)) {
+        return false;
+    }
+
+    file = fopen(nameFile.c_str(), "wb");
+
+    if( file == NULL) {
+        return false;
+    }
+
+    //writing the header...
+    WriteHeaderHDR(file, width, height, appliedExposure);
+
+    //RLE encoding is not allowed in some cases (see WriteScanlinesHDR)
+    WriteScanlinesHDR(file, data, width, height, channels, bRLE);
 
     fclose(file);
     return true;
@@ -0,0 +1,444 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_IO_IMAGE_STREAM_HPP
+#define PIC_IO_IMAGE_STREAM_HPP
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../base.hpp"
+#include "../util/io.hpp"
+#include "../util/mapped_file.hpp"
+#include "../io/hdr.hpp"
+#include "../io/pfm.hpp"
+#include "../io/tmp.hpp"
+
+namespace pic {
+
+/**
+ * @brief The ImageStreamReader class reads an image a band of rows at a
+ * time, from top to bottom. PFM, TMP and HDR files are supported; the file
+ * is mapped in memory, only the requested rows are touched, and the pages of
+ * the rows already read are dropped from memory.
+ */
+class ImageStreamReader
+{
+protected:
+    MappedFile file;
+    LABEL_IO_EXTENSION label;
+    const unsigned char *pixels, *end;
+    bool bLittleEndian, bRLE;
+    std::vector<unsigned char> buffer_line;
+    size_t released, page;
+
+    /**
+     * @brief discardRows drops from memory the pages of the rows already read.
+     */
+    void discardRows()
+    {
+        const unsigned char *data = file.getData();
+        size_t rowSize = size_t(width) * size_t(channels) * sizeof(float);
+
+        switch(label) {
+        case IO_PFM: {
+            //scanlines are stored from bottom to top
+            size_t lo = size_t(pixels - data) + size_t(height - y) * rowSize;
+            file.discard(lo, released);
+            released = ((lo + page - 1) / page) * page;
+        } break;
+
+        default: {
+            size_t hi = (label == IO_TMP) ? (size_t(pixels - data) + size_t(y) * rowSize) :
+                                            size_t(pixels - data);
+            file.discard(released, hi);
+            released = (hi / page) * page;
+        } break;
+        }
+    }
+
+public:
+    int width, height, channels, y;
+
+    /**
+     * @brief ImageStreamReader
+     */
+    ImageStreamReader()
+    {
+        label = IO_NULL;
+        pixels = NULL;
+        end = NULL;
+        bLittleEndian = true;
+        bRLE = false;
+        released = 0;
+        page = 4096;
+
+        width = 0;
+        height = 0;
+        channels = 0;
+        y = 0;
+    }
+
+    /**
+     * @brief open opens a file and reads its header.
+     * @param nameFile
+     * @return This function returns true if the file can be streamed.
+     */
+    bool open(std::string nameFile)
+    {
+        close();
+
+        label = getLabelHDRExtension(nameFile);
+
+        if((label != IO_PFM) && (label != IO_TMP) && (label != IO_HDR)) {
+            label = IO_NULL;
+            return false;
+        }
+
+        if(!file.open(nameFile)) {
+            return false;
+        }
+
+        const unsigned char *data = file.getData();
+        size_t size = file.getSize();
+        size_t nPixels = 0;
+        bool bValid = false;
+
+        switch(label) {
+        case IO_TMP: {
+            int frames;
+            float *tmp = ReadTMPMapped(&file, width, height, channels, frames);
+
+            if(tmp != NULL) {
+                //only the first frame is streamed
+                pixels = (const unsigned char *) tmp;
+                bValid = true;
+            }
+        } break;
+
+        case IO_PFM: {
+            long offset = ReadPFMHeader(data, size, width, height, channels, bLittleEndian);
+
+            if(offset > -1) {
+                pixels = data + offset;
+                nPixels = size_t(width) * size_t(height) * size_t(channels) * sizeof(float);
+                bValid = size >= (size_t(offset) + nPixels);
+            }
+        } break;
+
+        case IO_HDR: {
+            long offset = ReadHeaderHDR(data, size, width, height);
+
+            if(offset > -1) {
+                pixels = data + offset;
+                channels = 3;
+                nPixels = size_t(width) * size_t(height) * 4;
+                bRLE = (width >= 8) && (width <= 32767) && ((size - size_t(offset)) != nPixels);
+                bValid = bRLE || ((size - size_t(offset)) >= nPixels);
+                buffer_line.resize(size_t(width) * 4);
+            }
+        } break;
+
+        default: {
+        } break;
+        }
+
+        if(!bValid) {
+            close();
+            return false;
+        }
+
+        end = data + size;
+        y = 0;
+
+        page = MappedFile::getPageSize();
+        released = (label == IO_PFM) ? size : 0;
+        return true;
+    }
+
+    /**
+     * @brief close
+     */
+    void close()
+    {
+        file.release();
+        pixels = NULL;
+        end = NULL;
+        width = 0;
+        height = 0;
+        channels = 0;
+        y = 0;
+    }
+
+    /**
+     * @brief readRows reads the next n rows.
+     * @param n is the number of rows.
+     * @param out is a buffer of n * width * channels floats.
+     * @return This function returns false if rows could not be read.
+     */
+    bool readRows(int n, float *out)
+    {
+        if((pixels == NULL) || (n < 1) || ((y + n) > height)) {
+            return false;
+        }
+
+        size_t rowSize = size_t(width) * size_t(channels);
+
+        for(int i = 0; i < n; i++) {
+            float *row = out + size_t(i) * rowSize;
+
+            switch(label) {
+            case IO_TMP: {
+                memcpy(row, pixels + size_t(y) * rowSize * sizeof(float), rowSize * sizeof(float));
+            } break;
+
+            case IO_PFM: {
+                //scanlines are stored from bottom to top
+                memcpy(row, pixels + size_t(height - 1 - y) * rowSize * sizeof(float), rowSize * sizeof(float));
+
+                if(!bLittleEndian) {
+                    for(size_t j = 0; j < rowSize; j++) {
+                        row[j] = convertFloatEndianess(row[j]);
+                    }
+                }
+            } break;
+
+            case IO_HDR: {
+                const unsigned char *rgbe = pixels;
+
+                if(bRLE) {
+                    if(!DecodeLineHDR(pixels, end, &buffer_line[0], width)) {
+                        return false;
+                    }
+
+                    rgbe = &buffer_line[0];
+                } else {
+                    pixels += size_t(width) * 4;
+                }
+
+                const float *table = getRGBEExponentTable();
+
+                for(int j = 0; j < width; j++) {
+                    fromRGBEToFloat(&rgbe[j * 4], &row[j * 3], table);
+                }
+            } break;
+
+            default: {
+                return false;
+            }
+            }
+
+            y++;
+        }
+
+        discardRows();
+
+        return true;
+    }
+};
+
+/**
+ * @brief The ImageStreamWriter class writes an image a band of rows at a
+ * time, from top to bottom. PFM, TMP and HDR files are supported.
+ */
+class ImageStreamWriter
+{
+protected:
+    FILE *file;
+    LABEL_IO_EXTENSION label;
+    long offset;
+    std::vector<float> buffer_row;
+
+    /**
+     * @brief seek
+     * @param pos
+     * @return
+     */
+    bool seek(size_t pos)
+    {
+#ifdef PIC_WIN32
+        return _fseeki64(file, __int64(pos), SEEK_SET) == 0;
+#else
+        return fseeko(file, off_t(pos), SEEK_SET) == 0;
+#endif
+    }
+
+public:
+    int width, height, channels, y;
+
+    /**
+     * @brief ImageStreamWriter
+     */
+    ImageStreamWriter()
+    {
+        file = NULL;
+        label = IO_NULL;
+        offset = 0;
+
+        width = 0;
+        height = 0;
+        channels = 0;
+        y = 0;
+    }
+
+    ~ImageStreamWriter()
+    {
+        close();
+    }
+
+    /**
+     * @brief open creates a file and writes its header.
+     * @param nameFile
+     * @param width
+     * @param height
+     * @param channels
+     * @return This function returns true if the file was created.
+     */
+    bool open(std::string nameFile, int width, int height, int channels)
+    {
+        close();
+
+        if((width < 1) || (height < 1) || (channels < 1)) {
+            return false;
+        }
+
+        label = getLabelHDRExtension(nameFile);
+
+        if((label != IO_PFM) && (label != IO_TMP) && (label != IO_HDR)) {
+            label = IO_NULL;
+            return false;
+        }
+
+        if((label == IO_HDR) && (channels == 2)) {
+            return false;
+        }
+
+        file = fopen(nameFile.c_str(), "wb");
+
+        if(file == NULL) {
+            return false;
+        }
+
+        this->width = width;
+        this->height = height;
+        this->channels = channels;
+        y = 0;
+
+        switch(label) {
+        case IO_TMP: {
+            TMP_IMG_HEADER header;
+            header.frames = 1;
+            header.width = width;
+            header.height = height;
+            header.channels = channels;
+            fwrite(&header, sizeof(TMP_IMG_HEADER), 1, file);
+        } break;
+
+        case IO_PFM: {
+            offset = WriteHeaderPFM(file, width, height, channels);
+            buffer_row.resize(size_t(width) * (channels == 1 ? 1 : 3));
+        } break;
+
+        case IO_HDR: {
+            WriteHeaderHDR(file, width, height);
+        } break;
+
+        default: {
+        } break;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief close
+     */
+    void close()
+    {
+        if(file != NULL) {
+            fclose(file);
+            file = NULL;
+        }
+    }
+
+    /**
+     * @brief writeRows writes the next n rows.
+     * @param n is the number of rows.
+     * @param data is a buffer of n * width * channels floats.
+     * @return This function returns false if rows could not be written.
+     */
+    bool writeRows(int n, float *data)
+    {
+        if((file == NULL) || (n < 1) || ((y + n) > height)) {
+            return false;
+        }
+
+        size_t rowSize = size_t(width) * size_t(channels);
+
+        switch(label) {
+        case IO_TMP: {
+            fwrite(data, sizeof(float), rowSize * size_t(n), file);
+        } break;
+
+        case IO_PFM: {
+            int pfm_channels = channels == 1 ? 1 : 3;
+            int ind1 = channels == 2 ? 1 : 2;
+
+            //scanlines are stored from bottom to top
+            for(int i = 0; i < n; i++) {
+                float *row = data + size_t(i) * rowSize;
+                float *out = row;
+
+                if(channels != pfm_channels) {
+                    out = &buffer_row[0];
+
+                    for(int j = 0; j < width; j++) {
+                        out[j * 3    ] = row[j * channels];
+                        out[j * 3 + 1] = row[j * channels + 1];
+                        out[j * 3 + 2] = row[j * channels + ind1];
+                    }
+                }
+
+                size_t pfm_row = size_t(width) * size_t(pfm_channels);
+
+                if(!seek(size_t(offset) + size_t(height - 1 - y - i) * pfm_row * sizeof(float))) {
+                    return false;
+                }
+
+                fwrite(out, sizeof(float), pfm_row, file);
+            }
+        } break;
+
+        case IO_HDR: {
+            WriteScanlinesHDR(file, data, width, n, channels);
+        } break;
+
+        default: {
+            return false;
+        }
+        }
+
+        y += n;
+        return true;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_IO_IMAGE_STREAM_HPP */
@@ -19,9 +19,12 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_IO_PFM_HPP
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
 
 #include "../base.hpp"
+#include "../util/mapped_file.hpp"
 
 namespace pic {
 
@@ -48,7 +51,69 @@ PIC_INLINE float convertFloatEndianess(float value)
 }
 
 /**
- * @brief ReadPFM loads a portable float map from a file.
+ * @brief ReadPFMHeader parses the header of a portable float map in memory.
+ * @param buffer is the file content.
+ * @param size is the size of buffer in bytes.
+ * @param width
+ * @param height
+ * @param channel
+ * @param bLittleEndian is true if pixels are stored as little-endian.
+ * @return It returns the offset of the pixels in bytes, or -1 if the header
+ * is not valid.
+ */
+PIC_INLINE long ReadPFMHeader(const unsigned char *buffer, size_t size,
+                              int &width, int &height, int &channel,
+                              bool &bLittleEndian)
+{
+    if((buffer == NULL) || (size < 3) || (buffer[0] != 'P')) {
+        return -1;
+    }
+
+    if(buffer[1] == 'f') {
+        channel = 1;
+    } else {
+        if(buffer[1] == 'F') {
+            channel = 3;
+        } else {
+            return -1;
+        }
+    }
+
+    //a NULL terminated copy of the header for the parser
+    char header[256];
+    size_t n = size < sizeof(header) ? size : (sizeof(header) - 1);
+    memcpy(header, buffer, n);
+    header[n] = 0;
+
+    char *ptr = header + 3;
+    char *end = NULL;
+
+    width = int(strtol(ptr, &end, 10));
+    if(end == ptr) {
+        return -1;
+    }
+
+    ptr = end;
+    height = int(strtol(ptr, &end, 10));
+    if(end == ptr) {
+        return -1;
+    }
+
+    ptr = end;
+    float flag = float(strtod(ptr, &end));
+    if((end == ptr) || (*end == 0) || (width < 1) || (height < 1)) {
+        return -1;
+    }
+
+    bLittleEndian = flag < 0.0f;
+
+    //a single whitespace separates the header from the pixels
+    return long(end - header) + 1;
+}
+
+/**
+ * @brief ReadPFM loads a portable float map from a file. The file is mapped
+ * in memory and scanlines are copied (and flipped) with a single copy each.
  * @param nameFile
  * @param data
  * @param width
@@ -59,81 +124,83 @@ PIC_INLINE float convertFloatEndianess(float value)
 PIC_INLINE float *ReadPFM(std::string nameFile, float *data, int &width,
                           int &height, int &channel)
 {
-    FILE *file = fopen(nameFile.c_str(), "rb");
+    MappedFile file(nameFile);
 
-    if(file == NULL) {
+    if(!file.isValid()) {
         return NULL;
     }
 
-    char  flagc;
-    float flag;
-    char P = fgetc(file);
+    int w, h, c;
+    bool bLittleEndian;
+    long offset = ReadPFMHeader(file.getData(), file.getSize(), w, h, c, bLittleEndian);
 
-    if(P != 'P') {
-        fclose(file);
+    if(offset < 0) {
         return NULL;
     }
 
-    char F = fgetc(file);
+    size_t rowSize = size_t(w) * size_t(c);
 
-    bool fCheck = false;
-
-    if(F == 'f') {
-        fCheck = true;
-        channel = 1;
-    }
-
-    if(F == 'F') {
-        fCheck = true;
-        channel = 3;
-    }
-
-    if(!fCheck) {
-        fclose(file);
+    if(file.getSize() < (size_t(offset) + rowSize * size_t(h) * sizeof(float))) {
         return NULL;
     }
 
-
-    fgetc(file);
-    fscanf(file, "%d %d%c", &width, &height, &flagc);
-    fscanf(file, "%f%c", &flag, &flagc);
+    width = w;
+    height = h;
+    channel = c;
 
     if(data == NULL) {
         data = new float[width * height * channel];
     }
 
-    if(flag < 0.0f) {
-        //little-endian encoding
+    const unsigned char *pixels = file.getData() + offset;
 
-        for(int i = height - 1; i > -1; i--) {
-            int ind = i * width;
+    //scanlines are stored from bottom to top
+    for(int i = 0; i < height; i++) {
+        float *row = &data[size_t(height - 1 - i) * rowSize];
 
-            for(int j = 0; j < width; j++) {
-                int tmpInd = (ind + j) * channel;
+        memcpy(row, pixels + size_t(i) * rowSize * sizeof(float), rowSize * sizeof(float));
 
-                fread(&data[tmpInd], sizeof(float), channel, file);
+        if(!bLittleEndian) {
+            for(size_t j = 0; j < rowSize; j++) {
+                row[j] = convertFloatEndianess(row[j]);
             }
         }
-    } else {
-        //big-endian encoding
+    }
 
-        for(int i = height - 1; i > -1; i--) {
-            int ind = i * width;
+    return data;
+}
 
-            for(int j = 0; j < width; j++) {
-                int tmpInd = (ind + j) * channel;
+/**
+ * @brief WriteHeaderPFM writes the header of a portable float map.
+ * @param file
+ * @param width
+ * @param height
+ * @param channels
+ * @return It returns the size of the header in bytes.
+ */
+PIC_INLINE long WriteHeaderPFM(FILE *file, int width, int height, int channels)
+{
+    long start = ftell(file);
 
-                fread(&data[tmpInd], sizeof(float), channel, file);
+    fputc('P', file);
 
-                for(int k = 0; k < channel; k++) {
-                    data[tmpInd + k] = convertFloatEndianess(data[tmpInd + k]);
-                }
-            }
-        }
+    if(channels != 1) {
+        fputc('F', file);
+    } else {
+        fputc('f', file);
     }
 
-    fclose(file);
-    return data;
+    fputc(0x0a, file);
+
+    //width and height
+    fprintf(file, "%d %d", width, height);
+    fputc(0x0a, file);
+
+    //flag: writing little-endian only
+    fprintf(file, "%f", -1.0f);
+    fputc(0x0a, file);
+
+    return ftell(file) - start;
 }
 
 /**
@@ -159,23 +226,7 @@ PIC_INLINE bool WritePFM(std::string nameFile, float *data, int width,
     }
 
     //header
-    fputc('P', file);
-
-    if(channels != 1) {
-        fputc('F', file);
-    } else {
-        fputc('f', file);
-    }
-
-    fputc(0x0a, file);
-
-    //width and height
-    fprintf(file, "%d %d", width, height);
-    fputc(0x0a, file);
-
-    //flag: writing little-endian only
-    fprintf(file, "%f", -1.0f);
-    fputc(0x0a, file);
+    WriteHeaderPFM(file, width, height, channels);
 
     //data
     int ind1 = 1;
@@ -19,9 +19,11 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_IO_TMP_HPP
 
 #include <stdio.h>
+#include <string.h>
 #include <string>
 
 #include "../base.hpp"
+#include "../util/mapped_file.hpp"
 
 namespace pic {
 
@@ -63,23 +65,22 @@ PIC_INLINE float *ReadTMP(std::string nameFile, float *data, int &width,
     if(bHeader) {
         fread(&header, sizeof(TMP_IMG_HEADER), 1, file);
 
-        if(header.channels < 1 && header.frames < 1 && header.height < 1 &&
+        if(header.channels < 1 || header.frames < 1 || header.height < 1 ||
            header.width < 1) { //invalid image!
+            fclose(file);
             return NULL;
         }
-    }
-
-    if(data == NULL) {
-        data = new float[width * height * channels * frames];
-    }
 
-    if(bHeader) {
         width    = header.width;
         height   = header.height;
         channels = header.channels;
         frames   = header.frames;
     }
 
+    if(data == NULL) {
+        data = new float[width * height * channels * frames];
+    }
+
     fread(data, sizeof(float), frames * width * height * channels, file);
 
     fclose(file);
@@ -87,6 +88,51 @@ PIC_INLINE float *ReadTMP(std::string nameFile, float *data, int &width,
     return data;
 }
 
+/**
+ * @brief ReadTMPMapped returns the pixels of a dump temp file that is
+ * mapped in memory; no data is copied.
+ * @param file is the mapped file.
+ * @param width
+ * @param height
+ * @param channels
+ * @param frames
+ * @return It returns a pointer inside the mapping, or NULL if the file
+ * is not a valid temp image.
+ */
+PIC_INLINE float *ReadTMPMapped(MappedFile *file, int &width, int &height,
+                                int &channels, int &frames)
+{
+    if(file == NULL) {
+        return NULL;
+    }
+
+    if(!file->isValid() || (file->getSize() < sizeof(TMP_IMG_HEADER))) {
+        return NULL;
+    }
+
+    TMP_IMG_HEADER header;
+    memcpy(&header, file->getData(), sizeof(TMP_IMG_HEADER));
+
+    if(header.channels < 1 || header.frames < 1 || header.height < 1 ||
+       header.width < 1) { //invalid image!
+        return NULL;
+    }
+
+    size_t n = size_t(header.frames) * size_t(header.width) *
+               size_t(header.height) * size_t(header.channels);
+
+    if(file->getSize() < (sizeof(TMP_IMG_HEADER) + n * sizeof(float))) {
+        return NULL;
+    }
+
+    width    = header.width;
+    height   = header.height;
+    channels = header.channels;
+    frames   = header.frames;
+
+    return (float *)(file->getData() + sizeof(TMP_IMG_HEADER));
+}
+
 /**
  * @brief WriteTMP writes a dump temp file.
  * @param nameFile
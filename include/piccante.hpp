@@ -40,6 +40,10 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
  * \li \c PIC_DISABLE_STB disables the use of STB for reading/writing PNG and JPEG files (https://github.com/nothings/stb).
  * If it is not defined, picccante.hpp searchs for STB in "../../stb"
  * \li \c PIC_DISABLE_STB_LOCAL disables the use of local STB (i.e., placed in "../../stb")
+ * \li \c PIC_DISABLE_THREAD disables multi-threading; all the tasks submitted to pic::ThreadPool
+ * are executed by the calling thread.
+ * \li \c PIC_DISABLE_SIMD disables SSE/AVX2/AVX-512 kernels (selected at run-time through CPUID)
+ * for float buffers; scalar code is used instead.
  *
  * Note that when using Eigen types and standard containters, if you do not align containters, a good practice is to enable the following #define:
  * \li \c EIGEN_DONT_VECTORIZE
@@ -231,6 +235,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "base.hpp"
 #include "image.hpp"
 #include "image_vec.hpp"
+#include "image_t.hpp"
 #include "histogram.hpp"
 
 // sub dirs
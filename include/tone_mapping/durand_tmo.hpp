@@ -37,16 +37,19 @@ public:
 
     FilterLuminance flt_lum;
     float target_contrast;
+    bool bLattice;
 
     /**
      * @brief DurandTMO
+     * @param target_contrast
+     * @param bLattice
      */
-    DurandTMO(float target_contrast = 5.0f)
+    DurandTMO(float target_contrast = 5.0f, bool bLattice = false)
     {
         images.push_back(NULL);
         images.push_back(NULL);
         images.push_back(NULL);
-        update(target_contrast);
+        update(target_contrast, bLattice);
     }
 
     ~DurandTMO()
@@ -57,14 +60,17 @@ public:
     /**
      * @brief update
      * @param target_contrast
+     * @param bLattice if it is true, the base layer is computed with the
+     * permutohedral lattice bilateral filter, which is linear in time.
      */
-    void update(float target_contrast = 5.0f)
+    void update(float target_contrast = 5.0f, bool bLattice = false)
     {
         if(target_contrast <= 0.0f) {
             target_contrast = 5.0f;
         }
 
         this->target_contrast = target_contrast;
+        this->bLattice = bLattice;
     }
 
     /**
@@ -81,7 +87,7 @@ public:
         images[2] = flt_lum.Process(imgIn, images[2]);
 
         //bilateral filter seperation
-        bilateralSeparation(images[2], images, -1.0f, 0.4f, true);
+        bilateralSeparation(images[2], images, -1.0f, 0.4f, true, bLattice);
 
         Image *base = images[0];
         Image *detail = images[1];
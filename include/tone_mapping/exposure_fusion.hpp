@@ -18,6 +18,8 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_TONE_MAPPING_EXPOSURE_FUSION_HPP
 #define PIC_TONE_MAPPING_EXPOSURE_FUSION_HPP
 
+#include <functional>
+
 #include "../base.hpp"
 #include "../util/std_util.hpp"
 #include "../util/array.hpp"
@@ -25,6 +27,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "../filtering/filter_luminance.hpp"
 #include "../filtering/filter_laplacian.hpp"
 #include "../filtering/filter_exposure_fusion_weights.hpp"
+#include "../filtering/filter_simple_tmo.hpp"
 
 #include "../algorithms/pyramid.hpp"
 
@@ -34,15 +37,20 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 namespace pic {
 
 /**
- * @brief The ExposureFusion class
+ * @brief The ExposureFusion class implements Mertens et al.'s exposure
+ * fusion. Besides Process, exposures can be folded into the blended
+ * pyramid one at a time with addExposure, so that they can be discarded
+ * after they are added.
  */
 class ExposureFusion: public ToneMappingOperator
 {
 protected:
     FilterLuminance flt_lum;
     FilterExposureFusionWeights flt_weights;
+    FilterSimpleTMO flt_tmo;
 
     Pyramid *pW, *pI, *pOut;
+    int nExposures;
 
     /**
      * @brief removeNegative
@@ -54,6 +62,85 @@ protected:
         return MAX(x, 0.0f);
     }
 
+    /**
+     * @brief allocatePyramids
+     * @param img
+     */
+    void allocatePyramids(Image *img)
+    {
+        if(pOut != NULL) {
+            if(!pOut->get(0)->isSimilarType(img)) {
+                releaseAux();
+            }
+        }
+
+        if(pOut == NULL) {
+            int limitLevel = 2;
+            pW = new Pyramid(img->width, img->height, 1, false, limitLevel);
+            pI = new Pyramid(img->width, img->height, img->channels, true, limitLevel);
+            pOut = new Pyramid(img->width, img->height, img->channels, true, limitLevel);
+        }
+    }
+
+    /**
+     * @brief computeWeights computes the weights of img in images[1].
+     * @param img
+     */
+    void computeWeights(Image *img)
+    {
+        //work images of a different size are reallocated
+        for(int i = 0; i < 2; i++) {
+            if(images[i] != NULL) {
+                if((images[i]->width != img->width) || (images[i]->height != img->height)) {
+                    images[i] = delete_s(images[i]);
+                }
+            }
+        }
+
+        images[0] = flt_lum.Process(Single(img), images[0]);
+        images[1] = flt_weights.Process(Double(images[0], img), images[1]);
+    }
+
+    /**
+     * @brief blend adds the Laplacian pyramid of img weighted by the
+     * Gaussian pyramid of images[1] to pOut.
+     * @param img
+     */
+    void blend(Image *img)
+    {
+        pW->update(images[1]);
+        pI->update(img);
+
+        pI->mul(pW);
+        pOut->add(pI);
+    }
+
+    /**
+     * @brief reconstruct evaluates pOut and it normalizes its range.
+     * @param imgOut
+     * @return
+     */
+    Image *reconstruct(Image *imgOut)
+    {
+        imgOut = pOut->reconstruct(imgOut);
+
+        float *minVal = imgOut->getMinVal(NULL, NULL);
+        float *maxVal = imgOut->getMaxVal(NULL, NULL);
+
+        int ind;
+        float minV = Arrayf::getMin(minVal, imgOut->channels, ind);
+        float maxV = Arrayf::getMax(maxVal, imgOut->channels, ind);
+        *imgOut -= minV;
+        *imgOut /= (maxV- minV);
+
+        imgOut->applyFunction(removeNegative);
+
+        delete_vec_s(minVal);
+        delete_vec_s(maxVal);
+
+        return imgOut;
+    }
+
     /**
      * @brief ProcessAux
      * @param imgIn
@@ -63,13 +150,26 @@ protected:
     Image *ProcessAux(ImageVec imgIn, Image *imgOut)
     {
         if(imgIn.size() > 1) {
-            return ProcessAuxStack(imgIn, imgOut);
+            //exposures must have the same size
+            if(!ImageVecCheck(imgIn, -1) || !ImageVecCheckSimilarType(imgIn)) {
+                return imgOut;
+            }
+
+            return ProcessAuxStack(imgIn.size(), [&imgIn](int j) {
+                return imgIn[j];
+            }, imgOut);
         } else {
-            pic::ImageVec stack = getAllExposuresImages(imgIn[0]);
+            //exposures are generated when they are needed
+            std::vector<float> fstops = getAllExposures(imgIn[0]);
 
-            imgOut = ProcessAuxStack(stack, imgOut);
+            imgOut = ProcessAuxStack(int(fstops.size()), [&](int j) {
+                flt_tmo.update(2.2f, fstops[j]);
+                images[3] = flt_tmo.Process(imgIn, images[3]);
+                images[3]->clamp(0.0f, 1.0f);
+                return images[3];
+            }, imgOut);
 
-            stdVectorClear<Image>(stack);
+            images[3] = delete_s(images[3]);
 
             return imgOut;
         }
@@ -77,24 +177,27 @@ protected:
 
     /**
      * @brief ProcessAuxStack
-     * @param imgIn
+     * @param n is the number of exposures.
+     * @param getExposure returns the j-th exposure; it is called twice
+     * for each exposure.
      * @param imgOut
      * @return
      */
-    Image *ProcessAuxStack(ImageVec imgIn, Image *imgOut)
+    Image *ProcessAuxStack(int n, std::function<Image *(int)> getExposure, Image *imgOut)
     {
-        uint n = uint(imgIn.size());
-
-        if(n < 2 || !ImageVecCheck(imgIn, -1)) {
+        if(n < 2) {
             return imgOut;
         }
 
-        //compute weights values
-        int channels = imgIn[0]->channels;
-        int width = imgIn[0]->width;
-        int height = imgIn[0]->height;
+        Image *img = getExposure(0);
+        int width = img->width;
+        int height = img->height;
 
-        updateImage(imgIn[0]);
+        if(images[2] != NULL) {
+            if((images[2]->width != width) || (images[2]->height != height)) {
+                images[2] = delete_s(images[2]);
+            }
+        }
 
         if(images[2] == NULL) {//images[2] --> acc
             images[2] = new Image(1, width, height, 1);
@@ -102,53 +205,29 @@ protected:
 
         //compute weights values
         *images[2] = 0.0f;
-        for(uint j = 0; j < n; j++) {
-            images[0] = flt_lum.Process(Single(imgIn[j]), images[0]);
-            images[1] = flt_weights.Process(Double(images[0], imgIn[j]), images[1]);
+        for(int j = 0; j < n; j++) {
+            computeWeights(getExposure(j));
 
             *images[2] += *images[1];
         }
 
         //accumulate into a Pyramid
-
-        releaseAux();
-
-        int limitLevel = 2;
-        pW = new Pyramid(width, height, 1, false, limitLevel);
-        pI = new Pyramid(width, height, channels, true, limitLevel);
-        pOut = new Pyramid(width, height, channels, true, limitLevel);
-
+        allocatePyramids(img);
         pOut->setValue(0.0f);
+        nExposures = 0;
 
-        for(uint j = 0; j < n; j++) {
-            images[0] = flt_lum.Process(Single(imgIn[j]), images[0]);
-            images[1] = flt_weights.Process(Double(images[0], imgIn[j]), images[1]);
+        for(int j = 0; j < n; j++) {
+            img = getExposure(j);
+            computeWeights(img);
 
             //normalization
             *images[1] /= *images[2];
 
-            pW->update(images[1]);
-            pI->update(imgIn[j]);
-
-            pI->mul(pW);
-            pOut->add(pI);
+            blend(img);
         }
 
         //final result
-        imgOut = pOut->reconstruct(imgOut);
-
-        float *minVal = imgOut->getMinVal(NULL, NULL);
-        float *maxVal = imgOut->getMaxVal(NULL, NULL);
-
-        int ind;
-        float minV = Arrayf::getMin(minVal, imgOut->channels, ind);
-        float maxV = Arrayf::getMax(maxVal, imgOut->channels, ind);
-        *imgOut -= minV;
-        *imgOut /= (maxV- minV);
-
-        imgOut->applyFunction(removeNegative);
-
-        return imgOut;
+        return reconstruct(imgOut);
     }
 
     /**
@@ -159,6 +238,7 @@ protected:
         pW = delete_s(pW);
         pI = delete_s(pI);
         pOut = delete_s(pOut);
+        nExposures = 0;
     }
 
 public:
@@ -170,14 +250,15 @@ public:
      * @param wS
      */
     ExposureFusion(float wC = 1.0f, float wE = 1.0f,
-                   float wS = 1.0f)
+                   float wS = 1.0f) : flt_tmo(2.2f, 0.0f)
     {
         pW = NULL;
         pI = NULL;
         pOut = NULL;
+        nExposures = 0;
 
         flt_lum.update(LT_LUMA);
-        setToANullVector<Image>(images, 3);
+        setToANullVector<Image>(images, 4);
 
         update(wC, wE, wS);
     }
@@ -199,6 +280,74 @@ public:
         flt_weights.update(wC, wE, wS);
     }
 
+    /**
+     * @brief addExposure blends an exposure into the output pyramid and
+     * it accumulates its weights in images[2]; img is not referenced after
+     * the call. Memory does not depend on the number of exposures: the
+     * Gaussian pyramid of the sum of the weights, which is the sum of their
+     * Gaussian pyramids, normalizes each level in getResult; this is close
+     * to the normalization of Process.
+     * @param img is an LDR exposure in [0, 1].
+     */
+    void addExposure(Image *img)
+    {
+        if(img == NULL) {
+            return;
+        }
+
+        if(!img->isValid()) {
+            return;
+        }
+
+        allocatePyramids(img);
+
+        if(images[2] != NULL) {
+            if((images[2]->width != img->width) || (images[2]->height != img->height)) {
+                images[2] = delete_s(images[2]);
+            }
+        }
+
+        if(images[2] == NULL) {
+            images[2] = new Image(1, img->width, img->height, 1);
+            nExposures = 0;
+        }
+
+        if(nExposures == 0) {
+            pOut->setValue(0.0f);
+            *images[2] = 0.0f;
+        }
+
+        computeWeights(img);
+        blend(img);
+        *images[2] += *images[1];
+
+        nExposures++;
+    }
+
+    /**
+     * @brief getResult fuses the exposures added so far; a new sequence
+     * of exposures can be added after the call.
+     * @param imgOut
+     * @return
+     */
+    Image *getResult(Image *imgOut = NULL)
+    {
+        if((pOut == NULL) || (images[2] == NULL) || (nExposures < 1)) {
+            return imgOut;
+        }
+
+        //normalization
+        pW->update(images[2]);
+
+        for(int i = 0; i < pOut->size(); i++) {
+            *pOut->get(i) /= *pW->get(i);
+        }
+
+        nExposures = 0;
+
+        return reconstruct(imgOut);
+    }
+
     /**
      * @brief execute
      * @param imgIn
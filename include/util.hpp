@@ -28,6 +28,10 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "util/compability.hpp"
 //#include "util/convert_raw_to_images.hpp"
 #include "util/file_lister.hpp"
+#include "util/mapped_file.hpp"
+#include "util/fft.hpp"
+#include "util/fft_2d.hpp"
+#include "util/half.hpp"
 
 #ifndef PIC_DISABLE_OPENGL
 #include "util/gl/program.hpp"
@@ -47,6 +51,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #endif
 
 #include "util/image_sampler.hpp"
+#include "util/median.hpp"
 #include "util/io.hpp"
 #include "util/math.hpp"
 #include "util/polynomial.hpp"
@@ -59,15 +64,18 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "util/string.hpp"
 #include "util/tile.hpp"
 #include "util/tile_list.hpp"
+#include "util/thread_pool.hpp"
 #include "util/vec.hpp"
 #include "util/warp_samples.hpp"
 #include "util/rasterizer.hpp"
 #include "util/polyline.hpp"
 #include "util/dynamic_range.hpp"
+#include "util/permutohedral_lattice.hpp"
 
 //optimization
 #include "util/k_means.hpp"
 #include "util/k_means_rand.hpp"
+#include "util/k_means_plus_plus.hpp"
 
 #include "util/nelder_mead_opt_base.hpp"
 #include "util/nelder_mead_opt_positive_polynomial.hpp"
@@ -244,7 +244,7 @@ public:
      */
     static T norm(float *data, int n)
     {
-        return sqrtf(Array<float>::norm(data, n));
+        return sqrtf(Array<float>::norm_sq(data, n));
     }
 
     /**
@@ -23,6 +23,7 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "../base.hpp"
 #include "../util/math.hpp"
 #include "../util/array.hpp"
+#include "../util/simd.hpp"
 
 namespace pic {
 
@@ -369,6 +370,60 @@ public:
         return bufferOut;
     }
 
+    /**
+     * @brief minimum computes the element-wise minimum
+     * @param bufferOut
+     * @param bufferIn
+     * @param n
+     * @return
+     */
+    static T *minimum(T *bufferOut, T *bufferIn, int n)
+    {
+        #pragma omp parallel for
+        for(int i = 0; i < n; i++) {
+            bufferOut[i] = bufferOut[i] > bufferIn[i] ? bufferIn[i] : bufferOut[i];
+        }
+
+        return bufferOut;
+    }
+
+    /**
+     * @brief maximum computes the element-wise maximum
+     * @param bufferOut
+     * @param bufferIn
+     * @param n
+     * @return
+     */
+    static T *maximum(T *bufferOut, T *bufferIn, int n)
+    {
+        #pragma omp parallel for
+        for(int i = 0; i < n; i++) {
+            bufferOut[i] = bufferOut[i] < bufferIn[i] ? bufferIn[i] : bufferOut[i];
+        }
+
+        return bufferOut;
+    }
+
+    /**
+     * @brief blend computes bufferOut = bufferOut * weight + bufferIn * (1 - weight)
+     * @param bufferOut
+     * @param bufferIn
+     * @param weight
+     * @param n
+     * @return
+     */
+    static T *blend(T *bufferOut, T *bufferIn, T *weight, int n)
+    {
+        #pragma omp parallel for
+        for(int i = 0; i < n; i++) {
+            T w0 = weight[i];
+            T w1 = T(1) - w0;
+            bufferOut[i] = bufferOut[i] * w0 + bufferIn[i] * w1;
+        }
+
+        return bufferOut;
+    }
+
     /**
      * @brief flipH flips a buffer horizontally
      * @param buffer
@@ -875,6 +930,201 @@ public:
     }
 };
 
+//float buffers use SIMD kernels (see util/simd.hpp)
+
+template<>
+inline float *Buffer<float>::add(float *buffer, int n, float value)
+{
+    SIMD::constant<SIMDOpAdd>(buffer, buffer, value, n);
+    return buffer;
+}
+
+template<>
+inline float *Buffer<float>::add(float *bufferOut, float *bufferIn0, float *bufferIn1, int n)
+{
+    SIMD::binary<SIMDOpAdd>(bufferOut, bufferIn0, bufferIn1, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::add(float *bufferOut, float *bufferIn, int n)
+{
+    SIMD::binary<SIMDOpAdd>(bufferOut, bufferOut, bufferIn, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::sub(float *buffer, int n, float value)
+{
+    SIMD::constant<SIMDOpSub>(buffer, buffer, value, n);
+    return buffer;
+}
+
+template<>
+inline float *Buffer<float>::sub(float *bufferOut, float *bufferIn0, float *bufferIn1, int n)
+{
+    SIMD::binary<SIMDOpSub>(bufferOut, bufferIn0, bufferIn1, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::sub(float *bufferOut, float *bufferIn, int n)
+{
+    SIMD::binary<SIMDOpSub>(bufferOut, bufferOut, bufferIn, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::mul(float *buffer, int n, float value)
+{
+    SIMD::constant<SIMDOpMul>(buffer, buffer, value, n);
+    return buffer;
+}
+
+template<>
+inline float *Buffer<float>::mul(float *bufferOut, float *bufferIn0, float *bufferIn1, int n)
+{
+    SIMD::binary<SIMDOpMul>(bufferOut, bufferIn0, bufferIn1, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::mul(float *bufferOut, float *bufferIn, int n)
+{
+    SIMD::binary<SIMDOpMul>(bufferOut, bufferOut, bufferIn, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::div(float *buffer, int n, float value)
+{
+    SIMD::constant<SIMDOpDiv>(buffer, buffer, value, n);
+    return buffer;
+}
+
+template<>
+inline float *Buffer<float>::div(float *bufferOut, float *bufferIn0, float *bufferIn1, int n)
+{
+    SIMD::binary<SIMDOpDiv>(bufferOut, bufferIn0, bufferIn1, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::div(float *bufferOut, float *bufferIn, int n)
+{
+    SIMD::binary<SIMDOpDiv>(bufferOut, bufferOut, bufferIn, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::minimum(float *bufferOut, float *bufferIn, int n)
+{
+    SIMD::binary<SIMDOpMin>(bufferOut, bufferOut, bufferIn, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::maximum(float *bufferOut, float *bufferIn, int n)
+{
+    SIMD::binary<SIMDOpMax>(bufferOut, bufferOut, bufferIn, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::blend(float *bufferOut, float *bufferIn, float *weight, int n)
+{
+    SIMD::blend(bufferOut, bufferOut, bufferIn, weight, n);
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::addS(float *bufferOut, float *bufferIn, int n, int channels)
+{
+    if(channels == 1) {
+        SIMD::binary<SIMDOpAdd>(bufferOut, bufferOut, bufferIn, n);
+        return bufferOut;
+    }
+
+    SIMDParallel(n, [bufferOut, bufferIn, channels](int start, int end) {
+        for(int ind = start; ind < end; ind++) {
+            float *out = bufferOut + ind * channels;
+            float val = bufferIn[ind];
+
+            for(int j = 0; j < channels; j++) {
+                out[j] += val;
+            }
+        }
+    });
+
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::subS(float *bufferOut, float *bufferIn, int n, int channels)
+{
+    if(channels == 1) {
+        SIMD::binary<SIMDOpSub>(bufferOut, bufferOut, bufferIn, n);
+        return bufferOut;
+    }
+
+    SIMDParallel(n, [bufferOut, bufferIn, channels](int start, int end) {
+        for(int ind = start; ind < end; ind++) {
+            float *out = bufferOut + ind * channels;
+            float val = bufferIn[ind];
+
+            for(int j = 0; j < channels; j++) {
+                out[j] -= val;
+            }
+        }
+    });
+
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::mulS(float *bufferOut, float *bufferIn, int n, int channels)
+{
+    if(channels == 1) {
+        SIMD::binary<SIMDOpMul>(bufferOut, bufferOut, bufferIn, n);
+        return bufferOut;
+    }
+
+    SIMDParallel(n, [bufferOut, bufferIn, channels](int start, int end) {
+        for(int ind = start; ind < end; ind++) {
+            float *out = bufferOut + ind * channels;
+            float val = bufferIn[ind];
+
+            for(int j = 0; j < channels; j++) {
+                out[j] *= val;
+            }
+        }
+    });
+
+    return bufferOut;
+}
+
+template<>
+inline float *Buffer<float>::divS(float *bufferOut, float *bufferIn, int n, int channels)
+{
+    if(channels == 1) {
+        SIMD::binary<SIMDOpDiv>(bufferOut, bufferOut, bufferIn, n);
+        return bufferOut;
+    }
+
+    SIMDParallel(n, [bufferOut, bufferIn, channels](int start, int end) {
+        for(int ind = start; ind < end; ind++) {
+            float *out = bufferOut + ind * channels;
+            float val = bufferIn[ind];
+
+            for(int j = 0; j < channels; j++) {
+                out[j] /= val;
+            }
+        }
+    });
+
+    return bufferOut;
+}
+
 } // end namespace pic
 
 #endif /* PIC_UTIL_BUFFER_HPP */
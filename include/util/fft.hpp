@@ -19,7 +19,9 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #define PIC_UTIL_FFT_HPP
 
 #include <string.h>
+#include <math.h>
 #include <complex>
+#include <vector>
 
 #include "../base.hpp"
 #include "../util/math.hpp"
@@ -128,7 +130,7 @@ PIC_INLINE float *FFTIterative1D(float *in, unsigned int n, float *out = NULL)
     }
 
     for(unsigned int s = 1; s <= logn; s++) {
-        int m = 1 << s;
+        unsigned int m = 1 << s;
         float angle = -C_PI_2 / float(m);
 
         complexf omega_m = complexf(cosf(angle), sinf(angle));
@@ -159,6 +161,118 @@ PIC_INLINE float *FFTIterative1D(float *in, unsigned int n, float *out = NULL)
     return out;
 }
 
+/**
+ * @brief The FFTPlan1D class is a planned radix-2 FFT of size n; bit reversal
+ * indices and twiddle factors are computed once and reused by all transforms.
+ */
+class FFTPlan1D
+{
+protected:
+    std::vector<unsigned int> bit_rev;
+    std::vector<complexf> twiddles;
+
+public:
+    unsigned int n, logn;
+
+    /**
+     * @brief FFTPlan1D
+     */
+    FFTPlan1D()
+    {
+        n = 0;
+        logn = 0;
+    }
+
+    /**
+     * @brief FFTPlan1D
+     * @param n is the size of the transform; it has to be a power of two.
+     */
+    FFTPlan1D(unsigned int n)
+    {
+        this->n = 0;
+        logn = 0;
+        setup(n);
+    }
+
+    /**
+     * @brief setup plans a transform of size n.
+     * @param n is the size of the transform; it has to be a power of two.
+     */
+    void setup(unsigned int n)
+    {
+        if(n == this->n) {
+            return;
+        }
+
+        this->n = n;
+        logn = 0;
+        while((1u << logn) < n) {
+            logn++;
+        }
+
+        bit_rev.resize(n);
+        for(unsigned int i = 0; i < n; i++) {
+            bit_rev[i] = bitReversal(i, logn);
+        }
+
+        //twiddles are computed in double precision
+        unsigned int half = n >> 1;
+        twiddles.resize(half > 0 ? half : 1);
+        for(unsigned int i = 0; i < half; i++) {
+            double angle = -2.0 * 3.14159265358979323846 * double(i) / double(n);
+            twiddles[i] = complexf(float(cos(angle)), float(sin(angle)));
+        }
+    }
+
+    /**
+     * @brief transform computes an in-place unnormalized FFT.
+     * @param data is an array of n complex values.
+     * @param bInverse if it is true, the inverse transform is computed
+     * (without the 1/n scaling).
+     */
+    void transform(complexf *data, bool bInverse) const
+    {
+        for(unsigned int i = 0; i < n; i++) {
+            unsigned int j = bit_rev[i];
+            if(i < j) {
+                complexf tmp = data[i];
+                data[i] = data[j];
+                data[j] = tmp;
+            }
+        }
+
+        float sign = bInverse ? -1.0f : 1.0f;
+        float *d = reinterpret_cast<float *>(data);
+
+        for(unsigned int s = 1; s <= logn; s++) {
+            unsigned int m = 1 << s;
+            unsigned int half_m = m >> 1;
+            unsigned int step = n >> s;
+
+            for(unsigned int j = 0; j < half_m; j++) {
+                float w_re = twiddles[j * step].real();
+                float w_im = twiddles[j * step].imag() * sign;
+
+                for(unsigned int k = j; k < n; k += m) {
+                    unsigned int ind = k + half_m;
+
+                    float t_re = w_re * d[RE(ind)] - w_im * d[IM(ind)];
+                    float t_im = w_re * d[IM(ind)] + w_im * d[RE(ind)];
+
+                    float u_re = d[RE(k)];
+                    float u_im = d[IM(k)];
+
+                    d[RE(k)] = u_re + t_re;
+                    d[IM(k)] = u_im + t_im;
+
+                    d[RE(ind)] = u_re - t_re;
+                    d[IM(ind)] = u_im - t_im;
+                }
+            }
+        }
+    }
+};
+
 /**
  * @brief fftTest
  */
@@ -0,0 +1,381 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_FFT_2D_HPP
+#define PIC_UTIL_FFT_2D_HPP
+
+#include <vector>
+
+#include "../base.hpp"
+#include "../image.hpp"
+#include "../util/fft.hpp"
+#include "../util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The FFT2D class is a planned 2D real-to-complex FFT of power of two
+ * size. The spectrum has height rows of (width / 2 + 1) complex values; the other
+ * half is given by Hermitian symmetry. Rows are transformed two at a time as the
+ * real and imaginary parts of a complex FFT, and rows and columns are split
+ * among the threads of the ThreadPool.
+ */
+class FFT2D
+{
+protected:
+    FFTPlan1D plan_w, plan_h;
+
+public:
+    int width, height, width_c;
+
+    /**
+     * @brief FFT2D
+     */
+    FFT2D()
+    {
+        width = 0;
+        height = 0;
+        width_c = 0;
+    }
+
+    /**
+     * @brief getPowerOfTwo
+     * @param n
+     * @return This function returns the smallest power of two greater than
+     * or equal to n (and at least 2).
+     */
+    static int getPowerOfTwo(int n)
+    {
+        int ret = 2;
+        while(ret < n) {
+            ret <<= 1;
+        }
+        return ret;
+    }
+
+    /**
+     * @brief setup plans the transforms.
+     * @param width is the horizontal size; it has to be a power of two.
+     * @param height is the vertical size; it has to be a power of two.
+     */
+    void setup(int width, int height)
+    {
+        this->width = width;
+        this->height = height;
+        width_c = (width >> 1) + 1;
+
+        plan_w.setup(width);
+        plan_h.setup(height);
+    }
+
+    /**
+     * @brief spectrumSize
+     * @return This function returns the number of complex values of the spectrum.
+     */
+    int spectrumSize()
+    {
+        return width_c * height;
+    }
+
+    /**
+     * @brief forward computes the spectrum of a real buffer.
+     * @param in is a buffer of width * height floats.
+     * @param out is a buffer of spectrumSize() complex values.
+     */
+    void forward(const float *in, complexf *out)
+    {
+        int w = width;
+        int wc = width_c;
+
+        //rows: two real rows in a complex FFT
+        ThreadPool::getInstance()->parallelFor(0, height >> 1, [this, in, out, w, wc](int start, int end) {
+            std::vector<complexf> z(w);
+
+            for(int r = start; r < end; r++) {
+                const float *row0 = in + (r * 2) * w;
+                const float *row1 = row0 + w;
+
+                for(int x = 0; x < w; x++) {
+                    z[x] = complexf(row0[x], row1[x]);
+                }
+
+                plan_w.transform(&z[0], false);
+
+                complexf *out0 = out + (r * 2) * wc;
+                complexf *out1 = out0 + wc;
+
+                for(int k = 0; k < wc; k++) {
+                    complexf a = z[k];
+                    complexf b = std::conj(z[(w - k) & (w - 1)]);
+
+                    out0[k] = complexf((a.real() + b.real()) * 0.5f, (a.imag() + b.imag()) * 0.5f);
+                    //(a - b) / 2i
+                    out1[k] = complexf((a.imag() - b.imag()) * 0.5f, (b.real() - a.real()) * 0.5f);
+                }
+            }
+        });
+
+        transformColumns(out, false);
+    }
+
+    /**
+     * @brief inverse computes a real buffer from its spectrum (normalized by
+     * 1 / (width * height)). The spectrum is overwritten.
+     * @param in is a buffer of spectrumSize() complex values.
+     * @param out is a buffer of width * height floats.
+     */
+    void inverse(complexf *in, float *out)
+    {
+        transformColumns(in, true);
+
+        int w = width;
+        int wc = width_c;
+        float scale = 1.0f / (float(width) * float(height));
+
+        ThreadPool::getInstance()->parallelFor(0, height >> 1, [this, in, out, w, wc, scale](int start, int end) {
+            std::vector<complexf> z(w);
+
+            for(int r = start; r < end; r++) {
+                complexf *in0 = in + (r * 2) * wc;
+                complexf *in1 = in0 + wc;
+
+                //z = X0 + i X1, using the Hermitian symmetry of X0 and X1
+                for(int k = 0; k < wc; k++) {
+                    complexf a = in0[k];
+                    complexf b = in1[k];
+                    z[k] = complexf(a.real() - b.imag(), a.imag() + b.real());
+                }
+
+                for(int k = wc; k < w; k++) {
+                    complexf a = std::conj(in0[w - k]);
+                    complexf b = std::conj(in1[w - k]);
+                    z[k] = complexf(a.real() - b.imag(), a.imag() + b.real());
+                }
+
+                plan_w.transform(&z[0], true);
+
+                float *row0 = out + (r * 2) * w;
+                float *row1 = row0 + w;
+
+                for(int x = 0; x < w; x++) {
+                    row0[x] = z[x].real() * scale;
+                    row1[x] = z[x].imag() * scale;
+                }
+            }
+        });
+    }
+
+    /**
+     * @brief transformColumns
+     * @param data
+     * @param bInverse
+     */
+    void transformColumns(complexf *data, bool bInverse)
+    {
+        int h = height;
+        int wc = width_c;
+
+        ThreadPool::getInstance()->parallelFor(0, wc, [this, data, bInverse, h, wc](int start, int end) {
+            std::vector<complexf> col(h);
+
+            for(int k = start; k < end; k++) {
+                for(int y = 0; y < h; y++) {
+                    col[y] = data[y * wc + k];
+                }
+
+                plan_h.transform(&col[0], bInverse);
+
+                for(int y = 0; y < h; y++) {
+                    data[y * wc + k] = col[y];
+                }
+            }
+        });
+    }
+};
+
+/**
+ * @brief The FFTConvolver2D class computes the same result of FilterConv2D
+ * (i.e., correlation with clamped borders) in the frequency domain.
+ * The kernel spectrum is computed once in setup and it is reused by all
+ * process calls with images of the same size.
+ */
+class FFTConvolver2D
+{
+protected:
+    FFT2D fft;
+    int width, height, c_w_h, c_h_h, kernel_channels;
+    std::vector< std::vector<complexf> > kernel_hat;
+
+public:
+
+    /**
+     * @brief FFTConvolver2D
+     */
+    FFTConvolver2D()
+    {
+        width = 0;
+        height = 0;
+        c_w_h = 0;
+        c_h_h = 0;
+        kernel_channels = 0;
+    }
+
+    /**
+     * @brief isSetup
+     * @param width
+     * @param height
+     * @return This function returns true if the convolver is set up for
+     * images of size width x height.
+     */
+    bool isSetup(int width, int height)
+    {
+        return (kernel_channels > 0) && (this->width == width) && (this->height == height);
+    }
+
+    /**
+     * @brief setup computes the kernel spectrum.
+     * @param width is the horizontal size of images to be filtered.
+     * @param height is the vertical size of images to be filtered.
+     * @param kernel is the convolution kernel.
+     * @return This function returns true if it is successfull.
+     */
+    bool setup(int width, int height, Image *kernel)
+    {
+        if(kernel == NULL || width < 1 || height < 1) {
+            return false;
+        }
+
+        if(!kernel->isValid()) {
+            return false;
+        }
+
+        this->width = width;
+        this->height = height;
+        c_w_h = kernel->width >> 1;
+        c_h_h = kernel->height >> 1;
+        kernel_channels = kernel->channels;
+
+        fft.setup(FFT2D::getPowerOfTwo(width + 2 * c_w_h),
+                  FFT2D::getPowerOfTwo(height + 2 * c_h_h));
+
+        int pw = fft.width;
+        int ph = fft.height;
+
+        std::vector<float> buf(pw * ph);
+        kernel_hat.resize(kernel_channels);
+
+        for(int c = 0; c < kernel_channels; c++) {
+            std::fill(buf.begin(), buf.end(), 0.0f);
+
+            //the kernel is flipped and wrapped around the origin; taps
+            //are clamped as in FilterConv2D for even sizes
+            for(int k = -c_h_h; k <= c_h_h; k++) {
+                int y = (ph - k) % ph;
+
+                for(int l = -c_w_h; l <= c_w_h; l++) {
+                    int x = (pw - l) % pw;
+                    buf[y * pw + x] = (*kernel)(l + c_w_h, k + c_h_h)[c];
+                }
+            }
+
+            kernel_hat[c].resize(fft.spectrumSize());
+            fft.forward(&buf[0], &kernel_hat[c][0]);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief process
+     * @param imgIn is the input image; it has to have the size set in setup.
+     * @param imgOut is the output image.
+     * @return This function returns imgOut.
+     */
+    Image *process(Image *imgIn, Image *imgOut)
+    {
+        if(imgIn == NULL || !isSetup(imgIn->width, imgIn->height)) {
+            return imgOut;
+        }
+
+        if(imgOut == NULL) {
+            imgOut = imgIn->allocateSimilarOne();
+        }
+
+        int pw = fft.width;
+        int ph = fft.height;
+        int channels = imgOut->channels;
+
+        std::vector<float> buf(pw * ph);
+        std::vector<complexf> spectrum(fft.spectrumSize());
+
+        for(int f = 0; f < imgOut->frames; f++) {
+            for(int c = 0; c < channels; c++) {
+                //padding with clamped borders
+                int cw = c_w_h;
+                int ch = c_h_h;
+                float *b = &buf[0];
+
+                ThreadPool::getInstance()->parallelFor(0, ph, [imgIn, b, pw, cw, ch, c, f, this](int start, int end) {
+                    for(int y = start; y < end; y++) {
+                        float *row = b + y * pw;
+
+                        if(y >= (height + 2 * ch)) {
+                            std::fill(row, row + pw, 0.0f);
+                            continue;
+                        }
+
+                        for(int x = 0; x < (width + 2 * cw); x++) {
+                            row[x] = (*imgIn)(x - cw, y - ch, f)[c];
+                        }
+
+                        std::fill(row + width + 2 * cw, row + pw, 0.0f);
+                    }
+                });
+
+                fft.forward(b, &spectrum[0]);
+
+                complexf *k_hat = &kernel_hat[c % kernel_channels][0];
+                int n = fft.spectrumSize();
+                complexf *s = &spectrum[0];
+
+                for(int i = 0; i < n; i++) {
+                    float a_re = s[i].real();
+                    float a_im = s[i].imag();
+                    float b_re = k_hat[i].real();
+                    float b_im = k_hat[i].imag();
+                    s[i] = complexf(a_re * b_re - a_im * b_im, a_re * b_im + a_im * b_re);
+                }
+
+                fft.inverse(s, b);
+
+                for(int y = 0; y < height; y++) {
+                    float *row = b + (y + ch) * pw + cw;
+
+                    for(int x = 0; x < width; x++) {
+                        (*imgOut)(x, y, f)[c] = row[x];
+                    }
+                }
+            }
+        }
+
+        return imgOut;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_FFT_2D_HPP */
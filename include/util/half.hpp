@@ -0,0 +1,219 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_HALF_HPP
+#define PIC_UTIL_HALF_HPP
+
+#include <string.h>
+
+#include "../base.hpp"
+#include "../util/simd.hpp"
+
+namespace pic {
+
+/**
+ * @brief The Half class is an IEEE 754 half-precision float (binary16).
+ * Conversions from float round to nearest even, and they keep infinities,
+ * NaNs and subnormals.
+ */
+class Half
+{
+protected:
+
+#ifdef PIC_SIMD_X86
+    PIC_SIMD_TARGET_F16C static int toHalfF16C(const float *in, Half *out, int n)
+    {
+        int i = 0;
+        for(; i <= (n - 8); i += 8) {
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128((__m128i *)(out + i), h);
+        }
+
+        return i;
+    }
+
+    PIC_SIMD_TARGET_F16C static int toFloatF16C(const Half *in, float *out, int n)
+    {
+        int i = 0;
+        for(; i <= (n - 8); i += 8) {
+            __m128i h = _mm_loadu_si128((const __m128i *)(in + i));
+            _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+        }
+
+        return i;
+    }
+#endif
+
+public:
+    unsigned short bits;
+
+    Half()
+    {
+    }
+
+    Half(float value)
+    {
+        bits = fromFloat(value);
+    }
+
+    operator float() const
+    {
+        return toFloat(bits);
+    }
+
+    /**
+     * @brief fromFloat
+     * @param value
+     * @return This function returns the half bits of value.
+     */
+    static unsigned short fromFloat(float value)
+    {
+        unsigned int x;
+        memcpy(&x, &value, sizeof(float));
+
+        unsigned int sign = (x >> 16) & 0x8000;
+        unsigned int abs = x & 0x7fffffff;
+
+        //infinities and NaNs
+        if(abs >= 0x7f800000) {
+            return (unsigned short)(sign | 0x7c00 |
+                                    ((abs > 0x7f800000) ? (0x200 | ((abs >> 13) & 0x3ff)) : 0));
+        }
+
+        //too large: it rounds to infinity
+        if(abs >= 0x477ff000) {
+            return (unsigned short)(sign | 0x7c00);
+        }
+
+        //subnormals
+        if(abs < 0x38800000) {
+            if(abs <= 0x33000000) {
+                return (unsigned short) sign;
+            }
+
+            unsigned int e = abs >> 23;
+            unsigned int m = (abs & 0x7fffff) | 0x800000;
+            unsigned int shift = 126 - e;
+
+            unsigned int h = m >> shift;
+            unsigned int rem = m & ((1u << shift) - 1);
+            unsigned int halfway = 1u << (shift - 1);
+
+            if((rem > halfway) || ((rem == halfway) && (h & 1))) {
+                h++;
+            }
+
+            return (unsigned short)(sign | h);
+        }
+
+        //normals: exponent re-biasing
+        unsigned int h = (abs - 0x38000000) >> 13;
+        unsigned int rem = abs & 0x1fff;
+
+        if((rem > 0x1000) || ((rem == 0x1000) && (h & 1))) {
+            h++;
+        }
+
+        return (unsigned short)(sign | h);
+    }
+
+    /**
+     * @brief toFloat
+     * @param bits
+     * @return This function returns the float value of half bits.
+     */
+    static float toFloat(unsigned short bits)
+    {
+        unsigned int sign = (unsigned int)(bits & 0x8000) << 16;
+        int e = (bits >> 10) & 0x1f;
+        unsigned int m = bits & 0x3ff;
+        unsigned int x;
+
+        if(e == 0) {
+            if(m == 0) {
+                x = sign;
+            } else {
+                //subnormals are normalized
+                e = 1;
+                while((m & 0x400) == 0) {
+                    m <<= 1;
+                    e--;
+                }
+
+                m &= 0x3ff;
+                x = sign | ((unsigned int)(e + 112) << 23) | (m << 13);
+            }
+        } else {
+            if(e == 31) {
+                //NaNs are quieted like F16C does
+                x = sign | 0x7f800000 | (m << 13) | (m != 0 ? 0x400000 : 0);
+            } else {
+                x = sign | ((unsigned int)(e + 112) << 23) | (m << 13);
+            }
+        }
+
+        float ret;
+        memcpy(&ret, &x, sizeof(float));
+        return ret;
+    }
+
+    /**
+     * @brief convert converts a buffer of floats into halves.
+     * @param in
+     * @param out
+     * @param n
+     */
+    static void convert(const float *in, Half *out, int n)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if(SIMD::get() >= SIMD_AVX2) {
+            i = toHalfF16C(in, out, n);
+        }
+#endif
+
+        for(; i < n; i++) {
+            out[i].bits = fromFloat(in[i]);
+        }
+    }
+
+    /**
+     * @brief convert converts a buffer of halves into floats.
+     * @param in
+     * @param out
+     * @param n
+     */
+    static void convert(const Half *in, float *out, int n)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if(SIMD::get() >= SIMD_AVX2) {
+            i = toFloatF16C(in, out, n);
+        }
+#endif
+
+        for(; i < n; i++) {
+            out[i] = toFloat(in[i].bits);
+        }
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_HALF_HPP */
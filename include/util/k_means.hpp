@@ -21,11 +21,13 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <vector>
 #include <set>
 #include <chrono>
+#include <random>
 
 #include "../base.hpp"
 #include "../util/array.hpp"
 #include "../util/math.hpp"
 #include "../util/std_util.hpp"
+#include "../util/thread_pool.hpp"
 
 namespace pic{
 
@@ -71,6 +73,273 @@ protected:
         return label;
     }
 
+    /**
+     * @brief assignLabel2 finds the two closest centers.
+     * @param sample_j
+     * @param nDim
+     * @param centers
+     * @param dist_1 is the squared distance from the closest center.
+     * @param dist_2 is the squared distance from the second closest center.
+     * @return This function returns the label of the closest center.
+     */
+    uint assignLabel2(T* sample_j, int nDim, T* centers, T &dist_1, T &dist_2)
+    {
+        dist_1 = Array<T>::distanceSq(sample_j, &centers[0], nDim);
+        dist_2 = dist_1;
+        uint label = 0;
+        bool bSecond = false;
+
+        for(uint i = 1; i < k; i++) {
+            T *center_i = &centers[i * nDim];
+
+            T tmp_dist = Array<T>::distanceSq(sample_j, center_i, nDim);
+
+            if(tmp_dist < dist_1) {
+                dist_2 = dist_1;
+                dist_1 = tmp_dist;
+                label = i;
+            } else {
+                if(!bSecond || (tmp_dist < dist_2)) {
+                    dist_2 = tmp_dist;
+                }
+            }
+
+            bSecond = true;
+        }
+
+        return label;
+    }
+
+    /**
+     * @brief assignAll assigns all samples to their closest center in parallel.
+     * @param samples
+     * @param nSamples
+     * @param nDim
+     * @param centers
+     * @param assignment
+     */
+    void assignAll(T *samples, int nSamples, int nDim, T *centers, uint *assignment)
+    {
+        ThreadPool::getInstance()->parallelFor(0, nSamples, [&](int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                assignment[i] = assignLabel(&samples[i * nDim], nDim, centers);
+            }
+        }, 1024);
+    }
+
+    /**
+     * @brief updateCenters computes the means of the clusters in parallel;
+     * centers of empty clusters are not moved.
+     * @param samples
+     * @param nSamples
+     * @param nDim
+     * @param assignment
+     * @param centers
+     * @param move is the distance between old and new centers.
+     * @return This function returns true if no center has moved.
+     */
+    bool updateCenters(T *samples, int nSamples, int nDim, uint *assignment, T *centers, std::vector<T> &move)
+    {
+        //a fixed number of blocks makes sums independent of threads
+        int nBlocks = MIN(64, (nSamples + 4095) / 4096);
+        nBlocks = MAX(nBlocks, 1);
+
+        int kDim = k * nDim;
+        std::vector<double> sums(size_t(nBlocks) * kDim, 0.0);
+        std::vector<int> counts(size_t(nBlocks) * k, 0);
+
+        ThreadPool::getInstance()->run(nBlocks, [&](int b) {
+            int i0 = int((long long)(nSamples) * b / nBlocks);
+            int i1 = int((long long)(nSamples) * (b + 1) / nBlocks);
+
+            double *sum_b = &sums[size_t(b) * kDim];
+            int *count_b = &counts[size_t(b) * k];
+
+            for(int i = i0; i < i1; i++) {
+                uint a = assignment[i];
+                T *sample_i = &samples[i * nDim];
+                double *sum_a = &sum_b[a * nDim];
+
+                for(int j = 0; j < nDim; j++) {
+                    sum_a[j] += double(sample_i[j]);
+                }
+
+                count_b[a]++;
+            }
+        });
+
+        bool bNoChanges = true;
+
+        for(uint c = 0; c < k; c++) {
+            int count = 0;
+            for(int b = 0; b < nBlocks; b++) {
+                count += counts[size_t(b) * k + c];
+            }
+
+            move[c] = T(0);
+
+            if(count == 0) {
+                continue;
+            }
+
+            T dist = T(0);
+            for(int j = 0; j < nDim; j++) {
+                double sum = 0.0;
+                for(int b = 0; b < nBlocks; b++) {
+                    sum += sums[size_t(b) * kDim + c * nDim + j];
+                }
+
+                T mean = T(sum / double(count));
+                T tmp = mean - centers[c * nDim + j];
+                dist += tmp * tmp;
+                centers[c * nDim + j] = mean;
+            }
+
+            move[c] = T(sqrt(double(dist)));
+
+            if(float(dist) > 1e-6f) {
+                bNoChanges = false;
+            }
+        }
+
+        return bNoChanges;
+    }
+
+    /**
+     * @brief processLloyd runs Lloyd's iterations using Hamerly's bounds
+     * for skipping distance computations; each sample keeps an upper bound
+     * of the distance from its center and a lower bound of the distance
+     * from the second closest one.
+     * @param samples
+     * @param nSamples
+     * @param nDim
+     * @param centers
+     * @param assignment
+     */
+    void processLloyd(T *samples, int nSamples, int nDim, T *centers, uint *assignment)
+    {
+        std::vector<T> upper(nSamples), lower(nSamples);
+        std::vector<T> move(k), half_sep(k);
+
+        ThreadPool *tp = ThreadPool::getInstance();
+
+        tp->parallelFor(0, nSamples, [&](int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                T d1, d2;
+                assignment[i] = assignLabel2(&samples[i * nDim], nDim, centers, d1, d2);
+                upper[i] = T(sqrt(double(d1)));
+                lower[i] = T(sqrt(double(d2)));
+            }
+        }, 1024);
+
+        for(uint iter = 0; iter < maxIter; iter++) {
+            if(updateCenters(samples, nSamples, nDim, assignment, centers, move)) {
+                #ifdef PIC_DEBUG
+                    printf("Max iterations: %d\n", iter);
+                #endif
+                return;
+            }
+
+            //the two largest moves
+            uint c_max = 0;
+            T move_1 = T(0), move_2 = T(0);
+            for(uint c = 0; c < k; c++) {
+                if(move[c] > move_1) {
+                    move_2 = move_1;
+                    move_1 = move[c];
+                    c_max = c;
+                } else {
+                    if(move[c] > move_2) {
+                        move_2 = move[c];
+                    }
+                }
+            }
+
+            //half distance from the closest other center
+            for(uint c = 0; c < k; c++) {
+                T d = T(-1);
+                for(uint c2 = 0; c2 < k; c2++) {
+                    if(c2 != c) {
+                        T tmp = Array<T>::distanceSq(&centers[c * nDim], &centers[c2 * nDim], nDim);
+                        d = ((d < T(0)) || (tmp < d)) ? tmp : d;
+                    }
+                }
+
+                half_sep[c] = (d < T(0)) ? T(0) : T(sqrt(double(d)) * 0.5);
+            }
+
+            tp->parallelFor(0, nSamples, [&](int i0, int i1) {
+                for(int i = i0; i < i1; i++) {
+                    uint a = assignment[i];
+
+                    upper[i] += move[a];
+                    lower[i] -= (a == c_max) ? move_2 : move_1;
+
+                    T bound = MAX(half_sep[a], lower[i]);
+
+                    if(upper[i] <= bound) {
+                        continue;
+                    }
+
+                    T *sample_i = &samples[i * nDim];
+                    upper[i] = T(sqrt(double(Array<T>::distanceSq(sample_i, &centers[a * nDim], nDim))));
+
+                    if(upper[i] <= bound) {
+                        continue;
+                    }
+
+                    T d1, d2;
+                    assignment[i] = assignLabel2(sample_i, nDim, centers, d1, d2);
+                    upper[i] = T(sqrt(double(d1)));
+                    lower[i] = T(sqrt(double(d2)));
+                }
+            }, 1024);
+        }
+    }
+
+    /**
+     * @brief processMiniBatch runs mini-batch k-means: each iteration moves
+     * centers towards a random batch of samples with per-center learning
+     * rates.
+     * @param samples
+     * @param nSamples
+     * @param nDim
+     * @param centers
+     */
+    void processMiniBatch(T *samples, int nSamples, int nDim, T *centers)
+    {
+        std::mt19937 m(42);
+
+        std::vector<int> batch(batchSize);
+        std::vector<uint> batch_labels(batchSize);
+        std::vector<double> counts(k, 0.0);
+
+        for(uint iter = 0; iter < maxIter; iter++) {
+            for(int i = 0; i < batchSize; i++) {
+                batch[i] = int(m() % uint(nSamples));
+            }
+
+            ThreadPool::getInstance()->parallelFor(0, batchSize, [&](int i0, int i1) {
+                for(int i = i0; i < i1; i++) {
+                    batch_labels[i] = assignLabel(&samples[batch[i] * nDim], nDim, centers);
+                }
+            }, 256);
+
+            for(int i = 0; i < batchSize; i++) {
+                uint c = batch_labels[i];
+                counts[c] += 1.0;
+
+                T eta = T(1.0 / counts[c]);
+                T *center_c = &centers[c * nDim];
+                T *sample_i = &samples[batch[i] * nDim];
+
+                for(int j = 0; j < nDim; j++) {
+                    center_c[j] += eta * (sample_i[j] - center_c[j]);
+                }
+            }
+        }
+    }
+
     virtual T* initCenters(T *samples, int nSamples, int nDim, T* centers)
     {
         if(centers == NULL) {
@@ -112,24 +381,43 @@ protected:
     }
 
     uint k, maxIter;
+    int batchSize;
 
 public:
 
-    KMeans(uint k, uint maxIter)
+    KMeans(uint k, uint maxIter, int batchSize = 0)
     {
-        setup(k, maxIter);
+        setup(k, maxIter, batchSize);
     }
 
-    void setup(uint k, uint maxIter = 100)
+    /**
+     * @brief setup
+     * @param k is the number of clusters.
+     * @param maxIter is the maximum number of iterations.
+     * @param batchSize if it is greater than zero, mini-batch k-means is
+     * used with batches of batchSize samples.
+     */
+    void setup(uint k, uint maxIter = 100, int batchSize = 0)
     {
         this->k = k;
         this->maxIter = maxIter;
+        this->batchSize = batchSize;
     }
+
+    /**
+     * @brief Process clusters samples; it runs in parallel.
+     * @param samples is an array of nSamples samples of nDim values.
+     * @param nSamples
+     * @param nDim
+     * @param centers
+     * @param labels is the list of the samples of each cluster.
+     * @return This function returns the centers of the clusters.
+     */
     T* Process(T *samples, int nSamples, int nDim,
                T* centers,
                std::vector< std::set<uint> *> &labels)
     {
-        if(nSamples < k) {
+        if(nSamples < int(k)) {
             return NULL;
         }
 
@@ -140,68 +428,31 @@ public:
 
         centers = initCenters(samples, nSamples, nDim, centers);
 
-        for(uint i = 0; i < nSamples; i++) {
-            T *sample_i = &samples[i * nDim];
+        std::vector<uint> assignment(nSamples);
 
-            uint label = assignLabel(sample_i, nDim, centers);
-            labels[label]->insert(i);
+        if((batchSize > 0) && (batchSize < nSamples)) {
+            processMiniBatch(samples, nSamples, nDim, centers);
+            assignAll(samples, nSamples, nDim, centers, &assignment[0]);
+        } else {
+            processLloyd(samples, nSamples, nDim, centers, &assignment[0]);
         }
 
-        T *mean = new T[k * nDim];
-
-        for(uint i = 0; i < maxIter; i++) {
-            bool bNoChanges = true;
-
-            for(uint j = 0; j < k; j++) {
-                //compute new means
-                int index = j * nDim;
-                std::set<uint> *tmp = labels.at(j);
-                getMean(samples, &mean[index], nDim, tmp);
-
-                //update centers
-                float dist = Arrayf::distanceSq(&centers[index], &mean[index], nDim);
-
-                Arrayf::assign(&mean[index], nDim, &centers[index]);
-
-                if(dist > 1e-6f) {
-                    bNoChanges = false;
-                }
-            }
-
-            if(bNoChanges) {
-                #ifdef PIC_DEBUG
-                    printf("Max iterations: %d\n", i);
-                #endif
-
-                delete[] mean;
-                return centers;
-            } else {
-                //clear labels
-                for(uint j = 0; j < k; j++) {
-                    labels[j]->clear();
-                }
-
-                //re-assign labels
-                for(uint j = 0; j < nSamples; j++) {
-                    T *sample_j = &samples[j * nDim];
-                    uint label = assignLabel(sample_j, nDim, centers);
-                    labels[label]->insert(j);
-                }
-            }
+        //samples are inserted in order
+        for(int i = 0; i < nSamples; i++) {
+            std::set<uint> *label = labels[assignment[i]];
+            label->insert(label->end(), uint(i));
         }
 
-        delete[] mean;
-
         return centers;
     }
 
     static T* execute(T *samples, int nSamples, int nDim,
                       T* centers, int k,
                       std::vector< std::set<uint> *> &labels,
-                      uint maxIter = 100)
+                      uint maxIter = 100, int batchSize = 0)
     {
 
-        KMeans<T> km(k, maxIter);
+        KMeans<T> km(k, maxIter, batchSize);
 
         return km.Process(samples, nSamples, nDim, centers, labels);
     }
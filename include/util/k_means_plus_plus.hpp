@@ -0,0 +1,123 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_K_MEANS_PLUS_PLUS_HPP
+#define PIC_UTIL_K_MEANS_PLUS_PLUS_HPP
+
+#include <vector>
+#include <set>
+#include <random>
+
+#include "../base.hpp"
+#include "../util/array.hpp"
+#include "../util/math.hpp"
+#include "../util/std_util.hpp"
+#include "../util/thread_pool.hpp"
+#include "../util/k_means.hpp"
+
+namespace pic{
+
+/**
+ * @brief The KMeansPlusPlus class is k-means with k-means++ seeding: each
+ * new center is a sample chosen with probability proportional to its
+ * squared distance from the closest center already chosen.
+ */
+template<class T>
+class KMeansPlusPlus: public KMeans<T>
+{
+protected:
+
+    T* initCenters(T *samples, int nSamples, int nDim, T* centers)
+    {
+        std::mt19937 m(42);
+        std::uniform_real_distribution<double> dist_u(0.0, 1.0);
+
+        if(centers == NULL) {
+            centers = new T[this->k * nDim];
+        }
+
+        uint index = m() % nSamples;
+        Array<T>::assign(&samples[index * nDim], nDim, &centers[0]);
+
+        std::vector<T> dist(nSamples);
+
+        ThreadPool *tp = ThreadPool::getInstance();
+
+        tp->parallelFor(0, nSamples, [&](int i0, int i1) {
+            for(int i = i0; i < i1; i++) {
+                dist[i] = Array<T>::distanceSq(&samples[i * nDim], &centers[0], nDim);
+            }
+        }, 1024);
+
+        for(uint c = 1; c < this->k; c++) {
+            double sum = 0.0;
+            for(int i = 0; i < nSamples; i++) {
+                sum += double(dist[i]);
+            }
+
+            //all samples are centers already
+            if(sum <= 0.0) {
+                index = m() % nSamples;
+            } else {
+                double r = dist_u(m) * sum;
+
+                index = nSamples - 1;
+                double acc = 0.0;
+                for(int i = 0; i < nSamples; i++) {
+                    acc += double(dist[i]);
+                    if(acc >= r && dist[i] > T(0)) {
+                        index = i;
+                        break;
+                    }
+                }
+            }
+
+            T *center_c = &centers[c * nDim];
+            Array<T>::assign(&samples[index * nDim], nDim, center_c);
+
+            tp->parallelFor(0, nSamples, [&](int i0, int i1) {
+                for(int i = i0; i < i1; i++) {
+                    T tmp = Array<T>::distanceSq(&samples[i * nDim], center_c, nDim);
+                    dist[i] = MIN(dist[i], tmp);
+                }
+            }, 1024);
+        }
+
+        return centers;
+    }
+
+public:
+
+    KMeansPlusPlus(uint k, uint maxIter, int batchSize = 0) : KMeans<T>(k, maxIter, batchSize)
+    {
+    }
+
+    static T* execute(T *samples, int nSamples, int nDim,
+                      T* centers, int k,
+                      std::vector< std::set<uint> *> &labels,
+                      uint maxIter = 100, int batchSize = 0)
+    {
+
+        KMeansPlusPlus<T> km(k, maxIter, batchSize);
+
+        return km.Process(samples, nSamples, nDim, centers, labels);
+    }
+};
+
+} //end namespace pic
+
+#endif // PIC_UTIL_K_MEANS_PLUS_PLUS_HPP
@@ -61,17 +61,17 @@ protected:
 
 public:
 
-    KMeansRand(uint k, uint maxIter) : KMeans<T>(k, maxIter)
+    KMeansRand(uint k, uint maxIter, int batchSize = 0) : KMeans<T>(k, maxIter, batchSize)
     {
     }
 
     static T* execute(T *samples, int nSamples, int nDim,
                       T* centers, int k,
                       std::vector< std::set<uint> *> &labels,
-                      uint maxIter = 100)
+                      uint maxIter = 100, int batchSize = 0)
     {
 
-        KMeansRand<T> km(k, maxIter);
+        KMeansRand<T> km(k, maxIter, batchSize);
 
         return km.Process(samples, nSamples, nDim, centers, labels);
     }
@@ -0,0 +1,250 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_MAPPED_FILE_HPP
+#define PIC_UTIL_MAPPED_FILE_HPP
+
+#include <string>
+
+#ifdef PIC_WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "../base.hpp"
+
+namespace pic {
+
+/**
+ * @brief The MappedFile class maps a whole file in memory. The mapping is
+ * private and copy-on-write: pages are shared with the page cache until
+ * they are written, and writes are never carried back to the file.
+ */
+class MappedFile
+{
+protected:
+    unsigned char *data;
+    size_t size;
+
+#ifdef PIC_WIN32
+    HANDLE hFile, hMap;
+#endif
+
+public:
+
+    /**
+     * @brief MappedFile
+     */
+    MappedFile()
+    {
+        data = NULL;
+        size = 0;
+
+#ifdef PIC_WIN32
+        hFile = INVALID_HANDLE_VALUE;
+        hMap = NULL;
+#endif
+    }
+
+    /**
+     * @brief MappedFile
+     * @param nameFile
+     */
+    MappedFile(std::string nameFile) : MappedFile()
+    {
+        open(nameFile);
+    }
+
+    ~MappedFile()
+    {
+        release();
+    }
+
+    /**
+     * @brief open maps a file in memory.
+     * @param nameFile is the file name.
+     * @return This function returns true if the file was mapped.
+     */
+    bool open(std::string nameFile)
+    {
+        release();
+
+#ifdef PIC_WIN32
+        hFile = CreateFileA(nameFile.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+        if(hFile == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(hFile, &fileSize) || (fileSize.QuadPart <= 0)) {
+            release();
+            return false;
+        }
+
+        hMap = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+        if(hMap == NULL) {
+            release();
+            return false;
+        }
+
+        data = (unsigned char *) MapViewOfFile(hMap, FILE_MAP_COPY, 0, 0, 0);
+
+        if(data == NULL) {
+            release();
+            return false;
+        }
+
+        size = size_t(fileSize.QuadPart);
+#else
+        int fd = ::open(nameFile.c_str(), O_RDONLY);
+
+        if(fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if((fstat(fd, &st) != 0) || (st.st_size <= 0)) {
+            close(fd);
+            return false;
+        }
+
+        void *ptr = mmap(NULL, size_t(st.st_size), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, 0);
+
+        //the mapping keeps its own reference to the file
+        close(fd);
+
+        if(ptr == MAP_FAILED) {
+            return false;
+        }
+
+        data = (unsigned char *) ptr;
+        size = size_t(st.st_size);
+#endif
+
+        return true;
+    }
+
+    /**
+     * @brief release unmaps the file.
+     */
+    void release()
+    {
+#ifdef PIC_WIN32
+        if(data != NULL) {
+            UnmapViewOfFile(data);
+        }
+
+        if(hMap != NULL) {
+            CloseHandle(hMap);
+            hMap = NULL;
+        }
+
+        if(hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+        }
+#else
+        if(data != NULL) {
+            munmap(data, size);
+        }
+#endif
+
+        data = NULL;
+        size = 0;
+    }
+
+    /**
+     * @brief isValid
+     * @return This function returns true if a file is mapped.
+     */
+    bool isValid()
+    {
+        return data != NULL;
+    }
+
+    /**
+     * @brief getData
+     * @return This function returns the first byte of the mapping.
+     */
+    unsigned char *getData()
+    {
+        return data;
+    }
+
+    /**
+     * @brief getSize
+     * @return This function returns the size of the mapping in bytes.
+     */
+    size_t getSize()
+    {
+        return size;
+    }
+
+    /**
+     * @brief getPageSize
+     * @return This function returns the size of a memory page in bytes.
+     */
+    static size_t getPageSize()
+    {
+#ifdef PIC_WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return size_t(info.dwPageSize);
+#else
+        return size_t(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    /**
+     * @brief discard drops from memory the pages fully inside [start, end);
+     * they are read again from the file if they are accessed later. Pages
+     * that were written must not be discarded. On Windows, this function
+     * does nothing.
+     * @param start is an offset in bytes.
+     * @param end is an offset in bytes; the last page is included if end
+     * is the size of the file.
+     */
+    void discard(size_t start, size_t end)
+    {
+#ifndef PIC_WIN32
+        if((data == NULL) || (start >= end)) {
+            return;
+        }
+
+        size_t page = getPageSize();
+
+        start = ((start + page - 1) / page) * page;
+        end = (end >= size) ? (((size + page - 1) / page) * page) : ((end / page) * page);
+
+        if(start < end) {
+            madvise(data + start, end - start, MADV_DONTNEED);
+        }
+#endif
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_MAPPED_FILE_HPP */
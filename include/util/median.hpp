@@ -0,0 +1,413 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_MEDIAN_HPP
+#define PIC_UTIL_MEDIAN_HPP
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "../base.hpp"
+#include "../image.hpp"
+#include "../util/bbox.hpp"
+#include "../util/math.hpp"
+
+namespace pic {
+
+/**
+ * @brief sortPair sorts two values.
+ * @param a
+ * @param b
+ */
+inline void sortPair(float &a, float &b)
+{
+    float t = a < b ? a : b;
+    b = a < b ? b : a;
+    a = t;
+}
+
+/**
+ * @brief sortNetwork9 sorts 9 values with 25 compare-exchanges.
+ * @param v
+ */
+inline void sortNetwork9(float *v)
+{
+    sortPair(v[0], v[3]); sortPair(v[1], v[7]); sortPair(v[2], v[5]);
+    sortPair(v[4], v[8]); sortPair(v[0], v[7]); sortPair(v[2], v[4]);
+    sortPair(v[3], v[8]); sortPair(v[5], v[6]); sortPair(v[0], v[2]);
+    sortPair(v[1], v[3]); sortPair(v[4], v[5]); sortPair(v[7], v[8]);
+    sortPair(v[1], v[4]); sortPair(v[3], v[6]); sortPair(v[5], v[7]);
+    sortPair(v[0], v[1]); sortPair(v[2], v[4]); sortPair(v[3], v[5]);
+    sortPair(v[6], v[8]); sortPair(v[2], v[3]); sortPair(v[4], v[5]);
+    sortPair(v[6], v[7]); sortPair(v[1], v[2]); sortPair(v[3], v[4]);
+    sortPair(v[5], v[6]);
+}
+
+/**
+ * @brief median9 computes the median of 9 values with 19 compare-exchanges;
+ * values are partially sorted.
+ * @param v
+ * @return
+ */
+inline float median9(float *v)
+{
+    sortPair(v[1], v[2]); sortPair(v[4], v[5]); sortPair(v[7], v[8]);
+    sortPair(v[0], v[1]); sortPair(v[3], v[4]); sortPair(v[6], v[7]);
+    sortPair(v[1], v[2]); sortPair(v[4], v[5]); sortPair(v[7], v[8]);
+    sortPair(v[0], v[3]); sortPair(v[5], v[8]); sortPair(v[4], v[7]);
+    sortPair(v[3], v[6]); sortPair(v[1], v[4]); sortPair(v[2], v[5]);
+    sortPair(v[4], v[7]); sortPair(v[4], v[2]); sortPair(v[6], v[4]);
+    sortPair(v[4], v[2]);
+    return v[4];
+}
+
+/**
+ * @brief median25 computes the median of 25 values with 99 compare-exchanges;
+ * values are partially sorted.
+ * @param v
+ * @return
+ */
+inline float median25(float *v)
+{
+    sortPair(v[0], v[1]); sortPair(v[3], v[4]); sortPair(v[2], v[4]);
+    sortPair(v[2], v[3]); sortPair(v[6], v[7]); sortPair(v[5], v[7]);
+    sortPair(v[5], v[6]); sortPair(v[9], v[10]); sortPair(v[8], v[10]);
+    sortPair(v[8], v[9]); sortPair(v[12], v[13]); sortPair(v[11], v[13]);
+    sortPair(v[11], v[12]); sortPair(v[15], v[16]); sortPair(v[14], v[16]);
+    sortPair(v[14], v[15]); sortPair(v[18], v[19]); sortPair(v[17], v[19]);
+    sortPair(v[17], v[18]); sortPair(v[21], v[22]); sortPair(v[20], v[22]);
+    sortPair(v[20], v[21]); sortPair(v[23], v[24]); sortPair(v[2], v[5]);
+    sortPair(v[3], v[6]); sortPair(v[0], v[6]); sortPair(v[0], v[3]);
+    sortPair(v[4], v[7]); sortPair(v[1], v[7]); sortPair(v[1], v[4]);
+    sortPair(v[11], v[14]); sortPair(v[8], v[14]); sortPair(v[8], v[11]);
+    sortPair(v[12], v[15]); sortPair(v[9], v[15]); sortPair(v[9], v[12]);
+    sortPair(v[13], v[16]); sortPair(v[10], v[16]); sortPair(v[10], v[13]);
+    sortPair(v[20], v[23]); sortPair(v[17], v[23]); sortPair(v[17], v[20]);
+    sortPair(v[21], v[24]); sortPair(v[18], v[24]); sortPair(v[18], v[21]);
+    sortPair(v[19], v[22]); sortPair(v[8], v[17]); sortPair(v[9], v[18]);
+    sortPair(v[0], v[18]); sortPair(v[0], v[9]); sortPair(v[10], v[19]);
+    sortPair(v[1], v[19]); sortPair(v[1], v[10]); sortPair(v[11], v[20]);
+    sortPair(v[2], v[20]); sortPair(v[2], v[11]); sortPair(v[12], v[21]);
+    sortPair(v[3], v[21]); sortPair(v[3], v[12]); sortPair(v[13], v[22]);
+    sortPair(v[4], v[22]); sortPair(v[4], v[13]); sortPair(v[14], v[23]);
+    sortPair(v[5], v[23]); sortPair(v[5], v[14]); sortPair(v[15], v[24]);
+    sortPair(v[6], v[24]); sortPair(v[6], v[15]); sortPair(v[7], v[16]);
+    sortPair(v[7], v[19]); sortPair(v[13], v[21]); sortPair(v[15], v[23]);
+    sortPair(v[7], v[13]); sortPair(v[7], v[15]); sortPair(v[1], v[9]);
+    sortPair(v[3], v[11]); sortPair(v[5], v[17]); sortPair(v[11], v[17]);
+    sortPair(v[9], v[17]); sortPair(v[4], v[10]); sortPair(v[6], v[12]);
+    sortPair(v[7], v[14]); sortPair(v[4], v[6]); sortPair(v[4], v[7]);
+    sortPair(v[12], v[14]); sortPair(v[10], v[14]); sortPair(v[6], v[7]);
+    sortPair(v[10], v[12]); sortPair(v[6], v[10]); sortPair(v[6], v[17]);
+    sortPair(v[12], v[17]); sortPair(v[7], v[17]); sortPair(v[7], v[10]);
+    sortPair(v[12], v[18]); sortPair(v[7], v[12]); sortPair(v[10], v[18]);
+    sortPair(v[12], v[20]); sortPair(v[10], v[20]); sortPair(v[10], v[12]);
+    return v[12];
+}
+
+/**
+ * @brief The MedianHistogram class computes median filters of a channel in
+ * constant time per pixel, independently from the radius (Perreault and
+ * Hebert, "Median Filtering in Constant Time", 2007). Values are quantized
+ * in 2^bits bins; HDR channels are quantized in the log domain. A histogram
+ * is kept for each column of a tile and it slides down one row at a time; the
+ * kernel histogram slides right by adding and removing a column. Histograms
+ * have a coarse and a fine level, and a fine segment of the kernel is
+ * updated only when the median falls in it.
+ */
+class MedianHistogram
+{
+protected:
+    int radius, bits, nBins, nCoarse, shift;
+    bool bLog;
+    float vMin, vMax, lo, lo_log, scale;
+
+    //counts fit in 16 bits since the radius is at most 127
+    std::vector<unsigned short> columns, columnsCoarse, kernel, kernelCoarse;
+    std::vector<int> kernelStart;
+
+    /**
+     * @brief addColumn adds (sign = 1) or removes (sign = -1) bin to column c.
+     * @param c
+     * @param bin
+     * @param sign
+     */
+    inline void addColumn(int c, int bin, int sign)
+    {
+        columns[c * nBins + bin] += sign;
+        columnsCoarse[c * nCoarse + (bin >> shift)] += sign;
+    }
+
+    /**
+     * @brief updateSegment brings the fine segment k of the kernel to the
+     * window of columns [c, c + 2 * radius].
+     * @param k
+     * @param c
+     */
+    void updateSegment(int k, int c)
+    {
+        int nFine = 1 << shift;
+        int size = (radius << 1) + 1;
+        unsigned short *seg = &kernel[k * nFine];
+        int start = kernelStart[k];
+
+        if((start < 0) || ((c - start) >= size)) {
+            memset(seg, 0, sizeof(unsigned short) * nFine);
+
+            for(int i = c; i < (c + size); i++) {
+                unsigned short *col = &columns[i * nBins + k * nFine];
+
+                for(int j = 0; j < nFine; j++) {
+                    seg[j] += col[j];
+                }
+            }
+        } else {
+            for(int i = start; i < c; i++) {
+                unsigned short *col_out = &columns[i * nBins + k * nFine];
+                unsigned short *col_in = &columns[(i + size) * nBins + k * nFine];
+
+                for(int j = 0; j < nFine; j++) {
+                    seg[j] += col_in[j];
+                    seg[j] -= col_out[j];
+                }
+            }
+        }
+
+        kernelStart[k] = c;
+    }
+
+public:
+
+    /**
+     * @brief MedianHistogram
+     * @param radius is in [1, 127].
+     * @param bits is the number of bits of the bins; it is in [4, 16].
+     */
+    MedianHistogram(int radius = 1, int bits = 12)
+    {
+        this->radius = CLAMPi(radius, 1, 127);
+        this->bits = CLAMPi(bits, 4, 16);
+
+        nBins = 1 << this->bits;
+        shift = this->bits - (this->bits >> 1);
+        nCoarse = nBins >> shift;
+
+        bLog = false;
+        vMin = 0.0f;
+        vMax = 1.0f;
+        lo = 0.0f;
+        lo_log = 0.0f;
+        scale = float(nBins - 1);
+    }
+
+    /**
+     * @brief setRange computes the quantization of a channel of img; it
+     * uses the log domain when the channel spans more than 8 stops.
+     * @param img
+     * @param channel
+     */
+    void setRange(Image *img, int channel)
+    {
+        vMin = FLT_MAX;
+        vMax = -FLT_MAX;
+        float vMinPos = FLT_MAX;
+
+        int n = img->width * img->height * img->frames;
+        int channels = img->channels;
+
+        for(int i = 0; i < n; i++) {
+            float v = img->data[i * channels + channel];
+
+            if(!isfinite(v)) {
+                continue;
+            }
+
+            vMin = MIN(vMin, v);
+            vMax = MAX(vMax, v);
+
+            if(v > 0.0f) {
+                vMinPos = MIN(vMinPos, v);
+            }
+        }
+
+        if(vMin > vMax) {
+            vMin = 0.0f;
+            vMax = 0.0f;
+        }
+
+        //values below 32 stops from the maximum are clamped
+        lo = MAX(vMinPos, vMax * 2.3283064e-10f);
+        bLog = (vMax > 0.0f) && (vMinPos < FLT_MAX) && ((vMax / lo) > 256.0f);
+
+        if(bLog) {
+            lo_log = log2f(lo);
+            float range = log2f(vMax) - lo_log;
+            scale = range > 0.0f ? float(nBins - 2) / range : 0.0f;
+        } else {
+            float range = vMax - vMin;
+            scale = range > 0.0f ? float(nBins - 1) / range : 0.0f;
+        }
+    }
+
+    /**
+     * @brief copyRange copies the quantization of h, without its buffers.
+     * @param h is a histogram with the same number of bits.
+     */
+    void copyRange(const MedianHistogram &h)
+    {
+        bLog = h.bLog;
+        vMin = h.vMin;
+        vMax = h.vMax;
+        lo = h.lo;
+        lo_log = h.lo_log;
+        scale = h.scale;
+    }
+
+    /**
+     * @brief quantize
+     * @param v
+     * @return It returns the bin of v.
+     */
+    inline int quantize(float v)
+    {
+        float q;
+
+        if(bLog) {
+            //bin 0 is for values below lo
+            if(!(v >= lo)) {
+                return 0;
+            }
+
+            q = 1.0f + (log2f(v) - lo_log) * scale;
+        } else {
+            q = (v - vMin) * scale;
+        }
+
+        if(!(q > 0.0f)) {
+            return 0;
+        }
+
+        return q < float(nBins - 1) ? int(q + 0.5f) : (nBins - 1);
+    }
+
+    /**
+     * @brief dequantize
+     * @param bin
+     * @return It returns the value of the center of bin.
+     */
+    inline float dequantize(int bin)
+    {
+        if(scale <= 0.0f) {
+            return bLog ? vMax : vMin;
+        }
+
+        if(bLog) {
+            return bin > 0 ? exp2f(lo_log + float(bin - 1) / scale) : vMin;
+        } else {
+            return vMin + float(bin) / scale;
+        }
+    }
+
+    /**
+     * @brief Process computes the median of a channel of in for the pixels
+     * of box; borders are clamped.
+     * @param in
+     * @param out
+     * @param channel
+     * @param box
+     */
+    void Process(Image *in, Image *out, int channel, BBox *box)
+    {
+        int size = (radius << 1) + 1;
+        int nColumns = (box->x1 - box->x0) + (radius << 1);
+        int nFine = 1 << shift;
+        unsigned int mid = (unsigned int)(size * size) >> 1;
+
+        columns.assign(size_t(nColumns) * size_t(nBins), 0);
+        columnsCoarse.assign(size_t(nColumns) * size_t(nCoarse), 0);
+        kernel.resize(nBins);
+        kernelCoarse.resize(nCoarse);
+        kernelStart.resize(nCoarse);
+
+        for(int c = 0; c < nColumns; c++) {
+            int x = box->x0 - radius + c;
+
+            for(int y = box->y0 - radius; y <= (box->y0 + radius); y++) {
+                addColumn(c, quantize((*in)(x, y)[channel]), 1);
+            }
+        }
+
+        for(int j = box->y0; j < box->y1; j++) {
+            if(j > box->y0) {
+                for(int c = 0; c < nColumns; c++) {
+                    int x = box->x0 - radius + c;
+                    addColumn(c, quantize((*in)(x, j - radius - 1)[channel]), -1);
+                    addColumn(c, quantize((*in)(x, j + radius)[channel]), 1);
+                }
+            }
+
+            //the kernel starts at the first column; fine segments are lazy
+            for(int k = 0; k < nCoarse; k++) {
+                unsigned short sum = 0;
+
+                for(int c = 0; c < size; c++) {
+                    sum += columnsCoarse[c * nCoarse + k];
+                }
+
+                kernelCoarse[k] = sum;
+                kernelStart[k] = -1;
+            }
+
+            for(int i = box->x0; i < box->x1; i++) {
+                int c = i - box->x0;
+
+                if(c > 0) {
+                    unsigned short *col_out = &columnsCoarse[(c - 1) * nCoarse];
+                    unsigned short *col_in = &columnsCoarse[(c + size - 1) * nCoarse];
+
+                    for(int k = 0; k < nCoarse; k++) {
+                        kernelCoarse[k] += col_in[k];
+                        kernelCoarse[k] -= col_out[k];
+                    }
+                }
+
+                unsigned int count = 0;
+                int k = 0;
+                while((count + kernelCoarse[k]) <= mid) {
+                    count += kernelCoarse[k];
+                    k++;
+                }
+
+                updateSegment(k, c);
+
+                unsigned short *seg = &kernel[k * nFine];
+                int b = 0;
+                while((count + seg[b]) <= mid) {
+                    count += seg[b];
+                    b++;
+                }
+
+                (*out)(i, j)[channel] = dequantize((k << shift) + b);
+            }
+        }
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_MEDIAN_HPP */
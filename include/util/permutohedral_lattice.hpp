@@ -0,0 +1,585 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_PERMUTOHEDRAL_LATTICE_HPP
+#define PIC_UTIL_PERMUTOHEDRAL_LATTICE_HPP
+
+#include <vector>
+#include <functional>
+#include <math.h>
+#include <string.h>
+
+#include "../base.hpp"
+#include "../util/math.hpp"
+#include "../util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The PermutohedralLattice class implements Gaussian filtering in a
+ * d-dimensional position space on the permutohedral lattice (Adams et al.,
+ * "Fast High-Dimensional Filtering Using the Permutohedral Lattice", 2010).
+ * Points are splatted onto the vertices of their enclosing simplex, which
+ * are stored in a hash table; vertices are blurred along the d + 1 lattice
+ * directions, and then sliced back at the points. The cost is linear in
+ * the number of points and in d^2. Values are extended with a homogeneous
+ * coordinate, so sliced values are normalized.
+ */
+class PermutohedralLattice
+{
+protected:
+    int d, channels, vd;
+    int nPoints, nVertices;
+
+    //hash table of the vertices
+    std::vector<int> keys, table;
+    unsigned int capacity;
+
+    std::vector<float> values;
+    std::vector<int> offsets;
+    std::vector<float> weights;
+
+    //contributions of each vertex: entries[start[v]], ..., entries[start[v + 1] - 1]
+    //are indices in offsets and weights
+    std::vector<int> vertex_start, vertex_entries;
+
+    std::vector<float> scaleFactor;
+    std::vector<int> canonical;
+
+    /**
+     * @brief hash
+     * @param key
+     * @return
+     */
+    inline unsigned int hash(const int *key)
+    {
+        unsigned int h = 0;
+        for(int i = 0; i < d; i++) {
+            h += (unsigned int) key[i];
+            h *= 2531011;
+        }
+
+        return h;
+    }
+
+    /**
+     * @brief find
+     * @param key
+     * @return This function returns the index of the vertex key,
+     * or -1 if it is not in the lattice.
+     */
+    inline int find(const int *key)
+    {
+        unsigned int h = hash(key) & (capacity - 1);
+
+        while(true) {
+            int v = table[h];
+
+            if(v < 0) {
+                return -1;
+            }
+
+            if(memcmp(&keys[size_t(v) * d], key, d * sizeof(int)) == 0) {
+                return v;
+            }
+
+            h = (h + 1) & (capacity - 1);
+        }
+    }
+
+    /**
+     * @brief insert
+     * @param key
+     * @return This function returns the index of the vertex key; the
+     * vertex is created if it is not in the lattice.
+     */
+    inline int insert(const int *key)
+    {
+        if((unsigned int)(nVertices * 2) >= capacity) {
+            grow();
+        }
+
+        unsigned int h = hash(key) & (capacity - 1);
+
+        while(true) {
+            int v = table[h];
+
+            if(v < 0) {
+                table[h] = nVertices;
+                keys.insert(keys.end(), key, key + d);
+                nVertices++;
+                return nVertices - 1;
+            }
+
+            if(memcmp(&keys[size_t(v) * d], key, d * sizeof(int)) == 0) {
+                return v;
+            }
+
+            h = (h + 1) & (capacity - 1);
+        }
+    }
+
+    /**
+     * @brief grow doubles the capacity of the hash table.
+     */
+    void grow()
+    {
+        capacity *= 2;
+        table.assign(capacity, -1);
+
+        for(int v = 0; v < nVertices; v++) {
+            unsigned int h = hash(&keys[size_t(v) * d]) & (capacity - 1);
+
+            while(table[h] >= 0) {
+                h = (h + 1) & (capacity - 1);
+            }
+
+            table[h] = v;
+        }
+    }
+
+    /**
+     * @brief embed computes the vertices of the simplex enclosing a point
+     * and its barycentric coordinates.
+     * @param position is the point with d coordinates.
+     * @param key is the output with d + 1 keys of d coordinates.
+     * @param barycentric is the output with d + 2 values; the first
+     * d + 1 are the weights of the vertices.
+     * @param elevated is a buffer of d + 1 values.
+     * @param greedy is a buffer of d + 1 values.
+     * @param rank is a buffer of d + 1 values.
+     */
+    void embed(const float *position, int *key, float *barycentric,
+               float *elevated, int *greedy, int *rank)
+    {
+        //elevate the point onto the hyperplane H_d
+        float sm = 0.0f;
+        for(int i = d; i > 0; i--) {
+            float cf = position[i - 1] * scaleFactor[i - 1];
+            elevated[i] = sm - float(i) * cf;
+            sm += cf;
+        }
+        elevated[0] = sm;
+
+        //closest remainder-0 point
+        float invD1 = 1.0f / float(d + 1);
+        int sum = 0;
+        for(int i = 0; i <= d; i++) {
+            float v = elevated[i] * invD1;
+
+            //floor without calling libm
+            int v_down = int(v);
+            v_down -= (float(v_down) > v) ? 1 : 0;
+
+            int down = v_down * (d + 1);
+            int up = down + (d + 1);
+
+            if((float(up) - elevated[i]) < (elevated[i] - float(down))) {
+                greedy[i] = up;
+            } else {
+                greedy[i] = down;
+            }
+
+            sum += greedy[i];
+        }
+        sum /= (d + 1);
+
+        //rank differential to find the permutation
+        for(int i = 0; i <= d; i++) {
+            rank[i] = 0;
+        }
+
+        for(int i = 0; i < d; i++) {
+            for(int j = i + 1; j <= d; j++) {
+                if((elevated[i] - float(greedy[i])) < (elevated[j] - float(greedy[j]))) {
+                    rank[i]++;
+                } else {
+                    rank[j]++;
+                }
+            }
+        }
+
+        //wrap around if the point sum is not zero
+        if(sum > 0) {
+            for(int i = 0; i <= d; i++) {
+                if(rank[i] >= (d + 1 - sum)) {
+                    greedy[i] -= d + 1;
+                    rank[i] += sum - (d + 1);
+                } else {
+                    rank[i] += sum;
+                }
+            }
+        } else {
+            if(sum < 0) {
+                for(int i = 0; i <= d; i++) {
+                    if(rank[i] < -sum) {
+                        greedy[i] += d + 1;
+                        rank[i] += (d + 1) + sum;
+                    } else {
+                        rank[i] += sum;
+                    }
+                }
+            }
+        }
+
+        //barycentric coordinates
+        for(int i = 0; i < (d + 2); i++) {
+            barycentric[i] = 0.0f;
+        }
+
+        for(int i = 0; i <= d; i++) {
+            float delta = (elevated[i] - float(greedy[i])) * invD1;
+            barycentric[d - rank[i]] += delta;
+            barycentric[d + 1 - rank[i]] -= delta;
+        }
+        barycentric[0] += 1.0f + barycentric[d + 1];
+
+        //vertices of the simplex
+        for(int r = 0; r <= d; r++) {
+            int *key_r = &key[r * d];
+            for(int i = 0; i < d; i++) {
+                key_r[i] = greedy[i] + canonical[r * (d + 1) + rank[i]];
+            }
+        }
+    }
+
+public:
+
+    /**
+     * @brief PermutohedralLattice
+     * @param d is the number of dimensions of positions.
+     * @param channels is the number of values of a point.
+     */
+    PermutohedralLattice(int d, int channels)
+    {
+        d = MAX(d, 1);
+
+        this->d = d;
+        this->channels = MAX(channels, 1);
+        vd = this->channels + 1;
+        nPoints = 0;
+        nVertices = 0;
+        capacity = 0;
+
+        //the blur has a standard deviation of one in position space
+        float invStdDev = float(d + 1) * sqrtf(2.0f / 3.0f);
+
+        scaleFactor.resize(d);
+        for(int i = 0; i < d; i++) {
+            scaleFactor[i] = invStdDev / sqrtf(float((i + 1) * (i + 2)));
+        }
+
+        canonical.resize((d + 1) * (d + 1));
+        for(int i = 0; i <= d; i++) {
+            for(int j = 0; j <= (d - i); j++) {
+                canonical[i * (d + 1) + j] = i;
+            }
+
+            for(int j = d - i + 1; j <= d; j++) {
+                canonical[i * (d + 1) + j] = i - (d + 1);
+            }
+        }
+    }
+
+    /**
+     * @brief init builds the lattice; the simplices of the points are
+     * computed in parallel.
+     * @param nPoints
+     * @param position is a function writing the d coordinates of the
+     * i-th point into its second parameter; positions have to be scaled
+     * by the inverse of the standard deviations of the Gaussian.
+     */
+    void init(int nPoints, std::function<void(int, float *)> position)
+    {
+        this->nPoints = MAX(nPoints, 0);
+
+        int d1 = d + 1;
+
+        offsets.resize(size_t(this->nPoints) * d1);
+        weights.resize(size_t(this->nPoints) * d1);
+
+        nVertices = 0;
+        keys.clear();
+
+        capacity = 1024;
+        while(capacity < (unsigned int)(MIN(this->nPoints, 1 << 20))) {
+            capacity *= 2;
+        }
+        table.assign(capacity, -1);
+
+        //points are split into blocks whose vertices are first
+        //deduplicated in parallel, and then inserted in the lattice
+        const int block = 1024;
+        const int nBlocksChunk = 64;
+
+        std::vector< std::vector<int> > block_keys(nBlocksChunk), block_map(nBlocksChunk);
+
+        ThreadPool *tp = ThreadPool::getInstance();
+
+        for(int c0 = 0; c0 < this->nPoints; c0 += block * nBlocksChunk) {
+            int nBlocks = MIN(nBlocksChunk, (this->nPoints - c0 + block - 1) / block);
+
+            tp->run(nBlocks, [&](int b) {
+                int i0 = c0 + b * block;
+                int i1 = MIN(i0 + block, this->nPoints);
+
+                std::vector<float> pos(d), elevated(d1), barycentric(d1 + 1);
+                std::vector<int> greedy(d1), rank(d1), key(d1 * d);
+
+                unsigned int local_capacity = 1;
+                while(local_capacity < (unsigned int)(block * d1 * 2)) {
+                    local_capacity *= 2;
+                }
+
+                std::vector<int> local_table(local_capacity, -1);
+                std::vector<int> &local_keys = block_keys[b];
+                local_keys.clear();
+                int nLocal = 0;
+
+                for(int i = i0; i < i1; i++) {
+                    position(i, &pos[0]);
+                    embed(&pos[0], &key[0], &barycentric[0], &elevated[0], &greedy[0], &rank[0]);
+
+                    memcpy(&weights[size_t(i) * d1], &barycentric[0], d1 * sizeof(float));
+
+                    int *offsets_i = &offsets[size_t(i) * d1];
+
+                    for(int r = 0; r < d1; r++) {
+                        const int *key_r = &key[r * d];
+                        unsigned int h = hash(key_r) & (local_capacity - 1);
+
+                        while(true) {
+                            int v = local_table[h];
+
+                            if(v < 0) {
+                                local_table[h] = nLocal;
+                                local_keys.insert(local_keys.end(), key_r, key_r + d);
+                                offsets_i[r] = nLocal;
+                                nLocal++;
+                                break;
+                            }
+
+                            if(memcmp(&local_keys[size_t(v) * d], key_r, d * sizeof(int)) == 0) {
+                                offsets_i[r] = v;
+                                break;
+                            }
+
+                            h = (h + 1) & (local_capacity - 1);
+                        }
+                    }
+                }
+            });
+
+            //vertices are numbered in order of appearance
+            for(int b = 0; b < nBlocks; b++) {
+                int nLocal = int(block_keys[b].size()) / d;
+                block_map[b].resize(nLocal);
+
+                for(int k = 0; k < nLocal; k++) {
+                    block_map[b][k] = insert(&block_keys[b][size_t(k) * d]);
+                }
+            }
+
+            tp->run(nBlocks, [&](int b) {
+                int i0 = c0 + b * block;
+                int i1 = MIN(i0 + block, this->nPoints);
+
+                for(size_t k = size_t(i0) * d1; k < (size_t(i1) * d1); k++) {
+                    offsets[k] = block_map[b][offsets[k]];
+                }
+            });
+        }
+
+        //contributions are grouped by vertex in order of point
+        vertex_start.assign(nVertices + 1, 0);
+        int nEntries = this->nPoints * d1;
+
+        for(int k = 0; k < nEntries; k++) {
+            vertex_start[offsets[k] + 1]++;
+        }
+
+        for(int v = 0; v < nVertices; v++) {
+            vertex_start[v + 1] += vertex_start[v];
+        }
+
+        vertex_entries.resize(nEntries);
+        std::vector<int> pos(vertex_start.begin(), vertex_start.end() - 1);
+
+        for(int k = 0; k < nEntries; k++) {
+            vertex_entries[pos[offsets[k]]++] = k;
+        }
+
+        values.assign(size_t(nVertices) * vd, 0.0f);
+    }
+
+    /**
+     * @brief splat accumulates the values of the points on the vertices
+     * of the lattice; each thread gathers the contributions of a range of
+     * vertices, so that no vertex is written by two threads.
+     * @param data is an array of nPoints x channels values.
+     */
+    void splat(const float *data)
+    {
+        int d1 = d + 1;
+
+        ThreadPool::getInstance()->parallelFor(0, nVertices, [&](int v0, int v1) {
+            for(int v = v0; v < v1; v++) {
+                float *out = &values[size_t(v) * vd];
+
+                for(int c = 0; c < vd; c++) {
+                    out[c] = 0.0f;
+                }
+
+                for(int e = vertex_start[v]; e < vertex_start[v + 1]; e++) {
+                    int k = vertex_entries[e];
+                    float w = weights[k];
+                    const float *data_i = &data[size_t(k / d1) * channels];
+
+                    for(int c = 0; c < channels; c++) {
+                        out[c] += w * data_i[c];
+                    }
+
+                    //homogeneous coordinate
+                    for(int c = channels; c < vd; c++) {
+                        out[c] += w;
+                    }
+                }
+            }
+        }, 1024);
+    }
+
+    /**
+     * @brief blur convolves the vertices with a [1 2 1] / 4 kernel along
+     * each of the d + 1 directions of the lattice.
+     */
+    void blur()
+    {
+        int d1 = d + 1;
+
+        ThreadPool *tp = ThreadPool::getInstance();
+
+        std::vector<float> tmp(values.size());
+        std::vector<int> n1(nVertices), n2(nVertices);
+
+        for(int j = 0; j < d1; j++) {
+            //neighbors along the j-th direction
+            tp->parallelFor(0, nVertices, [&](int v0, int v1) {
+                std::vector<int> key1(d), key2(d);
+
+                for(int v = v0; v < v1; v++) {
+                    const int *key = &keys[size_t(v) * d];
+
+                    for(int i = 0; i < d; i++) {
+                        key1[i] = key[i] - 1;
+                        key2[i] = key[i] + 1;
+                    }
+
+                    if(j < d) {
+                        key1[j] = key[j] + d;
+                        key2[j] = key[j] - d;
+                    }
+
+                    n1[v] = find(&key1[0]);
+                    n2[v] = find(&key2[0]);
+                }
+            }, 1024);
+
+            tp->parallelFor(0, nVertices, [&](int v0, int v1) {
+                for(int v = v0; v < v1; v++) {
+                    const float *val = &values[size_t(v) * vd];
+                    float *out = &tmp[size_t(v) * vd];
+
+                    for(int c = 0; c < vd; c++) {
+                        out[c] = 0.5f * val[c];
+                    }
+
+                    if(n1[v] >= 0) {
+                        const float *val1 = &values[size_t(n1[v]) * vd];
+                        for(int c = 0; c < vd; c++) {
+                            out[c] += 0.25f * val1[c];
+                        }
+                    }
+
+                    if(n2[v] >= 0) {
+                        const float *val2 = &values[size_t(n2[v]) * vd];
+                        for(int c = 0; c < vd; c++) {
+                            out[c] += 0.25f * val2[c];
+                        }
+                    }
+                }
+            }, 1024);
+
+            values.swap(tmp);
+        }
+    }
+
+    /**
+     * @brief slice interpolates the blurred values at the points.
+     * @param out is an array of nPoints x channels values.
+     */
+    void slice(float *out)
+    {
+        int d1 = d + 1;
+
+        ThreadPool::getInstance()->parallelFor(0, nPoints, [&](int i0, int i1) {
+            std::vector<float> acc(vd);
+
+            for(int i = i0; i < i1; i++) {
+                const int *offsets_i = &offsets[size_t(i) * d1];
+                const float *weights_i = &weights[size_t(i) * d1];
+
+                for(int c = 0; c < vd; c++) {
+                    acc[c] = 0.0f;
+                }
+
+                for(int r = 0; r < d1; r++) {
+                    const float *val = &values[size_t(offsets_i[r]) * vd];
+
+                    for(int c = 0; c < vd; c++) {
+                        acc[c] += weights_i[r] * val[c];
+                    }
+                }
+
+                float *out_i = &out[size_t(i) * channels];
+                float norm = acc[channels];
+
+                if(norm > 0.0f) {
+                    for(int c = 0; c < channels; c++) {
+                        out_i[c] = acc[c] / norm;
+                    }
+                } else {
+                    for(int c = 0; c < channels; c++) {
+                        out_i[c] = 0.0f;
+                    }
+                }
+            }
+        }, 1024);
+    }
+
+    /**
+     * @brief getNumberOfVertices
+     * @return
+     */
+    int getNumberOfVertices()
+    {
+        return nVertices;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_PERMUTOHEDRAL_LATTICE_HPP */
@@ -0,0 +1,576 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_SIMD_HPP
+#define PIC_UTIL_SIMD_HPP
+
+#include "../base.hpp"
+#include "../util/thread_pool.hpp"
+
+#if !defined(PIC_DISABLE_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+    #define PIC_SIMD_X86
+
+    #include <immintrin.h>
+
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define PIC_SIMD_TARGET_AVX2
+        #define PIC_SIMD_TARGET_AVX512
+        #define PIC_SIMD_TARGET_F16C
+        #define PIC_SIMD_TARGET_POPCNT
+        #define PIC_SIMD_TARGET_AVX512_POPCNT
+    #else
+        #define PIC_SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+        #define PIC_SIMD_TARGET_AVX512 __attribute__((target("avx512f")))
+        //every CPU with AVX2 has F16C as well
+        #define PIC_SIMD_TARGET_F16C __attribute__((target("avx2,f16c")))
+        #define PIC_SIMD_TARGET_POPCNT __attribute__((target("popcnt")))
+        #define PIC_SIMD_TARGET_AVX512_POPCNT __attribute__((target("avx512f,avx512vpopcntdq")))
+    #endif
+#endif
+
+//number of floats above which buffer kernels are split among threads
+#ifndef PIC_SIMD_PARALLEL_THRESHOLD
+#define PIC_SIMD_PARALLEL_THRESHOLD 262144
+#endif
+
+namespace pic {
+
+enum SIMD_TYPE {SIMD_NONE, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512};
+
+/**
+ * @brief The SIMD class detects (once, through CPUID) the best instruction set
+ * available and runs float buffer kernels with it.
+ */
+class SIMD
+{
+protected:
+
+    /**
+     * @brief detect
+     * @return This function returns the best instruction set supported
+     * by both the CPU and the OS.
+     */
+    static SIMD_TYPE detect()
+    {
+#ifdef PIC_SIMD_X86
+    #ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        int nIds = info[0];
+
+        __cpuid(info, 1);
+        bool bOSXSAVE = (info[2] & (1 << 27)) != 0;
+        bool bAVX = (info[2] & (1 << 28)) != 0;
+
+        if(!(bOSXSAVE && bAVX) || (nIds < 7)) {
+            return SIMD_SSE2;
+        }
+
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+
+        bool bAVX2 = ((info[1] & (1 << 5)) != 0) && ((xcr0 & 0x6) == 0x6);
+        bool bAVX512 = ((info[1] & (1 << 16)) != 0) && ((xcr0 & 0xe6) == 0xe6);
+    #else
+        __builtin_cpu_init();
+        bool bAVX2 = __builtin_cpu_supports("avx2") != 0;
+        bool bAVX512 = __builtin_cpu_supports("avx512f") != 0;
+    #endif
+
+        if(bAVX512) {
+            return SIMD_AVX512;
+        }
+
+        if(bAVX2) {
+            return SIMD_AVX2;
+        }
+
+        return SIMD_SSE2;
+#else
+        return SIMD_NONE;
+#endif
+    }
+
+    /**
+     * @brief detectFeature
+     * @param bVPOPCNTDQ if it is false, POPCNT is checked.
+     * @return This function returns true if the CPU supports the feature.
+     */
+    static bool detectFeature(bool bVPOPCNTDQ)
+    {
+#ifdef PIC_SIMD_X86
+    #ifdef _MSC_VER
+        int info[4];
+        if(bVPOPCNTDQ) {
+            __cpuid(info, 0);
+            if(info[0] < 7) {
+                return false;
+            }
+
+            __cpuidex(info, 7, 0);
+            return (info[2] & (1 << 14)) != 0;
+        } else {
+            __cpuid(info, 1);
+            return (info[2] & (1 << 23)) != 0;
+        }
+    #else
+        __builtin_cpu_init();
+        if(bVPOPCNTDQ) {
+            return __builtin_cpu_supports("avx512vpopcntdq") != 0;
+        } else {
+            return __builtin_cpu_supports("popcnt") != 0;
+        }
+    #endif
+#else
+        return false;
+#endif
+    }
+
+    static SIMD_TYPE &current()
+    {
+        static SIMD_TYPE type = detect();
+        return type;
+    }
+
+public:
+
+    /**
+     * @brief getSupported
+     * @return This function returns the best instruction set of the machine.
+     */
+    static SIMD_TYPE getSupported()
+    {
+        static SIMD_TYPE type = detect();
+        return type;
+    }
+
+    /**
+     * @brief get
+     * @return This function returns the instruction set used by the kernels.
+     */
+    static SIMD_TYPE get()
+    {
+        return current();
+    }
+
+    /**
+     * @brief hasPOPCNT
+     * @return This function returns true if POPCNT can be used.
+     */
+    static bool hasPOPCNT()
+    {
+        static bool bPOPCNT = detectFeature(false);
+        return bPOPCNT && (get() >= SIMD_SSE2);
+    }
+
+    /**
+     * @brief hasVPOPCNTDQ
+     * @return This function returns true if AVX-512 VPOPCNTDQ can be used.
+     */
+    static bool hasVPOPCNTDQ()
+    {
+        static bool bVPOPCNTDQ = detectFeature(true);
+        return bVPOPCNTDQ && (get() >= SIMD_AVX512);
+    }
+
+    /**
+     * @brief set forces the instruction set used by the kernels (e.g. for
+     * testing the scalar path); it is capped to the supported one.
+     * @param type
+     */
+    static void set(SIMD_TYPE type)
+    {
+        SIMD_TYPE supported = getSupported();
+        current() = type < supported ? type : supported;
+    }
+
+    /**
+     * @brief binary computes out[i] = Op(in0[i], in1[i]).
+     * @param out
+     * @param in0
+     * @param in1
+     * @param n
+     */
+    template<class Op>
+    static void binary(float *out, const float *in0, const float *in1, int n);
+
+    /**
+     * @brief constant computes out[i] = Op(in[i], value).
+     * @param out
+     * @param in
+     * @param value
+     * @param n
+     */
+    template<class Op>
+    static void constant(float *out, const float *in, float value, int n);
+
+    /**
+     * @brief blend computes out[i] = in0[i] * w[i] + in1[i] * (1 - w[i]).
+     * @param out
+     * @param in0
+     * @param in1
+     * @param w
+     * @param n
+     */
+    static void blend(float *out, const float *in0, const float *in1, const float *w, int n);
+};
+
+/**
+ * @brief The SIMDOp structs are the element-wise operators of SIMD kernels.
+ * Note that min and max return the first operand on NaN, as the scalar code.
+ */
+struct SIMDOpAdd
+{
+    static inline float apply(float a, float b) { return a + b; }
+#ifdef PIC_SIMD_X86
+    static inline __m128 apply(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+    PIC_SIMD_TARGET_AVX2 static inline __m256 apply(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+    PIC_SIMD_TARGET_AVX512 static inline __m512 apply(__m512 a, __m512 b) { return _mm512_add_ps(a, b); }
+#endif
+};
+
+struct SIMDOpSub
+{
+    static inline float apply(float a, float b) { return a - b; }
+#ifdef PIC_SIMD_X86
+    static inline __m128 apply(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+    PIC_SIMD_TARGET_AVX2 static inline __m256 apply(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+    PIC_SIMD_TARGET_AVX512 static inline __m512 apply(__m512 a, __m512 b) { return _mm512_sub_ps(a, b); }
+#endif
+};
+
+struct SIMDOpMul
+{
+    static inline float apply(float a, float b) { return a * b; }
+#ifdef PIC_SIMD_X86
+    static inline __m128 apply(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+    PIC_SIMD_TARGET_AVX2 static inline __m256 apply(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+    PIC_SIMD_TARGET_AVX512 static inline __m512 apply(__m512 a, __m512 b) { return _mm512_mul_ps(a, b); }
+#endif
+};
+
+struct SIMDOpDiv
+{
+    static inline float apply(float a, float b) { return a / b; }
+#ifdef PIC_SIMD_X86
+    static inline __m128 apply(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+    PIC_SIMD_TARGET_AVX2 static inline __m256 apply(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+    PIC_SIMD_TARGET_AVX512 static inline __m512 apply(__m512 a, __m512 b) { return _mm512_div_ps(a, b); }
+#endif
+};
+
+struct SIMDOpMin
+{
+    static inline float apply(float a, float b) { return a > b ? b : a; }
+#ifdef PIC_SIMD_X86
+    static inline __m128 apply(__m128 a, __m128 b) { return _mm_min_ps(b, a); }
+    PIC_SIMD_TARGET_AVX2 static inline __m256 apply(__m256 a, __m256 b) { return _mm256_min_ps(b, a); }
+    PIC_SIMD_TARGET_AVX512 static inline __m512 apply(__m512 a, __m512 b) { return _mm512_min_ps(b, a); }
+#endif
+};
+
+struct SIMDOpMax
+{
+    static inline float apply(float a, float b) { return a < b ? b : a; }
+#ifdef PIC_SIMD_X86
+    static inline __m128 apply(__m128 a, __m128 b) { return _mm_max_ps(b, a); }
+    PIC_SIMD_TARGET_AVX2 static inline __m256 apply(__m256 a, __m256 b) { return _mm256_max_ps(b, a); }
+    PIC_SIMD_TARGET_AVX512 static inline __m512 apply(__m512 a, __m512 b) { return _mm512_max_ps(b, a); }
+#endif
+};
+
+//kernels: one per instruction set; vector kernels return the number of
+//processed elements and the scalar kernel completes the tail.
+//NOTE: add, sub, mul, div, min, and max are bit-exact with the scalar code;
+//blend may differ by 1 ulp when the compiler contracts it into an FMA.
+
+template<class Op>
+inline void SIMDBinaryScalar(float *out, const float *in0, const float *in1, int i, int n)
+{
+    for(; i < n; i++) {
+        out[i] = Op::apply(in0[i], in1[i]);
+    }
+}
+
+template<class Op>
+inline void SIMDConstantScalar(float *out, const float *in, float value, int i, int n)
+{
+    for(; i < n; i++) {
+        out[i] = Op::apply(in[i], value);
+    }
+}
+
+inline void SIMDBlendScalar(float *out, const float *in0, const float *in1, const float *w, int i, int n)
+{
+    for(; i < n; i++) {
+        float w0 = w[i];
+        float w1 = 1.0f - w0;
+        out[i] = in0[i] * w0 + in1[i] * w1;
+    }
+}
+
+#ifdef PIC_SIMD_X86
+
+template<class Op>
+inline int SIMDBinarySSE2(float *out, const float *in0, const float *in1, int n)
+{
+    int i = 0;
+    for(; i <= (n - 4); i += 4) {
+        _mm_storeu_ps(out + i, Op::apply(_mm_loadu_ps(in0 + i), _mm_loadu_ps(in1 + i)));
+    }
+
+    return i;
+}
+
+template<class Op>
+PIC_SIMD_TARGET_AVX2 inline int SIMDBinaryAVX2(float *out, const float *in0, const float *in1, int n)
+{
+    int i = 0;
+    for(; i <= (n - 8); i += 8) {
+        _mm256_storeu_ps(out + i, Op::apply(_mm256_loadu_ps(in0 + i), _mm256_loadu_ps(in1 + i)));
+    }
+
+    return i;
+}
+
+template<class Op>
+PIC_SIMD_TARGET_AVX512 inline int SIMDBinaryAVX512(float *out, const float *in0, const float *in1, int n)
+{
+    int i = 0;
+    for(; i <= (n - 16); i += 16) {
+        _mm512_storeu_ps(out + i, Op::apply(_mm512_loadu_ps(in0 + i), _mm512_loadu_ps(in1 + i)));
+    }
+
+    return i;
+}
+
+template<class Op>
+inline int SIMDConstantSSE2(float *out, const float *in, float value, int n)
+{
+    __m128 v = _mm_set1_ps(value);
+
+    int i = 0;
+    for(; i <= (n - 4); i += 4) {
+        _mm_storeu_ps(out + i, Op::apply(_mm_loadu_ps(in + i), v));
+    }
+
+    return i;
+}
+
+template<class Op>
+PIC_SIMD_TARGET_AVX2 inline int SIMDConstantAVX2(float *out, const float *in, float value, int n)
+{
+    __m256 v = _mm256_set1_ps(value);
+
+    int i = 0;
+    for(; i <= (n - 8); i += 8) {
+        _mm256_storeu_ps(out + i, Op::apply(_mm256_loadu_ps(in + i), v));
+    }
+
+    return i;
+}
+
+template<class Op>
+PIC_SIMD_TARGET_AVX512 inline int SIMDConstantAVX512(float *out, const float *in, float value, int n)
+{
+    __m512 v = _mm512_set1_ps(value);
+
+    int i = 0;
+    for(; i <= (n - 16); i += 16) {
+        _mm512_storeu_ps(out + i, Op::apply(_mm512_loadu_ps(in + i), v));
+    }
+
+    return i;
+}
+
+inline int SIMDBlendSSE2(float *out, const float *in0, const float *in1, const float *w, int n)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+
+    int i = 0;
+    for(; i <= (n - 4); i += 4) {
+        __m128 w0 = _mm_loadu_ps(w + i);
+        __m128 w1 = _mm_sub_ps(one, w0);
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(in0 + i), w0);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(in1 + i), w1);
+        _mm_storeu_ps(out + i, _mm_add_ps(a, b));
+    }
+
+    return i;
+}
+
+PIC_SIMD_TARGET_AVX2 inline int SIMDBlendAVX2(float *out, const float *in0, const float *in1, const float *w, int n)
+{
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    int i = 0;
+    for(; i <= (n - 8); i += 8) {
+        __m256 w0 = _mm256_loadu_ps(w + i);
+        __m256 w1 = _mm256_sub_ps(one, w0);
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in0 + i), w0);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in1 + i), w1);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(a, b));
+    }
+
+    return i;
+}
+
+PIC_SIMD_TARGET_AVX512 inline int SIMDBlendAVX512(float *out, const float *in0, const float *in1, const float *w, int n)
+{
+    __m512 one = _mm512_set1_ps(1.0f);
+
+    int i = 0;
+    for(; i <= (n - 16); i += 16) {
+        __m512 w0 = _mm512_loadu_ps(w + i);
+        __m512 w1 = _mm512_sub_ps(one, w0);
+        __m512 a = _mm512_mul_ps(_mm512_loadu_ps(in0 + i), w0);
+        __m512 b = _mm512_mul_ps(_mm512_loadu_ps(in1 + i), w1);
+        _mm512_storeu_ps(out + i, _mm512_add_ps(a, b));
+    }
+
+    return i;
+}
+
+#endif
+
+/**
+ * @brief SIMDParallel splits [0, n) into chunks (multiple of 64 floats) among
+ * the threads of the pool when n is above PIC_SIMD_PARALLEL_THRESHOLD.
+ * @param n
+ * @param func
+ */
+inline void SIMDParallel(int n, std::function<void(int, int)> func)
+{
+    ThreadPool *pool = ThreadPool::getInstance();
+    int nThreads = pool->getNumThreads();
+
+    if((n < PIC_SIMD_PARALLEL_THRESHOLD) || (nThreads < 2)) {
+        func(0, n);
+        return;
+    }
+
+    int grain = n / (nThreads * 4);
+    grain = ((grain + 63) / 64) * 64;
+
+    pool->parallelFor(0, n, func, grain);
+}
+
+template<class Op>
+inline void SIMD::binary(float *out, const float *in0, const float *in1, int n)
+{
+    SIMD_TYPE type = get();
+
+    SIMDParallel(n, [type, out, in0, in1](int start, int end) {
+        float *o = out + start;
+        const float *a = in0 + start;
+        const float *b = in1 + start;
+        int m = end - start;
+        int i = 0;
+
+        switch(type) {
+#ifdef PIC_SIMD_X86
+        case SIMD_AVX512:
+            i = SIMDBinaryAVX512<Op>(o, a, b, m);
+            break;
+
+        case SIMD_AVX2:
+            i = SIMDBinaryAVX2<Op>(o, a, b, m);
+            break;
+
+        case SIMD_SSE2:
+            i = SIMDBinarySSE2<Op>(o, a, b, m);
+            break;
+#endif
+        default:
+            i = 0;
+        }
+
+        SIMDBinaryScalar<Op>(o, a, b, i, m);
+    });
+}
+
+template<class Op>
+inline void SIMD::constant(float *out, const float *in, float value, int n)
+{
+    SIMD_TYPE type = get();
+
+    SIMDParallel(n, [type, out, in, value](int start, int end) {
+        float *o = out + start;
+        const float *a = in + start;
+        int m = end - start;
+        int i = 0;
+
+        switch(type) {
+#ifdef PIC_SIMD_X86
+        case SIMD_AVX512:
+            i = SIMDConstantAVX512<Op>(o, a, value, m);
+            break;
+
+        case SIMD_AVX2:
+            i = SIMDConstantAVX2<Op>(o, a, value, m);
+            break;
+
+        case SIMD_SSE2:
+            i = SIMDConstantSSE2<Op>(o, a, value, m);
+            break;
+#endif
+        default:
+            i = 0;
+        }
+
+        SIMDConstantScalar<Op>(o, a, value, i, m);
+    });
+}
+
+inline void SIMD::blend(float *out, const float *in0, const float *in1, const float *w, int n)
+{
+    SIMD_TYPE type = get();
+
+    SIMDParallel(n, [type, out, in0, in1, w](int start, int end) {
+        float *o = out + start;
+        const float *a = in0 + start;
+        const float *b = in1 + start;
+        const float *c = w + start;
+        int m = end - start;
+        int i = 0;
+
+        switch(type) {
+#ifdef PIC_SIMD_X86
+        case SIMD_AVX512:
+            i = SIMDBlendAVX512(o, a, b, c, m);
+            break;
+
+        case SIMD_AVX2:
+            i = SIMDBlendAVX2(o, a, b, c, m);
+            break;
+
+        case SIMD_SSE2:
+            i = SIMDBlendSSE2(o, a, b, c, m);
+            break;
+#endif
+        default:
+            i = 0;
+        }
+
+        SIMDBlendScalar(o, a, b, c, i, m);
+    });
+}
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_SIMD_HPP */
@@ -0,0 +1,440 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+*/
+
+#ifndef PIC_UTIL_THREAD_POOL_HPP
+#define PIC_UTIL_THREAD_POOL_HPP
+
+#include <vector>
+#include <deque>
+#include <functional>
+
+#ifndef PIC_DISABLE_THREAD
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#endif
+
+#include "../base.hpp"
+
+namespace pic {
+
+/**
+ * @brief The ThreadPool class is a process-wide pool of persistent workers.
+ * Each worker owns a deque of tasks; it pops its own work from the back and
+ * steals from the front of the other workers' deques when it runs out.
+ * The calling thread takes part in the execution of the tasks it submits,
+ * so nested calls (e.g. a filter called from a parallel loop) do not deadlock.
+ */
+class ThreadPool
+{
+protected:
+
+#ifndef PIC_DISABLE_THREAD
+    /**
+     * @brief The ThreadPoolJob struct tracks the tasks of a single run call.
+     */
+    struct ThreadPoolJob
+    {
+        std::function<void(int)> *func;
+        std::atomic<int> remaining;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    struct ThreadPoolTask
+    {
+        ThreadPoolJob *job;
+        int index;
+    };
+
+    struct ThreadPoolQueue
+    {
+        std::deque<ThreadPoolTask> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::thread *> workers;
+    std::vector<ThreadPoolQueue *> queues;
+
+    std::mutex mutex_sleep;
+    std::condition_variable cv_sleep;
+    std::atomic<int> pending;
+    std::atomic<uint> next_queue;
+    bool bStop;
+
+    /**
+     * @brief getWorkerIndex returns the index of the worker running
+     * the current thread, -1 if the thread does not belong to the pool.
+     * @return
+     */
+    static int &getWorkerIndex()
+    {
+        static thread_local int worker_index = -1;
+        return worker_index;
+    }
+
+    /**
+     * @brief pop takes a task from the back of queue index.
+     * @param index
+     * @param task
+     * @return
+     */
+    bool pop(int index, ThreadPoolTask &task)
+    {
+        ThreadPoolQueue *q = queues[index];
+        std::lock_guard<std::mutex> lock(q->mutex);
+
+        if(q->tasks.empty()) {
+            return false;
+        }
+
+        task = q->tasks.back();
+        q->tasks.pop_back();
+        pending--;
+        return true;
+    }
+
+    /**
+     * @brief steal takes a task from the front of queue index.
+     * @param index
+     * @param task
+     * @return
+     */
+    bool steal(int index, ThreadPoolTask &task)
+    {
+        ThreadPoolQueue *q = queues[index];
+        std::lock_guard<std::mutex> lock(q->mutex);
+
+        if(q->tasks.empty()) {
+            return false;
+        }
+
+        task = q->tasks.front();
+        q->tasks.pop_front();
+        pending--;
+        return true;
+    }
+
+    /**
+     * @brief getTask looks for a task first in the queue
+     * of index (if valid) and then in the other queues.
+     * @param index
+     * @param task
+     * @return
+     */
+    bool getTask(int index, ThreadPoolTask &task)
+    {
+        int n = int(queues.size());
+
+        if(index > -1) {
+            if(pop(index, task)) {
+                return true;
+            }
+        }
+
+        int start = index > -1 ? index + 1 : 0;
+        for(int i = 0; i < n; i++) {
+            int j = (start + i) % n;
+
+            if(j == index) {
+                continue;
+            }
+
+            if(steal(j, task)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief execute runs a task and signals its job when it was the last one.
+     * @param task
+     */
+    void execute(ThreadPoolTask &task)
+    {
+        ThreadPoolJob *job = task.job;
+        (*job->func)(task.index);
+
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if((--job->remaining) == 0) {
+            job->cv.notify_all();
+        }
+    }
+
+    /**
+     * @brief workerLoop is the main loop of a worker.
+     * @param index
+     */
+    void workerLoop(int index)
+    {
+        getWorkerIndex() = index;
+
+        while(true) {
+            ThreadPoolTask task;
+
+            if(getTask(index, task)) {
+                execute(task);
+            } else {
+                std::unique_lock<std::mutex> lock(mutex_sleep);
+                cv_sleep.wait(lock, [this] { return bStop || (pending.load() > 0); });
+
+                if(bStop && (pending.load() == 0)) {
+                    return;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief startWorkers launches nWorkers persistent workers.
+     * @param nWorkers
+     */
+    void startWorkers(int nWorkers)
+    {
+        bStop = false;
+        pending = 0;
+        next_queue = 0;
+
+        for(int i = 0; i < nWorkers; i++) {
+            queues.push_back(new ThreadPoolQueue());
+        }
+
+        for(int i = 0; i < nWorkers; i++) {
+            workers.push_back(new std::thread(std::bind(&ThreadPool::workerLoop, this, i)));
+        }
+    }
+
+    /**
+     * @brief stopWorkers joins and frees all workers.
+     */
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_sleep);
+            bStop = true;
+        }
+        cv_sleep.notify_all();
+
+        for(unsigned int i = 0; i < workers.size(); i++) {
+            workers[i]->join();
+            delete workers[i];
+        }
+
+        for(unsigned int i = 0; i < queues.size(); i++) {
+            delete queues[i];
+        }
+
+        workers.clear();
+        queues.clear();
+    }
+#endif
+
+    int nThreads;
+
+    /**
+     * @brief ThreadPool
+     * @param nThreads
+     */
+    ThreadPool(int nThreads)
+    {
+        this->nThreads = 1;
+        setNumThreads(nThreads);
+    }
+
+public:
+
+    ~ThreadPool()
+    {
+#ifndef PIC_DISABLE_THREAD
+        stopWorkers();
+#endif
+    }
+
+    /**
+     * @brief getInstance returns the process-wide pool. The first call creates
+     * it with one thread per hardware core.
+     * @return
+     */
+    static ThreadPool *getInstance()
+    {
+        static ThreadPool pool(0);
+        return &pool;
+    }
+
+    /**
+     * @brief getHardwareThreads returns the number of hardware threads.
+     * @return
+     */
+    static int getHardwareThreads()
+    {
+#ifndef PIC_DISABLE_THREAD
+        int n = int(std::thread::hardware_concurrency());
+        return n > 0 ? n : 1;
+#else
+        return 1;
+#endif
+    }
+
+    /**
+     * @brief setNumThreads sets how many threads (the caller included) execute
+     * the submitted tasks. It must not be called while tasks are running.
+     * @param nThreads is the number of threads; if it is lower than 1, it is set
+     * to the number of hardware threads.
+     */
+    void setNumThreads(int nThreads)
+    {
+        if(nThreads < 1) {
+            nThreads = getHardwareThreads();
+        }
+
+#ifndef PIC_DISABLE_THREAD
+        if((nThreads == this->nThreads) && (int(workers.size()) == (nThreads - 1))) {
+            return;
+        }
+
+        stopWorkers();
+        startWorkers(nThreads - 1);
+#else
+        nThreads = 1;
+#endif
+
+        this->nThreads = nThreads;
+    }
+
+    /**
+     * @brief capNumThreads limits the number of threads to at most nThreads.
+     * @param nThreads
+     */
+    void capNumThreads(int nThreads)
+    {
+        if((nThreads > 0) && (nThreads < this->nThreads)) {
+            setNumThreads(nThreads);
+        }
+    }
+
+    /**
+     * @brief getNumThreads
+     * @return This function returns the number of threads (the caller included).
+     */
+    int getNumThreads()
+    {
+        return nThreads;
+    }
+
+    /**
+     * @brief run executes func(i) for i in [0, nTasks) and returns when all
+     * tasks are done.
+     * @param nTasks is the number of tasks.
+     * @param func is the task function; its parameter is the task index.
+     */
+    void run(int nTasks, std::function<void(int)> func)
+    {
+        if(nTasks < 1) {
+            return;
+        }
+
+#ifndef PIC_DISABLE_THREAD
+        if((nThreads < 2) || (nTasks == 1)) {
+#endif
+            for(int i = 0; i < nTasks; i++) {
+                func(i);
+            }
+            return;
+#ifndef PIC_DISABLE_THREAD
+        }
+
+        ThreadPoolJob job;
+        job.func = &func;
+        job.remaining = nTasks;
+
+        int nQueues = int(queues.size());
+        int index = getWorkerIndex();
+
+        //the first task is kept for the calling thread
+        for(int i = 1; i < nTasks; i++) {
+            ThreadPoolTask task;
+            task.job = &job;
+            task.index = i;
+
+            int j = index > -1 ? index : int(next_queue++ % uint(nQueues));
+            ThreadPoolQueue *q = queues[j];
+            {
+                std::lock_guard<std::mutex> lock(q->mutex);
+                pending++;
+                q->tasks.push_back(task);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_sleep);
+        }
+        cv_sleep.notify_all();
+
+        ThreadPoolTask task;
+        task.job = &job;
+        task.index = 0;
+        execute(task);
+
+        //the caller helps while tasks are queued
+        while((job.remaining.load() > 0) && getTask(index, task)) {
+            execute(task);
+        }
+
+        //wait for the tasks still running on workers
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.cv.wait(lock, [&job] { return job.remaining.load() == 0; });
+#endif
+    }
+
+    /**
+     * @brief parallelFor splits [start, end) into chunks of at most grain
+     * elements and executes func(chunk_start, chunk_end) on each of them.
+     * @param start
+     * @param end
+     * @param func
+     * @param grain is the chunk size; if it is lower than 1, the range
+     * is split into a few chunks per thread.
+     */
+    void parallelFor(int start, int end, std::function<void(int, int)> func, int grain = 0)
+    {
+        int n = end - start;
+
+        if(n < 1) {
+            return;
+        }
+
+        if(grain < 1) {
+            grain = n / (nThreads * 4);
+            grain = grain > 0 ? grain : 1;
+        }
+
+        int nChunks = (n + grain - 1) / grain;
+
+        run(nChunks, [start, end, grain, &func](int i) {
+            int s = start + i * grain;
+            int e = s + grain;
+            func(s, e < end ? e : end);
+        });
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_THREAD_POOL_HPP */
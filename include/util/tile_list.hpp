@@ -18,31 +18,96 @@ file, You can obtain one at http://mozilla.org/MPL/2.0/.
 #ifndef PIC_UTIL_TILE_LIST_HPP
 #define PIC_UTIL_TILE_LIST_HPP
 
-#include <thread>
-#include <mutex>
 #include <vector>
+#include <utility>
+#include <algorithm>
+
+#ifndef PIC_DISABLE_THREAD
+#include <atomic>
+#endif
 
 #include "../base.hpp"
 #include "../util/tile.hpp"
 
 namespace pic {
 
+/**
+ * @brief The TILE_ORDER enum sets the order in which tiles are dispensed:
+ * row-major, Morton (Z-order) curve, or Hilbert curve.
+ */
+enum TILE_ORDER {TO_ROW_MAJOR, TO_MORTON, TO_HILBERT};
+
 /**
  * @brief The TileList class
  */
 class TileList
 {
 protected:
-    uint counter;
-
 #ifndef PIC_DISABLE_THREAD
-    std::mutex mutex;
+    std::atomic<uint> counter;
+#else
+    uint counter;
 #endif
 
+    TILE_ORDER order;
+    std::vector<uint> schedule;
+
+    /**
+     * @brief getMortonKey interleaves the bits of (x, y).
+     * @param x
+     * @param y
+     * @return
+     */
+    static uint getMortonKey(uint x, uint y)
+    {
+        uint key = 0;
+        for(uint i = 0; i < 16; i++) {
+            key |= ((x >> i) & 1) << (2 * i);
+            key |= ((y >> i) & 1) << (2 * i + 1);
+        }
+        return key;
+    }
+
+    /**
+     * @brief getHilbertKey computes the distance of (x, y) along
+     * the Hilbert curve filling a n x n grid (n is a power of two).
+     * @param n
+     * @param x
+     * @param y
+     * @return
+     */
+    static uint getHilbertKey(uint n, uint x, uint y)
+    {
+        uint key = 0;
+        for(uint s = n >> 1; s > 0; s >>= 1) {
+            uint rx = (x & s) > 0 ? 1 : 0;
+            uint ry = (y & s) > 0 ? 1 : 0;
+            key += s * s * ((3 * rx) ^ ry);
+
+            if(ry == 0) {
+                if(rx == 1) {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+
+                uint t = x;
+                x = y;
+                y = t;
+            }
+        }
+        return key;
+    }
+
+    /**
+     * @brief computeSchedule computes the dispensing order of the tiles.
+     */
+    void computeSchedule();
+
 public:
     int width, height;
     int h_tile, w_tile;
     int mod_h, mod_w;
+    int tileSize;
 
     /**
      * @brief tiles a list of tiles
@@ -74,9 +139,37 @@ public:
     /**
      * @brief getNext returns the index of the next tile to process.
      * @return This function returns the index of the next tile to proces.
+     * When all tiles have been dispensed, the returned value is greater than
+     * or equal to size().
      */
     uint getNext();
 
+    /**
+     * @brief getNextBatch claims up to n tiles with a single atomic operation.
+     * @param n is the number of tiles to claim.
+     * @param first is the first claimed slot; the tile index of the k-th claimed
+     * slot is getScheduled(first + k).
+     * @return This function returns the number of claimed tiles (0 when the
+     * list is exhausted).
+     */
+    uint getNextBatch(uint n, uint &first);
+
+    /**
+     * @brief getScheduled maps a dispensing slot into a tile index.
+     * @param slot
+     * @return
+     */
+    uint getScheduled(uint slot)
+    {
+        return slot < schedule.size() ? schedule[slot] : slot;
+    }
+
+    /**
+     * @brief setOrder sets the order in which tiles are dispensed.
+     * @param order
+     */
+    void setOrder(TILE_ORDER order);
+
     /**
      * @brief size
      * @return
@@ -123,6 +216,8 @@ public:
 PIC_INLINE TileList::TileList()
 {
     counter = 0;
+    order = TO_ROW_MAJOR;
+    tileSize = 0;
 
     w_tile = 0;
     h_tile = 0;
@@ -134,6 +229,8 @@ PIC_INLINE TileList::TileList()
 PIC_INLINE TileList::TileList(int tileSize, int width, int height)
 {
     counter = 0;
+    order = TO_ROW_MAJOR;
+    this->tileSize = 0;
     create(tileSize, width, height);
 }
 
@@ -151,15 +248,34 @@ PIC_INLINE BBox TileList::getBBox(int index)
 
 PIC_INLINE uint TileList::getNext()
 {
-    uint ret = 0;
-    {
 #ifndef PIC_DISABLE_THREAD
-        std::lock_guard<std::mutex> lock(mutex);
+    uint ret = counter.fetch_add(1, std::memory_order_relaxed);
+#else
+    uint ret = counter++;
 #endif
-        ret = counter;
-        counter++;
+    return getScheduled(ret);
+}
+
+PIC_INLINE uint TileList::getNextBatch(uint n, uint &first)
+{
+    uint nTiles = size();
+
+    if(n < 1) {
+        n = 1;
     }
-    return ret;
+
+#ifndef PIC_DISABLE_THREAD
+    first = counter.fetch_add(n, std::memory_order_relaxed);
+#else
+    first = counter;
+    counter += n;
+#endif
+
+    if(first >= nTiles) {
+        return 0;
+    }
+
+    return (nTiles - first) < n ? (nTiles - first) : n;
 }
 
 PIC_INLINE uint TileList::size()
@@ -169,11 +285,47 @@ PIC_INLINE uint TileList::size()
 
 PIC_INLINE void TileList::resetCounter()
 {
-    {
-#ifndef PIC_DISABLE_THREAD
-        std::lock_guard<std::mutex> lock(mutex);
-#endif
-        counter = 0;
+    counter = 0;
+}
+
+PIC_INLINE void TileList::setOrder(TILE_ORDER order)
+{
+    if(this->order == order) {
+        return;
+    }
+
+    this->order = order;
+    computeSchedule();
+}
+
+PIC_INLINE void TileList::computeSchedule()
+{
+    schedule.clear();
+
+    if((order == TO_ROW_MAJOR) || tiles.empty() || (tileSize < 1)) {
+        return;
+    }
+
+    uint n = 1;
+    uint nx = uint(w_tile + (mod_w != 0 ? 1 : 0));
+    uint ny = uint(h_tile + (mod_h != 0 ? 1 : 0));
+    while((n < nx) || (n < ny)) {
+        n <<= 1;
+    }
+
+    std::vector< std::pair<uint, uint> > keys;
+    for(uint i = 0; i < tiles.size(); i++) {
+        uint x = uint(tiles[i].startX / tileSize);
+        uint y = uint(tiles[i].startY / tileSize);
+
+        uint key = (order == TO_MORTON) ? getMortonKey(x, y) : getHilbertKey(n, x, y);
+        keys.push_back(std::make_pair(key, i));
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    for(uint i = 0; i < keys.size(); i++) {
+        schedule.push_back(keys[i].second);
     }
 }
 
@@ -192,6 +344,7 @@ PIC_INLINE void TileList::create(int tileSize, int width, int height)
 
     this->width = width;
     this->height = height;
+    this->tileSize = tileSize;
 
     h_tile = height / tileSize;
     w_tile = width  / tileSize;
@@ -240,6 +393,8 @@ PIC_INLINE void TileList::create(int tileSize, int width, int height)
             tiles.push_back(tile);
         }
     }
+
+    computeSchedule();
 }
 
 PIC_INLINE void TileList::writeIntoMemory(Image *output)